@@ -55,6 +55,7 @@ typedef struct {
     int cross_validation;
     int holdout;
     int logfile;
+    int hash_bits;
 
     int help;
     int help_params;
@@ -143,6 +144,18 @@ BEGIN_OPTION_MAP(parse_learn_options, learn_option_t)
         opt->params[opt->num_params] = mystrdup(arg);
         ++opt->num_params;
 
+    ON_OPTION_WITH_ARG(LONGOPT("hash-bits"))
+        char param[64];
+        opt->hash_bits = atoi(arg);
+        if (opt->hash_bits < 1 || CRFSUITE_HASH_MAX_BITS < opt->hash_bits) {
+            fprintf(stderr, "ERROR: The number of hash bits must be in [1, %d]: %s\n", CRFSUITE_HASH_MAX_BITS, arg);
+            return -1;
+        }
+        sprintf(param, "feature.hash_bits=%d", opt->hash_bits);
+        opt->params = (char **)realloc(opt->params, sizeof(char*) * (opt->num_params + 1));
+        opt->params[opt->num_params] = mystrdup(param);
+        ++opt->num_params;
+
     ON_OPTION_WITH_ARG(SHORTOPT('m') || LONGOPT("model"))
         free(opt->model);
         opt->model = mystrdup(arg);
@@ -198,6 +211,10 @@ static void show_usage(FILE *fp, const char *argv0, const char *command)
     fprintf(fp, "                        specified by '-a' or '--algorithm' and the graphical\n");
     fprintf(fp, "                        model specified by '-t' or '--type' to see the list of\n");
     fprintf(fp, "                        algorithm-specific parameters\n");
+    fprintf(fp, "      --hash-bits=BITS  hash attributes into 2^BITS ids instead of storing the\n");
+    fprintf(fp, "                        attribute strings (feature hashing); the memory for\n");
+    fprintf(fp, "                        attributes is bounded, and the model stores no string\n");
+    fprintf(fp, "                        of attributes (sets the parameter feature.hash_bits)\n");
     fprintf(fp, "  -m, --model=FILE      store the model to FILE (DEFAULT=''); if the value is\n");
     fprintf(fp, "                        empty, this utility does not store the model\n");
     fprintf(fp, "  -g, --split=N         split the instances into N groups; this option is\n");
@@ -277,7 +294,13 @@ int main_learn(int argc, char *argv[], const char *argv0)
     }
 
     /* Create dictionaries for attributes and labels. */
-    ret = crfsuite_create_instance("dictionary", (void**)&data.attrs);
+    if (0 < opt.hash_bits) {
+        char dictionary_id[64];
+        sprintf(dictionary_id, "dictionary/hash:%d", opt.hash_bits);
+        ret = crfsuite_create_instance(dictionary_id, (void**)&data.attrs);
+    } else {
+        ret = crfsuite_create_instance("dictionary", (void**)&data.attrs);
+    }
     if (!ret) {
         fprintf(fpe, "ERROR: Failed to create a dictionary instance.\n");
         ret = 1;
@@ -43,11 +43,13 @@
 int main_learn(int argc, char *argv[], const char *argv0);
 int main_tag(int argc, char *argv[], const char *argv0);
 int main_dump(int argc, char *argv[], const char *argv0);
+int main_quantize(int argc, char *argv[], const char *argv0);
 
 
 
 typedef struct {
     int help;            /**< Show help message and exit. */
+    int version;         /**< Show version information and exit. */
 
     FILE *fpi;
     FILE *fpo;
@@ -68,6 +70,9 @@ BEGIN_OPTION_MAP(parse_options, option_t)
     ON_OPTION(SHORTOPT('h') || LONGOPT("help"))
         opt->help = 1;
 
+    ON_OPTION(SHORTOPT('v') || LONGOPT("version"))
+        opt->version = 1;
+
 END_OPTION_MAP()
 
 void show_copyright(FILE *fp)
@@ -86,8 +91,11 @@ static void show_usage(FILE *fp, const char *argv0)
     fprintf(fp, "    learn       Obtain a model from a training set of instances\n");
     fprintf(fp, "    tag         Assign suitable labels to given instances by using a model\n");
     fprintf(fp, "    dump        Output a model in a plain-text format\n");
+    fprintf(fp, "    quantize    Write a copy of a model with quantized feature weights\n");
     fprintf(fp, "\n");
     fprintf(fp, "For the usage of each command, specify -h option in the command argument.\n");
+    fprintf(fp, "Specify -v option to show the version and the instruction set for vector\n");
+    fprintf(fp, "operations chosen for this CPU.\n");
 }
 
 
@@ -113,6 +121,13 @@ int main(int argc, char *argv[])
         return 0;
     }
 
+    /* Show the version information if specified. */
+    if (opt.version) {
+        show_copyright(fpo);
+        fprintf(fpo, "Vector operations: %s\n", crfsuite_vecmath_name());
+        return 0;
+    }
+
     /* Check whether a command is specified in the command-line. */
     if (argc <= arg_used) {
         fprintf(fpe, "ERROR: No command specified. See help (-h) for the usage.\n");
@@ -128,6 +143,8 @@ int main(int argc, char *argv[])
         return main_tag(argc-arg_used, argv+arg_used, argv0);
     } else if (strcmp(command, "dump") == 0) {
         return main_dump(argc-arg_used, argv+arg_used, argv0);
+    } else if (strcmp(command, "quantize") == 0) {
+        return main_quantize(argc-arg_used, argv+arg_used, argv0);
     } else {
         fprintf(fpe, "ERROR: Unrecognized command (%s) specified.\n", command);    
         return 1;
@@ -0,0 +1,324 @@
+/*
+ *        Quantize command for CRFsuite frontend.
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/* $Id$ */
+
+#include <os.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <crfsuite.h>
+#include "option.h"
+#include "iwa.h"
+
+#define    SAFE_RELEASE(obj)    if ((obj) != NULL) { (obj)->release(obj); (obj) = NULL; }
+
+void show_copyright(FILE *fp);
+
+typedef struct {
+    int type;
+    char *evaluate;
+    int help;
+} quantize_option_t;
+
+static char* mystrdup(const char *src)
+{
+    char *dst = (char*)malloc(strlen(src)+1);
+    if (dst != NULL) {
+        strcpy(dst, src);
+    }
+    return dst;
+}
+
+static void quantize_option_init(quantize_option_t* opt)
+{
+    memset(opt, 0, sizeof(*opt));
+    opt->type = CRFSUITE_QUANTIZE_INT8;
+}
+
+static void quantize_option_finish(quantize_option_t* opt)
+{
+    free(opt->evaluate);
+}
+
+BEGIN_OPTION_MAP(parse_quantize_options, quantize_option_t)
+
+    ON_OPTION_WITH_ARG(SHORTOPT('t') || LONGOPT("type"))
+        if (strcmp(arg, "fp16") == 0) {
+            opt->type = CRFSUITE_QUANTIZE_FP16;
+        } else if (strcmp(arg, "int8") == 0) {
+            opt->type = CRFSUITE_QUANTIZE_INT8;
+        } else {
+            fprintf(stderr, "ERROR: Unknown weight type: %s\n", arg);
+            return -1;
+        }
+
+    ON_OPTION_WITH_ARG(SHORTOPT('e') || LONGOPT("evaluate"))
+        free(opt->evaluate);
+        opt->evaluate = mystrdup(arg);
+
+    ON_OPTION(SHORTOPT('h') || LONGOPT("help"))
+        opt->help = 1;
+
+END_OPTION_MAP()
+
+static void show_usage(FILE *fp, const char *argv0, const char *command)
+{
+    fprintf(fp, "USAGE: %s %s [OPTIONS] <MODEL> <OUTPUT>\n", argv0, command);
+    fprintf(fp, "Write a copy of the model (MODEL) with quantized feature weights to a file\n");
+    fprintf(fp, "(OUTPUT). Compare the accuracy of the two models on labeled instances in a\n");
+    fprintf(fp, "data set (with -e option). Only the weights shrink; the attribute and\n");
+    fprintf(fp, "label dictionaries and the feature sources and references are stored as\n");
+    fprintf(fp, "before. A quantized model is thus only about 1.2-1.5 times (not 4-8 times)\n");
+    fprintf(fp, "smaller than the original model.\n");
+    fprintf(fp, "\n");
+    fprintf(fp, "OPTIONS:\n");
+    fprintf(fp, "    -t, --type=TYPE     Encode the weights in TYPE (DEFAULT='int8')\n");
+    fprintf(fp, "                        fp16: 16-bit floating-point numbers\n");
+    fprintf(fp, "                        int8: 8-bit integers with a scale for each label\n");
+    fprintf(fp, "    -e, --evaluate=DATA Report the accuracy of both models on a data set (DATA)\n");
+    fprintf(fp, "    -h, --help          Show the usage of this command and exit\n");
+}
+
+static long file_size(const char *filename)
+{
+    long size = -1;
+    FILE *fp = fopen(filename, "rb");
+    if (fp != NULL) {
+        if (fseek(fp, 0, SEEK_END) == 0) {
+            size = ftell(fp);
+        }
+        fclose(fp);
+    }
+    return size;
+}
+
+static void output_evaluation(FILE *fpo, const char *name, const crfsuite_evaluation_t* eval)
+{
+    fprintf(fpo, "%s: item accuracy: %.4f, instance accuracy: %.4f, macro F1: %.4f\n",
+        name, eval->item_accuracy, eval->inst_accuracy, eval->macro_fmeasure);
+}
+
+/*
+ * Tag the labeled instances in a data set with the original and quantized
+ * models, and report the accuracy of both models and their agreement.
+ */
+static int evaluate(FILE *fpo, FILE *fpe, const char *data, crfsuite_model_t* model, crfsuite_model_t* qmodel)
+{
+    int i, L = 0, ret = 0, lid = -1;
+    int num_items = 0, num_agreed = 0;
+    int *output = NULL, *qoutput = NULL;
+    crfsuite_instance_t inst;
+    crfsuite_item_t item;
+    crfsuite_attribute_t cont;
+    crfsuite_evaluation_t eval, qeval;
+    iwa_t* iwa = NULL;
+    const iwa_token_t* token = NULL;
+    crfsuite_tagger_t *tagger = NULL, *qtagger = NULL;
+    crfsuite_dictionary_t *attrs = NULL, *labels = NULL;
+    FILE *fp = NULL;
+
+    /* Initialize the objects for instance and evaluation. */
+    crfsuite_instance_init(&inst);
+    memset(&eval, 0, sizeof(eval));
+    memset(&qeval, 0, sizeof(qeval));
+
+    /* Both models have the same labels and attributes. */
+    if ((ret = model->get_labels(model, &labels)) ||
+        (ret = model->get_attrs(model, &attrs)) ||
+        (ret = model->get_tagger(model, &tagger)) ||
+        (ret = qmodel->get_tagger(qmodel, &qtagger))) {
+        goto force_exit;
+    }
+
+    L = labels->num(labels);
+    crfsuite_evaluation_init(&eval, L);
+    crfsuite_evaluation_init(&qeval, L);
+
+    fp = fopen(data, "r");
+    if (fp == NULL) {
+        fprintf(fpe, "ERROR: failed to open the stream for the input data,\n");
+        fprintf(fpe, "  %s\n", data);
+        ret = 1;
+        goto force_exit;
+    }
+
+    iwa = iwa_reader(fp);
+    if (iwa == NULL) {
+        fprintf(fpe, "ERROR: Failed to initialize the parser for the input data.\n");
+        ret = 1;
+        goto force_exit;
+    }
+
+    while (token = iwa_read(iwa), token != NULL) {
+        switch (token->type) {
+        case IWA_BOI:
+            lid = -1;
+            crfsuite_item_init(&item);
+            break;
+        case IWA_EOI:
+            crfsuite_instance_append(&inst, &item, lid);
+            crfsuite_item_finish(&item);
+            break;
+        case IWA_ITEM:
+            if (lid == -1) {
+                lid = labels->to_id(labels, token->attr);
+                if (lid < 0) lid = L;    /* #L stands for a unknown label. */
+            } else {
+                int aid = attrs->to_id(attrs, token->attr);
+                if (0 <= aid) {
+                    if (token->value && *token->value) {
+                        crfsuite_attribute_set(&cont, aid, atof(token->value));
+                    } else {
+                        crfsuite_attribute_set(&cont, aid, 1.0);
+                    }
+                    crfsuite_item_append_attribute(&item, &cont);
+                }
+            }
+            break;
+        case IWA_NONE:
+        case IWA_EOF:
+            if (!crfsuite_instance_empty(&inst)) {
+                floatval_t score = 0;
+
+                output = (int*)calloc(sizeof(int), inst.num_items);
+                qoutput = (int*)calloc(sizeof(int), inst.num_items);
+                if (output == NULL || qoutput == NULL) {
+                    ret = CRFSUITEERR_OUTOFMEMORY;
+                    goto force_exit;
+                }
+
+                if ((ret = tagger->set(tagger, &inst)) ||
+                    (ret = tagger->viterbi(tagger, output, &score)) ||
+                    (ret = qtagger->set(qtagger, &inst)) ||
+                    (ret = qtagger->viterbi(qtagger, qoutput, &score))) {
+                    goto force_exit;
+                }
+
+                crfsuite_evaluation_accmulate(&eval, inst.labels, output, inst.num_items);
+                crfsuite_evaluation_accmulate(&qeval, inst.labels, qoutput, inst.num_items);
+                for (i = 0;i < inst.num_items;++i) {
+                    if (output[i] == qoutput[i]) ++num_agreed;
+                }
+                num_items += inst.num_items;
+
+                free(output);
+                free(qoutput);
+                output = qoutput = NULL;
+                crfsuite_instance_finish(&inst);
+            }
+            break;
+        }
+    }
+
+    crfsuite_evaluation_finalize(&eval);
+    crfsuite_evaluation_finalize(&qeval);
+    output_evaluation(fpo, "Original ", &eval);
+    output_evaluation(fpo, "Quantized", &qeval);
+    fprintf(fpo, "Agreement: %.4f (%d/%d items)\n",
+        num_items ? num_agreed / (double)num_items : 0., num_agreed, num_items);
+
+force_exit:
+    iwa_delete(iwa);
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    free(output);
+    free(qoutput);
+    crfsuite_instance_finish(&inst);
+    crfsuite_evaluation_finish(&eval);
+    crfsuite_evaluation_finish(&qeval);
+
+    SAFE_RELEASE(qtagger);
+    SAFE_RELEASE(tagger);
+    SAFE_RELEASE(attrs);
+    SAFE_RELEASE(labels);
+    return ret;
+}
+
+int main_quantize(int argc, char *argv[], const char *argv0)
+{
+    int ret = 0, arg_used = 0;
+    quantize_option_t opt;
+    const char *command = argv[0];
+    const char *input = NULL, *output = NULL;
+    FILE *fpo = stdout, *fpe = stderr;
+    crfsuite_model_t *model = NULL, *qmodel = NULL;
+
+    /* Parse the command-line option. */
+    quantize_option_init(&opt);
+    arg_used = option_parse(++argv, --argc, parse_quantize_options, &opt);
+    if (arg_used < 0) {
+        ret = 1;
+        goto force_exit;
+    }
+
+    /* Show the help message for this command if specified. */
+    if (opt.help) {
+        show_copyright(fpo);
+        show_usage(fpo, argv0, command);
+        goto force_exit;
+    }
+
+    /* Check for the source and destination models. */
+    if (argc <= arg_used + 1) {
+        fprintf(fpe, "ERROR: No model or output specified. See help (-h) for the usage.\n");
+        ret = 1;
+        goto force_exit;
+    }
+    input = argv[arg_used];
+    output = argv[arg_used+1];
+
+    /* Write the quantized model. */
+    if (ret = crfsuite_quantize_model(input, output, opt.type)) {
+        fprintf(fpe, "ERROR: Failed to quantize the model (%s).\n", input);
+        goto force_exit;
+    }
+    fprintf(fpo, "Model size: %ld -> %ld [bytes]\n", file_size(input), file_size(output));
+
+    /* Compare the accuracy of the models if specified. */
+    if (opt.evaluate != NULL) {
+        if ((ret = crfsuite_create_instance_from_file(input, (void**)&model)) ||
+            (ret = crfsuite_create_instance_from_file(output, (void**)&qmodel))) {
+            fprintf(fpe, "ERROR: Failed to read the models.\n");
+            goto force_exit;
+        }
+        if (ret = evaluate(fpo, fpe, opt.evaluate, model, qmodel)) {
+            goto force_exit;
+        }
+    }
+
+force_exit:
+    SAFE_RELEASE(qmodel);
+    SAFE_RELEASE(model);
+    quantize_option_finish(&opt);
+    return ret;
+}
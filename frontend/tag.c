@@ -30,6 +30,10 @@
 
 /* $Id$ */
 
+#ifdef    HAVE_CONFIG_H
+#include <config.h>
+#endif/*HAVE_CONFIG_H*/
+
 #include <os.h>
 
 #include <stdio.h>
@@ -38,12 +42,95 @@
 #include <time.h>
 #include <math.h>
 
+#ifdef  _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif/*_WIN32*/
+
 #include <crfsuite.h>
 #include "option.h"
 #include "iwa.h"
 
 #define    SAFE_RELEASE(obj)    if ((obj) != NULL) { (obj)->release(obj); (obj) = NULL; }
 
+/* Threads, mutexes, and condition variables for the pipelined tagging, and
+   the wall-clock time (in seconds) for measuring the tagging speed. */
+#ifdef  _WIN32
+
+typedef HANDLE thread_t;
+typedef CRITICAL_SECTION mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+
+#define THREAD_FUNC(name, arg)  static DWORD WINAPI name(LPVOID arg)
+#define THREAD_RETURN           return 0
+
+static int thread_create(thread_t *th, LPTHREAD_START_ROUTINE func, void *arg)
+{
+    *th = CreateThread(NULL, 0, func, arg, 0, NULL);
+    return (*th != NULL) ? 0 : 1;
+}
+
+static void thread_join(thread_t th)
+{
+    WaitForSingleObject(th, INFINITE);
+    CloseHandle(th);
+}
+
+#define mutex_init(m)       InitializeCriticalSection(m)
+#define mutex_destroy(m)    DeleteCriticalSection(m)
+#define mutex_lock(m)       EnterCriticalSection(m)
+#define mutex_unlock(m)     LeaveCriticalSection(m)
+#define cond_init(c)        InitializeConditionVariable(c)
+#define cond_destroy(c)
+#define cond_wait(c, m)     SleepConditionVariableCS(c, m, INFINITE)
+#define cond_broadcast(c)   WakeAllConditionVariable(c)
+
+static double wall_clock()
+{
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+}
+
+#else
+
+typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t cond_t;
+
+#define THREAD_FUNC(name, arg)  static void *name(void *arg)
+#define THREAD_RETURN           return NULL
+
+static int thread_create(thread_t *th, void *(*func)(void*), void *arg)
+{
+    return pthread_create(th, NULL, func, arg);
+}
+
+static void thread_join(thread_t th)
+{
+    pthread_join(th, NULL);
+}
+
+#define mutex_init(m)       pthread_mutex_init(m, NULL)
+#define mutex_destroy(m)    pthread_mutex_destroy(m)
+#define mutex_lock(m)       pthread_mutex_lock(m)
+#define mutex_unlock(m)     pthread_mutex_unlock(m)
+#define cond_init(c)        pthread_cond_init(c, NULL)
+#define cond_destroy(c)     pthread_cond_destroy(c)
+#define cond_wait(c, m)     pthread_cond_wait(c, m)
+#define cond_broadcast(c)   pthread_cond_broadcast(c)
+
+static double wall_clock()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#endif/*_WIN32*/
+
 void show_copyright(FILE *fp);
 
 typedef struct {
@@ -53,8 +140,15 @@ typedef struct {
     int probability;
     int marginal;
     int marginal_all;
+    int sparse;
+    double threshold;
     int quiet;
     int reference;
+    int decode;
+    int dense;
+    int mmap;
+    int single;
+    int num_threads;
     int help;
 
     int num_params;
@@ -116,9 +210,32 @@ BEGIN_OPTION_MAP(parse_tagger_options, tagger_option_t)
     ON_OPTION(SHORTOPT('l') || LONGOPT("marginal-all"))
         opt->marginal_all = 1;
 
+    ON_OPTION_WITH_ARG(LONGOPT("marginal-threshold"))
+        opt->sparse = 1;
+        opt->threshold = atof(arg);
+
     ON_OPTION(SHORTOPT('q') || LONGOPT("quiet"))
         opt->quiet = 1;
 
+    ON_OPTION(SHORTOPT('d') || LONGOPT("decode"))
+        opt->decode = 1;
+
+    ON_OPTION(SHORTOPT('D') || LONGOPT("dense"))
+        opt->dense = 1;
+
+    ON_OPTION(LONGOPT("mmap"))
+        opt->mmap = 1;
+
+    ON_OPTION(LONGOPT("float"))
+        opt->single = 1;
+
+    ON_OPTION_WITH_ARG(SHORTOPT('j') || LONGOPT("jobs"))
+        opt->num_threads = atoi(arg);
+        if (opt->num_threads < 1) {
+            fprintf(stderr, "ERROR: The number of jobs must be positive: %s\n", arg);
+            return -1;
+        }
+
     ON_OPTION(SHORTOPT('h') || LONGOPT("help"))
         opt->help = 1;
 
@@ -143,32 +260,126 @@ static void show_usage(FILE *fp, const char *argv0, const char *command)
     fprintf(fp, "    -p, --probability   Output the probability of the label sequences\n");
     fprintf(fp, "    -i, --marginal      Output the marginal probabilitiy of items for their predicted label\n");
     fprintf(fp, "    -l, --marginal-all  Output the marginal probabilities of items for all labels\n");
+    fprintf(fp, "        --marginal-threshold=P\n");
+    fprintf(fp, "                        Output only the marginal probabilities above P (with -l)\n");
     fprintf(fp, "    -q, --quiet         Suppress tagging results (useful for test mode)\n");
+    fprintf(fp, "    -d, --decode        Decode the feature weights in memory for faster tagging\n");
+    fprintf(fp, "    -D, --dense         Decode the feature weights into dense rows (for few labels)\n");
+    fprintf(fp, "        --mmap          Map the model file into memory instead of reading it\n");
+    fprintf(fp, "        --float         Compute the Viterbi algorithm in single precision\n");
+    fprintf(fp, "    -j, --jobs=N        Tag instances on N worker threads, with a reader and a\n");
+    fprintf(fp, "                        writer thread keeping the order of the input\n");
     fprintf(fp, "    -h, --help          Show the usage of this command and exit\n");
 }
 
 
 
+/**
+ * Tagging result of an instance.
+ */
+typedef struct {
+    int *output;                /**< Viterbi labels [T]. */
+    floatval_t score;           /**< Score of the Viterbi labels. */
+    floatval_t lognorm;         /**< Normalization factor (with -p). */
+    floatval_t *marginals;      /**< Marginals of all labels [T][L] (with -i or -l). */
+    int *offsets;               /**< Offsets of the positions [T+1] (with --marginal-threshold). */
+    int *labels;                /**< Labels above the threshold. */
+    floatval_t *probs;          /**< Marginals of the labels above the threshold. */
+} tag_result_t;
+
+static void tag_result_finish(tag_result_t* res)
+{
+    free(res->probs);
+    free(res->labels);
+    free(res->offsets);
+    free(res->marginals);
+    free(res->output);
+    memset(res, 0, sizeof(*res));
+}
+
+static int
+tag_instance(
+    crfsuite_tagger_t *tagger,
+    crfsuite_instance_t *inst,
+    int L,
+    tag_result_t *res,
+    const tagger_option_t* opt
+    )
+{
+    int n, ret = 0;
+    const int T = inst->num_items;
+
+    /* Initialize the object to receive the tagging result. */
+    memset(res, 0, sizeof(*res));
+    res->output = (int*)calloc(T, sizeof(int));
+    if (res->output == NULL) {
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+
+    /* Set the instance to the tagger. */
+    if ((ret = tagger->set(tagger, inst))) {
+        return ret;
+    }
+
+    /* Obtain the viterbi label sequence. */
+    if ((ret = tagger->viterbi(tagger, res->output, &res->score))) {
+        return ret;
+    }
+
+    if (opt->probability) {
+        if ((ret = tagger->lognorm(tagger, &res->lognorm))) {
+            return ret;
+        }
+    }
+
+    if (opt->marginal || (opt->marginal_all && !opt->sparse)) {
+        res->marginals = (floatval_t*)calloc(T * L, sizeof(floatval_t));
+        if (res->marginals == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        if ((ret = tagger->marginals(tagger, res->marginals))) {
+            return ret;
+        }
+    }
+
+    if (opt->marginal_all && opt->sparse) {
+        /* At most 1/threshold labels exceed the threshold at a position;
+           one more label absorbs the rounding errors of the marginals
+           (and of 1/threshold) that sum up to nearly one. */
+        n = T * L;
+        if (0 < opt->threshold && (int)(1. / opt->threshold) + 1 < L) {
+            n = T * ((int)(1. / opt->threshold) + 1);
+        }
+        res->offsets = (int*)calloc(T+1, sizeof(int));
+        res->labels = (int*)calloc(n, sizeof(int));
+        res->probs = (floatval_t*)calloc(n, sizeof(floatval_t));
+        if (res->offsets == NULL || res->labels == NULL || res->probs == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        if ((ret = tagger->marginals_sparse(tagger, opt->threshold, res->offsets, res->labels, res->probs, n))) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
 static void
 output_result(
     FILE *fpo,
-    crfsuite_tagger_t *tagger,
     const crfsuite_instance_t *inst,
-    int *output,
+    const tag_result_t *res,
     crfsuite_dictionary_t *labels,
-    floatval_t score,
     const tagger_option_t* opt
     )
 {
-    int i, l;
-    floatval_t prob;
+    int i, k, l;
     const char *label = NULL;
+    const int L = labels->num(labels);
 
     if (opt->probability) {
-        floatval_t lognorm;
-        tagger->lognorm(tagger, &lognorm);
-	fprintf(fpo, "@score\t%f\t%f\n", score, lognorm);
-        fprintf(fpo, "@probability\t%f\n", exp(score - lognorm));
+	fprintf(fpo, "@score\t%f\t%f\n", res->score, res->lognorm);
+        fprintf(fpo, "@probability\t%f\n", exp(res->score - res->lognorm));
     }
 
     for (i = 0;i < inst->num_items;++i) {
@@ -178,20 +389,24 @@ output_result(
             labels->free(labels, label);
         }
 
-        labels->to_string(labels, output[i], &label);
+        labels->to_string(labels, res->output[i], &label);
         fprintf(fpo, "%s", label);
         labels->free(labels, label);
 
         if (opt->marginal) {
-            tagger->marginal_point(tagger, output[i], i, &prob);
-            fprintf(fpo, ":%f", prob);
+            fprintf(fpo, ":%f", res->marginals[L * i + res->output[i]]);
         }
 
-        if (opt->marginal_all) {
-            for (l = 0;l < labels->num(labels);++l) {
-                tagger->marginal_point(tagger, l, i, &prob);
+        if (opt->marginal_all && opt->sparse) {
+            for (k = res->offsets[i];k < res->offsets[i+1];++k) {
+                labels->to_string(labels, res->labels[k], &label);
+                fprintf(fpo, "\t%s:%f", label, res->probs[k]);
+                labels->free(labels, label);
+            }
+        } else if (opt->marginal_all) {
+            for (l = 0;l < L;++l) {
                 labels->to_string(labels, l, &label);
-                fprintf(fpo, "\t%s:%f", label, prob);
+                fprintf(fpo, "\t%s:%f", label, res->marginals[L * i + l]);
                 labels->free(labels, label);
             }
         }
@@ -220,8 +435,13 @@ output_instance(
         for (j = 0;j < inst->items[i].num_contents;++j) {
             const char *attr = NULL;
             attrs->to_string(attrs, inst->items[i].contents[j].aid, &attr);
-            fprintf(fpo, "\t%s:%f", attr, inst->items[i].contents[j].value);
-            attrs->free(attrs, attr);
+            if (attr != NULL) {
+                fprintf(fpo, "\t%s:%f", attr, inst->items[i].contents[j].value);
+                attrs->free(attrs, attr);
+            } else {
+                /* A model of feature hashing has no attribute string. */
+                fprintf(fpo, "\t#%d:%f", inst->items[i].contents[j].aid, inst->items[i].contents[j].value);
+            }
         }
 
         fprintf(fpo, "\n");
@@ -237,21 +457,408 @@ static int message_callback(void *instance, const char *format, va_list args)
     return 0;
 }
 
-static int tag(tagger_option_t* opt, crfsuite_model_t* model)
+/*
+ * Read an instance from the IWA parser.
+ *  Attributes unknown to the model are ignored, and labels unknown to the
+ *  model are set to #L. This function returns zero at the end of the
+ *  stream.
+ */
+static int
+read_instance(
+    iwa_t *iwa,
+    crfsuite_dictionary_t *attrs,
+    crfsuite_dictionary_t *labels,
+    crfsuite_instance_t *inst
+    )
 {
-    int N = 0, L = 0, ret = 0, lid = -1;
-    clock_t clk0, clk1;
-    crfsuite_instance_t inst;
+    int lid = -1;
     crfsuite_item_t item;
     crfsuite_attribute_t cont;
+    const iwa_token_t* token = NULL;
+    const int L = labels->num(labels);
+
+    while (token = iwa_read(iwa), token != NULL) {
+        switch (token->type) {
+        case IWA_BOI:
+            /* Initialize an item. */
+            lid = -1;
+            crfsuite_item_init(&item);
+            break;
+        case IWA_EOI:
+            /* Append the item to the instance. */
+            crfsuite_instance_append(inst, &item, lid);
+            crfsuite_item_finish(&item);
+            break;
+        case IWA_ITEM:
+            if (lid == -1) {
+                /* The first field in a line presents a label. */
+                lid = labels->to_id(labels, token->attr);
+                if (lid < 0) lid = L;    /* #L stands for a unknown label. */
+            } else {
+                /* Fields after the first field present attributes. */
+                int aid = attrs->to_id(attrs, token->attr);
+                /* Ignore attributes 'unknown' to the model. */
+                if (0 <= aid) {
+                    /* Associate the attribute with the current item. */
+                    if (token->value && *token->value) {
+                        crfsuite_attribute_set(&cont, aid, atof(token->value));
+                    } else {
+                        crfsuite_attribute_set(&cont, aid, 1.0);
+                    }
+                    crfsuite_item_append_attribute(&item, &cont);
+                }
+            }
+            break;
+        case IWA_NONE:
+        case IWA_EOF:
+            if (!crfsuite_instance_empty(inst)) {
+                return 1;
+            }
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/*
+    Pipelined tagging (-j N).
+
+    The calling thread reads instances into batches of TAG_BATCH_SIZE and
+    queues them; N worker threads tag the batches with their own taggers
+    and accumulate their own evaluations; a writer thread outputs the
+    batches in the order of the input. At most 4N batches are in flight,
+    so that the memory usage does not depend on the size of the input.
+ */
+#define TAG_BATCH_SIZE  64
+
+typedef struct tag_tag_batch {
+    int seq;                    /**< Sequential number of the batch. */
+    int num_instances;          /**< Number of instances. */
+    crfsuite_instance_t insts[TAG_BATCH_SIZE];
+    tag_result_t results[TAG_BATCH_SIZE];
+    struct tag_tag_batch *next; /**< Next batch in the queue. */
+} tag_batch_t;
+
+struct tag_tag_pipeline;
+
+typedef struct {
+    struct tag_tag_pipeline *pl;
+    crfsuite_tagger_t *tagger;  /**< Tagger of the worker. */
+    crfsuite_evaluation_t eval; /**< Evaluation of the instances tagged by the worker. */
+    thread_t thread;
+    int created;
+} tag_worker_t;
+
+typedef struct tag_tag_pipeline {
+    const tagger_option_t *opt;
+    crfsuite_dictionary_t *labels;
+    int L;
+
+    mutex_t mutex;
+    cond_t cond_todo;           /**< Signaled when a batch is queued. */
+    cond_t cond_done;           /**< Signaled when a batch is tagged. */
+    cond_t cond_space;          /**< Signaled when a batch is written. */
+
+    tag_batch_t *head;          /**< Queue of the batches to tag. */
+    tag_batch_t *tail;
+    tag_batch_t **done;         /**< Tagged batches [capacity] by seq % capacity. */
+    int capacity;               /**< Maximum number of batches in flight. */
+    int num_inflight;           /**< Number of batches read but not written. */
+    int num_batches;            /**< Number of batches read. */
+    int eof;                    /**< Nonzero after the last batch is queued. */
+    int ret;                    /**< Status code of the first failure. */
+} tag_pipeline_t;
+
+static void tag_batch_delete(tag_batch_t *batch)
+{
+    int i;
+
+    if (batch != NULL) {
+        for (i = 0;i < batch->num_instances;++i) {
+            tag_result_finish(&batch->results[i]);
+            crfsuite_instance_finish(&batch->insts[i]);
+        }
+        free(batch);
+    }
+}
+
+/* Stop the pipeline on a failure; the mutex must be held. */
+static void tag_pipeline_abort(tag_pipeline_t *pl, int ret)
+{
+    if (pl->ret == 0) {
+        pl->ret = ret;
+    }
+    cond_broadcast(&pl->cond_todo);
+    cond_broadcast(&pl->cond_done);
+    cond_broadcast(&pl->cond_space);
+}
+
+THREAD_FUNC(tag_worker, arg)
+{
+    int i, ret = 0;
+    tag_batch_t *batch = NULL;
+    tag_worker_t *w = (tag_worker_t*)arg;
+    tag_pipeline_t *pl = w->pl;
+
+    for (;;) {
+        /* Take a batch from the queue. */
+        mutex_lock(&pl->mutex);
+        while (pl->head == NULL && !pl->eof && pl->ret == 0) {
+            cond_wait(&pl->cond_todo, &pl->mutex);
+        }
+        batch = pl->head;
+        if (batch == NULL || pl->ret != 0) {
+            mutex_unlock(&pl->mutex);
+            break;
+        }
+        pl->head = batch->next;
+        if (pl->head == NULL) {
+            pl->tail = NULL;
+        }
+        mutex_unlock(&pl->mutex);
+
+        /* Tag the instances in the batch. */
+        for (i = 0;i < batch->num_instances;++i) {
+            crfsuite_instance_t *inst = &batch->insts[i];
+            if ((ret = tag_instance(w->tagger, inst, pl->L, &batch->results[i], pl->opt))) {
+                break;
+            }
+            if (pl->opt->evaluate) {
+                crfsuite_evaluation_accmulate(&w->eval, inst->labels, batch->results[i].output, inst->num_items);
+            }
+        }
+
+        /* Pass the batch to the writer (which discards it on a failure). */
+        mutex_lock(&pl->mutex);
+        pl->done[batch->seq % pl->capacity] = batch;
+        cond_broadcast(&pl->cond_done);
+        if (ret) {
+            tag_pipeline_abort(pl, ret);
+        }
+        mutex_unlock(&pl->mutex);
+        if (ret) {
+            break;
+        }
+    }
+
+    THREAD_RETURN;
+}
+
+THREAD_FUNC(tag_writer, arg)
+{
+    int i, next, slot;
+    tag_batch_t *batch = NULL;
+    tag_pipeline_t *pl = (tag_pipeline_t*)arg;
+    const tagger_option_t *opt = pl->opt;
+
+    for (next = 0;;++next) {
+        /* Wait for the batch #next. */
+        slot = next % pl->capacity;
+        mutex_lock(&pl->mutex);
+        while (pl->done[slot] == NULL && pl->ret == 0 &&
+            !(pl->eof && next == pl->num_batches)) {
+            cond_wait(&pl->cond_done, &pl->mutex);
+        }
+        batch = pl->done[slot];
+        if (batch == NULL || pl->ret != 0) {
+            mutex_unlock(&pl->mutex);
+            break;
+        }
+        pl->done[slot] = NULL;
+        mutex_unlock(&pl->mutex);
+
+        if (!opt->quiet) {
+            for (i = 0;i < batch->num_instances;++i) {
+                output_result(opt->fpo, &batch->insts[i], &batch->results[i], pl->labels, opt);
+            }
+        }
+        tag_batch_delete(batch);
+
+        /* Let the reader queue another batch. */
+        mutex_lock(&pl->mutex);
+        --pl->num_inflight;
+        cond_broadcast(&pl->cond_space);
+        mutex_unlock(&pl->mutex);
+    }
+
+    THREAD_RETURN;
+}
+
+static int
+tag_pipelined(
+    tagger_option_t* opt,
+    crfsuite_model_t* model,
+    int flags,
+    iwa_t *iwa,
+    crfsuite_dictionary_t *attrs,
+    crfsuite_dictionary_t *labels,
+    crfsuite_evaluation_t *eval,
+    int *ptr_num_instances
+    )
+{
+    int i, n, ret = 0, eof = 0, N = 0;
+    thread_t writer;
+    int writer_created = 0;
+    tag_pipeline_t pl;
+    tag_batch_t *batch = NULL;
+    tag_worker_t *workers = NULL;
+    const int num_workers = opt->num_threads;
+
+    memset(&pl, 0, sizeof(pl));
+    pl.opt = opt;
+    pl.labels = labels;
+    pl.L = labels->num(labels);
+    pl.capacity = 4 * num_workers;
+    mutex_init(&pl.mutex);
+    cond_init(&pl.cond_todo);
+    cond_init(&pl.cond_done);
+    cond_init(&pl.cond_space);
+
+    pl.done = (tag_batch_t**)calloc(pl.capacity, sizeof(tag_batch_t*));
+    workers = (tag_worker_t*)calloc(num_workers, sizeof(tag_worker_t));
+    if (pl.done == NULL || workers == NULL) {
+        ret = CRFSUITEERR_OUTOFMEMORY;
+        goto force_exit;
+    }
+
+    /* Create a tagger for each worker. */
+    for (i = 0;i < num_workers;++i) {
+        workers[i].pl = &pl;
+        crfsuite_evaluation_init(&workers[i].eval, pl.L);
+        if ((ret = model->get_tagger_ex(model, flags, &workers[i].tagger))) {
+            goto force_exit;
+        }
+    }
+
+    /* Start the workers and the writer. */
+    for (i = 0;i < num_workers;++i) {
+        if (thread_create(&workers[i].thread, tag_worker, &workers[i]) != 0) {
+            ret = CRFSUITEERR_OUTOFMEMORY;
+            break;
+        }
+        workers[i].created = 1;
+    }
+    if (ret == 0) {
+        if (thread_create(&writer, tag_writer, &pl) != 0) {
+            ret = CRFSUITEERR_OUTOFMEMORY;
+        } else {
+            writer_created = 1;
+        }
+    }
+
+    /* Read batches of instances and queue them. */
+    while (ret == 0 && !eof) {
+        batch = (tag_batch_t*)calloc(1, sizeof(tag_batch_t));
+        if (batch == NULL) {
+            ret = CRFSUITEERR_OUTOFMEMORY;
+            break;
+        }
+        for (n = 0;n < TAG_BATCH_SIZE;++n) {
+            crfsuite_instance_init(&batch->insts[n]);
+            if (!read_instance(iwa, attrs, labels, &batch->insts[n])) {
+                eof = 1;
+                break;
+            }
+        }
+        batch->num_instances = n;
+        if (n == 0) {
+            tag_batch_delete(batch);
+            break;
+        }
+
+        mutex_lock(&pl.mutex);
+        while (pl.capacity <= pl.num_inflight && pl.ret == 0) {
+            cond_wait(&pl.cond_space, &pl.mutex);
+        }
+        if (pl.ret != 0) {
+            mutex_unlock(&pl.mutex);
+            tag_batch_delete(batch);
+            break;
+        }
+        batch->seq = pl.num_batches++;
+        ++pl.num_inflight;
+        if (pl.tail != NULL) {
+            pl.tail->next = batch;
+        } else {
+            pl.head = batch;
+        }
+        pl.tail = batch;
+        cond_broadcast(&pl.cond_todo);
+        mutex_unlock(&pl.mutex);
+        N += n;
+    }
+
+    /* Let the threads finish. */
+    mutex_lock(&pl.mutex);
+    pl.eof = 1;
+    if (ret) {
+        tag_pipeline_abort(&pl, ret);
+    }
+    cond_broadcast(&pl.cond_todo);
+    cond_broadcast(&pl.cond_done);
+    mutex_unlock(&pl.mutex);
+
+    for (i = 0;i < num_workers;++i) {
+        if (workers[i].created) {
+            thread_join(workers[i].thread);
+        }
+    }
+    if (writer_created) {
+        thread_join(writer);
+    }
+    if (ret == 0) {
+        ret = pl.ret;
+    }
+
+    /* Merge the evaluations of the workers. */
+    for (i = 0;i < num_workers;++i) {
+        crfsuite_evaluation_merge(eval, &workers[i].eval);
+    }
+    *ptr_num_instances = N;
+
+force_exit:
+    /* Discard the batches left by a failure. */
+    while (pl.head != NULL) {
+        batch = pl.head;
+        pl.head = batch->next;
+        tag_batch_delete(batch);
+    }
+    for (i = 0;i < pl.capacity && pl.done != NULL;++i) {
+        tag_batch_delete(pl.done[i]);
+    }
+    if (workers != NULL) {
+        for (i = 0;i < num_workers;++i) {
+            SAFE_RELEASE(workers[i].tagger);
+            crfsuite_evaluation_finish(&workers[i].eval);
+        }
+    }
+    free(workers);
+    free(pl.done);
+    cond_destroy(&pl.cond_space);
+    cond_destroy(&pl.cond_done);
+    cond_destroy(&pl.cond_todo);
+    mutex_destroy(&pl.mutex);
+    return ret;
+}
+
+static int tag(tagger_option_t* opt, crfsuite_model_t* model)
+{
+    int N = 0, L = 0, ret = 0, flags = CRFSUITE_TAGGER_DEFAULT;
+    double sec0, sec1;
+    crfsuite_instance_t inst;
     crfsuite_evaluation_t eval;
-    char *comment = NULL;
+    tag_result_t res;
     iwa_t* iwa = NULL;
-    const iwa_token_t* token = NULL;
     crfsuite_tagger_t *tagger = NULL;
     crfsuite_dictionary_t *attrs = NULL, *labels = NULL;
     FILE *fp = NULL, *fpi = opt->fpi, *fpo = opt->fpo, *fpe = opt->fpe;
 
+    /* Initialize the objects for instance and evaluation. */
+    crfsuite_instance_init(&inst);
+    memset(&eval, 0, sizeof(eval));
+    memset(&res, 0, sizeof(res));
+
     /* Obtain the dictionary interface representing the labels in the model. */
     if (ret = model->get_labels(model, &labels)) {
         goto force_exit;
@@ -262,14 +869,23 @@ static int tag(tagger_option_t* opt, crfsuite_model_t* model)
         goto force_exit;
     }
 
-    /* Obtain the tagger interface. */
-    if (ret = model->get_tagger(model, &tagger)) {
-        goto force_exit;
+    /* Choose the tagger; a Viterbi-only tagger suffices unless the
+       probabilities are requested. */
+    if (opt->single) {
+        flags |= CRFSUITE_TAGGER_FLOAT;
+    }
+    if (!opt->probability && !opt->marginal && !opt->marginal_all) {
+        flags |= CRFSUITE_TAGGER_VITERBI;
+    }
+
+    /* Obtain the tagger interface (the workers obtain their own). */
+    if (opt->num_threads <= 1) {
+        if (ret = model->get_tagger_ex(model, flags, &tagger)) {
+            goto force_exit;
+        }
     }
 
-    /* Initialize the objects for instance and evaluation. */
     L = labels->num(labels);
-    crfsuite_instance_init(&inst);
     crfsuite_evaluation_init(&eval, L);
 
     /* Open the stream for the input data. */
@@ -290,80 +906,38 @@ static int tag(tagger_option_t* opt, crfsuite_model_t* model)
     }
 
     /* Read the input data and assign labels. */
-    clk0 = clock();
-    while (token = iwa_read(iwa), token != NULL) {
-        switch (token->type) {
-        case IWA_BOI:
-            /* Initialize an item. */
-            lid = -1;
-            crfsuite_item_init(&item);
-            free(comment);
-            comment = NULL;
-            break;
-        case IWA_EOI:
-            /* Append the item to the instance. */
-            crfsuite_instance_append(&inst, &item, lid);
-            crfsuite_item_finish(&item);
-            break;
-        case IWA_ITEM:
-            if (lid == -1) {
-                /* The first field in a line presents a label. */
-                lid = labels->to_id(labels, token->attr);
-                if (lid < 0) lid = L;    /* #L stands for a unknown label. */
-            } else {
-                /* Fields after the first field present attributes. */
-                int aid = attrs->to_id(attrs, token->attr);
-                /* Ignore attributes 'unknown' to the model. */
-                if (0 <= aid) {
-                    /* Associate the attribute with the current item. */
-                    if (token->value && *token->value) {
-                        crfsuite_attribute_set(&cont, aid, atof(token->value));
-                    } else {
-                        crfsuite_attribute_set(&cont, aid, 1.0);
-                    }
-                    crfsuite_item_append_attribute(&item, &cont);
-                }
+    sec0 = wall_clock();
+    if (1 < opt->num_threads) {
+        if (ret = tag_pipelined(opt, model, flags, iwa, attrs, labels, &eval, &N)) {
+            goto force_exit;
+        }
+    } else {
+        while (read_instance(iwa, attrs, labels, &inst)) {
+            /* Tag the instance. */
+            if ((ret = tag_instance(tagger, &inst, L, &res, opt))) {
+                goto force_exit;
             }
-            break;
-        case IWA_NONE:
-        case IWA_EOF:
-            if (!crfsuite_instance_empty(&inst)) {
-                /* Initialize the object to receive the tagging result. */
-                floatval_t score = 0;
-                int *output = calloc(sizeof(int), inst.num_items);
-
-                /* Set the instance to the tagger. */
-                if ((ret = tagger->set(tagger, &inst))) {
-                    goto force_exit;
-                }
 
-                /* Obtain the viterbi label sequence. */
-                if ((ret = tagger->viterbi(tagger, output, &score))) {
-                    goto force_exit;
-                }
-
-                ++N;
-
-                /* Accumulate the tagging performance. */
-                if (opt->evaluate) {
-                    crfsuite_evaluation_accmulate(&eval, inst.labels, output, inst.num_items);
-                }
+            ++N;
 
-                if (!opt->quiet) {
-                    output_result(fpo, tagger, &inst, output, labels, score, opt);
-                }
+            /* Accumulate the tagging performance. */
+            if (opt->evaluate) {
+                crfsuite_evaluation_accmulate(&eval, inst.labels, res.output, inst.num_items);
+            }
 
-                free(output);
-                crfsuite_instance_finish(&inst);
+            if (!opt->quiet) {
+                output_result(fpo, &inst, &res, labels, opt);
             }
-            break;
+
+            tag_result_finish(&res);
+            crfsuite_instance_finish(&inst);
         }
     }
-    clk1 = clock();
+    sec1 = wall_clock();
 
     /* Compute the performance if specified. */
     if (opt->evaluate) {
-        double sec = (clk1 - clk0) / (double)CLOCKS_PER_SEC;
+        double sec = sec1 - sec0;
         crfsuite_evaluation_finalize(&eval);
         crfsuite_evaluation_output(&eval, labels, message_callback, stdout);
         fprintf(fpo, "Elapsed time: %f [sec] (%.1f [instance/sec])\n", sec, N / sec);
@@ -380,7 +954,7 @@ force_exit:
         fp = NULL;
     }
 
-    free(comment);
+    tag_result_finish(&res);
     crfsuite_instance_finish(&inst);
     crfsuite_evaluation_finish(&eval);
 
@@ -424,7 +998,11 @@ int main_tag(int argc, char *argv[], const char *argv0)
     /* Read the model. */
     if (opt.model != NULL) {
         /* Create a model instance corresponding to the model file. */
-        if (ret = crfsuite_create_instance_from_file(opt.model, (void**)&model)) {
+        int flags = CRFSUITE_LOAD_DEFAULT;
+        if (opt.decode) flags |= CRFSUITE_LOAD_DECODE;
+        if (opt.dense) flags |= CRFSUITE_LOAD_DENSE;
+        if (opt.mmap) flags |= CRFSUITE_LOAD_MMAP;
+        if (ret = crfsuite_create_instance_from_file_ex(opt.model, flags, (void**)&model)) {
             goto force_exit;
         }
 
@@ -66,6 +66,9 @@ typedef double floatval_t;
 /** Maximum value of a float value. */
 #define    FLOAT_MAX    DBL_MAX
 
+/** Type of a hash value of an attribute. */
+typedef unsigned long long crfsuite_hash_t;
+
 /**
  * Status codes.
  */
@@ -186,6 +189,27 @@ typedef struct {
     crfsuite_dictionary_t    *labels;
 } crfsuite_data_t;
 
+/**
+ * A batch of instances packed in the compressed sparse row (CSR) format.
+ *  The items of the instance #n are #item_offsets[n], ...,
+ *  #item_offsets[n+1]-1, and the attributes of the item #i are
+ *  aids[attr_offsets[i]], ..., aids[attr_offsets[i+1]-1]. The arrays are
+ *  owned by the caller; a batch can thus be built once and reused without
+ *  allocating crfsuite_instance_t objects.
+ */
+typedef struct {
+    /** Number of instances (N). */
+    int                 num_instances;
+    /** Offsets of the instances in the items [N+1]; item_offsets[0] = 0. */
+    const int           *item_offsets;
+    /** Offsets of the items in the attributes [I+1], where I = item_offsets[N]. */
+    const int           *attr_offsets;
+    /** Attribute ids; ids out of the range of the model are ignored. */
+    const int           *aids;
+    /** Attribute values, or NULL if all the values are 1. */
+    const floatval_t    *values;
+} crfsuite_batch_t;
+
 /**@}*/
 
 
@@ -268,6 +292,10 @@ typedef int (*crfsuite_logging_callback)(void *user, const char *format, va_list
 
 /**
  * CRFSuite model interface.
+ *  A model object is immutable once created: it holds the model data and
+ *  the transition matrices compiled from them. Multiple threads may use a
+ *  model object at the same time, typically by obtaining a tagger for each
+ *  thread with get_tagger().
  */
 struct tag_crfsuite_model {
     /**
@@ -296,6 +324,9 @@ struct tag_crfsuite_model {
 
     /**
      * Obtain the pointer to crfsuite_tagger_t interface.
+     *  This function creates a new tagger (decode session) that shares the
+     *  compiled data of the model and owns only the work area for tagging.
+     *  This is cheap and thread-safe.
      *  @param  model       The pointer to this model instance.
      *  @param  ptr_tagger  The pointer that receives a crfsuite_tagger_t
      *                      pointer.
@@ -328,6 +359,19 @@ struct tag_crfsuite_model {
      *  @return int         The status code.
      */
     int (*dump)(crfsuite_model_t* model, FILE *fpo);
+
+    /**
+     * Obtain the pointer to crfsuite_tagger_t interface with options.
+     *  This function is identical to get_tagger() except that it receives
+     *  the options of the new tagger.
+     *  @param  model       The pointer to this model instance.
+     *  @param  flags       The options of the tagger (CRFSUITE_TAGGER_*).
+     *  @param  ptr_tagger  The pointer that receives a crfsuite_tagger_t
+     *                      pointer.
+     *  @return int         The status code; \c CRFSUITEERR_NOTSUPPORTED
+     *                      for an unknown option.
+     */
+    int (*get_tagger_ex)(crfsuite_model_t* model, int flags, crfsuite_tagger_t** ptr_tagger);
 };
 
 
@@ -390,6 +434,9 @@ struct tag_crfsuite_trainer {
 
 /**
  * CRFSuite tagger interface.
+ *  A tagger is a decode session: it keeps the state of the instance given
+ *  by set(), so a tagger must not be used by multiple threads at the same
+ *  time. Create a tagger for each thread from a shared model instead.
  */
 struct tag_crfsuite_tagger {
     /**
@@ -488,6 +535,128 @@ struct tag_crfsuite_tagger {
      *  @return int         The status code.
      */
     int (*marginal_path)(crfsuite_tagger_t *tagger, const int *path, int begin, int end, floatval_t *ptr_prob);
+
+    /**
+     * Find the Viterbi label sequences of instances.
+     *  This function tags sequences of similar lengths in lockstep, which
+     *  is faster than calling set() and viterbi() for every instance when
+     *  the model has a small number of labels. A tagger created with
+     *  CRFSUITE_TAGGER_FLOAT tags the instances one by one instead, so
+     *  that the scores agree with those of viterbi(). It discards the
+     *  instance set by set().
+     *  @param  tagger      The pointer to this tagger instance.
+     *  @param  insts       The array of the instances to be tagged.
+     *  @param  n           The number of the instances.
+     *  @param  labels      The label array that receives the Viterbi label
+     *                      sequences of the instances one after another. The
+     *                      number of elements in the array must be no smaller
+     *                      than the total number of items of the instances.
+     *  @param  scores      The array that receives the scores of the Viterbi
+     *                      label sequences [n]; this can be NULL.
+     *  @return int         The status code.
+     */
+    int (*viterbi_batch)(crfsuite_tagger_t* tagger, const crfsuite_instance_t *insts, int n, int *labels, floatval_t *scores);
+
+    /**
+     * Find the Viterbi label sequences of a batch of instances on threads.
+     *  This function splits the instances of the batch among threads, each
+     *  of which tags them with a work area of its own. The calling thread
+     *  is one of the threads. The first call creates the other threads,
+     *  and the tagger keeps them, waiting, with the work areas for the
+     *  subsequent calls until it is released; a call that requests more
+     *  threads than before replaces them. This function follows the
+     *  options of the tagger (e.g., CRFSUITE_TAGGER_FLOAT), and discards
+     *  the instance set by set(). A tagger must not run this function on
+     *  two threads at the same time.
+     *  @param  tagger      The pointer to this tagger instance.
+     *  @param  batch       The batch of instances.
+     *  @param  num_threads The number of threads.
+     *  @param  labels      The label array that receives the Viterbi label
+     *                      sequences; the label of the item #i is stored in
+     *                      labels[i] [item_offsets[N]].
+     *  @param  scores      The array that receives the scores of the Viterbi
+     *                      label sequences [N]; this can be NULL.
+     *  @return int         The status code.
+     */
+    int (*tag_batch)(crfsuite_tagger_t* tagger, const crfsuite_batch_t *batch, int num_threads, int *labels, floatval_t *scores);
+
+    /**
+     * Compute the marginal probabilities of all labels at all positions.
+     *  This function computes the same values as marginal_point() does,
+     *  a row of labels at a time.
+     *  @param  tagger      The pointer to this tagger instance.
+     *  @param  probs       The array that receives the marginal probability
+     *                      of the label #l at the position #t in
+     *                      probs[t * L + l] [T][L].
+     *  @return int         The status code.
+     */
+    int (*marginals)(crfsuite_tagger_t* tagger, floatval_t *probs);
+
+    /**
+     * Compute the marginal probabilities above a threshold.
+     *  This function stores the labels whose marginal probabilities exceed
+     *  the threshold, in ascending order of the labels for each position.
+     *  The labels at the position #t are labels[offsets[t]], ...,
+     *  labels[offsets[t+1]-1]. Since the marginal probabilities at a
+     *  position sum to one, no more than T * min(L, 1/threshold) labels
+     *  are stored for a positive threshold.
+     *  @param  tagger      The pointer to this tagger instance.
+     *  @param  threshold   The threshold of the marginal probabilities.
+     *  @param  offsets     The array that receives the offsets of the
+     *                      positions [T+1].
+     *  @param  labels      The array that receives the labels [size].
+     *  @param  probs       The array that receives the marginal
+     *                      probabilities of the labels [size].
+     *  @param  size        The number of elements of labels and probs.
+     *  @return int         The status code; \c CRFSUITEERR_OVERFLOW if more
+     *                      than size labels exceed the threshold.
+     */
+    int (*marginals_sparse)(crfsuite_tagger_t* tagger, floatval_t threshold, int *offsets, int *labels, floatval_t *probs, int size);
+
+    /**
+     * Find the k label sequences with the highest scores (k-best Viterbi).
+     *  The first sequence is identical to the one that viterbi() finds.
+     *  Fewer than k sequences are found if the instance has fewer than k
+     *  label sequences (L^T < k).
+     *  @param  tagger      The pointer to this tagger instance.
+     *  @param  k           The maximum number of label sequences.
+     *  @param  paths       The array that receives the label sequences in
+     *                      descending order of the scores; the label at
+     *                      the position #t of the r-th sequence is stored
+     *                      in paths[r * T + t] [k][T].
+     *  @param  scores      The array that receives the scores of the label
+     *                      sequences [k]. This argument can be \c NULL.
+     *  @param  ptr_num     The pointer that receives the number of label
+     *                      sequences found.
+     *  @return int         The status code.
+     */
+    int (*viterbi_nbest)(crfsuite_tagger_t* tagger, int k, int *paths, floatval_t *scores, int *ptr_num);
+
+    /**
+     * Constrain the label sequences of the current instance.
+     *  This function restricts the label sequences that viterbi(),
+     *  viterbi_nbest(), lognorm(), and the functions computing marginal
+     *  probabilities consider to those that satisfy the constraints, until
+     *  the next call of set(). The probabilities are conditioned on the
+     *  constraints, and score() is not affected. The Viterbi and
+     *  forward-backward algorithms visit only the labels allowed at each
+     *  position, so that small sets of labels speed up decoding. A label
+     *  set is a bitset of (L+7)/8 bytes, in which the bit (l % 8) of the
+     *  byte [l / 8] represents the label #l. If no label sequence
+     *  satisfies the constraints, viterbi(), lognorm(), and the functions
+     *  computing marginal probabilities return
+     *  \c CRFSUITEERR_INCOMPATIBLE.
+     *  @param  tagger      The pointer to this tagger instance.
+     *  @param  allowed     The array of the sets of labels allowed at the
+     *                      positions [T][(L+7)/8]. This argument can be
+     *                      \c NULL to allow all labels.
+     *  @param  forbidden   The array of the sets of labels #j to which the
+     *                      transitions from the label #i are forbidden
+     *                      [L][(L+7)/8]. This argument can be \c NULL to
+     *                      allow all transitions.
+     *  @return int         The status code.
+     */
+    int (*set_constraints)(crfsuite_tagger_t* tagger, const unsigned char *allowed, const unsigned char *forbidden);
 };
 
 /**
@@ -561,6 +730,34 @@ struct tag_crfsuite_dictionary {
      *                      freed.
      */
     void (*free)(crfsuite_dictionary_t* dic, const char *str);
+
+    /**
+     * Obtain the integer IDs for an array of strings.
+     *  This function is equivalent to calling to_id() for each string,
+     *  but may be faster, e.g., for all attributes of an item.
+     *  @param  dic         The pointer to this dictionary instance.
+     *  @param  strs        The array of strings.
+     *  @param  n           The number of strings.
+     *  @param  ids         The array that receives the IDs (\c -1 for
+     *                      strings not in the dictionary).
+     *  @return int         \c 0 if successful, an error code otherwise.
+     */
+    int (*to_ids)(crfsuite_dictionary_t* dic, const char **strs, int n, int *ids);
+
+    /**
+     * Obtain the integer IDs for an array of attribute hash values.
+     *  The hash values are computed by crfsuite_attribute_hash(). Only the
+     *  dictionaries of feature hashing (created as "dictionary/hash:BITS")
+     *  and the attribute dictionaries of the models trained with them
+     *  support this function; the IDs are obtained without any string.
+     *  @param  dic         The pointer to this dictionary instance.
+     *  @param  hashes      The array of hash values.
+     *  @param  n           The number of hash values.
+     *  @param  ids         The array that receives the IDs.
+     *  @return int         \c 0 if successful, \c CRFSUITEERR_NOTSUPPORTED
+     *                      if the dictionary does not hash attributes.
+     */
+    int (*hash_to_ids)(crfsuite_dictionary_t* dic, const crfsuite_hash_t *hashes, int n, int *ids);
 };
 
 /**
@@ -746,6 +943,106 @@ int crfsuite_create_instance(const char *iid, void **ptr);
  */
 int crfsuite_create_instance_from_file(const char *filename, void **ptr);
 
+/**
+ * Options for reading a model, which can be combined with bitwise OR.
+ *  @see    crfsuite_create_instance_from_file_ex(),
+ *          crfsuite_create_instance_from_memory_ex().
+ */
+enum {
+    /** Read the model as it is. */
+    CRFSUITE_LOAD_DEFAULT = 0x0000,
+    /**
+     * Decode the state features into arrays of labels and weights grouped
+     * by attributes at the load time. This speeds up tagging at the cost
+     * of 12 bytes of memory for each state feature (6 or 5 bytes for a
+     * model quantized to fp16 or int8, whose weights stay quantized).
+     */
+    CRFSUITE_LOAD_DECODE = 0x0001,
+    /**
+     * Store the state features of an attribute as a dense row of weights
+     * for all labels if the attribute emits at least a quarter of the
+     * labels; the rest are decoded as in CRFSUITE_LOAD_DECODE, which this
+     * flag implies. A row is added to the scores with a vector operation.
+     * This is effective for models with a small label set (e.g., part-of-
+     * speech tagging and chunking); it has no effect if the model has more
+     * than 64 labels.
+     */
+    CRFSUITE_LOAD_DENSE = 0x0002,
+    /**
+     * Map the model file into memory (read-only) instead of reading it to
+     * a private buffer. Processes that map the same file share one copy in
+     * the page cache, and the model is loaded without reading the file.
+     * The file must not be modified while the model is in use. This flag
+     * is ignored by crfsuite_create_instance_from_memory_ex().
+     */
+    CRFSUITE_LOAD_MMAP = 0x0004,
+    /**
+     * Ask the operating system to read the mapped file ahead (madvise
+     * with MADV_WILLNEED). This flag implies CRFSUITE_LOAD_MMAP. Loading
+     * the model fails with CRFSUITEERR_NOTSUPPORTED on platforms without
+     * the hint (e.g., Windows).
+     */
+    CRFSUITE_LOAD_WILLNEED = 0x0008,
+    /**
+     * Ask the operating system to back the mapped file with huge pages
+     * (madvise with MADV_HUGEPAGE). This flag implies CRFSUITE_LOAD_MMAP.
+     * Loading the model fails with CRFSUITEERR_NOTSUPPORTED on platforms
+     * without the hint (e.g., Windows and macOS); the hint has no effect
+     * if the kernel does not enable transparent huge pages.
+     */
+    CRFSUITE_LOAD_HUGEPAGE = 0x0010,
+    /**
+     * Lock the mapped file in memory (mlock) so that it is never paged
+     * out. Loading the model fails if the pages cannot be locked (e.g.,
+     * when exceeding RLIMIT_MEMLOCK). This flag implies CRFSUITE_LOAD_MMAP.
+     */
+    CRFSUITE_LOAD_MLOCK = 0x0020,
+};
+
+/**
+ * Options for a tagger, which can be combined with bitwise OR.
+ *  @see    crfsuite_model_t::get_tagger_ex().
+ */
+enum {
+    /** Compute the scores in double precision. */
+    CRFSUITE_TAGGER_DEFAULT = 0x0000,
+    /**
+     * Compute the Viterbi algorithm in single precision, which halves
+     * the memory of the Viterbi lattice and doubles the width of the
+     * vector operations. The state scores of an item are accumulated in
+     * double precision and rounded, so the Viterbi label sequence may
+     * differ from the double-precision one only when two paths have
+     * nearly equal scores. The tagger keeps the state scores in double
+     * precision as well, so that the score of the Viterbi label sequence,
+     * score(), lognorm(), the marginal probabilities, viterbi_nbest(),
+     * and constrained decoding agree with those of a double-precision
+     * tagger.
+     */
+    CRFSUITE_TAGGER_FLOAT = 0x0001,
+    /**
+     * Compute only the Viterbi label sequences and their scores. The
+     * tagger keeps two rows of Viterbi scores and stores the backward
+     * edges in one byte (up to 256 labels) or two bytes (up to 65536
+     * labels) instead of the Viterbi lattice, which reduces the memory
+     * of the tagger for an instance several times. lognorm() and the
+     * marginal probabilities return \c CRFSUITEERR_NOTSUPPORTED.
+     */
+    CRFSUITE_TAGGER_VITERBI = 0x0002,
+};
+
+/**
+ * Create an instance of a model object from a model file with options.
+ *  @param  filename    The filename of the model.
+ *  @param  flags       The options for reading the model (CRFSUITE_LOAD_*).
+ *  @param  ptr         The pointer to \c void* that points to the
+ *                      instance of the model object if successful,
+ *                      *ptr points to \c NULL otherwise.
+ *  @return int         \c 0 if this function creates an object successfully,
+ *                      \c CRFSUITEERR_NOTSUPPORTED if the platform lacks a
+ *                      requested option, or another error code otherwise.
+ */
+int crfsuite_create_instance_from_file_ex(const char *filename, int flags, void **ptr);
+
 /**
  * Create an instance of a model object from a model in memory.
  *  @param  data        A pointer to the model data.
@@ -759,6 +1056,87 @@ int crfsuite_create_instance_from_file(const char *filename, void **ptr);
  */
 int crfsuite_create_instance_from_memory(const void *data, size_t size, void **ptr);
 
+/**
+ * Create an instance of a model object from a model in memory with options.
+ *  @param  data        A pointer to the model data.
+ *                      Must be 16-byte aligned.
+ *  @param  size        A size (in bytes) of the model data.
+ *  @param  flags       The options for reading the model (CRFSUITE_LOAD_*).
+ *  @param  ptr         The pointer to \c void* that points to the
+ *                      instance of the model object if successful,
+ *                      *ptr points to \c NULL otherwise.
+ *  @return int         \c 0 if this function creates an object successfully,
+ *                      \c 1 otherwise
+ */
+int crfsuite_create_instance_from_memory_ex(const void *data, size_t size, int flags, void **ptr);
+
+/**
+ * Encodings of quantized feature weights.
+ *  @see    crfsuite_quantize_model().
+ */
+enum {
+    /**
+     * 8-byte floating-point numbers as trained; this writes a copy of a
+     * model (e.g., of the format version 1) in the current format.
+     */
+    CRFSUITE_QUANTIZE_NONE = 0,
+    /**
+     * IEEE 754 half-precision floating-point numbers (2 bytes per weight).
+     * The relative error of a weight is below 2^-11.
+     */
+    CRFSUITE_QUANTIZE_FP16 = 1,
+    /**
+     * 8-bit integers (1 byte per weight) multiplied by a scale factor for
+     * each destination label of state and transition features. The error
+     * of a weight is below 1/254 of the maximum absolute weight of the
+     * features sharing the scale factor.
+     */
+    CRFSUITE_QUANTIZE_INT8 = 2,
+};
+
+/**
+ * Write a copy of a model with quantized feature weights.
+ *  Taggers read the quantized weights as they are; the state scores are
+ *  accumulated from 2-byte or 1-byte weights instead of 8-byte weights,
+ *  at the cost of small errors in the scores. This holds for the arrays
+ *  decoded with CRFSUITE_LOAD_DECODE and CRFSUITE_LOAD_DENSE as well.
+ *  Only the weights shrink: the attribute and label dictionaries and the
+ *  feature sources and references are stored as before, so a quantized
+ *  model file is only about 1.2-1.5 times (not 4-8 times) smaller than
+ *  the original one.
+ *  @param  input       The filename of the source model.
+ *  @param  output      The filename of the quantized model.
+ *  @param  type        The encoding of the weights (CRFSUITE_QUANTIZE_*).
+ *  @return int         \c 0 if this function writes the model successfully,
+ *                      an error code (CRFSUITEERR_*) otherwise.
+ */
+int crfsuite_quantize_model(const char *input, const char *output, int type);
+
+/**
+ * Compute the hash value of an attribute for feature hashing.
+ *  A dictionary of feature hashing, created by crfsuite_create_instance()
+ *  with the interface identifier "dictionary/hash:BITS" (e.g.,
+ *  "dictionary/hash:20"), maps an attribute to one of 2^BITS IDs by this
+ *  hash value instead of storing the attribute string; the training
+ *  parameter "feature.hash_bits" must be set to BITS so that the model
+ *  keeps no attribute string either. An application may compute the hash
+ *  values of the attributes in advance and give them to the hash_to_ids()
+ *  function of the attribute dictionary of such a model.
+ *  @param  str         The attribute string.
+ *  @param  n           The length of the string in bytes.
+ *  @return crfsuite_hash_t The hash value.
+ */
+crfsuite_hash_t crfsuite_attribute_hash(const char *str, size_t n);
+
+/** Maximum number of bits of the IDs in feature hashing. */
+#define CRFSUITE_HASH_MAX_BITS  30
+
+/**
+ * The attribute ID for a hash value in a dictionary of 2^bits IDs.
+ */
+#define CRFSUITE_HASH_TO_ID(h, bits) \
+    ((int)((crfsuite_hash_t)(h) >> (64 - (bits))))
+
 /**
  * Create instances of tagging object from a model file.
  *  @param  filename    The filename of the model.
@@ -1011,6 +1389,17 @@ void crfsuite_evaluation_clear(crfsuite_evaluation_t* eval);
  */
 int crfsuite_evaluation_accmulate(crfsuite_evaluation_t* eval, const int* reference, const int* prediction, int T);
 
+/**
+ * Add the counts accumulated in another evaluation structure.
+ *  This function merges the evaluations accumulated separately (e.g., by
+ *  threads) before crfsuite_evaluation_finalize() is called.
+ *  @param  eval        The pointer to crfsuite_evaluation_t.
+ *  @param  src         The pointer to crfsuite_evaluation_t to be added.
+ *  @return int         \c 0 if succeeded, \c 1 if the numbers of labels
+ *                      differ.
+ */
+int crfsuite_evaluation_merge(crfsuite_evaluation_t* eval, const crfsuite_evaluation_t* src);
+
 /**
  * Finalize the evaluation result.
  *  @param  eval        The pointer to crfsuite_evaluation_t.
@@ -1050,6 +1439,15 @@ int crfsuite_interlocked_increment(int *count);
  */
 int crfsuite_interlocked_decrement(int *count);
 
+/**
+ * Obtains the name of the instruction set used by vector operations.
+ *  The library probes the CPU at run time and chooses the fastest
+ *  implementation of vector operations from "scalar", "sse2", "avx2",
+ *  and "avx512".
+ *  @return             The name of the instruction set.
+ */
+const char* crfsuite_vecmath_name();
+
 /**@}*/
 
 /**@}*/
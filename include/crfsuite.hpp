@@ -279,6 +279,11 @@ Tagger::~Tagger()
 }
 
 bool Tagger::open(const std::string& name)
+{
+    return this->open(name, CRFSUITE_LOAD_DEFAULT);
+}
+
+bool Tagger::open(const std::string& name, int flags)
 {
     int ret;
 
@@ -286,7 +291,7 @@ bool Tagger::open(const std::string& name)
     this->close();
 
     // Open the model file.
-    if ((ret = crfsuite_create_instance_from_file(name.c_str(), (void**)&model))) {
+    if ((ret = crfsuite_create_instance_from_file_ex(name.c_str(), flags, (void**)&model))) {
         return false;
     }
 
@@ -298,6 +303,11 @@ bool Tagger::open(const std::string& name)
     return true;
 }
 
+bool Tagger::open(const char* name, int flags)
+{
+    return this->open(std::string(name), flags);
+}
+
 bool Tagger::open(const void* data, std::size_t size)
 {
     int ret;
@@ -383,15 +393,27 @@ void Tagger::set(const ItemSequence& xseq)
     }
 
     // Build an instance.
+    std::vector<const char*> strs;
+    std::vector<int> aids;
     crfsuite_instance_init_n(&_inst, xseq.size());
     for (size_t t = 0;t < xseq.size();++t) {
         const Item& item = xseq[t];
         crfsuite_item_t* _item = &_inst.items[t];
 
+        // Look up the attributes of the item at a time.
+        strs.resize(item.size());
+        aids.resize(item.size());
+        for (size_t i = 0;i < item.size();++i) {
+            strs[i] = item[i].attr.c_str();
+        }
+        if (!item.empty()) {
+            attrs->to_ids(attrs, &strs[0], (int)item.size(), &aids[0]);
+        }
+
         // Set the attributes in the item.
         crfsuite_item_init(_item);
         for (size_t i = 0;i < item.size();++i) {
-            int aid = attrs->to_id(attrs, item[i].attr.c_str());
+            int aid = aids[i];
             if (0 <= aid) {
                 crfsuite_attribute_t cont;
                 crfsuite_attribute_set(&cont, aid, item[i].value);
@@ -411,6 +433,61 @@ void Tagger::set(const ItemSequence& xseq)
     attrs->release(attrs);
 }
 
+void Tagger::set(const HashedItemSequence& xseq)
+{
+    int ret;
+    crfsuite_instance_t _inst;
+    crfsuite_dictionary_t *attrs = NULL;
+
+    if (model == NULL || tagger == NULL) {
+        throw std::invalid_argument("The tagger is not opened");
+    }
+
+    // Obtain the dictionary interface representing the attributes in the model.
+    if ((ret = model->get_attrs(model, &attrs))) {
+        throw std::runtime_error("Failed to obtain the dictionary interface for attributes");
+    }
+
+    // Build an instance.
+    std::vector<crfsuite_hash_t> hashes;
+    std::vector<int> aids;
+    crfsuite_instance_init_n(&_inst, xseq.size());
+    for (size_t t = 0;t < xseq.size();++t) {
+        const HashedItem& item = xseq[t];
+        crfsuite_item_t* _item = &_inst.items[t];
+
+        // Map the hash values of the item to the attribute ids at a time.
+        hashes.resize(item.size());
+        aids.resize(item.size());
+        for (size_t i = 0;i < item.size();++i) {
+            hashes[i] = item[i].hash;
+        }
+        if (!item.empty()) {
+            if ((ret = attrs->hash_to_ids(attrs, &hashes[0], (int)item.size(), &aids[0]))) {
+                crfsuite_instance_finish(&_inst);
+                attrs->release(attrs);
+                throw std::invalid_argument("The model does not hash attributes");
+            }
+        }
+
+        // Set the attributes in the item.
+        crfsuite_item_init_n(_item, item.size());
+        for (size_t i = 0;i < item.size();++i) {
+            crfsuite_attribute_set(&_item->contents[i], aids[i], item[i].value);
+        }
+    }
+
+    // Set the instance to the tagger.
+    if ((ret = tagger->set(tagger, &_inst))) {
+        crfsuite_instance_finish(&_inst);
+        attrs->release(attrs);
+        throw std::runtime_error("Failed to set the instance to the tagger.");
+    }
+
+    crfsuite_instance_finish(&_inst);
+    attrs->release(attrs);
+}
+
 StringList Tagger::viterbi()
 {
     int ret;
@@ -459,6 +536,55 @@ StringList Tagger::viterbi()
     return yseq;
 }
 
+ScoredPathList Tagger::viterbi_nbest(int k)
+{
+    int ret, num = 0;
+    ScoredPathList paths;
+    crfsuite_dictionary_t *labels = NULL;
+
+    if (model == NULL || tagger == NULL) {
+        throw std::invalid_argument("The tagger is not opened");
+    }
+
+    // Make sure that the current instance is not empty.
+    const size_t T = (size_t)tagger->length(tagger);
+    if (T <= 0 || k <= 0) {
+        return paths;
+    }
+
+    // Obtain the dictionary interface representing the labels in the model.
+    if ((ret = model->get_labels(model, &labels))) {
+        throw std::runtime_error("Failed to obtain the dictionary interface for labels");
+    }
+
+    // Run the k-best Viterbi algorithm.
+    std::vector<int> path(T * k);
+    std::vector<floatval_t> scores(k);
+    if ((ret = tagger->viterbi_nbest(tagger, k, &path[0], &scores[0], &num))) {
+        labels->release(labels);
+        throw std::runtime_error("Failed to find the k-best paths.");
+    }
+
+    // Convert the paths to label sequences.
+    paths.resize(num);
+    for (int r = 0;r < num;++r) {
+        paths[r].labels.resize(T);
+        paths[r].score = scores[r];
+        for (size_t t = 0;t < T;++t) {
+            const char *label = NULL;
+            if (labels->to_string(labels, path[T * r + t], &label) != 0) {
+                labels->release(labels);
+                throw std::runtime_error("Failed to convert a label identifier to string.");
+            }
+            paths[r].labels[t] = label;
+            labels->free(labels, label);
+        }
+    }
+
+    labels->release(labels);
+    return paths;
+}
+
 double Tagger::probability(const StringList& yseq)
 {
     int ret;
@@ -587,6 +713,11 @@ std::string version()
     return CRFSUITE_VERSION;
 }
 
+unsigned long long attribute_hash(const std::string& attr)
+{
+    return crfsuite_attribute_hash(attr.c_str(), attr.size());
+}
+
 }
 
 #endif/*__CRFSUITE_HPP__*/
@@ -166,6 +166,72 @@ typedef std::vector<Item>  ItemSequence;
  */
 typedef std::vector<std::string> StringList;
 
+/**
+ * Tuple of the hash value of an attribute and its value.
+ *  A model trained with feature hashing (e.g., with the '--hash-bits'
+ *  option of the frontend) accepts attributes as hash values computed by
+ *  attribute_hash(), so that an application does not build strings for
+ *  the attributes when tagging.
+ */
+class HashedAttribute
+{
+public:
+    /// Hash value of the attribute.
+    unsigned long long hash;
+    /// Attribute value (weight).
+    double value;
+
+    /**
+     * Construct an attribute with the default hash value and value.
+     */
+    HashedAttribute() : hash(0), value(1.)
+    {
+    }
+
+    /**
+     * Construct an attribute.
+     *  @param  h           The hash value of the attribute.
+     *  @param  val         The attribute value.
+     */
+    HashedAttribute(unsigned long long h, double val = 1.) : hash(h), value(val)
+    {
+    }
+};
+
+/**
+ * Type of an item of hashed attributes in a sequence.
+ */
+typedef std::vector<HashedAttribute> HashedItem;
+
+/**
+ * Type of a sequence of items of hashed attributes.
+ */
+typedef std::vector<HashedItem>  HashedItemSequence;
+
+/**
+ * Tuple of a label sequence and its score.
+ */
+class ScoredPath
+{
+public:
+    /// Label sequence.
+    StringList labels;
+    /// Score of the label sequence (without the normalization factor).
+    double score;
+
+    /**
+     * Construct an empty label sequence.
+     */
+    ScoredPath() : score(0.)
+    {
+    }
+};
+
+/**
+ * Type of a list of label sequences with their scores.
+ */
+typedef std::vector<ScoredPath> ScoredPathList;
+
 
 
 
@@ -326,6 +392,26 @@ public:
      */
     bool open(const std::string& name);
 
+    /**
+     * Open a model file with options.
+     *  @param  name        The file name of the model file.
+     *  @param  flags       The options for reading the model, a combination
+     *                      of CRFSUITE_LOAD_* values in crfsuite.h (e.g.,
+     *                      CRFSUITE_LOAD_MMAP to map the file into memory).
+     *  @return bool        \c true if the model file is successfully opened,
+     *                      \c false otherwise (e.g., when the model file is
+     *                      not found).
+     *  @throw  std::runtime_error      An internal error in the model.
+     */
+    bool open(const std::string& name, int flags);
+
+    /**
+     * Open a model file with options.
+     *  This overload prevents open("model.crf", flags) from resolving to
+     *  open(const void*, std::size_t).
+     */
+    bool open(const char* name, int flags);
+
     /**
      * Open a model from memory.
      *  @param  data        A pointer to the model data.
@@ -372,6 +458,18 @@ public:
      */
     void set(const ItemSequence& xseq);
 
+    /**
+     * Set an item sequence of hashed attributes.
+     *  This function sets an item sequence for future calls for
+     *  viterbi(), probability(), and marginal() functions, as set() does
+     *  for attribute strings.
+     *  @param  xseq        The item sequence to be tagged.
+     *  @throw  std::invalid_argument   A model is not opened, or the model
+     *                                  was not trained with feature hashing.
+     *  @throw  std::runtime_error      An internal error.
+     */
+    void set(const HashedItemSequence& xseq);
+
     /**
      * Find the Viterbi label sequence for the item sequence.
      *  @return StringList  The label sequence predicted.
@@ -380,6 +478,19 @@ public:
      */
     StringList viterbi();
 
+    /**
+     * Find the k label sequences with the highest scores.
+     *  The first label sequence is identical to the one that viterbi()
+     *  finds. The probability of a label sequence is
+     *  exp(score - log(Z)), where Z is the normalization factor.
+     *  @param  k           The maximum number of label sequences.
+     *  @return ScoredPathList  The label sequences and their scores in
+     *                      descending order of the scores.
+     *  @throw  std::invalid_argument   A model is not opened.
+     *  @throw  std::runtime_error      An internal error.
+     */
+    ScoredPathList viterbi_nbest(int k);
+
     /**
      * Compute the probability of the label sequence.
      *  @param  yseq        The label sequence.
@@ -404,6 +515,13 @@ public:
  */
 std::string version();
 
+/**
+ * Compute the hash value of an attribute for feature hashing.
+ *  @param  attr        The attribute.
+ *  @return unsigned long long  The hash value.
+ */
+unsigned long long attribute_hash(const std::string& attr);
+
 /**@} */
 
 
@@ -175,7 +175,10 @@ typedef struct tag_cqdb cqdb_t;        /**< Typedef of a CQDB reader. */
  * Open a new CQDB reader on a memory block.
  *
  *    This function initializes a database on a memory block and returns the
- *    pointer to a ::cqdb_t instance to access the database.
+ *    pointer to a ::cqdb_t instance to access the database. The reader
+ *    does not copy the hash tables nor the reverse lookup array, but reads
+ *    them from the memory block at every lookup; the memory block must be
+ *    kept until calling cqdb_delete().
  *
  *    @param    buffer        The pointer to the memory block.
  *    @param    size        The size of the memory block.
@@ -31,6 +31,13 @@
 
 /* $Id$ */
 
+/*
+ * Declare ftello() and fseeko() with 64-bit offsets even under -std=c99, so
+ * that a database can be written at an offset beyond 2GB of a file.
+ */
+#define _DEFAULT_SOURCE
+#define _FILE_OFFSET_BITS   64
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -38,6 +45,14 @@
 
 #include <cqdb.h>
 
+#ifdef  _MSC_VER
+#define ftell64     _ftelli64
+#define fseek64     _fseeki64
+#else
+#define ftell64     ftello
+#define fseek64     fseeko
+#endif/*_MSC_VER*/
+
 #define CHUNKID             "CQDB"
 #define BYTEORDER_CHECK     (0x62445371)
 #define NUM_TABLES          (256)
@@ -61,6 +76,14 @@ typedef struct {
     bucket_t*   bucket;     /**< Bucket (array of bucket_t). */
 } table_t;
 
+/**
+ * A hash table in the memory block of a reader.
+ */
+typedef struct {
+    uint32_t        num;    /**< Number of elements in the table. */
+    const uint8_t*  bucket; /**< Bucket (pairs of hash value and offset). */
+} table_image_t;
+
 /**
  * CQDB chunk header.
  */
@@ -87,7 +110,7 @@ typedef struct {
 struct tag_cqdb_writer {
     uint32_t    flag;           /**< Operation flag. */
     FILE*       fp;             /**< File pointer. */
-    uint32_t    begin;          /**< Offset address to the head of this database. */
+    int64_t     begin;          /**< Offset address to the head of this database. */
     uint32_t    cur;            /**< Offset address to a new key/data pair. */
     table_t     ht[NUM_TABLES]; /**< Hash tables (string -> id). */
 
@@ -104,9 +127,9 @@ struct tag_cqdb {
     size_t         size;           /**< Size of the memory block. */
 
     header_t       header;         /**< Chunk header. */
-    table_t        ht[NUM_TABLES]; /**< Hash tables (string -> id). */
+    table_image_t  ht[NUM_TABLES]; /**< Hash tables (string -> id). */
 
-    uint32_t*      bwd;            /**< Array for backward look-up (id -> string). */
+    const uint8_t* bwd;            /**< Array for backward look-up (id -> string). */
 
     int            num;            /**< Number of key/data pairs. */
 };
@@ -142,7 +165,7 @@ cqdb_writer_t* cqdb_writer(FILE *fp, int flag)
         memset(dbw, 0, sizeof(*dbw));
         dbw->flag = flag;
         dbw->fp = fp;
-        dbw->begin = ftell(dbw->fp);
+        dbw->begin = ftell64(dbw->fp);
         dbw->cur = OFFSET_DATA;
 
         /* Initialize the hash tables.*/
@@ -155,7 +178,7 @@ cqdb_writer_t* cqdb_writer(FILE *fp, int flag)
         dbw->bwd_size = 0;
 
         /* Move the file pointer to the offset to the first key/data pair. */
-        if (fseek(dbw->fp, dbw->begin + dbw->cur, SEEK_SET) != 0) {
+        if (fseek64(dbw->fp, dbw->begin + dbw->cur, SEEK_SET) != 0) {
             goto error_exit;    /* Seek error. */
         }
     }
@@ -257,7 +280,7 @@ int cqdb_writer_close(cqdb_writer_t* dbw)
 {
     uint32_t i, j;
     int k, ret = 0;
-    long offset = 0;
+    int64_t offset = 0;
     header_t header;
 
     /* If an error have occurred, just free the memory blocks. */
@@ -326,7 +349,7 @@ int cqdb_writer_close(cqdb_writer_t* dbw)
     /* Write the backlink array if specified. */
     if (!(dbw->flag & CQDB_ONEWAY) && 0 < dbw->bwd_size) {
         /* Store the offset to the head of this array. */
-        header.bwd_offset = ftell(dbw->fp) - dbw->begin;
+        header.bwd_offset = (uint32_t)(ftell64(dbw->fp) - dbw->begin);
         /* Store the contents of the backlink array. */
         for (i = 0;i < dbw->bwd_num;++i) {
             write_uint32(dbw, dbw->bwd[i]);
@@ -340,15 +363,15 @@ int cqdb_writer_close(cqdb_writer_t* dbw)
     }
 
     /* Store the current position. */
-    offset = ftell(dbw->fp);
+    offset = ftell64(dbw->fp);
     if (offset == -1) {
         ret = CQDB_ERROR_FILETELL;
         goto error_exit;
     }
-    header.size = (uint32_t)offset - dbw->begin;
+    header.size = (uint32_t)(offset - dbw->begin);
 
     /* Rewind the current position to the beginning. */
-    if (fseek(dbw->fp, dbw->begin, SEEK_SET) != 0) {
+    if (fseek64(dbw->fp, dbw->begin, SEEK_SET) != 0) {
         ret = CQDB_ERROR_FILESEEK;
         goto error_exit;
     }
@@ -381,7 +404,7 @@ int cqdb_writer_close(cqdb_writer_t* dbw)
     }
 
     /* Seek to the last position. */
-    if (fseek(dbw->fp, offset, SEEK_SET) != 0) {
+    if (fseek64(dbw->fp, offset, SEEK_SET) != 0) {
         ret = CQDB_ERROR_FILESEEK;
         goto error_exit;
     }
@@ -391,20 +414,35 @@ int cqdb_writer_close(cqdb_writer_t* dbw)
 
 error_exit:
     /* Seek to the first position. */
-    fseek(dbw->fp, dbw->begin, SEEK_SET);
+    fseek64(dbw->fp, dbw->begin, SEEK_SET);
     cqdb_writer_delete(dbw);
     return ret;
 }
 
 
 
+/*
+ * The reader does not copy the hash tables and the backlink array from the
+ * memory block, but reads their (unaligned) elements at every look-up. The
+ * elements are stored in little endian, which a little-endian host loads
+ * with a single instruction.
+ */
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || \
+    defined(_M_IX86) || defined(_M_X64) || defined(_M_ARM64)
+#define CQDB_LITTLE_ENDIAN
+#endif
+
 static uint32_t read_uint32(const uint8_t* p)
 {
     uint32_t value;
+#ifdef  CQDB_LITTLE_ENDIAN
+    memcpy(&value, p, sizeof(value));
+#else
     value  = ((uint32_t)p[0]);
     value |= ((uint32_t)p[1] << 8);
     value |= ((uint32_t)p[2] << 16);
     value |= ((uint32_t)p[3] << 24);
+#endif/*CQDB_LITTLE_ENDIAN*/
     return value;
 }
 
@@ -417,30 +455,6 @@ static const uint8_t *read_tableref(tableref_t* ref, const uint8_t *p)
     return p;
 }
 
-static bucket_t* read_bucket(const uint8_t* p, uint32_t num)
-{
-    uint32_t i;
-    bucket_t *bucket = (bucket_t*)calloc(num, sizeof(bucket_t));
-    for (i = 0;i < num;++i) {
-        bucket[i].hash = read_uint32(p);
-        p += sizeof(uint32_t);
-        bucket[i].offset = read_uint32(p);
-        p += sizeof(uint32_t);
-    }
-    return bucket;
-}
-
-static uint32_t* read_backward_links(const uint8_t* p, uint32_t num)
-{
-    uint32_t i;
-    uint32_t *bwd = (uint32_t*)calloc(num, sizeof(uint32_t));
-    for (i = 0;i < num;++i) {
-        bwd[i] = read_uint32(p);
-        p += sizeof(uint32_t);
-    }
-    return bwd;
-}
-
 cqdb_t* cqdb_reader(const void *buffer, size_t size)
 {
     int i;
@@ -498,8 +512,14 @@ cqdb_t* cqdb_reader(const void *buffer, size_t size)
             tableref_t ref;
             p = read_tableref(&ref, p);
             if (ref.offset) {
+                /* Check that the bucket is inside the chunk. */
+                if (db->header.size < ref.offset ||
+                    (db->header.size - ref.offset) / sizeof(bucket_t) < ref.num) {
+                    free(db);
+                    return NULL;
+                }
                 /* Set buckets. */
-                db->ht[i].bucket = read_bucket(db->buffer + ref.offset, ref.num);
+                db->ht[i].bucket = db->buffer + ref.offset;
                 db->ht[i].num = ref.num;
             } else {
                 /* An empty hash table. */
@@ -513,7 +533,13 @@ cqdb_t* cqdb_reader(const void *buffer, size_t size)
 
         /* Set the pointer to the backlink array if any. */
         if (db->header.bwd_offset) {
-            db->bwd = read_backward_links(db->buffer + db->header.bwd_offset, db->num);
+            /* Check that the backlink array is inside the chunk. */
+            if (db->header.size < db->header.bwd_offset ||
+                (db->header.size - db->header.bwd_offset) / sizeof(uint32_t) < db->header.bwd_size) {
+                free(db);
+                return NULL;
+            }
+            db->bwd = db->buffer + db->header.bwd_offset;
         } else {
             db->bwd = NULL;
         }
@@ -524,33 +550,26 @@ cqdb_t* cqdb_reader(const void *buffer, size_t size)
 
 void cqdb_delete(cqdb_t* db)
 {
-    int i;
-
-    if (db != NULL) {
-        for (i = 0;i < NUM_TABLES;++i) {
-            free(db->ht[i].bucket);
-        }
-        free(db->bwd);
-        free(db);
-    }
+    /* The hash tables and the backlink array belong to the memory block. */
+    free(db);
 }
 
 int cqdb_to_id(cqdb_t* db, const char *str)
 {
     uint32_t hv = hashlittle(str, strlen(str)+1, 0);
     int t = hv % 256;
-    table_t* ht = &db->ht[t];
+    const table_image_t* ht = &db->ht[t];
 
     if (ht->num && ht->bucket != NULL) {
         int n = ht->num;
         int k = (hv >> 8) % n;
-        bucket_t* p = NULL;
+        uint32_t offset = 0;
 
-        while (p = &ht->bucket[k], p->offset) {
-            if (p->hash == hv) {
+        while ((offset = read_uint32(ht->bucket + sizeof(bucket_t) * k + sizeof(uint32_t))) != 0) {
+            if (read_uint32(ht->bucket + sizeof(bucket_t) * k) == hv) {
                 int value;
                 uint32_t ksize;
-                const uint8_t *q = db->buffer + p->offset;
+                const uint8_t *q = db->buffer + offset;
                 value = (int)read_uint32(q);
                 q += sizeof(uint32_t);
                 ksize = read_uint32(q);
@@ -570,7 +589,7 @@ const char* cqdb_to_string(cqdb_t* db, int id)
 {
     /* Check if the current database supports the backward look-up. */
     if (db->bwd != NULL && (uint32_t)id < db->header.bwd_size) {
-        uint32_t offset = db->bwd[id];
+        uint32_t offset = read_uint32(db->bwd + sizeof(uint32_t) * id);
         if (offset) {
             const uint8_t *p = db->buffer + offset;
             p += sizeof(uint32_t);  /* Skip key data. */
@@ -50,6 +50,9 @@ enum {
     CTXF_BASE       = 0x01,
     CTXF_VITERBI    = 0x01,
     CTXF_MARGINALS  = 0x02,
+    CTXF_FASTEXP    = 0x04,     /**< Approximate exponents with vecfastexp(). */
+    CTXF_SHARED_TRANS = 0x08,   /**< Read the transition matrices of another context. */
+    CTXF_LEAN       = 0x10,     /**< Keep two rows of Viterbi scores and compact edges. */
     CTXF_ALL        = 0xFF,
 };
 
@@ -108,6 +111,16 @@ typedef struct {
      */
     floatval_t *trans;
 
+    /**
+     * Transposed transition scores.
+     *  This is a [L][L] matrix whose element [j][i] is a copy of the
+     *  element [i][j] of the transition matrix. The Viterbi algorithm
+     *  scans a row of this matrix to find the best predecessor of label #j
+     *  with contiguous memory accesses.
+     *  This member is available only with CTXF_VITERBI flag enabled.
+     */
+    floatval_t *transposed_trans;
+
     /**
      * Alpha score matrix.
      *  This is a [T][L] matrix whose element [t][l] presents the total
@@ -140,9 +153,51 @@ typedef struct {
      *  This is a [T][L] matrix whose element [t][j] represents the label #i
      *  that yields the maximum score to arrive at (t, j).
      *  This member is available only with CTXF_VITERBI flag enabled.
+     *  With CTXF_LEAN flag, this is a [L] vector (work space) for the
+     *  edges at the current position, and alpha_score holds only the rows
+     *  of the previous and current positions ([2][L]).
      */
     int *backward_edge;
 
+    /**
+     * Compact backward edges.
+     *  This is a [T][L] matrix of integers of edge_size bytes, which stores
+     *  the backward edges with CTXF_LEAN flag; one byte suffices for up to
+     *  256 labels, and two bytes for up to 65536 labels.
+     */
+    void *compact_edge;
+    int edge_size;
+
+    /**
+     * Work areas of the k-best Viterbi algorithm.
+     *  nbest_score holds the k best scores of the paths arriving at the
+     *  labels of the previous and current positions ([2][k][L]) in
+     *  descending order, followed by work space. nbest_back is a
+     *  [T][L][k] matrix (followed by work space) whose element
+     *  [t][j][r] stores the predecessor (i * k + s) of the r-th best path
+     *  arriving at (t, j), i.e., the s-th best path arriving at (t-1, i).
+     *  nbest_order is a [L] vector of the labels sorted by their scores.
+     *  These are allocated by crf1dc_viterbi_nbest() on demand.
+     */
+    floatval_t *nbest_score;
+    int *nbest_back;
+    void *nbest_order;
+    int cap_nbest_score;
+    int cap_nbest_back;
+
+    /**
+     * Labels allowed at the positions (crf1dc_set_allowed()).
+     *  This is a [T][L] matrix whose row #t lists the num_allowed[t]
+     *  labels allowed at #t in ascending order. The Viterbi and
+     *  forward-backward algorithms visit only these labels at positions
+     *  where some labels are not allowed. The lists are used only if
+     *  constrained is nonzero.
+     */
+    int *allowed;
+    int *num_allowed;
+    int cap_allowed;
+    int constrained;
+
     /**
      * Exponents of state scores.
      *  This is a [T][L] matrix whose element [t][l] presents the exponent
@@ -187,6 +242,8 @@ typedef struct {
     (&MATRIX(ctx->state, ctx->num_labels, 0, i))
 #define    TRANS_SCORE(ctx, i) \
     (&MATRIX(ctx->trans, ctx->num_labels, 0, i))
+#define    TRANSPOSED_TRANS_SCORE(ctx, j) \
+    (&MATRIX(ctx->transposed_trans, ctx->num_labels, 0, j))
 #define    EXP_STATE_SCORE(ctx, i) \
     (&MATRIX(ctx->exp_state, ctx->num_labels, 0, i))
 #define    EXP_TRANS_SCORE(ctx, i) \
@@ -197,6 +254,8 @@ typedef struct {
     (&MATRIX(ctx->mexp_trans, ctx->num_labels, 0, i))
 #define    BACKWARD_EDGE_AT(ctx, t) \
     (&MATRIX(ctx->backward_edge, ctx->num_labels, 0, t))
+#define    ALLOWED_LABELS(ctx, t) \
+    (&MATRIX(ctx->allowed, ctx->num_labels, 0, t))
 
 crf1d_context_t* crf1dc_new(int flag, int L, int T);
 int crf1dc_set_num_items(crf1d_context_t* ctx, int T);
@@ -204,16 +263,132 @@ void crf1dc_delete(crf1d_context_t* ctx);
 void crf1dc_reset(crf1d_context_t* ctx, int flag);
 void crf1dc_exp_state(crf1d_context_t* ctx);
 void crf1dc_exp_transition(crf1d_context_t* ctx);
+void crf1dc_transpose_transition(crf1d_context_t* ctx);
+void crf1dc_share_transition(crf1d_context_t* ctx, const crf1d_context_t* src);
+void crf1dc_mask_transition(crf1d_context_t* ctx, const crf1d_context_t* src, const unsigned char *forbidden);
+int crf1dc_set_allowed(crf1d_context_t* ctx, const unsigned char *allowed);
 void crf1dc_alpha_score(crf1d_context_t* ctx);
 void crf1dc_beta_score(crf1d_context_t* ctx);
 void crf1dc_marginals(crf1d_context_t* ctx);
+void crf1dc_marginal_points(crf1d_context_t *ctx, int t, floatval_t *prob);
 floatval_t crf1dc_marginal_point(crf1d_context_t *ctx, int l, int t);
 floatval_t crf1dc_marginal_path(crf1d_context_t *ctx, const int *path, int begin, int end);
 floatval_t crf1dc_score(crf1d_context_t* ctx, const int *labels);
 floatval_t crf1dc_lognorm(crf1d_context_t* ctx);
 floatval_t crf1dc_viterbi(crf1d_context_t* ctx, int *labels);
+int crf1dc_viterbi_nbest(crf1d_context_t* ctx, int k, int *paths, floatval_t *scores, int *ptr_num);
 void crf1dc_debug_context(FILE *fp);
 
+/**
+ * Number of sequences that a batch context processes in lockstep.
+ */
+#define CRF1D_BATCH_LANES   8
+
+/**
+ * Batch context structure.
+ *  This structure computes the forward-backward and Viterbi algorithms of
+ *  up to CRF1D_BATCH_LANES sequences (lanes) at a time. The matrices store
+ *  the values of the lanes next to each other, i.e., the element [t][l][b]
+ *  of a [T][L][B] matrix presents (t, l) of the sequence in the lane #b.
+ *  The lanes shorter than T are padded with zero state scores; the padding
+ *  does not change the results of the lanes. Sequences of similar lengths
+ *  waste the least computation on the padding.
+ */
+typedef struct {
+    int flag;               /**< Flag specifying the functionality. */
+    int num_labels;         /**< The total number of distinct labels (L). */
+    int num_items;          /**< The number of items (T) of the longest lane. */
+    int cap_items;          /**< The maximum number of items. */
+
+    /**
+     * Lengths of the lanes.
+     *  An unused lane has zero length.
+     */
+    int lengths[CRF1D_BATCH_LANES];
+
+    /**
+     * Logarithms of the normalization factors of the lanes.
+     */
+    floatval_t log_norm[CRF1D_BATCH_LANES];
+
+    floatval_t *state;          /**< State scores [T][L][B]. */
+    floatval_t *exp_state;      /**< Exponents of state scores [T][L][B]. */
+    floatval_t *alpha_score;    /**< Alpha (Viterbi) scores [T][L][B]. */
+    floatval_t *beta_score;     /**< Beta scores [T][L][B]. */
+    floatval_t *mexp_state;     /**< Model expectations of states [T][L][B]. */
+    int *backward_edge;         /**< Backward edges [T][L][B]. */
+    floatval_t *row;            /**< Work space [L][B]. */
+
+    /**
+     * Scale factors.
+     *  This is a [B][T] matrix whose element [b][t] presents the scaling
+     *  coefficient at #t of the lane #b.
+     */
+    floatval_t *scale_factor;
+
+    /**
+     * Model expectations of transitions of the lanes.
+     *  This is a [L][L][B] matrix accumulating the expectations of the
+     *  transitions (i--j) of the lane #b.
+     */
+    floatval_t *trans_lanes;
+
+    /**
+     * Model expectations of transitions.
+     *  This is a [L][L] matrix whose element [i][j] presents the sum of the
+     *  expectations of the transition (i--j) of the lanes, weighted by the
+     *  argument of crf1dbc_marginals().
+     */
+    floatval_t *mexp_trans;
+
+    const floatval_t *trans;        /**< Transition scores [L][L] (shared). */
+    const floatval_t *exp_trans;    /**< Exponents of transition scores [L][L] (shared). */
+    floatval_t *transposed_exp_trans;   /**< Transposed exp_trans [L][L]. */
+} crf1d_batch_context_t;
+
+#define    BATCH_MATRIX(bc, p, t) \
+    (&(bc)->p[(t) * (bc)->num_labels * CRF1D_BATCH_LANES])
+
+crf1d_batch_context_t* crf1dbc_new(int flag, int L, int T);
+int crf1dbc_set_num_items(crf1d_batch_context_t* bc, int T);
+void crf1dbc_delete(crf1d_batch_context_t* bc);
+void crf1dbc_reset(crf1d_batch_context_t* bc);
+void crf1dbc_share_transition(crf1d_batch_context_t* bc, const crf1d_context_t* src);
+void crf1dbc_set_state(crf1d_batch_context_t* bc, int b, const floatval_t *state, int T);
+void crf1dbc_exp_state(crf1d_batch_context_t* bc);
+void crf1dbc_alpha_score(crf1d_batch_context_t* bc);
+void crf1dbc_beta_score(crf1d_batch_context_t* bc);
+void crf1dbc_marginals(crf1d_batch_context_t* bc, const floatval_t *weights);
+void crf1dbc_viterbi(crf1d_batch_context_t* bc, int * const *labels, floatval_t *scores);
+
+/**
+ * Single-precision context structure.
+ *  This structure holds the scores of the Viterbi algorithm in float, which
+ *  halves the memory of the matrices and doubles the width of the vector
+ *  operations. It computes neither marginals nor the normalization factor;
+ *  these need the double-precision context (crf1d_context_t).
+ */
+typedef struct {
+    int flag;                   /**< CTXF_VITERBI, CTXF_SHARED_TRANS and CTXF_LEAN. */
+    int num_labels;             /**< The total number of distinct labels (L). */
+    int num_items;              /**< The number of items (T) in the instance. */
+    int cap_items;              /**< The maximum number of items. */
+    float *state;               /**< State scores [T][L]. */
+    float *trans;               /**< Transition scores [L][L]. */
+    float *alpha_score;         /**< Viterbi scores [T][L], or [2][L] with CTXF_LEAN. */
+    int *backward_edge;         /**< Backward edges [T][L], or [L] with CTXF_LEAN. */
+    void *compact_edge;         /**< Compact backward edges [T][L] (CTXF_LEAN). */
+    int edge_size;              /**< The size of an element of compact_edge. */
+} crf1d_context_float_t;
+
+crf1d_context_float_t* crf1dcf_new(int flag, int L, int T);
+int crf1dcf_set_num_items(crf1d_context_float_t* ctx, int T);
+void crf1dcf_delete(crf1d_context_float_t* ctx);
+void crf1dcf_reset(crf1d_context_float_t* ctx);
+void crf1dcf_set_transition(crf1d_context_float_t* ctx, const crf1d_context_t* src);
+void crf1dcf_share_transition(crf1d_context_float_t* ctx, const crf1d_context_float_t* src);
+floatval_t crf1dcf_viterbi(crf1d_context_float_t* ctx, int *labels);
+
 /** @} */
 
 
@@ -270,8 +445,18 @@ typedef struct {
 typedef struct {
     int        num_features;    /**< Number of features referred */
     int*    fids;            /**< Array of feature ids */
+    int        width;           /**< Bytes per feature id in a model (crf1dm_get_featureid()) */
 } feature_refs_t;
 
+/**
+ * Maximum number of labels for storing state features in dense rows.
+ *    The state features of an attribute are sorted by their destination
+ *    labels and receive consecutive feature ids. If an attribute emits all
+ *    of the L labels, its weights thus form a dense row of L elements,
+ *    which is added to the state scores with a vector operation.
+ */
+#define CRF1D_DENSE_MAX_LABELS  64
+
 crf1df_feature_t* crf1df_generate(
     int *ptr_num_features,
     dataset_t *ds,
@@ -323,6 +508,7 @@ int crf1dmw_put_label(crf1dmw_t* writer, int lid, const char *value);
 int crf1dmw_open_attrs(crf1dmw_t* writer, int num_attributes);
 int crf1dmw_close_attrs(crf1dmw_t* writer);
 int crf1dmw_put_attr(crf1dmw_t* writer, int aid, const char *value);
+int crf1dmw_hash_attrs(crf1dmw_t* writer, int bits);
 int crf1dmw_open_labelrefs(crf1dmw_t* writer, int num_labels);
 int crf1dmw_close_labelrefs(crf1dmw_t* writer);
 int crf1dmw_put_labelref(crf1dmw_t* writer, int lid, const feature_refs_t* ref, int *map);
@@ -333,7 +519,8 @@ int crf1dmw_open_features(crf1dmw_t* writer);
 int crf1dmw_close_features(crf1dmw_t* writer);
 int crf1dmw_put_feature(crf1dmw_t* writer, int fid, const crf1dm_feature_t* f);
 
-crf1dm_t* crf1dm_new(const char *filename);
+int crf1dm_check_flags(int flags);
+crf1dm_t* crf1dm_new(const char *filename, int flags);
 crf1dm_t* crf1dm_new_from_memory(const void *data, size_t size);
 void crf1dm_close(crf1dm_t* model);
 int crf1dm_get_num_attrs(crf1dm_t* model);
@@ -341,12 +528,19 @@ int crf1dm_get_num_labels(crf1dm_t* model);
 const char *crf1dm_to_label(crf1dm_t* model, int lid);
 int crf1dm_to_lid(crf1dm_t* model, const char *value);
 int crf1dm_to_aid(crf1dm_t* model, const char *value);
+int crf1dm_to_aids(crf1dm_t* model, const char **values, int n, int *aids);
+int crf1dm_hash_to_aids(crf1dm_t* model, const crfsuite_hash_t *hashes, int n, int *aids);
 const char *crf1dm_to_attr(crf1dm_t* model, int aid);
 int crf1dm_get_labelref(crf1dm_t* model, int lid, feature_refs_t* ref);
 int crf1dm_get_attrref(crf1dm_t* model, int aid, feature_refs_t* ref);
 int crf1dm_get_featureid(feature_refs_t* ref, int i);
 int crf1dm_get_feature(crf1dm_t* model, int fid, crf1dm_feature_t* f);
+int crf1dm_get_weight_type(crf1dm_t* model);
+int crf1dm_get_state_scales(crf1dm_t* model, floatval_t *scales);
+int crf1dm_get_fp16_feature(crf1dm_t* model, int fid, int *dst);
+int crf1dm_get_int8_feature(crf1dm_t* model, int fid, int *dst);
 void crf1dm_dump(crf1dm_t* model, FILE *fp);
+int crf1dm_quantize(crf1dm_t* model, const char *filename, int weight_type);
 
 /** @} */
 
@@ -37,9 +37,11 @@
 #include <os.h>
 
 #include <float.h>
+#include <inttypes.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <crfsuite.h>
 
@@ -47,6 +49,47 @@
 #include "vecmath.h"
 
 
+/* The size of the integers that can store the labels #0, ..., #(L-1). */
+static int edge_size(int L)
+{
+    if (L <= 0x100) {
+        return sizeof(uint8_t);
+    } else if (L <= 0x10000) {
+        return sizeof(uint16_t);
+    } else {
+        return sizeof(int);
+    }
+}
+
+/* Store the backward edges at (t, *) into the compact matrix. */
+static void pack_edges(void *edges, int size, int t, const int *back, int L)
+{
+    int j;
+
+    if (size == sizeof(uint8_t)) {
+        uint8_t *p = (uint8_t*)edges + (size_t)L * t;
+        for (j = 0;j < L;++j) p[j] = (uint8_t)back[j];
+    } else if (size == sizeof(uint16_t)) {
+        uint16_t *p = (uint16_t*)edges + (size_t)L * t;
+        for (j = 0;j < L;++j) p[j] = (uint16_t)back[j];
+    } else {
+        memcpy((int*)edges + (size_t)L * t, back, sizeof(int) * L);
+    }
+}
+
+/* Read the backward edge at (t, j) from the compact matrix. */
+static int unpack_edge(const void *edges, int size, int t, int j, int L)
+{
+    const size_t i = (size_t)L * t + j;
+
+    if (size == sizeof(uint8_t)) {
+        return ((const uint8_t*)edges)[i];
+    } else if (size == sizeof(uint16_t)) {
+        return ((const uint16_t*)edges)[i];
+    } else {
+        return ((const int*)edges)[i];
+    }
+}
 
 crf1d_context_t* crf1dc_new(int flag, int L, int T)
 {
@@ -57,13 +100,25 @@ crf1d_context_t* crf1dc_new(int flag, int L, int T)
     if (ctx != NULL) {
         ctx->flag = flag;
         ctx->num_labels = L;
+        ctx->edge_size = edge_size(L);
+
+        /* The transition matrices are set by crf1dc_share_transition(). */
+        if (!(ctx->flag & CTXF_SHARED_TRANS)) {
+            ctx->trans = (floatval_t*)calloc(L * L, sizeof(floatval_t));
+            if (ctx->trans == NULL) goto error_exit;
 
-        ctx->trans = (floatval_t*)calloc(L * L, sizeof(floatval_t));
-        if (ctx->trans == NULL) goto error_exit;
+            if (ctx->flag & CTXF_VITERBI) {
+                ctx->transposed_trans = (floatval_t*)calloc(L * L, sizeof(floatval_t));
+                if (ctx->transposed_trans == NULL) goto error_exit;
+            }
+
+            if (ctx->flag & CTXF_MARGINALS) {
+                ctx->exp_trans = (floatval_t*)_aligned_malloc((L * L + 4) * sizeof(floatval_t), 16);
+                if (ctx->exp_trans == NULL) goto error_exit;
+            }
+        }
 
         if (ctx->flag & CTXF_MARGINALS) {
-            ctx->exp_trans = (floatval_t*)_aligned_malloc((L * L + 4) * sizeof(floatval_t), 16);
-            if (ctx->exp_trans == NULL) goto error_exit;
             ctx->mexp_trans = (floatval_t*)calloc(L * L, sizeof(floatval_t));
             if (ctx->mexp_trans == NULL) goto error_exit;
         }
@@ -86,10 +141,12 @@ error_exit:
 int crf1dc_set_num_items(crf1d_context_t* ctx, int T)
 {
     const int L = ctx->num_labels;
+    const int lean = (ctx->flag & CTXF_LEAN);
 
     ctx->num_items = T;
 
     if (ctx->cap_items < T) {
+        free(ctx->compact_edge);
         free(ctx->backward_edge);
         free(ctx->mexp_state);
         _aligned_free(ctx->exp_state);
@@ -99,20 +156,29 @@ int crf1dc_set_num_items(crf1d_context_t* ctx, int T)
         free(ctx->alpha_score);
         free(ctx->state);
 
-        ctx->alpha_score = (floatval_t*)calloc(T * L, sizeof(floatval_t));
+        ctx->alpha_score = (floatval_t*)calloc((lean ? 2 : T) * L, sizeof(floatval_t));
         if (ctx->alpha_score == NULL) return CRFSUITEERR_OUTOFMEMORY;
-        ctx->beta_score = (floatval_t*)calloc(T * L, sizeof(floatval_t));
-        if (ctx->beta_score == NULL) return CRFSUITEERR_OUTOFMEMORY;
-        ctx->scale_factor = (floatval_t*)calloc(T, sizeof(floatval_t));
-        if (ctx->scale_factor == NULL) return CRFSUITEERR_OUTOFMEMORY;
-        ctx->row = (floatval_t*)calloc(L, sizeof(floatval_t));
-        if (ctx->row == NULL) return CRFSUITEERR_OUTOFMEMORY;
+
+        /* A lean context runs only the Viterbi algorithm. */
+        if (!lean) {
+            ctx->beta_score = (floatval_t*)calloc(T * L, sizeof(floatval_t));
+            if (ctx->beta_score == NULL) return CRFSUITEERR_OUTOFMEMORY;
+            ctx->scale_factor = (floatval_t*)calloc(T, sizeof(floatval_t));
+            if (ctx->scale_factor == NULL) return CRFSUITEERR_OUTOFMEMORY;
+            ctx->row = (floatval_t*)calloc(L, sizeof(floatval_t));
+            if (ctx->row == NULL) return CRFSUITEERR_OUTOFMEMORY;
+        }
 
         if (ctx->flag & CTXF_VITERBI) {
-            ctx->backward_edge = (int*)calloc(T * L, sizeof(int));
+            ctx->backward_edge = (int*)calloc((lean ? 1 : T) * L, sizeof(int));
             if (ctx->backward_edge == NULL) return CRFSUITEERR_OUTOFMEMORY;
         }
 
+        if (lean) {
+            ctx->compact_edge = calloc(T * L, ctx->edge_size);
+            if (ctx->compact_edge == NULL) return CRFSUITEERR_OUTOFMEMORY;
+        }
+
         ctx->state = (floatval_t*)calloc(T * L, sizeof(floatval_t));
         if (ctx->state == NULL) return CRFSUITEERR_OUTOFMEMORY;
 
@@ -132,6 +198,12 @@ int crf1dc_set_num_items(crf1d_context_t* ctx, int T)
 void crf1dc_delete(crf1d_context_t* ctx)
 {
     if (ctx != NULL) {
+        free(ctx->num_allowed);
+        free(ctx->allowed);
+        free(ctx->nbest_order);
+        free(ctx->nbest_back);
+        free(ctx->nbest_score);
+        free(ctx->compact_edge);
         free(ctx->backward_edge);
         free(ctx->mexp_state);
         _aligned_free(ctx->exp_state);
@@ -141,8 +213,11 @@ void crf1dc_delete(crf1d_context_t* ctx)
         free(ctx->beta_score);
         free(ctx->alpha_score);
         free(ctx->mexp_trans);
-        _aligned_free(ctx->exp_trans);
-        free(ctx->trans);
+        if (!(ctx->flag & CTXF_SHARED_TRANS)) {
+            _aligned_free(ctx->exp_trans);
+            free(ctx->transposed_trans);
+            free(ctx->trans);
+        }
     }
     free(ctx);
 }
@@ -155,7 +230,7 @@ void crf1dc_reset(crf1d_context_t* ctx, int flag)
     if (flag & RF_STATE) {
         veczero(ctx->state, T*L);
     }
-    if (flag & RF_TRANS) {
+    if ((flag & RF_TRANS) && !(ctx->flag & CTXF_SHARED_TRANS)) {
         veczero(ctx->trans, L*L);
     }
 
@@ -172,7 +247,11 @@ void crf1dc_exp_state(crf1d_context_t* ctx)
     const int L = ctx->num_labels;
 
     veccopy(ctx->exp_state, ctx->state, L * T);
-    vecexp(ctx->exp_state, L * T);
+    if (ctx->flag & CTXF_FASTEXP) {
+        vecfastexp(ctx->exp_state, L * T);
+    } else {
+        vecexp(ctx->exp_state, L * T);
+    }
 }
 
 void crf1dc_exp_transition(crf1d_context_t* ctx)
@@ -180,12 +259,120 @@ void crf1dc_exp_transition(crf1d_context_t* ctx)
     const int L = ctx->num_labels;
 
     veccopy(ctx->exp_trans, ctx->trans, L * L);
-    vecexp(ctx->exp_trans, L * L);
+    if (ctx->flag & CTXF_FASTEXP) {
+        vecfastexp(ctx->exp_trans, L * L);
+    } else {
+        vecexp(ctx->exp_trans, L * L);
+    }
+}
+
+void crf1dc_transpose_transition(crf1d_context_t* ctx)
+{
+    int i, j;
+    const floatval_t *trans = NULL;
+    const int L = ctx->num_labels;
+
+    /* Transpose the transition matrix so that the scores of transitions
+       arriving at label #j are stored in a row. */
+    for (i = 0;i < L;++i) {
+        trans = TRANS_SCORE(ctx, i);
+        for (j = 0;j < L;++j) {
+            TRANSPOSED_TRANS_SCORE(ctx, j)[i] = trans[j];
+        }
+    }
+}
+
+void crf1dc_share_transition(crf1d_context_t* ctx, const crf1d_context_t* src)
+{
+    /* The context reads, but never writes, the matrices of the source. */
+    ctx->trans = src->trans;
+    ctx->transposed_trans = src->transposed_trans;
+    ctx->exp_trans = src->exp_trans;
+}
+
+void crf1dc_mask_transition(crf1d_context_t* ctx, const crf1d_context_t* src, const unsigned char *forbidden)
+{
+    int i, j;
+    const int L = ctx->num_labels;
+    const int stride = (L + 7) / 8;
+
+    /*
+        Copy the transition scores of the source context, and disable the
+        forbidden transitions (i -> j) with the score -FLOAT_MAX, which
+        absorbs any score added to it, and the exponent zero.
+     */
+    veccopy(ctx->trans, src->trans, L * L);
+    for (i = 0;i < L;++i) {
+        for (j = 0;j < L;++j) {
+            if (forbidden[stride * i + j / 8] & (1 << (j % 8))) {
+                TRANS_SCORE(ctx, i)[j] = -FLOAT_MAX;
+            }
+        }
+    }
+    crf1dc_transpose_transition(ctx);
+
+    if (ctx->flag & CTXF_MARGINALS) {
+        crf1dc_exp_transition(ctx);
+        for (i = 0;i < L * L;++i) {
+            if (ctx->trans[i] == -FLOAT_MAX) {
+                ctx->exp_trans[i] = 0.;
+            }
+        }
+    }
+}
+
+int crf1dc_set_allowed(crf1d_context_t* ctx, const unsigned char *allowed)
+{
+    int j, n, t;
+    const unsigned char *bits = NULL;
+    const int T = ctx->num_items;
+    const int L = ctx->num_labels;
+    const int stride = (L + 7) / 8;
+
+    /* Remove the constraints. */
+    ctx->constrained = 0;
+    if (allowed == NULL) {
+        return 0;
+    }
+
+    if (ctx->cap_allowed < T) {
+        free(ctx->num_allowed);
+        free(ctx->allowed);
+        ctx->cap_allowed = 0;
+        ctx->allowed = (int*)malloc(sizeof(int) * T * L);
+        ctx->num_allowed = (int*)malloc(sizeof(int) * T);
+        if (ctx->allowed == NULL || ctx->num_allowed == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        ctx->cap_allowed = T;
+    }
+
+    /* List the labels allowed at each position. */
+    for (t = 0;t < T;++t) {
+        int *labels = ALLOWED_LABELS(ctx, t);
+        bits = &allowed[stride * t];
+        for (j = 0, n = 0;j < L;++j) {
+            if (bits[j / 8] & (1 << (j % 8))) {
+                labels[n++] = j;
+            }
+        }
+        ctx->num_allowed[t] = n;
+    }
+
+    ctx->constrained = 1;
+    return 0;
+}
+
+/* Test whether some labels are not allowed at either of two positions. */
+static int is_sparse(const crf1d_context_t* ctx, int t0, int t1)
+{
+    const int L = ctx->num_labels;
+    return ctx->constrained && (ctx->num_allowed[t0] < L || ctx->num_allowed[t1] < L);
 }
 
 void crf1dc_alpha_score(crf1d_context_t* ctx)
 {
-    int i, t;
+    int a, b, i, j, t;
     floatval_t sum, *cur = NULL;
     floatval_t *scale = &ctx->scale_factor[0];
     const floatval_t *prev = NULL, *trans = NULL, *state = NULL;
@@ -197,7 +384,15 @@ void crf1dc_alpha_score(crf1d_context_t* ctx)
      */
     cur = ALPHA_SCORE(ctx, 0);
     state = EXP_STATE_SCORE(ctx, 0);
-    veccopy(cur, state, L);
+    if (is_sparse(ctx, 0, 0)) {
+        veczero(cur, L);
+        for (b = 0;b < ctx->num_allowed[0];++b) {
+            j = ALLOWED_LABELS(ctx, 0)[b];
+            cur[j] = state[j];
+        }
+    } else {
+        veccopy(cur, state, L);
+    }
     sum = vecsum(cur, L);
     *scale = (sum != 0.) ? 1. / sum : 1.;
     vecscale(cur, *scale, L);
@@ -212,11 +407,29 @@ void crf1dc_alpha_score(crf1d_context_t* ctx)
         state = EXP_STATE_SCORE(ctx, t);
 
         veczero(cur, L);
-        for (i = 0;i < L;++i) {
-            trans = EXP_TRANS_SCORE(ctx, i);
-            vecaadd(cur, prev[i], trans, L);
+        if (is_sparse(ctx, t-1, t)) {
+            /* Visit only the transitions between allowed labels. */
+            const int *src = ALLOWED_LABELS(ctx, t-1);
+            const int *dst = ALLOWED_LABELS(ctx, t);
+            for (a = 0;a < ctx->num_allowed[t-1];++a) {
+                i = src[a];
+                trans = EXP_TRANS_SCORE(ctx, i);
+                for (b = 0;b < ctx->num_allowed[t];++b) {
+                    j = dst[b];
+                    cur[j] += prev[i] * trans[j];
+                }
+            }
+            for (b = 0;b < ctx->num_allowed[t];++b) {
+                j = dst[b];
+                cur[j] *= state[j];
+            }
+        } else {
+            for (i = 0;i < L;++i) {
+                trans = EXP_TRANS_SCORE(ctx, i);
+                vecaadd(cur, prev[i], trans, L);
+            }
+            vecmul(cur, state, L);
         }
-        vecmul(cur, state, L);
         sum = vecsum(cur, L);
         *scale = (sum != 0.) ? 1. / sum : 1.;
         vecscale(cur, *scale, L);
@@ -232,7 +445,8 @@ void crf1dc_alpha_score(crf1d_context_t* ctx)
 
 void crf1dc_beta_score(crf1d_context_t* ctx)
 {
-    int i, t;
+    int a, b, i, t;
+    floatval_t sum;
     floatval_t *cur = NULL;
     floatval_t *row = ctx->row;
     const floatval_t *next = NULL, *state = NULL, *trans = NULL;
@@ -255,9 +469,25 @@ void crf1dc_beta_score(crf1d_context_t* ctx)
         vecmul(row, state, L);
 
         /* Compute the beta score at (t, i). */
-        for (i = 0;i < L;++i) {
-            trans = EXP_TRANS_SCORE(ctx, i);
-            cur[i] = vecdot(trans, row, L);
+        if (is_sparse(ctx, t, t+1)) {
+            /* Visit only the transitions between allowed labels. */
+            const int *src = ALLOWED_LABELS(ctx, t);
+            const int *dst = ALLOWED_LABELS(ctx, t+1);
+            veczero(cur, L);
+            for (a = 0;a < ctx->num_allowed[t];++a) {
+                i = src[a];
+                trans = EXP_TRANS_SCORE(ctx, i);
+                sum = 0.;
+                for (b = 0;b < ctx->num_allowed[t+1];++b) {
+                    sum += trans[dst[b]] * row[dst[b]];
+                }
+                cur[i] = sum;
+            }
+        } else {
+            for (i = 0;i < L;++i) {
+                trans = EXP_TRANS_SCORE(ctx, i);
+                cur[i] = vecdot(trans, row, L);
+            }
         }
         vecscale(cur, *scale, L);
         --scale;
@@ -276,12 +506,7 @@ void crf1dc_marginals(crf1d_context_t* ctx)
                    = (1. / C[t]) * fwd'[t][i] * bwd'[t][i]
      */
     for (t = 0;t < T;++t) {
-        floatval_t *fwd = ALPHA_SCORE(ctx, t);
-        floatval_t *bwd = BETA_SCORE(ctx, t);
-        floatval_t *prob = STATE_MEXP(ctx, t);
-        veccopy(prob, fwd, L);
-        vecmul(prob, bwd, L);
-        vecscale(prob, 1. / ctx->scale_factor[t], L);
+        crf1dc_marginal_points(ctx, t, STATE_MEXP(ctx, t));
     }
 
     /*
@@ -313,6 +538,16 @@ void crf1dc_marginals(crf1d_context_t* ctx)
     }
 }
 
+void crf1dc_marginal_points(crf1d_context_t *ctx, int t, floatval_t *prob)
+{
+    const int L = ctx->num_labels;
+
+    /* p(t,i) = (1. / C[t]) * fwd'[t][i] * bwd'[t][i] for all i. */
+    veccopy(prob, ALPHA_SCORE(ctx, t), L);
+    vecmul(prob, BETA_SCORE(ctx, t), L);
+    vecscale(prob, 1. / ctx->scale_factor[t], L);
+}
+
 floatval_t crf1dc_marginal_point(crf1d_context_t *ctx, int l, int t)
 {
     floatval_t *fwd = ALPHA_SCORE(ctx, t);
@@ -465,57 +700,93 @@ floatval_t crf1dc_lognorm(crf1d_context_t* ctx)
 
 floatval_t crf1dc_viterbi(crf1d_context_t* ctx, int *labels)
 {
-    int i, j, t;
+    int a, b, i, j, t;
     int *back = NULL;
-    floatval_t max_score, score, *cur = NULL;
+    floatval_t score, max_score, *cur = NULL;
     int argmax_score;
     const floatval_t *prev = NULL, *state = NULL, *trans = NULL;
     const int T = ctx->num_items;
     const int L = ctx->num_labels;
+    const int lean = (ctx->flag & CTXF_LEAN);
 
     /*
         This function assumes state and trans scores to be in the logarithm domain.
+        A lean context alternates two rows of scores, and packs the
+        backward edges at (t, *) into the compact matrix. The labels that
+        are not allowed have the score -FLOAT_MAX.
      */
 
+    /* The owner of shared matrices transposes them in advance. */
+    if (!(ctx->flag & CTXF_SHARED_TRANS)) {
+        crf1dc_transpose_transition(ctx);
+    }
+
     /* Compute the scores at (0, *). */
     cur = ALPHA_SCORE(ctx, 0);
     state = STATE_SCORE(ctx, 0);
-    for (j = 0;j < L;++j) {
-        cur[j] = state[j];
+    if (is_sparse(ctx, 0, 0)) {
+        vecset(cur, -FLOAT_MAX, L);
+        for (b = 0;b < ctx->num_allowed[0];++b) {
+            j = ALLOWED_LABELS(ctx, 0)[b];
+            cur[j] = state[j];
+        }
+    } else {
+        for (j = 0;j < L;++j) {
+            cur[j] = state[j];
+        }
     }
 
     /* Compute the scores at (t, *). */
     for (t = 1;t < T;++t) {
-        prev = ALPHA_SCORE(ctx, t-1);
-        cur = ALPHA_SCORE(ctx, t);
+        prev = ALPHA_SCORE(ctx, lean ? (t-1) & 1 : t-1);
+        cur = ALPHA_SCORE(ctx, lean ? t & 1 : t);
         state = STATE_SCORE(ctx, t);
-        back = BACKWARD_EDGE_AT(ctx, t);
-
-        /* Compute the score of (t, j). */
-        for (j = 0;j < L;++j) {
-            max_score = -FLOAT_MAX;
-            argmax_score = -1;
-            for (i = 0;i < L;++i) {
-                /* Transit from (t-1, i) to (t, j). */
-                trans = TRANS_SCORE(ctx, i);
-                score = prev[i] + trans[j];
-
-                /* Store this path if it has the maximum score. */
-                if (max_score < score) {
-                    max_score = score;
-                    argmax_score = i;
+        back = lean ? ctx->backward_edge : BACKWARD_EDGE_AT(ctx, t);
+
+        if (is_sparse(ctx, t-1, t)) {
+            /* Visit only the transitions between allowed labels. */
+            const int *src = ALLOWED_LABELS(ctx, t-1);
+            const int *dst = ALLOWED_LABELS(ctx, t);
+            vecset(cur, -FLOAT_MAX, L);
+            for (b = 0;b < ctx->num_allowed[t];++b) {
+                j = dst[b];
+                trans = TRANSPOSED_TRANS_SCORE(ctx, j);
+                max_score = -FLOAT_MAX;
+                argmax_score = -1;
+                for (a = 0;a < ctx->num_allowed[t-1];++a) {
+                    i = src[a];
+                    score = prev[i] + trans[i];
+                    if (max_score < score) {
+                        max_score = score;
+                        argmax_score = i;
+                    }
                 }
+                if (argmax_score >= 0) back[j] = argmax_score;
+                cur[j] = max_score + state[j];
+            }
+        } else {
+            /* Compute the score of (t, j). */
+            for (j = 0;j < L;++j) {
+                /* Find the transition from (t-1, i) to (t, j) with the maximum
+                   score; the smallest #i wins a tie. */
+                trans = TRANSPOSED_TRANS_SCORE(ctx, j);
+                max_score = -FLOAT_MAX;
+                argmax_score = vecaddargmax(&max_score, prev, trans, L);
+                /* Backward link (#t, #j) -> (#t-1, #i). */
+                if (argmax_score >= 0) back[j] = argmax_score;
+                /* Add the state score on (t, j). */
+                cur[j] = max_score + state[j];
             }
-            /* Backward link (#t, #j) -> (#t-1, #i). */
-            if (argmax_score >= 0) back[j] = argmax_score;
-            /* Add the state score on (t, j). */
-            cur[j] = max_score + state[j];
+        }
+
+        if (lean) {
+            pack_edges(ctx->compact_edge, ctx->edge_size, t, back, L);
         }
     }
 
     /* Find the node (#T, #i) that reaches EOS with the maximum score. */
     max_score = -FLOAT_MAX;
-    prev = ALPHA_SCORE(ctx, T-1);
+    prev = ALPHA_SCORE(ctx, lean ? (T-1) & 1 : T-1);
     /* Set a score for T-1 to be overwritten later. Just in case we don't
        end up with something beating -FLOAT_MAX. */
     labels[T-1] = 0;
@@ -528,8 +799,787 @@ floatval_t crf1dc_viterbi(crf1d_context_t* ctx, int *labels)
 
     /* Tag labels by tracing the backward links. */
     for (t = T-2;0 <= t;--t) {
-        back = BACKWARD_EDGE_AT(ctx, t+1);
-        labels[t] = back[labels[t+1]];
+        if (lean) {
+            labels[t] = unpack_edge(ctx->compact_edge, ctx->edge_size, t+1, labels[t+1], L);
+        } else {
+            back = BACKWARD_EDGE_AT(ctx, t+1);
+            labels[t] = back[labels[t+1]];
+        }
+    }
+
+    /* Return the maximum score (without the normalization factor subtracted). */
+    return max_score;
+}
+
+/**
+ * Label and the score of the best path arriving at it.
+ */
+typedef struct {
+    floatval_t score;
+    int label;
+} nbest_node_t;
+
+/* Sort nodes in descending order of scores; the smaller label wins a tie. */
+static int nbest_compare(const void *x, const void *y)
+{
+    const nbest_node_t *a = (const nbest_node_t*)x;
+    const nbest_node_t *b = (const nbest_node_t*)y;
+    if (a->score != b->score) {
+        return (a->score > b->score) ? -1 : 1;
+    }
+    return (a->label < b->label) ? -1 : (a->label > b->label);
+}
+
+/*
+ * Sort the labels that have paths arriving at them by the scores of
+ * their best paths, and return the number of the labels.
+ */
+static int nbest_sort(nbest_node_t *order, const floatval_t *best, int L)
+{
+    int i, n = 0;
+
+    for (i = 0;i < L;++i) {
+        if (-FLOAT_MAX < best[i]) {
+            order[n].score = best[i];
+            order[n].label = i;
+            ++n;
+        }
+    }
+    qsort(order, n, sizeof(nbest_node_t), nbest_compare);
+    return n;
+}
+
+/* Test whether a path (score, link) precedes another (s, l) in a list. */
+#define NBEST_PRECEDES(score, link, s, l) \
+    ((s) < (score) || ((score) == (s) && (link) < (l)))
+
+/*
+ * Insert a path into the sorted list of the k best paths.
+ *  The list holds m paths in descending order of scores, and a path with
+ *  a smaller link precedes the others with the same score; this order
+ *  does not depend on the order of insertions. The paths arrive roughly
+ *  in descending order, so that the position is searched from the tail.
+ */
+static int nbest_insert(floatval_t *list, int *back, int m, int k, floatval_t score, int link)
+{
+    int q = (m < k) ? m : k-1;
+
+    while (0 < q && NBEST_PRECEDES(score, link, list[q-1], back[q-1])) {
+        list[q] = list[q-1];
+        back[q] = back[q-1];
+        --q;
+    }
+    list[q] = score;
+    back[q] = link;
+    return (m < k) ? m + 1 : k;
+}
+
+/*
+ * Merge the lists of the paths arriving at the labels of the previous
+ * position into the list of the k best paths arriving at a node.
+ *  prev is a [k][L] matrix whose element [r][i] is the score of the r-th
+ *  best path arriving at the label #i (-FLOAT_MAX for no path), and
+ *  order presents num_order labels in descending order of prev[0][i].
+ *  trans[i] is the score of the transition from #i to the node (NULL for
+ *  no transition), and max_trans is the maximum of trans. The labels are
+ *  visited in the order until no path through them can enter the list.
+ */
+static int nbest_merge(
+    floatval_t *list, int *back, int k,
+    const floatval_t *prev, const nbest_node_t *order, int num_order,
+    const floatval_t *trans, floatval_t max_trans, int n, int L)
+{
+    int i, q, r, link, m = 0;
+    floatval_t score, tr;
+
+    for (q = 0;q < num_order;++q) {
+        if (m == k && order[q].score + max_trans < list[k-1]) {
+            break;
+        }
+        i = order[q].label;
+        tr = (trans != NULL) ? trans[i] : 0.;
+        for (r = 0;r < n;++r) {
+            score = prev[L * r + i] + tr;
+            link = k * i + r;
+            /* A forbidden transition absorbs the score into -FLOAT_MAX. */
+            if (score <= -FLOAT_MAX) {
+                break;
+            }
+            /* The rest of the list of #i cannot enter the list either. */
+            if (m == k && !NBEST_PRECEDES(score, link, list[k-1], back[k-1])) {
+                break;
+            }
+            m = nbest_insert(list, back, m, k, score, link);
+        }
+    }
+
+    return m;
+}
+
+int crf1dc_viterbi_nbest(crf1d_context_t* ctx, int k, int *paths, floatval_t *scores, int *ptr_num)
+{
+    int b, i, j, m, n, r, t, link, num_order, num_nodes, num_paths;
+    int *last = NULL;
+    nbest_node_t *order = NULL;
+    floatval_t *cur = NULL, *max_trans = NULL, *list = NULL;
+    const floatval_t *prev = NULL, *state = NULL, *trans = NULL;
+    const int T = ctx->num_items;
+    const int L = ctx->num_labels;
+
+    /*
+        This function keeps the k best paths arriving at each node (t, j),
+        which are extended from the lists of the nodes (t-1, *). The scores
+        of the lists at the previous and current positions are stored in
+        [k][L] matrices. The labels at the previous position are sorted by
+        their best paths once for all nodes (t, *), so that the extension
+        visits only a few labels that can yield the k best paths.
+        The nodes that have fewer paths than the others, e.g., the labels
+        that are not allowed, pad their lists with the score -FLOAT_MAX.
+     */
+    *ptr_num = 0;
+    if (T <= 0 || k <= 0) {
+        return 0;
+    }
+
+    /* Allocate the work areas. */
+    if (ctx->cap_nbest_score < 2 * k * L + L + k) {
+        free(ctx->nbest_score);
+        ctx->cap_nbest_score = 0;
+        ctx->nbest_score = (floatval_t*)malloc(sizeof(floatval_t) * (2 * k * L + L + k));
+        if (ctx->nbest_score == NULL) return CRFSUITEERR_OUTOFMEMORY;
+        ctx->cap_nbest_score = 2 * k * L + L + k;
+    }
+    if (ctx->cap_nbest_back < (T * L + 1) * k) {
+        free(ctx->nbest_back);
+        ctx->cap_nbest_back = 0;
+        ctx->nbest_back = (int*)malloc(sizeof(int) * (T * L + 1) * k);
+        if (ctx->nbest_back == NULL) return CRFSUITEERR_OUTOFMEMORY;
+        ctx->cap_nbest_back = (T * L + 1) * k;
+    }
+    if (ctx->nbest_order == NULL) {
+        ctx->nbest_order = malloc(sizeof(nbest_node_t) * L);
+        if (ctx->nbest_order == NULL) return CRFSUITEERR_OUTOFMEMORY;
+    }
+    max_trans = &ctx->nbest_score[2 * k * L];
+    list = &max_trans[L];
+    last = &ctx->nbest_back[T * L * k];
+    order = (nbest_node_t*)ctx->nbest_order;
+
+    /* The owner of shared matrices transposes them in advance. */
+    if (!(ctx->flag & CTXF_SHARED_TRANS)) {
+        crf1dc_transpose_transition(ctx);
+    }
+
+    /* Find the maximum transition score to each label. */
+    for (j = 0;j < L;++j) {
+        trans = TRANSPOSED_TRANS_SCORE(ctx, j);
+        max_trans[j] = trans[0];
+        for (i = 1;i < L;++i) {
+            if (max_trans[j] < trans[i]) {
+                max_trans[j] = trans[i];
+            }
+        }
+    }
+
+    /* Every node at t = 0 has a single path. */
+    cur = ctx->nbest_score;
+    state = STATE_SCORE(ctx, 0);
+    if (is_sparse(ctx, 0, 0)) {
+        vecset(cur, -FLOAT_MAX, L);
+        for (b = 0;b < ctx->num_allowed[0];++b) {
+            j = ALLOWED_LABELS(ctx, 0)[b];
+            cur[j] = state[j];
+        }
+    } else {
+        veccopy(cur, state, L);
+    }
+    n = 1;
+
+    /* Extend the paths to (t, *). */
+    for (t = 1;t < T;++t) {
+        prev = &ctx->nbest_score[k * L * ((t-1) & 1)];
+        cur = &ctx->nbest_score[k * L * (t & 1)];
+        state = STATE_SCORE(ctx, t);
+
+        /* Sort the labels at t-1 by their best paths. */
+        num_order = nbest_sort(order, prev, L);
+
+        /* The lists of the nodes at t hold up to num_paths paths. */
+        num_paths = (k / L < n) ? k : n * L;
+        num_nodes = ctx->constrained ? ctx->num_allowed[t] : L;
+        if (num_nodes < L) {
+            vecset(cur, -FLOAT_MAX, L * num_paths);
+        }
+
+        for (b = 0;b < num_nodes;++b) {
+            j = (num_nodes < L) ? ALLOWED_LABELS(ctx, t)[b] : b;
+            m = nbest_merge(
+                list, &ctx->nbest_back[k * (L * t + j)], k, prev, order,
+                num_order, TRANSPOSED_TRANS_SCORE(ctx, j), max_trans[j], n, L);
+            /* Add the state score on (t, j). */
+            for (r = 0;r < m;++r) {
+                cur[L * r + j] = list[r] + state[j];
+            }
+            for (;r < num_paths;++r) {
+                cur[L * r + j] = -FLOAT_MAX;
+            }
+        }
+        n = num_paths;
+    }
+
+    /* Find the k best paths that reach EOS. */
+    prev = &ctx->nbest_score[k * L * ((T-1) & 1)];
+    num_order = nbest_sort(order, prev, L);
+    m = nbest_merge(list, last, k, prev, order, num_order, NULL, 0., n, L);
+
+    /* Tag labels by tracing the backward links of the paths. */
+    for (r = 0;r < m;++r) {
+        int *labels = &paths[T * r];
+        link = last[r];
+        for (t = T-1;0 <= t;--t) {
+            labels[t] = link / k;
+            if (0 < t) {
+                link = ctx->nbest_back[k * (L * t + labels[t]) + link % k];
+            }
+        }
+        if (scores != NULL) {
+            scores[r] = list[r];
+        }
+    }
+
+    *ptr_num = m;
+    return 0;
+}
+
+#if CRF1D_BATCH_LANES != VECMATH_LANES
+#error "The batch context requires lane vectors of CRF1D_BATCH_LANES elements."
+#endif
+
+#define LANES   CRF1D_BATCH_LANES
+
+crf1d_batch_context_t* crf1dbc_new(int flag, int L, int T)
+{
+    crf1d_batch_context_t* bc = NULL;
+
+    bc = (crf1d_batch_context_t*)calloc(1, sizeof(crf1d_batch_context_t));
+    if (bc != NULL) {
+        bc->flag = flag;
+        bc->num_labels = L;
+
+        /* The transition matrices are set by crf1dbc_share_transition(). */
+        if (bc->flag & CTXF_MARGINALS) {
+            bc->transposed_exp_trans = (floatval_t*)calloc(L * L, sizeof(floatval_t));
+            if (bc->transposed_exp_trans == NULL) goto error_exit;
+            bc->trans_lanes = (floatval_t*)calloc(L * L * LANES, sizeof(floatval_t));
+            if (bc->trans_lanes == NULL) goto error_exit;
+            bc->mexp_trans = (floatval_t*)calloc(L * L, sizeof(floatval_t));
+            if (bc->mexp_trans == NULL) goto error_exit;
+        }
+
+        bc->row = (floatval_t*)calloc(L * LANES, sizeof(floatval_t));
+        if (bc->row == NULL) goto error_exit;
+
+        if (crf1dbc_set_num_items(bc, T) != 0) {
+            goto error_exit;
+        }
+
+        /* T gives the 'hint' for maximum length of items. */
+        bc->num_items = 0;
+    }
+
+    return bc;
+
+error_exit:
+    crf1dbc_delete(bc);
+    return NULL;
+}
+
+int crf1dbc_set_num_items(crf1d_batch_context_t* bc, int T)
+{
+    const int L = bc->num_labels;
+
+    bc->num_items = T;
+
+    if (bc->cap_items < T) {
+        free(bc->backward_edge);
+        free(bc->mexp_state);
+        _aligned_free(bc->exp_state);
+        free(bc->scale_factor);
+        free(bc->beta_score);
+        free(bc->alpha_score);
+        free(bc->state);
+        bc->backward_edge = NULL;
+        bc->mexp_state = NULL;
+        bc->exp_state = NULL;
+        bc->scale_factor = NULL;
+        bc->beta_score = NULL;
+        bc->alpha_score = NULL;
+        bc->state = NULL;
+        bc->cap_items = 0;
+
+        bc->state = (floatval_t*)calloc(T * L * LANES, sizeof(floatval_t));
+        if (bc->state == NULL) return CRFSUITEERR_OUTOFMEMORY;
+        bc->alpha_score = (floatval_t*)calloc(T * L * LANES, sizeof(floatval_t));
+        if (bc->alpha_score == NULL) return CRFSUITEERR_OUTOFMEMORY;
+        bc->scale_factor = (floatval_t*)calloc(LANES * T, sizeof(floatval_t));
+        if (bc->scale_factor == NULL) return CRFSUITEERR_OUTOFMEMORY;
+
+        if (bc->flag & CTXF_VITERBI) {
+            bc->backward_edge = (int*)calloc(T * L * LANES, sizeof(int));
+            if (bc->backward_edge == NULL) return CRFSUITEERR_OUTOFMEMORY;
+        }
+
+        if (bc->flag & CTXF_MARGINALS) {
+            bc->beta_score = (floatval_t*)calloc(T * L * LANES, sizeof(floatval_t));
+            if (bc->beta_score == NULL) return CRFSUITEERR_OUTOFMEMORY;
+            bc->exp_state = (floatval_t*)_aligned_malloc((T * L * LANES + 4) * sizeof(floatval_t), 16);
+            if (bc->exp_state == NULL) return CRFSUITEERR_OUTOFMEMORY;
+            bc->mexp_state = (floatval_t*)calloc(T * L * LANES, sizeof(floatval_t));
+            if (bc->mexp_state == NULL) return CRFSUITEERR_OUTOFMEMORY;
+        }
+
+        bc->cap_items = T;
+    }
+
+    return 0;
+}
+
+void crf1dbc_delete(crf1d_batch_context_t* bc)
+{
+    if (bc != NULL) {
+        free(bc->backward_edge);
+        free(bc->mexp_state);
+        _aligned_free(bc->exp_state);
+        free(bc->scale_factor);
+        free(bc->beta_score);
+        free(bc->alpha_score);
+        free(bc->state);
+        free(bc->row);
+        free(bc->mexp_trans);
+        free(bc->trans_lanes);
+        free(bc->transposed_exp_trans);
+    }
+    free(bc);
+}
+
+void crf1dbc_reset(crf1d_batch_context_t* bc)
+{
+    int b;
+    const int T = bc->num_items;
+    const int L = bc->num_labels;
+
+    /* Zero state scores for the padding of the lanes. */
+    veczero(bc->state, T * L * LANES);
+    for (b = 0;b < LANES;++b) {
+        bc->lengths[b] = 0;
+        bc->log_norm[b] = 0;
+    }
+}
+
+void crf1dbc_share_transition(crf1d_batch_context_t* bc, const crf1d_context_t* src)
+{
+    int i, j;
+    const int L = bc->num_labels;
+
+    /* The batch context reads, but never writes, the matrices of the source. */
+    bc->trans = src->trans;
+    bc->exp_trans = src->exp_trans;
+
+    /* The beta scores multiply the transposed matrix with lane vectors. */
+    if (bc->flag & CTXF_MARGINALS) {
+        for (i = 0;i < L;++i) {
+            for (j = 0;j < L;++j) {
+                bc->transposed_exp_trans[L * j + i] = bc->exp_trans[L * i + j];
+            }
+        }
+    }
+}
+
+void crf1dbc_set_state(crf1d_batch_context_t* bc, int b, const floatval_t *state, int T)
+{
+    int t, l;
+    const int L = bc->num_labels;
+
+    for (t = 0;t < T;++t) {
+        floatval_t *dst = BATCH_MATRIX(bc, state, t);
+        for (l = 0;l < L;++l) {
+            dst[l * LANES + b] = state[l];
+        }
+        state += L;
+    }
+    bc->lengths[b] = T;
+}
+
+void crf1dbc_exp_state(crf1d_batch_context_t* bc)
+{
+    const int n = bc->num_items * bc->num_labels * LANES;
+
+    veccopy(bc->exp_state, bc->state, n);
+    if (bc->flag & CTXF_FASTEXP) {
+        vecfastexp(bc->exp_state, n);
+    } else {
+        vecexp(bc->exp_state, n);
+    }
+}
+
+void crf1dbc_alpha_score(crf1d_batch_context_t* bc)
+{
+    int b, j, t;
+    floatval_t c[LANES], *cur = NULL;
+    const int T = bc->num_items;
+    const int L = bc->num_labels;
+    const int cap = bc->cap_items;
+
+    for (t = 0;t < T;++t) {
+        cur = BATCH_MATRIX(bc, alpha_score, t);
+
+        /*
+            alpha[0][j] = state[0][j]
+            alpha[t][j] = state[t][j] * \sum_{i} alpha[t-1][i] * trans[i][j]
+         */
+        if (t == 0) {
+            veccopy(cur, BATCH_MATRIX(bc, exp_state, 0), L * LANES);
+        } else {
+            veclanematmul(cur, bc->exp_trans, BATCH_MATRIX(bc, alpha_score, t-1), L);
+            vecmul(cur, BATCH_MATRIX(bc, exp_state, t), L * LANES);
+        }
+
+        /* Normalize the scores of each lane. */
+        for (b = 0;b < LANES;++b) c[b] = 0.;
+        for (j = 0;j < L;++j) {
+            for (b = 0;b < LANES;++b) c[b] += cur[j * LANES + b];
+        }
+        for (b = 0;b < LANES;++b) {
+            c[b] = (c[b] != 0.) ? 1. / c[b] : 1.;
+            bc->scale_factor[cap * b + t] = c[b];
+        }
+        for (j = 0;j < L;++j) {
+            for (b = 0;b < LANES;++b) cur[j * LANES + b] *= c[b];
+        }
+    }
+
+    /* log(norm) = - \sum_{t = 0}^{T-1} log(C[t]) for each lane. */
+    for (b = 0;b < LANES;++b) {
+        bc->log_norm[b] = (0 < bc->lengths[b]) ?
+            -vecsumlog(&bc->scale_factor[cap * b], bc->lengths[b]) : 0.;
+    }
+}
+
+void crf1dbc_beta_score(crf1d_batch_context_t* bc)
+{
+    int b, j, t;
+    floatval_t *cur = NULL, *row = bc->row;
+    const floatval_t *next = NULL, *state = NULL;
+    const int T = bc->num_items;
+    const int L = bc->num_labels;
+    const int cap = bc->cap_items;
+
+    for (t = T-1;0 <= t;--t) {
+        cur = BATCH_MATRIX(bc, beta_score, t);
+
+        /* beta[t][i] = \sum_{j} trans[i][j] * state[t+1][j] * beta[t+1][j] */
+        if (t < T-1) {
+            next = BATCH_MATRIX(bc, beta_score, t+1);
+            state = BATCH_MATRIX(bc, exp_state, t+1);
+            veccopy(row, next, L * LANES);
+            vecmul(row, state, L * LANES);
+            veclanematmul(cur, bc->transposed_exp_trans, row, L);
+        }
+
+        /* A lane starts at its last item, and is zero after the item. */
+        for (b = 0;b < LANES;++b) {
+            const int last = bc->lengths[b] - 1;
+            if (t < last) {
+                const floatval_t c = bc->scale_factor[cap * b + t];
+                for (j = 0;j < L;++j) cur[j * LANES + b] *= c;
+            } else {
+                const floatval_t c = (t == last) ? bc->scale_factor[cap * b + t] : 0.;
+                for (j = 0;j < L;++j) cur[j * LANES + b] = c;
+            }
+        }
+    }
+}
+
+void crf1dbc_marginals(crf1d_batch_context_t* bc, const floatval_t *weights)
+{
+    int b, i, j, t;
+    floatval_t c[LANES];
+    floatval_t *row = bc->row;
+    const int T = bc->num_items;
+    const int L = bc->num_labels;
+    const int cap = bc->cap_items;
+
+    /*
+        Compute the model expectations of states.
+            p(t,i) = (1. / C[t]) * fwd'[t][i] * bwd'[t][i]
+        The expectations of the padding are zero.
+     */
+    for (t = 0;t < T;++t) {
+        const floatval_t *fwd = BATCH_MATRIX(bc, alpha_score, t);
+        const floatval_t *bwd = BATCH_MATRIX(bc, beta_score, t);
+        floatval_t *prob = BATCH_MATRIX(bc, mexp_state, t);
+        for (b = 0;b < LANES;++b) {
+            c[b] = (t < bc->lengths[b]) ? 1. / bc->scale_factor[cap * b + t] : 0.;
+        }
+        for (j = 0;j < L;++j) {
+            for (b = 0;b < LANES;++b) {
+                prob[j * LANES + b] = fwd[j * LANES + b] * bwd[j * LANES + b] * c[b];
+            }
+        }
+    }
+
+    /*
+        Compute the model expectations of transitions.
+            p(t,i,t+1,j) = fwd'[t][i] * edge[i][j] * state[t+1][j] * bwd'[t+1][j]
+        The lanes accumulate fwd'[t][i] * row[t+1][j] over t, where
+        row[t+1][j] = state[t+1][j] * bwd'[t+1][j] (zero in the padding),
+        and the factor edge[i][j] is applied to the sum.
+     */
+    veczero(bc->trans_lanes, L * L * LANES);
+    for (t = 0;t < T-1;++t) {
+        const floatval_t *fwd = BATCH_MATRIX(bc, alpha_score, t);
+        const floatval_t *state = BATCH_MATRIX(bc, exp_state, t+1);
+        const floatval_t *bwd = BATCH_MATRIX(bc, beta_score, t+1);
+        for (b = 0;b < LANES;++b) {
+            c[b] = (t+1 < bc->lengths[b]) ? 1. : 0.;
+        }
+        for (j = 0;j < L;++j) {
+            for (b = 0;b < LANES;++b) {
+                row[j * LANES + b] = state[j * LANES + b] * bwd[j * LANES + b] * c[b];
+            }
+        }
+        for (i = 0;i < L;++i) {
+            veclanemuladd(&bc->trans_lanes[L * LANES * i], &fwd[i * LANES], row, L);
+        }
+    }
+
+    /* Sum up the expectations of the lanes with the weights. */
+    for (i = 0;i < L * L;++i) {
+        const floatval_t *lanes = &bc->trans_lanes[i * LANES];
+        floatval_t sum = 0.;
+        for (b = 0;b < LANES;++b) {
+            sum += weights[b] * lanes[b];
+        }
+        bc->mexp_trans[i] = bc->exp_trans[i] * sum;
+    }
+}
+
+void crf1dbc_viterbi(crf1d_batch_context_t* bc, int * const *labels, floatval_t *scores)
+{
+    int b, i, t;
+    int *back = NULL;
+    floatval_t max_score;
+    const floatval_t *prev = NULL;
+    const int T = bc->num_items;
+    const int L = bc->num_labels;
+
+    /*
+        Compute the scores at (t, *) of the lanes; the smallest #i wins a tie
+        of transitions from (t-1, i) as crf1dc_viterbi() does.
+     */
+    if (T <= 0) {
+        /* All the lanes are empty; there is no score matrix. */
+        return;
+    }
+    veccopy(BATCH_MATRIX(bc, alpha_score, 0), BATCH_MATRIX(bc, state, 0), L * LANES);
+    for (t = 1;t < T;++t) {
+        floatval_t *cur = BATCH_MATRIX(bc, alpha_score, t);
+        veclanemaxplus(cur, BATCH_MATRIX(bc, backward_edge, t),
+            bc->trans, BATCH_MATRIX(bc, alpha_score, t-1), L);
+        vecadd(cur, BATCH_MATRIX(bc, state, t), L * LANES);
+    }
+
+    for (b = 0;b < LANES;++b) {
+        int *path = labels[b];
+        const int last = bc->lengths[b] - 1;
+        if (last < 0) {
+            continue;
+        }
+
+        /* Find the node (#last, #i) that reaches EOS with the maximum score. */
+        max_score = -FLOAT_MAX;
+        prev = BATCH_MATRIX(bc, alpha_score, last);
+        path[last] = 0;
+        for (i = 0;i < L;++i) {
+            if (max_score < prev[i * LANES + b]) {
+                max_score = prev[i * LANES + b];
+                path[last] = i;
+            }
+        }
+
+        /* Tag labels by tracing the backward links. */
+        for (t = last-1;0 <= t;--t) {
+            back = BATCH_MATRIX(bc, backward_edge, t+1);
+            path[t] = back[path[t+1] * LANES + b];
+        }
+
+        if (scores != NULL) {
+            scores[b] = max_score;
+        }
+    }
+}
+
+#undef  LANES
+
+
+crf1d_context_float_t* crf1dcf_new(int flag, int L, int T)
+{
+    crf1d_context_float_t* ctx = NULL;
+
+    ctx = (crf1d_context_float_t*)calloc(1, sizeof(crf1d_context_float_t));
+    if (ctx != NULL) {
+        ctx->flag = flag;
+        ctx->num_labels = L;
+        ctx->edge_size = edge_size(L);
+
+        /* The transition matrices are set by crf1dcf_share_transition(). */
+        if (!(ctx->flag & CTXF_SHARED_TRANS)) {
+            ctx->trans = (float*)calloc(L * L, sizeof(float));
+            if (ctx->trans == NULL) goto error_exit;
+        }
+
+        if (crf1dcf_set_num_items(ctx, T) != 0) {
+            goto error_exit;
+        }
+
+        /* T gives the 'hint' for maximum length of items. */
+        ctx->num_items = 0;
+    }
+
+    return ctx;
+
+error_exit:
+    crf1dcf_delete(ctx);
+    return NULL;
+}
+
+int crf1dcf_set_num_items(crf1d_context_float_t* ctx, int T)
+{
+    const int L = ctx->num_labels;
+    const int lean = (ctx->flag & CTXF_LEAN);
+
+    ctx->num_items = T;
+
+    if (ctx->cap_items < T) {
+        free(ctx->compact_edge);
+        free(ctx->backward_edge);
+        free(ctx->alpha_score);
+        free(ctx->state);
+        ctx->compact_edge = NULL;
+        ctx->backward_edge = NULL;
+        ctx->alpha_score = NULL;
+        ctx->state = NULL;
+        ctx->cap_items = 0;
+
+        ctx->state = (float*)calloc(T * L, sizeof(float));
+        if (ctx->state == NULL) return CRFSUITEERR_OUTOFMEMORY;
+        ctx->alpha_score = (float*)calloc((lean ? 2 : T) * L, sizeof(float));
+        if (ctx->alpha_score == NULL) return CRFSUITEERR_OUTOFMEMORY;
+        ctx->backward_edge = (int*)calloc((lean ? 1 : T) * L, sizeof(int));
+        if (ctx->backward_edge == NULL) return CRFSUITEERR_OUTOFMEMORY;
+        if (lean) {
+            ctx->compact_edge = calloc(T * L, ctx->edge_size);
+            if (ctx->compact_edge == NULL) return CRFSUITEERR_OUTOFMEMORY;
+        }
+
+        ctx->cap_items = T;
+    }
+
+    return 0;
+}
+
+void crf1dcf_delete(crf1d_context_float_t* ctx)
+{
+    if (ctx != NULL) {
+        free(ctx->compact_edge);
+        free(ctx->backward_edge);
+        free(ctx->alpha_score);
+        free(ctx->state);
+        if (!(ctx->flag & CTXF_SHARED_TRANS)) {
+            free(ctx->trans);
+        }
+    }
+    free(ctx);
+}
+
+void crf1dcf_reset(crf1d_context_float_t* ctx)
+{
+    memset(ctx->state, 0, sizeof(float) * ctx->num_items * ctx->num_labels);
+}
+
+void crf1dcf_set_transition(crf1d_context_float_t* ctx, const crf1d_context_t* src)
+{
+    int i, j;
+    const int L = ctx->num_labels;
+
+    /* Round the transition scores of the double-precision context. */
+    for (i = 0;i < L;++i) {
+        for (j = 0;j < L;++j) {
+            ctx->trans[L * i + j] = (float)src->trans[L * i + j];
+        }
+    }
+}
+
+void crf1dcf_share_transition(crf1d_context_float_t* ctx, const crf1d_context_float_t* src)
+{
+    /* The context reads, but never writes, the matrices of the source. */
+    ctx->trans = src->trans;
+}
+
+floatval_t crf1dcf_viterbi(crf1d_context_float_t* ctx, int *labels)
+{
+    int i, j, t;
+    int *back = NULL;
+    float max_score, *cur = NULL;
+    const float *prev = NULL, *state = NULL;
+    const int T = ctx->num_items;
+    const int L = ctx->num_labels;
+    const int lean = (ctx->flag & CTXF_LEAN);
+
+    /* Compute the scores at (0, *). */
+    memcpy(ctx->alpha_score, ctx->state, sizeof(float) * L);
+
+    /* Compute the scores at (t, *). */
+    for (t = 1;t < T;++t) {
+        prev = &ctx->alpha_score[L * (lean ? (t-1) & 1 : t-1)];
+        cur = &ctx->alpha_score[L * (lean ? t & 1 : t)];
+        state = &ctx->state[L * t];
+        back = lean ? ctx->backward_edge : &ctx->backward_edge[L * t];
+
+        /*
+            Compute the scores of (t, *) for all j at once, which keeps
+            the vector operations free of horizontal reductions; the
+            smallest #i wins a tie as in crf1dc_viterbi().
+         */
+        vecmaxplusf(cur, back, ctx->trans, prev, L);
+        for (j = 0;j < L;++j) {
+            cur[j] += state[j];
+        }
+
+        if (lean) {
+            pack_edges(ctx->compact_edge, ctx->edge_size, t, back, L);
+        }
+    }
+
+    /* Find the node (#T, #i) that reaches EOS with the maximum score. */
+    max_score = -FLT_MAX;
+    prev = &ctx->alpha_score[L * (lean ? (T-1) & 1 : T-1)];
+    labels[T-1] = 0;
+    for (i = 0;i < L;++i) {
+        if (max_score < prev[i]) {
+            max_score = prev[i];
+            labels[T-1] = i;
+        }
+    }
+
+    /* Tag labels by tracing the backward links. */
+    for (t = T-2;0 <= t;--t) {
+        if (lean) {
+            labels[t] = unpack_edge(ctx->compact_edge, ctx->edge_size, t+1, labels[t+1], L);
+        } else {
+            back = &ctx->backward_edge[L * (t+1)];
+            labels[t] = back[labels[t+1]];
+        }
     }
 
     /* Return the maximum score (without the normalization factor subtracted). */
@@ -46,6 +46,8 @@
 #include "crf1d.h"
 #include "params.h"
 #include "logging.h"
+#include "parallel.h"
+#include "vecmath.h"
 
 /**
  * Parameters for feature generation.
@@ -54,8 +56,32 @@ typedef struct {
     floatval_t  feature_minfreq;                /** The threshold for occurrences of features. */
     int         feature_possible_states;        /** Dense state features. */
     int         feature_possible_transitions;   /** Dense transition features. */
+    int         feature_hash_bits;              /** Number of bits of the hashed attribute ids. */
+    int         fast_exp;                       /** Approximate exponents in forward-backward. */
+    int         lanes;                          /** Run forward-backward on sequences in lockstep. */
+    int         num_threads;                    /** Number of threads for the batch gradients. */
+    int         deterministic;                  /** Reduce the batch gradients in a fixed order. */
+    int         deterministic_chunks;           /** Number of instance chunks in the deterministic mode. */
 } crf1de_option_t;
 
+/**
+ * Work area of a thread computing the batch gradients.
+ */
+typedef struct {
+    crf1d_context_t *ctx;           /**< CRF1d context of the thread. */
+    crf1d_batch_context_t *bc;      /**< Batch context of the thread (NULL unless lanes). */
+    floatval_t *g;                  /**< Model expectations accumulated by the thread [K]. */
+    floatval_t logl;                /**< Log-likelihood accumulated by the thread. */
+} crf1de_worker_t;
+
+/**
+ * Partial sums for a chunk of instances in the deterministic mode.
+ */
+typedef struct {
+    floatval_t *g;                  /**< Model expectations of the instances in the chunk [K]. */
+    floatval_t logl;                /**< Log-likelihood of the instances in the chunk. */
+} crf1de_chunk_t;
+
 /**
  * CRF1d internal data.
  */
@@ -72,8 +98,33 @@ typedef struct {
 
     crf1d_context_t *ctx;           /**< CRF1d context. */
     crf1de_option_t opt;            /**< CRF1d options. */
+
+    int num_workers;                /**< Number of threads for the batch gradients. */
+    crf1de_worker_t *workers;       /**< Work areas of the threads [num_workers]. */
+    int num_chunks;                 /**< Number of instance chunks (deterministic mode). */
+    crf1de_chunk_t *chunks;         /**< Partial sums of the chunks [num_chunks]. */
+
+    int shared;                     /**< Non-zero if the features belong to another encoder (fork). */
 } crf1de_t;
 
+/**
+ * Arguments of a parallel computation of the batch gradients.
+ */
+typedef struct {
+    crf1de_t *crf1de;
+    dataset_t *ds;
+    const floatval_t *w;
+    floatval_t *g;
+} crf1de_batch_t;
+
+/**
+ * An instance in the processing order of the batch context.
+ */
+typedef struct {
+    int num_items;
+    int i;
+} crf1de_order_t;
+
 #define    FEATURE(crf1de, k) \
     (&(crf1de)->features[(k)])
 #define    ATTRIBUTE(crf1de, a) \
@@ -81,6 +132,10 @@ typedef struct {
 #define    TRANSITION(crf1de, i) \
     (&(crf1de)->forward_trans[(i)])
 
+/* Whether the weights of the attribute form a dense row w[fids[0]...]. */
+#define    IS_DENSE_ATTRIBUTE(attr, L) \
+    ((L) <= CRF1D_DENSE_MAX_LABELS && (attr)->num_features == (L))
+
 
 
 static void crf1de_init(crf1de_t *crf1de)
@@ -93,6 +148,11 @@ static void crf1de_init(crf1de_t *crf1de)
     crf1de->attributes = NULL;
     crf1de->forward_trans = NULL;
     crf1de->ctx = NULL;
+    crf1de->num_workers = 0;
+    crf1de->workers = NULL;
+    crf1de->num_chunks = 0;
+    crf1de->chunks = NULL;
+    crf1de->shared = 0;
     /* Initialize except for opt. */
 }
 
@@ -100,6 +160,34 @@ static void crf1de_finish(crf1de_t *crf1de)
 {
     int i;
 
+    /* A fork owns nothing but the context. */
+    if (crf1de->shared) {
+        crf1dc_delete(crf1de->ctx);
+        crf1de->ctx = NULL;
+        return;
+    }
+
+    if (crf1de->chunks != NULL) {
+        for (i = 0;i < crf1de->num_chunks;++i) {
+            free(crf1de->chunks[i].g);
+        }
+        free(crf1de->chunks);
+        crf1de->chunks = NULL;
+        crf1de->num_chunks = 0;
+    }
+    if (crf1de->workers != NULL) {
+        /* The first worker shares the context of the encoder. */
+        for (i = 0;i < crf1de->num_workers;++i) {
+            crf1dbc_delete(crf1de->workers[i].bc);
+        }
+        for (i = 1;i < crf1de->num_workers;++i) {
+            crf1dc_delete(crf1de->workers[i].ctx);
+            free(crf1de->workers[i].g);
+        }
+        free(crf1de->workers);
+        crf1de->workers = NULL;
+        crf1de->num_workers = 0;
+    }
     if (crf1de->ctx != NULL) {
         crf1dc_delete(crf1de->ctx);
         crf1de->ctx = NULL;
@@ -126,12 +214,12 @@ static void crf1de_finish(crf1de_t *crf1de)
 
 static void crf1de_state_score(
     crf1de_t *crf1de,
+    crf1d_context_t* ctx,
     const crfsuite_instance_t* inst,
     const floatval_t* w
     )
 {
     int i, t, r;
-    crf1d_context_t* ctx = crf1de->ctx;
     const int T = inst->num_items;
     const int L = crf1de->num_labels;
 
@@ -147,6 +235,12 @@ static void crf1de_state_score(
             const feature_refs_t *attr = ATTRIBUTE(crf1de, a);
             floatval_t value = item->contents[i].value;
 
+            /* Add the row of weights if the attribute emits every label. */
+            if (IS_DENSE_ATTRIBUTE(attr, L)) {
+                vecaadd(state, value, &w[attr->fids[0]], L);
+                continue;
+            }
+
             /* Loop over the state features associated with the attribute. */
             for (r = 0;r < attr->num_features;++r) {
                 /* State feature associates the attribute #a with the label #(f->dst). */
@@ -173,7 +267,7 @@ crf1de_state_score_scaled(
 
     /* Forward to the non-scaling version for fast computation when scale == 1. */
     if (scale == 1.) {
-        crf1de_state_score(crf1de, inst, w);
+        crf1de_state_score(crf1de, ctx, inst, w);
         return;
     }
 
@@ -189,6 +283,12 @@ crf1de_state_score_scaled(
             const feature_refs_t *attr = ATTRIBUTE(crf1de, a);
             floatval_t value = item->contents[i].value * scale;
 
+            /* Add the row of weights if the attribute emits every label. */
+            if (IS_DENSE_ATTRIBUTE(attr, L)) {
+                vecaadd(state, value, &w[attr->fids[0]], L);
+                continue;
+            }
+
             /* Loop over the state features associated with the attribute. */
             for (r = 0;r < attr->num_features;++r) {
                 /* State feature associates the attribute #a with the label #(f->dst). */
@@ -306,6 +406,19 @@ crf1de_features_on_path(
     }
 }
 
+/*
+ * Add a value to a feature weight; forks share the weights with the
+ * other threads.
+ */
+inline static void crf1de_update(const crf1de_t* crf1de, floatval_t *w, int fid, floatval_t value)
+{
+    if (crf1de->shared) {
+        parallel_add_relaxed(&w[fid], value);
+    } else {
+        w[fid] += value;
+    }
+}
+
 static void
 crf1de_observation_expectation(
     crf1de_t* crf1de,
@@ -338,7 +451,7 @@ crf1de_observation_expectation(
                 int fid = attr->fids[r];
                 const crf1df_feature_t *f = FEATURE(crf1de, fid);
                 if (f->dst == j) {
-                    w[fid] += value * scale;
+                    crf1de_update(crf1de, w, fid, value * scale);
                 }
             }
         }
@@ -350,7 +463,7 @@ crf1de_observation_expectation(
                 int fid = edge->fids[r];
                 const crf1df_feature_t *f = FEATURE(crf1de, fid);
                 if (f->dst == j) {
-                    w[fid] += scale;
+                    crf1de_update(crf1de, w, fid, scale);
                 }
             }
         }
@@ -362,13 +475,13 @@ crf1de_observation_expectation(
 static void
 crf1de_model_expectation(
     crf1de_t *crf1de,
+    crf1d_context_t* ctx,
     const crfsuite_instance_t *inst,
     floatval_t *w,
     const floatval_t scale
     )
 {
     int a, c, i, t, r;
-    crf1d_context_t* ctx = crf1de->ctx;
     const feature_refs_t *attr = NULL, *trans = NULL;
     const crfsuite_item_t* item = NULL;
     const int T = inst->num_items;
@@ -389,7 +502,7 @@ crf1de_model_expectation(
             for (r = 0;r < attr->num_features;++r) {
                 int fid = attr->fids[r];
                 crf1df_feature_t *f = FEATURE(crf1de, fid);
-                w[fid] += prob[f->dst] * value * scale;
+                crf1de_update(crf1de, w, fid, prob[f->dst] * value * scale);
             }
         }
     }
@@ -402,7 +515,60 @@ crf1de_model_expectation(
             /* Transition feature from #i to #(f->dst). */
             int fid = edge->fids[r];
             crf1df_feature_t *f = FEATURE(crf1de, fid);
-            w[fid] += prob[f->dst] * scale;
+            crf1de_update(crf1de, w, fid, prob[f->dst] * scale);
+        }
+    }
+}
+
+static void
+crf1de_batch_model_expectation(
+    crf1de_t *crf1de,
+    crf1d_batch_context_t* bc,
+    const crfsuite_instance_t **seqs,
+    int n,
+    floatval_t *w
+    )
+{
+    int a, b, c, i, t, r;
+    const feature_refs_t *attr = NULL, *trans = NULL;
+    const crfsuite_item_t* item = NULL;
+    const int L = crf1de->num_labels;
+
+    for (b = 0;b < n;++b) {
+        const crfsuite_instance_t *inst = seqs[b];
+        const floatval_t scale = inst->weight;
+
+        for (t = 0;t < inst->num_items;++t) {
+            /* The expectations of the lane #b are at [f->dst][b]. */
+            const floatval_t *prob = BATCH_MATRIX(bc, mexp_state, t) + b;
+
+            /* Compute expectations for state features at position #t. */
+            item = &inst->items[t];
+            for (c = 0;c < item->num_contents;++c) {
+                /* Access the attribute. */
+                floatval_t value = item->contents[c].value;
+                a = item->contents[c].aid;
+                attr = ATTRIBUTE(crf1de, a);
+
+                /* Loop over state features for the attribute. */
+                for (r = 0;r < attr->num_features;++r) {
+                    int fid = attr->fids[r];
+                    crf1df_feature_t *f = FEATURE(crf1de, fid);
+                    crf1de_update(crf1de, w, fid, prob[f->dst * CRF1D_BATCH_LANES] * value * scale);
+                }
+            }
+        }
+    }
+
+    /* The transition expectations are already weighted by the instances. */
+    for (i = 0;i < L;++i) {
+        const floatval_t *prob = &bc->mexp_trans[L * i];
+        const feature_refs_t *edge = TRANSITION(crf1de, i);
+        for (r = 0;r < edge->num_features;++r) {
+            /* Transition feature from #i to #(f->dst). */
+            int fid = edge->fids[r];
+            crf1df_feature_t *f = FEATURE(crf1de, fid);
+            crf1de_update(crf1de, w, fid, prob[f->dst]);
         }
     }
 }
@@ -429,6 +595,22 @@ crf1de_set_data(
     crf1de->num_attributes = A;
     crf1de->num_labels = L;
 
+    /* The attribute dictionary must hash attributes into as many ids; a
+       dictionary that stores strings does not support hash_to_ids(). The
+       largest hash value yields the largest id, i.e., 2^bits-1. */
+    if (opt->feature_hash_bits != 0) {
+        int aid = -1;
+        const crfsuite_hash_t h = ~(crfsuite_hash_t)0;
+        crfsuite_dictionary_t *attrs = ds->data->attrs;
+        if (opt->feature_hash_bits < 0 || CRFSUITE_HASH_MAX_BITS < opt->feature_hash_bits ||
+            A != (1 << opt->feature_hash_bits) ||
+            attrs->hash_to_ids(attrs, &h, 1, &aid) != 0 || aid != A-1) {
+            logging(lg, "ERROR: The attribute dictionary is not a dictionary of feature hashing with 2^%d ids (feature.hash_bits)\n", opt->feature_hash_bits);
+            ret = CRFSUITEERR_INCOMPATIBLE;
+            goto error_exit;
+        }
+    }
+
     /* Find the maximum length of items in the data set. */
     for (i = 0;i < N;++i) {
         const crfsuite_instance_t *inst = dataset_get(ds, i);
@@ -438,7 +620,8 @@ crf1de_set_data(
     }
 
     /* Construct a CRF context. */
-    crf1de->ctx = crf1dc_new(CTXF_MARGINALS | CTXF_VITERBI, L, T);
+    crf1de->ctx = crf1dc_new(
+        CTXF_MARGINALS | CTXF_VITERBI | (opt->fast_exp ? CTXF_FASTEXP : 0), L, T);
     if (crf1de->ctx == NULL) {
         ret = CRFSUITEERR_OUTOFMEMORY;
         goto error_exit;
@@ -450,6 +633,14 @@ crf1de_set_data(
     logging(lg, "feature.minfreq: %f\n", opt->feature_minfreq);
     logging(lg, "feature.possible_states: %d\n", opt->feature_possible_states);
     logging(lg, "feature.possible_transitions: %d\n", opt->feature_possible_transitions);
+    logging(lg, "feature.hash_bits: %d\n", opt->feature_hash_bits);
+    logging(lg, "fast_exp: %d\n", opt->fast_exp);
+    logging(lg, "lanes: %d\n", opt->lanes);
+    logging(lg, "num_threads: %d\n", opt->num_threads);
+    logging(lg, "deterministic: %d\n", opt->deterministic);
+    if (opt->deterministic) {
+        logging(lg, "deterministic.chunks: %d\n", opt->deterministic_chunks);
+    }
     begin = clock();
     crf1de->features = crf1df_generate(
         &crf1de->num_features,
@@ -483,6 +674,65 @@ crf1de_set_data(
         goto error_exit;
     }
 
+    /* Allocate the work areas of the threads for the batch gradients. */
+    crf1de->num_workers = (1 < opt->num_threads) ? opt->num_threads : 1;
+    crf1de->workers = (crf1de_worker_t*)calloc(crf1de->num_workers, sizeof(crf1de_worker_t));
+    if (crf1de->workers == NULL) {
+        ret = CRFSUITEERR_OUTOFMEMORY;
+        goto error_exit;
+    }
+    crf1de->workers[0].ctx = crf1de->ctx;
+    for (i = 1;i < crf1de->num_workers;++i) {
+        crf1de_worker_t* wk = &crf1de->workers[i];
+        wk->ctx = crf1dc_new(crf1de->ctx->flag, L, T);
+        if (wk->ctx == NULL) {
+            ret = CRFSUITEERR_OUTOFMEMORY;
+            goto error_exit;
+        }
+        /* The deterministic mode accumulates the expectations in chunks. */
+        if (!opt->deterministic) {
+            wk->g = (floatval_t*)calloc(crf1de->num_features, sizeof(floatval_t));
+            if (wk->g == NULL) {
+                ret = CRFSUITEERR_OUTOFMEMORY;
+                goto error_exit;
+            }
+        }
+    }
+
+    /* Allocate the batch contexts of the threads. */
+    if (opt->lanes) {
+        for (i = 0;i < crf1de->num_workers;++i) {
+            crf1de_worker_t* wk = &crf1de->workers[i];
+            wk->bc = crf1dbc_new(crf1de->ctx->flag, L, T);
+            if (wk->bc == NULL) {
+                ret = CRFSUITEERR_OUTOFMEMORY;
+                goto error_exit;
+            }
+        }
+    }
+
+    /*
+        Allocate the partial sums of the instance chunks for the deterministic
+        mode. The number of chunks does not depend on the number of threads,
+        so that the summation order is identical for any number of threads.
+     */
+    if (opt->deterministic) {
+        crf1de->num_chunks = (1 < opt->deterministic_chunks) ? opt->deterministic_chunks : 1;
+        crf1de->chunks = (crf1de_chunk_t*)calloc(crf1de->num_chunks, sizeof(crf1de_chunk_t));
+        if (crf1de->chunks == NULL) {
+            ret = CRFSUITEERR_OUTOFMEMORY;
+            goto error_exit;
+        }
+        for (i = 0;i < crf1de->num_chunks;++i) {
+            crf1de->chunks[i].g = (floatval_t*)calloc(crf1de->num_features, sizeof(floatval_t));
+            if (crf1de->chunks[i].g == NULL) {
+                crf1de->num_chunks = i;
+                ret = CRFSUITEERR_OUTOFMEMORY;
+                goto error_exit;
+            }
+        }
+    }
+
     return ret;
 
 error_exit:
@@ -509,6 +759,7 @@ crf1de_save_model(
     const int L = crf1de->num_labels;
     const int A = crf1de->num_attributes;
     const int K = crf1de->num_features;
+    const int hash_bits = crf1de->opt.feature_hash_bits;
     int J = 0, B = 0;
 
     /* Start storing the model. */
@@ -539,6 +790,12 @@ crf1de_save_model(
     for (a = 0;a < A;++a) amap[a] = -1;
 #endif/*CRF_TRAIN_SAVE_NO_PRUNING*/
 
+    /* The hashed attribute ids must be kept as they are. */
+    if (hash_bits != 0) {
+        for (a = 0;a < A;++a) amap[a] = a;
+        B = A;
+    }
+
     /*
      *  Open a model writer.
      */
@@ -617,24 +874,31 @@ crf1de_save_model(
     }
 
     /* Write attributes. */
-    logging(lg, "Writing attributes\n");
-    if (ret = crf1dmw_open_attrs(writer, B)) {
-        goto error_exit;
-    }
-    for (a = 0;a < A;++a) {
-        if (0 <= amap[a]) {
-            const char *str = NULL;
-            attrs->to_string(attrs, a, &str);
-            if (str != NULL) {
-                if (ret = crf1dmw_put_attr(writer, amap[a], str)) {
-                    goto error_exit;
+    if (hash_bits != 0) {
+        logging(lg, "Writing no attribute (feature hashing with %d bits)\n", hash_bits);
+        if (ret = crf1dmw_hash_attrs(writer, hash_bits)) {
+            goto error_exit;
+        }
+    } else {
+        logging(lg, "Writing attributes\n");
+        if (ret = crf1dmw_open_attrs(writer, B)) {
+            goto error_exit;
+        }
+        for (a = 0;a < A;++a) {
+            if (0 <= amap[a]) {
+                const char *str = NULL;
+                attrs->to_string(attrs, a, &str);
+                if (str != NULL) {
+                    if (ret = crf1dmw_put_attr(writer, amap[a], str)) {
+                        goto error_exit;
+                    }
+                    attrs->free(attrs, str);
                 }
-                attrs->free(attrs, str);
             }
         }
-    }
-    if (ret = crf1dmw_close_attrs(writer)) {
-        goto error_exit;
+        if (ret = crf1dmw_close_attrs(writer)) {
+            goto error_exit;
+        }
     }
 
     /* Write label feature references. */
@@ -706,6 +970,36 @@ static int crf1de_exchange_options(crfsuite_params_t* params, crf1de_option_t* o
             "feature.possible_transitions", opt->feature_possible_transitions, 0,
             "Force to generate possible transition features."
             )
+        DDX_PARAM_INT(
+            "feature.hash_bits", opt->feature_hash_bits, 0,
+            "The number of bits of the attribute ids when the attribute dictionary\n"
+            "hashes attributes (\"dictionary/hash:BITS\"); the model then stores no\n"
+            "attribute string. Set zero for a dictionary of attribute strings."
+            )
+        DDX_PARAM_INT(
+            "fast_exp", opt->fast_exp, 0,
+            "Use a faster approximation of exp() (relative error < 1e-8) in forward-backward."
+            )
+        DDX_PARAM_INT(
+            "lanes", opt->lanes, 0,
+            "Run forward-backward on 8 sequences of similar lengths in lockstep (SIMD\n"
+            "lanes) for the gradients of the whole data set. The gradients may differ\n"
+            "from those of the default path in the last digits."
+            )
+        DDX_PARAM_INT(
+            "num_threads", opt->num_threads, 1,
+            "The number of threads for computing the gradients of the whole data set,\n"
+            "for updating the feature weights without a lock in l2sgd, and for training\n"
+            "on as many shards with parameter mixing in ap, pa, and arow."
+            )
+        DDX_PARAM_INT(
+            "deterministic", opt->deterministic, 0,
+            "Add up the gradients in a fixed order so that the model does not depend on num_threads."
+            )
+        DDX_PARAM_INT(
+            "deterministic.chunks", opt->deterministic_chunks, 64,
+            "The number of instance chunks for the deterministic mode (uses this many gradient buffers)."
+            )
     END_PARAM_MAP()
 
     return 0;
@@ -791,16 +1085,252 @@ static int encoder_initialize(encoder_t *self, dataset_t *ds, logging_t *lg)
     self->ds = ds;
     self->num_features = crf1de->num_features;
     self->cap_items = crf1de->ctx->cap_items;
+    self->num_threads = crf1de->opt.num_threads;
     return ret;
 }
 
+static int crf1de_compare_order(const void *x, const void *y)
+{
+    const crf1de_order_t *a = (const crf1de_order_t*)x;
+    const crf1de_order_t *b = (const crf1de_order_t*)y;
+    if (a->num_items != b->num_items) {
+        return (a->num_items < b->num_items) ? -1 : 1;
+    }
+    return (a->i < b->i) ? -1 : (a->i > b->i);
+}
+
+/*
+ * Accumulate the model expectations of the instances [begin, end) with the
+ * batch context; the instances are sorted by their lengths so that every
+ * batch pads the lanes the least. Returns a non-zero value if out of memory.
+ */
+static int crf1de_accumulate_lanes(
+    crf1de_t *crf1de,
+    crf1de_worker_t *wk,
+    dataset_t *ds,
+    const floatval_t *w,
+    int begin,
+    int end,
+    floatval_t *g,
+    floatval_t *ptr_logl
+    )
+{
+    int b, i, n;
+    floatval_t logl = 0;
+    floatval_t scores[CRF1D_BATCH_LANES], weights[CRF1D_BATCH_LANES];
+    const crfsuite_instance_t *seqs[CRF1D_BATCH_LANES];
+    crf1d_context_t *ctx = wk->ctx;
+    crf1d_batch_context_t *bc = wk->bc;
+    crf1de_order_t *order = NULL;
+
+    order = (crf1de_order_t*)malloc(sizeof(crf1de_order_t) * (end - begin + 1));
+    if (order == NULL) {
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+    for (i = begin;i < end;++i) {
+        order[i-begin].num_items = dataset_get(ds, i)->num_items;
+        order[i-begin].i = i;
+    }
+    qsort(order, end - begin, sizeof(crf1de_order_t), crf1de_compare_order);
+
+    crf1dbc_share_transition(bc, ctx);
+    for (i = begin;i < end;i += n) {
+        n = (end - i < CRF1D_BATCH_LANES) ? end - i : CRF1D_BATCH_LANES;
+
+        /* The last instance of the batch is the longest. */
+        crf1dbc_set_num_items(bc, order[i-begin+n-1].num_items);
+        crf1dbc_reset(bc);
+
+        /* Compute the state scores of the instances and their paths. */
+        for (b = 0;b < CRF1D_BATCH_LANES;++b) {
+            weights[b] = 0.;
+        }
+        for (b = 0;b < n;++b) {
+            const crfsuite_instance_t *seq = dataset_get(ds, order[i-begin+b].i);
+            crf1dc_set_num_items(ctx, seq->num_items);
+            crf1dc_reset(ctx, RF_STATE);
+            crf1de_state_score(crf1de, ctx, seq, w);
+            scores[b] = crf1dc_score(ctx, seq->labels);
+            crf1dbc_set_state(bc, b, ctx->state, seq->num_items);
+            weights[b] = seq->weight;
+            seqs[b] = seq;
+        }
+
+        /* Compute forward/backward scores of the lanes. */
+        crf1dbc_exp_state(bc);
+        crf1dbc_alpha_score(bc);
+        crf1dbc_beta_score(bc);
+        crf1dbc_marginals(bc, weights);
+
+        /* Update the log-likelihood and the model expectations. */
+        for (b = 0;b < n;++b) {
+            logl += (scores[b] - bc->log_norm[b]) * weights[b];
+        }
+        crf1de_batch_model_expectation(crf1de, bc, seqs, n, g);
+    }
+
+    free(order);
+    *ptr_logl = logl;
+    return 0;
+}
+
+/*
+ * Accumulate the model expectations of the instances [begin, end) into g and
+ * return their log-likelihood.
+ */
+static floatval_t crf1de_accumulate(
+    crf1de_t *crf1de,
+    crf1de_worker_t *wk,
+    dataset_t *ds,
+    const floatval_t *w,
+    int begin,
+    int end,
+    floatval_t *g
+    )
+{
+    int i;
+    floatval_t logp = 0, logl = 0;
+    crf1d_context_t *ctx = wk->ctx;
+
+    if (wk->bc != NULL && crf1de_accumulate_lanes(crf1de, wk, ds, w, begin, end, g, &logl) == 0) {
+        return logl;
+    }
+
+    for (i = begin;i < end;++i) {
+        const crfsuite_instance_t *seq = dataset_get(ds, i);
+
+        /* Set label sequences and state scores. */
+        crf1dc_set_num_items(ctx, seq->num_items);
+        crf1dc_reset(ctx, RF_STATE);
+        crf1de_state_score(crf1de, ctx, seq, w);
+        crf1dc_exp_state(ctx);
+
+        /* Compute forward/backward scores. */
+        crf1dc_alpha_score(ctx);
+        crf1dc_beta_score(ctx);
+        crf1dc_marginals(ctx);
+
+        /* Compute the probability of the input sequence on the model. */
+        logp = crf1dc_score(ctx, seq->labels) - crf1dc_lognorm(ctx);
+        /* Update the log-likelihood. */
+        logl += logp * seq->weight;
+
+        /* Update the model expectations of features. */
+        crf1de_model_expectation(crf1de, ctx, seq, g, seq->weight);
+    }
+
+    return logl;
+}
+
+/* Copy the transition scores computed by the first thread. */
+static void crf1de_share_transition(crf1de_t *crf1de, crf1d_context_t *ctx)
+{
+    const int L = crf1de->num_labels;
+    if (ctx != crf1de->ctx) {
+        veccopy(ctx->trans, crf1de->ctx->trans, L * L);
+        veccopy(ctx->exp_trans, crf1de->ctx->exp_trans, L * L);
+    }
+}
+
+/*
+ * Compute the log-likelihood and the model expectations of the instances
+ * assigned to the thread #p; the instances are split into contiguous blocks.
+ */
+static void crf1de_batch_expectation(void *instance, int p)
+{
+    crf1de_batch_t* batch = (crf1de_batch_t*)instance;
+    crf1de_t *crf1de = batch->crf1de;
+    crf1de_worker_t *wk = &crf1de->workers[p];
+    floatval_t *g = (p == 0) ? batch->g : wk->g;
+    const int N = batch->ds->num_instances;
+    const int P = crf1de->num_workers;
+    const int begin = (int)((long long)N * p / P);
+    const int end = (int)((long long)N * (p+1) / P);
+
+    crf1de_share_transition(crf1de, wk->ctx);
+    if (0 < p) {
+        veczero(g, crf1de->num_features);
+    }
+    wk->logl = crf1de_accumulate(crf1de, wk, batch->ds, batch->w, begin, end, g);
+}
+
+/*
+ * Add the model expectations of the threads to the gradients; the thread
+ * #p processes the features in the #p-th block.
+ */
+static void crf1de_batch_reduce(void *instance, int p)
+{
+    int q;
+    crf1de_batch_t* batch = (crf1de_batch_t*)instance;
+    crf1de_t *crf1de = batch->crf1de;
+    const int K = crf1de->num_features;
+    const int P = crf1de->num_workers;
+    const int begin = (int)((long long)K * p / P);
+    const int end = (int)((long long)K * (p+1) / P);
+
+    for (q = 1;q < P;++q) {
+        vecadd(batch->g + begin, crf1de->workers[q].g + begin, end - begin);
+    }
+}
+
+/*
+ * Compute the log-likelihood and the model expectations of the chunks
+ * #p, #p+P, #p+2P, ... (deterministic mode). Every chunk is accumulated
+ * into its own buffer, so the partial sums do not depend on the thread
+ * that computes them.
+ */
+static void crf1de_batch_expectation_chunks(void *instance, int p)
+{
+    int c;
+    crf1de_batch_t* batch = (crf1de_batch_t*)instance;
+    crf1de_t *crf1de = batch->crf1de;
+    crf1de_worker_t *wk = &crf1de->workers[p];
+    const int N = batch->ds->num_instances;
+    const int M = crf1de->num_chunks;
+
+    crf1de_share_transition(crf1de, wk->ctx);
+    for (c = p;c < M;c += crf1de->num_workers) {
+        crf1de_chunk_t *chunk = &crf1de->chunks[c];
+        const int begin = (int)((long long)N * c / M);
+        const int end = (int)((long long)N * (c+1) / M);
+        veczero(chunk->g, crf1de->num_features);
+        chunk->logl = crf1de_accumulate(crf1de, wk, batch->ds, batch->w, begin, end, chunk->g);
+    }
+}
+
+/*
+ * Add up the partial sums of the chunks with a fixed summation tree
+ * (deterministic mode): chunk #c receives chunk #c+s for s = 1, 2, 4, ...
+ * and c = 0, 2s, 4s, ...; the thread #p processes the features in the
+ * #p-th block. Elementwise additions yield the same values however the
+ * features are split into blocks.
+ */
+static void crf1de_batch_reduce_chunks(void *instance, int p)
+{
+    int c, s;
+    crf1de_batch_t* batch = (crf1de_batch_t*)instance;
+    crf1de_t *crf1de = batch->crf1de;
+    const int K = crf1de->num_features;
+    const int M = crf1de->num_chunks;
+    const int P = crf1de->num_workers;
+    const int begin = (int)((long long)K * p / P);
+    const int end = (int)((long long)K * (p+1) / P);
+
+    for (s = 1;s < M;s *= 2) {
+        for (c = 0;c + s < M;c += 2 * s) {
+            vecadd(crf1de->chunks[c].g + begin, crf1de->chunks[c+s].g + begin, end - begin);
+        }
+    }
+    vecadd(batch->g + begin, crf1de->chunks[0].g + begin, end - begin);
+}
+
 /* LEVEL_NONE -> LEVEL_NONE. */
 static int encoder_objective_and_gradients_batch(encoder_t *self, dataset_t *ds, const floatval_t *w, floatval_t *f, floatval_t *g)
 {
     int i;
-    floatval_t logp = 0, logl = 0;
+    floatval_t logl = 0;
+    crf1de_batch_t batch;
     crf1de_t *crf1de = (crf1de_t*)self->internal;
-    const int N = ds->num_instances;
     const int K = crf1de->num_features;
 
     /*
@@ -820,29 +1350,36 @@ static int encoder_objective_and_gradients_batch(encoder_t *self, dataset_t *ds,
     crf1dc_exp_transition(crf1de->ctx);
 
     /*
-        Compute model expectations.
+        Compute model expectations. Each thread accumulates the expectations
+        of a block of instances, and the threads then add up the expectations
+        for their blocks of features. The deterministic mode accumulates the
+        expectations of fixed chunks of instances instead of thread blocks,
+        so that the gradients are bit-identical for any number of threads.
      */
-    for (i = 0;i < N;++i) {
-        const crfsuite_instance_t *seq = dataset_get(ds, i);
-
-        /* Set label sequences and state scores. */
-        crf1dc_set_num_items(crf1de->ctx, seq->num_items);
-        crf1dc_reset(crf1de->ctx, RF_STATE);
-        crf1de_state_score(crf1de, seq, w);
-        crf1dc_exp_state(crf1de->ctx);
-
-        /* Compute forward/backward scores. */
-        crf1dc_alpha_score(crf1de->ctx);
-        crf1dc_beta_score(crf1de->ctx);
-        crf1dc_marginals(crf1de->ctx);
-
-        /* Compute the probability of the input sequence on the model. */
-        logp = crf1dc_score(crf1de->ctx, seq->labels) - crf1dc_lognorm(crf1de->ctx);
-        /* Update the log-likelihood. */
-        logl += logp * seq->weight;
-
-        /* Update the model expectations of features. */
-        crf1de_model_expectation(crf1de, seq, g, seq->weight);
+    batch.crf1de = crf1de;
+    batch.ds = ds;
+    batch.w = w;
+    batch.g = g;
+    if (crf1de->chunks != NULL) {
+        int s, M = crf1de->num_chunks;
+        parallel_run(crf1de->num_workers, crf1de_batch_expectation_chunks, &batch);
+        parallel_run(crf1de->num_workers, crf1de_batch_reduce_chunks, &batch);
+
+        /* Add up the log-likelihoods with the same summation tree. */
+        for (s = 1;s < M;s *= 2) {
+            for (i = 0;i + s < M;i += 2 * s) {
+                crf1de->chunks[i].logl += crf1de->chunks[i+s].logl;
+            }
+        }
+        logl = crf1de->chunks[0].logl;
+    } else {
+        parallel_run(crf1de->num_workers, crf1de_batch_expectation, &batch);
+        if (1 < crf1de->num_workers) {
+            parallel_run(crf1de->num_workers, crf1de_batch_reduce, &batch);
+        }
+        for (i = 0;i < crf1de->num_workers;++i) {
+            logl += crf1de->workers[i].logl;
+        }
     }
 
     *f = -logl;
@@ -920,11 +1457,49 @@ static int encoder_objective_and_gradients(encoder_t *self, floatval_t *f, float
     set_level(self, LEVEL_MARGINAL);
     gain *= weight;
     crf1de_observation_expectation(crf1de, self->inst, self->inst->labels, g, gain);
-    crf1de_model_expectation(crf1de, self->inst, g, -gain);
+    crf1de_model_expectation(crf1de, crf1de->ctx, self->inst, g, -gain);
     *f = (-crf1dc_score(crf1de->ctx,  self->inst->labels) + crf1dc_lognorm(crf1de->ctx)) * weight;
     return 0;
 }
 
+static encoder_t *encoder_fork(encoder_t *self)
+{
+    encoder_t *fork = NULL;
+    crf1de_t *enc = NULL;
+    const crf1de_t *crf1de = (crf1de_t*)self->internal;
+
+    fork = (encoder_t*)malloc(sizeof(encoder_t));
+    enc = (crf1de_t*)malloc(sizeof(crf1de_t));
+    if (fork == NULL || enc == NULL) {
+        goto error_exit;
+    }
+
+    /* Share the features, but not the work areas for the batch gradients. */
+    *enc = *crf1de;
+    enc->num_workers = 0;
+    enc->workers = NULL;
+    enc->num_chunks = 0;
+    enc->chunks = NULL;
+    enc->shared = 1;
+    enc->ctx = crf1dc_new(crf1de->ctx->flag, crf1de->num_labels, crf1de->ctx->cap_items);
+    if (enc->ctx == NULL) {
+        goto error_exit;
+    }
+
+    *fork = *self;
+    fork->internal = enc;
+    fork->w = NULL;
+    fork->scale = 1.;
+    fork->inst = NULL;
+    fork->level = LEVEL_NONE;
+    return fork;
+
+error_exit:
+    free(enc);
+    free(fork);
+    return NULL;
+}
+
 static void encoder_release(encoder_t *self)
 {
     crf1de_t *crf1de = (crf1de_t*)self->internal;
@@ -952,6 +1527,7 @@ encoder_t *crf1d_create_encoder()
             self->viterbi = encoder_viterbi;
             self->partition_factor = encoder_partition_factor;
             self->objective_and_gradients = encoder_objective_and_gradients;
+            self->fork = encoder_fork;
             self->release = encoder_release;
             self->internal = enc;
         }
@@ -30,26 +30,85 @@
 
 /* $Id$ */
 
+/*
+ * Declare ftello() and fseeko() with 64-bit offsets, and madvise() with the
+ * MADV_* hints, even under -std=c99.
+ */
+#define _DEFAULT_SOURCE
+#define _FILE_OFFSET_BITS   64
+
+#ifdef    HAVE_CONFIG_H
+#include <config.h>
+#endif/*HAVE_CONFIG_H*/
+
 #include "os.h"
 
 #include <inttypes.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <cqdb.h>
 
+#ifdef  _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif/*_WIN32*/
+
 #include <crfsuite.h>
 #include "crf1d.h"
+#include "vecmath.h"
 
 #define FILEMAGIC       "lCRF"
 #define MODELTYPE       "FOMC"
 #define VERSION_NUMBER  (100)
-#define CHUNK_LABELREF  "LFRF"
-#define CHUNK_ATTRREF   "AFRF"
-#define CHUNK_FEATURE   "FEAT"
+#define VERSION_NUMBER_V2   (200)
+#define BYTEORDER_CHECK (0x62445371)
 #define HEADER_SIZE     48
+#define HEADER_SIZE_V2  192
 #define CHUNK_SIZE      12
 #define FEATURE_SIZE    20
+#define SECTION_ALIGN   64
+
+/*
+ * The model format version 2 differs from the version 1 in these points:
+ *  - the offsets in the header are 64-bit integers;
+ *  - the header has a byte-order marker (BYTEORDER_CHECK);
+ *  - the types, sources, destinations, and weights of the features are
+ *    stored in separate arrays (instead of 20-byte records), in which the
+ *    types, sources, and destinations take the fewest bytes (1, 2, or 4)
+ *    that hold their largest values;
+ *  - the feature references are stored in arrays of feature ids with the
+ *    index arrays delimiting the references of labels (attributes), both
+ *    of which take the fewest bytes (1, 2, or 4) that hold their values;
+ *  - every section begins at an offset of a multiple of 64 bytes;
+ *  - the weights may be quantized to 16-bit floating-point values or to
+ *    8-bit integers with scale factors for each pair of a feature type
+ *    and a destination label (see crf1dm_quantize());
+ *  - the attribute strings may have a minimal perfect hash index with a
+ *    Bloom filter in addition to the attribute CQDB (see crf1dm_to_aid());
+ *  - a model of feature hashing has no attribute CQDB; the attribute id is
+ *    the upper attr_hash_bits bits of the hash value of the attribute.
+ * All integers and floating-point values are stored in little endian as
+ * in the version 1, so that a little-endian host reads the arrays in place.
+ */
+
+#ifdef  _MSC_VER
+#define ftell64     _ftelli64
+#define fseek64     _fseeki64
+#else
+#define ftell64     ftello
+#define fseek64     fseeko
+#endif/*_MSC_VER*/
+
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || \
+    defined(_M_IX86) || defined(_M_X64) || defined(_M_ARM64)
+#define CRF1DM_LITTLE_ENDIAN
+#endif
 
 enum {
     WSTATE_NONE,
@@ -62,39 +121,54 @@ enum {
 
 typedef struct {
     uint8_t     magic[4];       /* File magic. */
-    uint32_t    size;           /* File size. */
+    uint64_t    size;           /* File size. */
     uint8_t     type[4];        /* Model type */
     uint32_t    version;        /* Version number. */
+    uint32_t    byteorder;      /* Byte-order marker (version 2). */
     uint32_t    num_features;   /* Number of features. */
     uint32_t    num_labels;     /* Number of labels. */
     uint32_t    num_attrs;      /* Number of attributes. */
-    uint32_t    off_features;   /* Offset to features. */
-    uint32_t    off_labels;     /* Offset to label CQDB. */
-    uint32_t    off_attrs;      /* Offset to attribute CQDB. */
-    uint32_t    off_labelrefs;  /* Offset to label feature references. */
-    uint32_t    off_attrrefs;   /* Offset to attribute feature references. */
+    uint64_t    off_features;   /* Offset to features (version 1). */
+    uint64_t    off_labels;     /* Offset to label CQDB. */
+    uint64_t    off_attrs;      /* Offset to attribute CQDB. */
+    uint64_t    off_labelrefs;  /* Offset to label feature references (index in version 2). */
+    uint64_t    off_attrrefs;   /* Offset to attribute feature references (index in version 2). */
+    uint64_t    off_labelfids;  /* Offset to feature ids of labels (version 2). */
+    uint64_t    off_attrfids;   /* Offset to feature ids of attributes (version 2). */
+    uint64_t    off_types;      /* Offset to feature types (version 2). */
+    uint64_t    off_srcs;       /* Offset to feature sources (version 2). */
+    uint64_t    off_dsts;       /* Offset to feature destinations (version 2). */
+    uint64_t    off_weights;    /* Offset to feature weights (version 2). */
+    uint32_t    weight_type;    /* Encoding of the weights (WT_*, version 2). */
+    uint32_t    scale_stride;   /* Number of scale factors for each feature type (version 2). */
+    uint64_t    off_scales;     /* Offset to scale factors of WT_INT8 weights (version 2). */
+    uint64_t    off_attrbuckets;    /* Offset to buckets of the attribute index (version 2). */
+    uint64_t    off_attrslots;  /* Offset to slots of the attribute index (version 2). */
+    uint32_t    num_attrbuckets;    /* Number of buckets of the attribute index (version 2). */
+    uint32_t    attr_hash_bits; /* Number of bits of the hashed attribute ids, or zero (version 2). */
+    uint8_t     widths[8];      /* Bytes per type, source, destination, label reference, and attribute reference (version 2). */
 } header_t;
 
-typedef struct {
-    uint8_t     chunk[4];       /* Chunk id */
-    uint32_t    size;           /* Chunk size. */
-    uint32_t    num;            /* Number of items. */
-    uint32_t    offsets[1];     /* Offsets. */
-} featureref_header_t;
-
-typedef struct {
-    uint8_t     chunk[4];       /* Chunk id */
-    uint32_t    size;           /* Chunk size. */
-    uint32_t    num;            /* Number of items. */
-} feature_header_t;
+/**
+ * Encodings of feature weights.
+ */
+enum {
+    WT_FLOAT64 = 0,             /**< 64-bit floating point. */
+    WT_FLOAT16 = CRFSUITE_QUANTIZE_FP16,    /**< 16-bit floating point. */
+    WT_INT8 = CRFSUITE_QUANTIZE_INT8,       /**< 8-bit integer times a scale factor. */
+};
 
 struct tag_crf1dm {
     uint8_t*       buffer_orig;
     const uint8_t* buffer;
-    uint32_t       size;
+    size_t         size;
+    void*          mapped;      /**< Mapped view of the model file, or NULL. */
+    size_t         mapped_size; /**< Size of the mapped view. */
     header_t*      header;
     cqdb_t*        labels;
     cqdb_t*        attrs;
+    const uint8_t* attrbuckets; /**< Buckets of the attribute index, or NULL. */
+    const uint8_t* attrslots;   /**< Slots of the attribute index, or NULL. */
 };
 
 struct tag_crf1dmw {
@@ -102,8 +176,24 @@ struct tag_crf1dmw {
     int state;
     header_t header;
     cqdb_writer_t* dbw;
-    featureref_header_t* href;
-    feature_header_t* hfeat;
+
+    uint32_t *index;        /* Index array of the references being written. */
+    uint32_t num_refs;      /* Number of the references. */
+    uint32_t next_ref;      /* Id of the next reference. */
+    uint32_t num_fids;      /* Number of the feature ids put. */
+    uint32_t cap_fids;      /* Capacity of the feature ids. */
+    uint32_t *fids;         /* Feature ids of the references being written. */
+
+    uint32_t cap_features;  /* Capacity of the feature arrays. */
+    uint32_t *types;        /* Types of the features. */
+    uint32_t *srcs;         /* Sources of the features. */
+    uint32_t *dsts;         /* Destinations of the features. */
+    floatval_t *weights;    /* Weights of the features. */
+    int weight_type;        /* Encoding of the weights (WT_*). */
+
+    uint64_t *attr_hashes;  /* Hash values of the attributes. */
+    uint32_t *attr_records; /* Offsets of the attribute records in the CQDB. */
+    uint32_t num_attr_hashes;   /* Number of the attributes put. */
 };
 
 
@@ -140,10 +230,30 @@ static int write_uint32(FILE *fp, uint32_t value)
 
 static int read_uint32(const uint8_t* buffer, uint32_t* value)
 {
+#ifdef  CRF1DM_LITTLE_ENDIAN
+    memcpy(value, buffer, sizeof(*value));
+#else
     *value  = ((uint32_t)buffer[0]);
     *value |= ((uint32_t)buffer[1] << 8);
     *value |= ((uint32_t)buffer[2] << 16);
     *value |= ((uint32_t)buffer[3] << 24);
+#endif/*CRF1DM_LITTLE_ENDIAN*/
+    return sizeof(*value);
+}
+
+static int write_uint64(FILE *fp, uint64_t value)
+{
+    int ret = write_uint32(fp, (uint32_t)(value & 0xFFFFFFFF));
+    ret |= write_uint32(fp, (uint32_t)(value >> 32));
+    return ret;
+}
+
+static int read_uint64(const uint8_t* buffer, uint64_t* value)
+{
+    uint32_t lo, hi;
+    read_uint32(buffer, &lo);
+    read_uint32(buffer + sizeof(uint32_t), &hi);
+    *value = ((uint64_t)hi << 32) | lo;
     return sizeof(*value);
 }
 
@@ -169,6 +279,53 @@ static int read_uint8_array(const uint8_t* buffer, uint8_t *array, size_t n)
     return ret;
 }
 
+static int write_uint_array(FILE *fp, const uint32_t *array, uint32_t n, int width)
+{
+    uint32_t i;
+    int ret = 0;
+    for (i = 0;i < n;++i) {
+        switch (width) {
+        case 1:
+            ret |= write_uint8(fp, (uint8_t)array[i]);
+            break;
+        case 2:
+            ret |= write_uint8(fp, (uint8_t)(array[i] & 0xFF));
+            ret |= write_uint8(fp, (uint8_t)(array[i] >> 8));
+            break;
+        default:
+            ret |= write_uint32(fp, array[i]);
+            break;
+        }
+    }
+    return ret;
+}
+
+static uint32_t read_uint_element(const uint8_t* buffer, int width, uint32_t i)
+{
+    uint32_t value;
+    switch (width) {
+    case 1:
+        return buffer[i];
+    case 2:
+        return (uint32_t)buffer[2 * (size_t)i] | ((uint32_t)buffer[2 * (size_t)i + 1] << 8);
+    default:
+        read_uint32(buffer + sizeof(uint32_t) * (size_t)i, &value);
+        return value;
+    }
+}
+
+/* Number of bytes (1, 2, or 4) that hold every value of the array. */
+static int uint_width(const uint32_t *array, uint32_t n)
+{
+    uint32_t i, max = 0;
+    for (i = 0;i < n;++i) {
+        if (max < array[i]) {
+            max = array[i];
+        }
+    }
+    return (max <= 0xFF) ? 1 : ((max <= 0xFFFF) ? 2 : 4);
+}
+
 static void write_float(FILE *fp, floatval_t value)
 {
     /*
@@ -196,6 +353,9 @@ static void write_float(FILE *fp, floatval_t value)
 
 static int read_float(const uint8_t* buffer, floatval_t* value)
 {
+#ifdef  CRF1DM_LITTLE_ENDIAN
+    memcpy(value, buffer, sizeof(*value));
+#else
     uint64_t iv;
     iv  = ((uint64_t)buffer[0]);
     iv |= ((uint64_t)buffer[1] << 8);
@@ -206,9 +366,145 @@ static int read_float(const uint8_t* buffer, floatval_t* value)
     iv |= ((uint64_t)buffer[6] << 48);
     iv |= ((uint64_t)buffer[7] << 56);
     memcpy(value, &iv, sizeof(*value));
+#endif/*CRF1DM_LITTLE_ENDIAN*/
     return sizeof(*value);
 }
 
+/*
+ * Convert a weight to a 16-bit floating-point value (IEEE 754 binary16),
+ * rounding to the nearest even. Values out of the range become infinity.
+ */
+static uint16_t float_to_half(floatval_t value)
+{
+    uint32_t x, sign, mant, half, rem, halfway;
+    int exp, shift;
+    float fv = (float)value;
+
+    memcpy(&x, &fv, sizeof(x));
+    sign = (x >> 16) & 0x8000;
+    exp = (int)((x >> 23) & 0xFF) - 127 + 15;
+    mant = x & 0x7FFFFF;
+
+    if (((x >> 23) & 0xFF) == 0xFF) {
+        /* Infinity or NaN. */
+        return (uint16_t)(sign | 0x7C00 | (mant != 0 ? 0x200 : 0));
+    } else if (31 <= exp) {
+        /* Overflow. */
+        return (uint16_t)(sign | 0x7C00);
+    } else if (exp <= 0) {
+        /* Subnormal value or zero. */
+        if (exp < -10) {
+            return (uint16_t)sign;
+        }
+        mant |= 0x800000;
+        shift = 14 - exp;
+        half = mant >> shift;
+        rem = mant & ((1U << shift) - 1);
+        halfway = 1U << (shift - 1);
+    } else {
+        half = ((uint32_t)exp << 10) | (mant >> 13);
+        rem = mant & 0x1FFF;
+        halfway = 0x1000;
+    }
+
+    /* A carry may move the value to the next exponent, which is correct. */
+    if (halfway < rem || (rem == halfway && (half & 1))) {
+        ++half;
+    }
+    return (uint16_t)(sign | half);
+}
+
+static int read_half(const uint8_t* buffer, floatval_t* value)
+{
+    *value = vechalf((uint16_t)(buffer[0] | (buffer[1] << 8)));
+    return sizeof(uint16_t);
+}
+
+/*
+ * The minimal perfect hash index of attributes.
+ *  An attribute string is hashed into a 64-bit value h. The upper 32 bits
+ *  of h choose a bucket, and the displacement of the bucket, mixed with h,
+ *  chooses a slot; the writer finds displacements so that every attribute
+ *  has its own slot (hash and displace). A slot stores the lower 32 bits
+ *  of h (fingerprint) and the offset of the attribute record in the CQDB
+ *  (the attribute id, the key size, and the key), so that a lookup reads
+ *  one displacement and one slot, and reads the record to compare the key
+ *  only when the fingerprint matches. The displacement of a bucket with
+ *  one attribute may instead hold the slot itself (with ATTRINDEX_DIRECT),
+ *  so that the writer need not search for the last few free slots.
+ *
+ *  Next to the displacement, a bucket has a 32-bit Bloom filter in which
+ *  each attribute of the bucket sets three bits chosen by h. Many of the
+ *  attributes are unknown to the model at tagging time; the filter rejects
+ *  most of them (all but about 4%) with the cache line of the bucket that
+ *  the lookup reads anyway, without reading a slot.
+ */
+#define ATTRINDEX_LAMBDA        4           /* Average number of attributes in a bucket. */
+#define ATTRINDEX_MAX_TRIALS    (1 << 20)   /* Maximum number of displacements to try. */
+#define ATTRINDEX_DIRECT_TRIALS 64          /* Trials before a bucket with one attribute takes a free slot. */
+#define ATTRINDEX_DIRECT        0x80000000U
+#define ATTRINDEX_BUCKET_SIZE   8           /* Displacement and filter. */
+#define ATTRINDEX_SLOT_SIZE     8           /* Fingerprint and record offset. */
+
+static uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+crfsuite_hash_t crfsuite_attribute_hash(const char *str, size_t n)
+{
+    size_t i;
+    uint64_t w, h = 0x9E3779B97F4A7C15ULL * (n + 1);
+    const uint8_t *p = (const uint8_t*)str;
+
+    for (i = 0;i + 8 <= n;i += 8, p += 8) {
+#ifdef  CRF1DM_LITTLE_ENDIAN
+        memcpy(&w, p, sizeof(w));
+#else
+        w  = ((uint64_t)p[0]);
+        w |= ((uint64_t)p[1] << 8);
+        w |= ((uint64_t)p[2] << 16);
+        w |= ((uint64_t)p[3] << 24);
+        w |= ((uint64_t)p[4] << 32);
+        w |= ((uint64_t)p[5] << 40);
+        w |= ((uint64_t)p[6] << 48);
+        w |= ((uint64_t)p[7] << 56);
+#endif/*CRF1DM_LITTLE_ENDIAN*/
+        h = (h ^ mix64(w)) * 0x87C37B91114253D5ULL;
+    }
+    for (w = 0;i < n;++i, ++p) {
+        w |= (uint64_t)*p << (8 * (i & 7));
+    }
+    h = (h ^ mix64(w)) * 0x87C37B91114253D5ULL;
+    return mix64(h);
+}
+
+/* Map a 32-bit value to [0, n) without a division. */
+#define ATTRINDEX_RANGE(x, n)   ((uint32_t)(((uint64_t)(uint32_t)(x) * (n)) >> 32))
+#define ATTRINDEX_BUCKET(h, n)  ATTRINDEX_RANGE((h) >> 32, (n))
+#define ATTRINDEX_SLOT(h, d, n) ATTRINDEX_RANGE(mix64((h) + (uint64_t)(d) * 0x9E3779B97F4A7C15ULL), (n))
+#define ATTRINDEX_FILTER(h) \
+    ((1U << ((h) & 31)) | (1U << (((h) >> 5) & 31)) | (1U << (((h) >> 10) & 31)))
+
+/*
+ * Pad the file with zeros so that the next section begins at a multiple of
+ * SECTION_ALIGN bytes, and return the offset of the section.
+ */
+static uint64_t align_section(FILE *fp)
+{
+    uint64_t offset = (uint64_t)ftell64(fp);
+    while (offset % SECTION_ALIGN != 0) {
+        write_uint8(fp, 0);
+        ++offset;
+    }
+    return offset;
+}
+
 crf1dmw_t* crf1mmw(const char *filename)
 {
     header_t *header = NULL;
@@ -230,10 +526,11 @@ crf1dmw_t* crf1mmw(const char *filename)
     header = &writer->header;
     memcpy(header->magic, FILEMAGIC, 4);
     memcpy(header->type, MODELTYPE, 4);
-    header->version = VERSION_NUMBER;
+    header->version = VERSION_NUMBER_V2;
+    header->byteorder = BYTEORDER_CHECK;
 
     /* Advance the file position to skip the file header. */
-    if (fseek(writer->fp, HEADER_SIZE, SEEK_CUR) != 0) {
+    if (fseek64(writer->fp, HEADER_SIZE_V2, SEEK_CUR) != 0) {
         goto error_exit;
     }
 
@@ -249,32 +546,66 @@ error_exit:
     return NULL;
 }
 
+static void crf1dmw_delete(crf1dmw_t* writer)
+{
+    if (writer->fp != NULL) {
+        fclose(writer->fp);
+    }
+    free(writer->index);
+    free(writer->fids);
+    free(writer->types);
+    free(writer->srcs);
+    free(writer->dsts);
+    free(writer->weights);
+    free(writer->attr_hashes);
+    free(writer->attr_records);
+    free(writer);
+}
+
 int crf1dmw_close(crf1dmw_t* writer)
 {
     FILE *fp = writer->fp;
     header_t *header = &writer->header;
 
     /* Store the file size. */
-    header->size = (uint32_t)ftell(fp);
+    header->size = (uint64_t)ftell64(fp);
 
     /* Move the file position to the head. */
-    if (fseek(fp, 0, SEEK_SET) != 0) {
+    if (fseek64(fp, 0, SEEK_SET) != 0) {
         goto error_exit;
     }
 
-    /* Write the file header. */
+    /*
+        Write the file header. The 32-bit size field of the version 1 is
+        kept at the same position, but it is unused.
+     */
     write_uint8_array(fp, header->magic, sizeof(header->magic));
-    write_uint32(fp, header->size);
+    write_uint32(fp, 0);
     write_uint8_array(fp, header->type, sizeof(header->type));
     write_uint32(fp, header->version);
+    write_uint32(fp, header->byteorder);
     write_uint32(fp, header->num_features);
     write_uint32(fp, header->num_labels);
     write_uint32(fp, header->num_attrs);
-    write_uint32(fp, header->off_features);
-    write_uint32(fp, header->off_labels);
-    write_uint32(fp, header->off_attrs);
-    write_uint32(fp, header->off_labelrefs);
-    write_uint32(fp, header->off_attrrefs);
+    write_uint64(fp, header->size);
+    write_uint64(fp, header->off_labels);
+    write_uint64(fp, header->off_attrs);
+    write_uint64(fp, header->off_types);
+    write_uint64(fp, header->off_srcs);
+    write_uint64(fp, header->off_dsts);
+    write_uint64(fp, header->off_weights);
+    write_uint64(fp, header->off_labelrefs);
+    write_uint64(fp, header->off_labelfids);
+    write_uint64(fp, header->off_attrrefs);
+    write_uint64(fp, header->off_attrfids);
+    write_uint32(fp, header->weight_type);
+    write_uint32(fp, header->scale_stride);
+    write_uint64(fp, header->off_scales);
+    write_uint64(fp, header->off_attrbuckets);
+    write_uint64(fp, header->off_attrslots);
+    write_uint32(fp, header->num_attrbuckets);
+    write_uint32(fp, header->attr_hash_bits);
+    write_uint8_array(fp, header->widths, sizeof(header->widths));
 
     /* Check for any error occurrence. */
     if (ferror(fp)) {
@@ -282,17 +613,11 @@ int crf1dmw_close(crf1dmw_t* writer)
     }
 
     /* Close the writer. */
-    fclose(fp);
-    free(writer);
+    crf1dmw_delete(writer);
     return 0;
 
 error_exit:
-    if (writer != NULL) {
-        if (writer->fp != NULL) {
-            fclose(writer->fp);
-        }
-        free(writer);
-    }
+    crf1dmw_delete(writer);
     return 1;
 }
 
@@ -304,7 +629,7 @@ int crf1dmw_open_labels(crf1dmw_t* writer, int num_labels)
     }
 
     /* Store the current offset. */
-    writer->header.off_labels = (uint32_t)ftell(writer->fp);
+    writer->header.off_labels = align_section(writer->fp);
 
     /* Open a CQDB chunk for writing. */
     writer->dbw = cqdb_writer(writer->fp, 0);
@@ -358,7 +683,7 @@ int crf1dmw_open_attrs(crf1dmw_t* writer, int num_attrs)
     }
 
     /* Store the current offset. */
-    writer->header.off_attrs = (uint32_t)ftell(writer->fp);
+    writer->header.off_attrs = align_section(writer->fp);
 
     /* Open a CQDB chunk for writing. */
     writer->dbw = cqdb_writer(writer->fp, 0);
@@ -367,11 +692,133 @@ int crf1dmw_open_attrs(crf1dmw_t* writer, int num_attrs)
         return 1;
     }
 
+    /* Keep the hash values of the attributes for the index. */
+    writer->attr_hashes = (uint64_t*)calloc(num_attrs + 1, sizeof(uint64_t));
+    writer->attr_records = (uint32_t*)calloc(num_attrs + 1, sizeof(uint32_t));
+
     writer->state = WSTATE_ATTRS;
     writer->header.num_attrs = num_attrs;
     return 0;
 }
 
+/*
+ * Find the displacements of the attribute index and write the index.
+ *  The writer leaves the index out (the reader then uses the CQDB) if it
+ *  fails to find the displacements, e.g., when two attributes have the
+ *  same hash value.
+ */
+static int crf1dmw_write_attr_index(crf1dmw_t* writer)
+{
+    uint32_t i, j, k, d, b;
+    FILE *fp = writer->fp;
+    header_t *header = &writer->header;
+    const uint64_t *hashes = writer->attr_hashes;
+    const uint32_t n = header->num_attrs;
+    const uint32_t B = n / ATTRINDEX_LAMBDA + 1;
+    uint32_t *disps = NULL, *filters = NULL, *slots = NULL, *order = NULL, *sizes = NULL, *begins = NULL, *keys = NULL;
+    uint8_t *taken = NULL;
+    uint32_t max_size = 0, num_buckets = 0, next_free = 0, pos[64];
+    int ret = 0;
+
+    disps = (uint32_t*)calloc(B, sizeof(uint32_t));
+    filters = (uint32_t*)calloc(B, sizeof(uint32_t));
+    slots = (uint32_t*)calloc(2 * (size_t)n, sizeof(uint32_t));
+    order = (uint32_t*)calloc(B, sizeof(uint32_t));
+    sizes = (uint32_t*)calloc(B + 1, sizeof(uint32_t));
+    begins = (uint32_t*)calloc(B + 1, sizeof(uint32_t));
+    keys = (uint32_t*)calloc(n, sizeof(uint32_t));
+    taken = (uint8_t*)calloc(n, sizeof(uint8_t));
+    if (disps == NULL || filters == NULL || slots == NULL || order == NULL || sizes == NULL ||
+        begins == NULL || keys == NULL || taken == NULL) {
+        ret = CRFSUITEERR_OUTOFMEMORY;
+        goto exit;
+    }
+
+    /* Group the attributes by their buckets. */
+    for (i = 0;i < n;++i) {
+        b = ATTRINDEX_BUCKET(hashes[i], B);
+        ++sizes[b];
+        filters[b] |= ATTRINDEX_FILTER(hashes[i]);
+    }
+    for (b = 0;b < B;++b) {
+        begins[b+1] = begins[b] + sizes[b];
+        if (max_size < sizes[b]) max_size = sizes[b];
+    }
+    if (64 < max_size || ATTRINDEX_DIRECT <= n) {
+        goto exit;
+    }
+    memset(sizes, 0, sizeof(uint32_t) * B);
+    for (i = 0;i < n;++i) {
+        b = ATTRINDEX_BUCKET(hashes[i], B);
+        keys[begins[b] + sizes[b]++] = i;
+    }
+
+    /* Sort the non-empty buckets in descending order of their sizes. */
+    for (num_buckets = 0, j = max_size;0 < j;--j) {
+        for (b = 0;b < B;++b) {
+            if (sizes[b] == j) order[num_buckets++] = b;
+        }
+    }
+
+    /* Find the displacement of each bucket, larger buckets first. */
+    for (k = 0;k < num_buckets;++k) {
+        const uint32_t *bkeys = &keys[begins[order[k]]];
+        const uint32_t m = sizes[order[k]];
+
+        const uint32_t max_trials = (m == 1) ? ATTRINDEX_DIRECT_TRIALS : ATTRINDEX_MAX_TRIALS;
+
+        for (d = 0;d < max_trials;++d) {
+            for (i = 0;i < m;++i) {
+                pos[i] = ATTRINDEX_SLOT(hashes[bkeys[i]], d, n);
+                if (taken[pos[i]]) break;
+                for (j = 0;j < i;++j) {
+                    if (pos[j] == pos[i]) break;
+                }
+                if (j < i) break;
+            }
+            if (i == m) break;
+        }
+        if (d == max_trials) {
+            if (m != 1) {
+                goto exit;
+            }
+            /* Take the first free slot. */
+            while (taken[next_free]) ++next_free;
+            pos[0] = next_free;
+            d = ATTRINDEX_DIRECT | next_free;
+        }
+
+        disps[order[k]] = d;
+        for (i = 0;i < m;++i) {
+            taken[pos[i]] = 1;
+            slots[2*pos[i]] = (uint32_t)hashes[bkeys[i]];
+            slots[2*pos[i]+1] = writer->attr_records[bkeys[i]];
+        }
+    }
+
+    /* Write the buckets and slots. */
+    header->num_attrbuckets = B;
+    header->off_attrbuckets = align_section(fp);
+    for (b = 0;b < B;++b) {
+        write_uint32(fp, disps[b]);
+        write_uint32(fp, filters[b]);
+    }
+    header->off_attrslots = align_section(fp);
+    for (i = 0;i < 2 * n;++i) write_uint32(fp, slots[i]);
+    ret = ferror(fp) ? CRFSUITEERR_INTERNAL_LOGIC : 0;
+
+exit:
+    free(taken);
+    free(keys);
+    free(begins);
+    free(sizes);
+    free(order);
+    free(slots);
+    free(filters);
+    free(disps);
+    return ret;
+}
+
 int crf1dmw_close_attrs(crf1dmw_t* writer)
 {
     /* Make sure that we are writing attributes. */
@@ -383,14 +830,30 @@ int crf1dmw_close_attrs(crf1dmw_t* writer)
     if (cqdb_writer_close(writer->dbw)) {
         return 1;
     }
-
     writer->dbw = NULL;
+
+    /* Write the index of the attributes if all of them were put. */
+    if (writer->attr_hashes != NULL && writer->attr_records != NULL &&
+        0 < writer->header.num_attrs &&
+        writer->num_attr_hashes == writer->header.num_attrs) {
+        if (crf1dmw_write_attr_index(writer)) {
+            return 1;
+        }
+    }
+    free(writer->attr_hashes);
+    free(writer->attr_records);
+    writer->attr_hashes = NULL;
+    writer->attr_records = NULL;
+
     writer->state = WSTATE_NONE;
     return 0;
 }
 
 int crf1dmw_put_attr(crf1dmw_t* writer, int aid, const char *value)
 {
+    /* The CQDB writer writes the record at the current position. */
+    uint64_t record = (uint64_t)ftell64(writer->fp) - writer->header.off_attrs;
+
     /* Make sure that we are writing labels. */
     if (writer->state != WSTATE_ATTRS) {
         return 1;
@@ -401,307 +864,362 @@ int crf1dmw_put_attr(crf1dmw_t* writer, int aid, const char *value)
         return 1;
     }
 
+    /* Keep the hash value for the index of the attributes. */
+    if (writer->attr_hashes != NULL && writer->attr_records != NULL &&
+        0 <= aid && aid < (int)writer->header.num_attrs && record <= 0xFFFFFFFFU) {
+        writer->attr_hashes[aid] = crfsuite_attribute_hash(value, strlen(value));
+        writer->attr_records[aid] = (uint32_t)record;
+        ++writer->num_attr_hashes;
+    }
+
     return 0;
 }
 
-int crf1dmw_open_labelrefs(crf1dmw_t* writer, int num_labels)
+int crf1dmw_hash_attrs(crf1dmw_t* writer, int bits)
 {
-    uint32_t offset;
-    FILE *fp = writer->fp;
-    featureref_header_t* href = NULL;
-    size_t size = CHUNK_SIZE + sizeof(uint32_t) * num_labels;
-
     /* Check if we aren't writing anything at this moment. */
-    if (writer->state != WSTATE_NONE) {
-        return CRFSUITEERR_INTERNAL_LOGIC;
-    }
-
-    /* Allocate a feature reference array. */
-    href = (featureref_header_t*)calloc(size, 1);
-    if (href == NULL) {
-        return CRFSUITEERR_OUTOFMEMORY;
+    if (writer->state != WSTATE_NONE || writer->header.off_attrs != 0) {
+        return 1;
     }
-
-    /* Align the offset to a DWORD boundary. */
-    offset = (uint32_t)ftell(fp);
-    while (offset % 4 != 0) {
-        uint8_t c = 0;
-        fwrite(&c, sizeof(uint8_t), 1, fp);
-        ++offset;
+    if (bits < 1 || CRFSUITE_HASH_MAX_BITS < bits) {
+        return 1;
     }
 
-    /* Store the current offset position to the file header. */
-    writer->header.off_labelrefs = offset;
-    fseek(fp, size, SEEK_CUR);
-
-    /* Fill members in the feature reference header. */
-    memcpy(href->chunk, CHUNK_LABELREF, 4);
-    href->size = 0;
-    href->num = num_labels;
+    /* The model has no attribute CQDB, but the number of the hashed ids. */
+    writer->header.attr_hash_bits = (uint32_t)bits;
+    writer->header.num_attrs = 1U << bits;
+    return 0;
+}
 
-    writer->href = href;
-    writer->state = WSTATE_LABELREFS;
+/*
+ * Feature references are stored in two sections: the feature ids of all
+ * labels (or attributes) in a row, and the index array whose elements
+ * #i and #(i+1) delimit the feature ids of the label (or attribute) #i.
+ * The writer keeps the feature ids and the index array in memory until
+ * the references are closed, and then writes both in the fewest bytes
+ * that hold the largest feature id and the number of the feature ids.
+ */
+static int crf1dmw_open_refs(crf1dmw_t* writer, int num)
+{
+    /* Allocate the index array. */
+    writer->index = (uint32_t*)calloc(num + 1, sizeof(uint32_t));
+    if (writer->index == NULL) {
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+    writer->num_refs = num;
+    writer->next_ref = 0;
+    writer->num_fids = 0;
     return 0;
 }
 
-int crf1dmw_close_labelrefs(crf1dmw_t* writer)
+static int crf1dmw_close_refs(crf1dmw_t* writer, uint64_t *ptr_off_index, uint64_t *ptr_off_fids, uint8_t *ptr_width)
 {
     uint32_t i;
+    int width;
     FILE *fp = writer->fp;
-    featureref_header_t* href = writer->href;
-    uint32_t begin = writer->header.off_labelrefs, end = 0;
 
-    /* Make sure that we are writing label feature references. */
-    if (writer->state != WSTATE_LABELREFS) {
-        return CRFSUITEERR_INTERNAL_LOGIC;
+    /* Terminate the index array; missing references are empty. */
+    for (i = writer->next_ref;i <= writer->num_refs;++i) {
+        writer->index[i] = writer->num_fids;
     }
 
-    /* Store the current offset position. */
-    end = (uint32_t)ftell(fp);
-
-    /* Compute the size of this chunk. */
-    href->size = (end - begin);
-
-    /* Write the chunk header and offset array. */
-    fseek(fp, begin, SEEK_SET);
-    write_uint8_array(fp, href->chunk, 4);
-    write_uint32(fp, href->size);
-    write_uint32(fp, href->num);
-    for (i = 0;i < href->num;++i) {
-        write_uint32(fp, href->offsets[i]);
+    /* The last element of the index array is the largest. */
+    width = uint_width(writer->fids, writer->num_fids);
+    if (width < uint_width(&writer->index[writer->num_refs], 1)) {
+        width = uint_width(&writer->index[writer->num_refs], 1);
     }
-
-    /* Move the file pointer to the tail. */
-    fseek(fp, end, SEEK_SET);
-
-    /* Uninitialize. */
-    free(href);
-    writer->href = NULL;
+    *ptr_width = (uint8_t)width;
+
+    /* Write the index array after the feature ids. */
+    *ptr_off_fids = align_section(fp);
+    write_uint_array(fp, writer->fids, writer->num_fids, width);
+    *ptr_off_index = align_section(fp);
+    write_uint_array(fp, writer->index, writer->num_refs + 1, width);
+
+    free(writer->index);
+    writer->index = NULL;
+    free(writer->fids);
+    writer->fids = NULL;
+    writer->cap_fids = 0;
     writer->state = WSTATE_NONE;
-    return 0;
+    return ferror(fp) ? CRFSUITEERR_INTERNAL_LOGIC : 0;
 }
 
-int crf1dmw_put_labelref(crf1dmw_t* writer, int lid, const feature_refs_t* ref, int *map)
+static int crf1dmw_put_ref(crf1dmw_t* writer, int i, const feature_refs_t* ref, int *map)
 {
-    int i, fid;
-    uint32_t n = 0, offset = 0;
-    FILE *fp = writer->fp;
-    featureref_header_t* href = writer->href;
+    int r, fid;
 
-    /* Make sure that we are writing label feature references. */
-    if (writer->state != WSTATE_LABELREFS) {
+    /* We must put references in the ascending order of their ids. */
+    if (i < (int)writer->next_ref || (int)writer->num_refs <= i) {
         return CRFSUITEERR_INTERNAL_LOGIC;
     }
 
-    /* Store the current offset to the offset array. */
-    href->offsets[lid] = ftell(fp);
+    /* The references #next_ref, ..., #(i-1) are empty. */
+    while ((int)writer->next_ref <= i) {
+        writer->index[writer->next_ref++] = writer->num_fids;
+    }
 
-    /* Count the number of references to active features. */
-    for (i = 0;i < ref->num_features;++i) {
-        if (0 <= map[ref->fids[i]]) ++n;
+    /* Expand the array of feature ids if necessary. */
+    if (writer->cap_fids < writer->num_fids + (uint32_t)ref->num_features) {
+        uint32_t cap = (writer->num_fids + (uint32_t)ref->num_features) * 2;
+        uint32_t *fids = (uint32_t*)realloc(writer->fids, sizeof(uint32_t) * cap);
+        if (fids == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        writer->fids = fids;
+        writer->cap_fids = cap;
     }
 
-    /* Write the feature reference. */
-    write_uint32(fp, (uint32_t)n);
-    for (i = 0;i < ref->num_features;++i) {
-        fid = map[ref->fids[i]];
-        if (0 <= fid) write_uint32(fp, (uint32_t)fid);
+    /* Put the ids of active features. */
+    for (r = 0;r < ref->num_features;++r) {
+        fid = map[ref->fids[r]];
+        if (0 <= fid) {
+            writer->fids[writer->num_fids++] = (uint32_t)fid;
+        }
     }
 
     return 0;
 }
 
-int crf1dmw_open_attrrefs(crf1dmw_t* writer, int num_attrs)
+int crf1dmw_open_labelrefs(crf1dmw_t* writer, int num_labels)
 {
-    uint32_t offset;
-    FILE *fp = writer->fp;
-    featureref_header_t* href = NULL;
-    size_t size = CHUNK_SIZE + sizeof(uint32_t) * num_attrs;
+    int ret;
 
     /* Check if we aren't writing anything at this moment. */
     if (writer->state != WSTATE_NONE) {
         return CRFSUITEERR_INTERNAL_LOGIC;
     }
 
-    /* Allocate a feature reference array. */
-    href = (featureref_header_t*)calloc(size, 1);
-    if (href == NULL) {
-        return CRFSUITEERR_OUTOFMEMORY;
+    if (ret = crf1dmw_open_refs(writer, num_labels)) {
+        return ret;
     }
+    writer->state = WSTATE_LABELREFS;
+    return 0;
+}
 
-    /* Align the offset to a DWORD boundary. */
-    offset = (uint32_t)ftell(fp);
-    while (offset % 4 != 0) {
-        uint8_t c = 0;
-        fwrite(&c, sizeof(uint8_t), 1, fp);
-        ++offset;
+int crf1dmw_close_labelrefs(crf1dmw_t* writer)
+{
+    /* Make sure that we are writing label feature references. */
+    if (writer->state != WSTATE_LABELREFS) {
+        return CRFSUITEERR_INTERNAL_LOGIC;
+    }
+
+    return crf1dmw_close_refs(writer, &writer->header.off_labelrefs, &writer->header.off_labelfids, &writer->header.widths[3]);
+}
+
+int crf1dmw_put_labelref(crf1dmw_t* writer, int lid, const feature_refs_t* ref, int *map)
+{
+    /* Make sure that we are writing label feature references. */
+    if (writer->state != WSTATE_LABELREFS) {
+        return CRFSUITEERR_INTERNAL_LOGIC;
     }
 
-    /* Store the current offset position to the file header. */
-    writer->header.off_attrrefs = offset;
-    fseek(fp, size, SEEK_CUR);
+    return crf1dmw_put_ref(writer, lid, ref, map);
+}
+
+int crf1dmw_open_attrrefs(crf1dmw_t* writer, int num_attrs)
+{
+    int ret;
 
-    /* Fill members in the feature reference header. */
-    memcpy(href->chunk, CHUNK_ATTRREF, 4);
-    href->size = 0;
-    href->num = num_attrs;
+    /* Check if we aren't writing anything at this moment. */
+    if (writer->state != WSTATE_NONE) {
+        return CRFSUITEERR_INTERNAL_LOGIC;
+    }
 
-    writer->href = href;
+    if (ret = crf1dmw_open_refs(writer, num_attrs)) {
+        return ret;
+    }
     writer->state = WSTATE_ATTRREFS;
     return 0;
 }
 
 int crf1dmw_close_attrrefs(crf1dmw_t* writer)
 {
-    uint32_t i;
-    FILE *fp = writer->fp;
-    featureref_header_t* href = writer->href;
-    uint32_t begin = writer->header.off_attrrefs, end = 0;
-
     /* Make sure that we are writing attribute feature references. */
     if (writer->state != WSTATE_ATTRREFS) {
         return CRFSUITEERR_INTERNAL_LOGIC;
     }
 
-    /* Store the current offset position. */
-    end = (uint32_t)ftell(fp);
-
-    /* Compute the size of this chunk. */
-    href->size = (end - begin);
-
-    /* Write the chunk header and offset array. */
-    fseek(fp, begin, SEEK_SET);
-    write_uint8_array(fp, href->chunk, 4);
-    write_uint32(fp, href->size);
-    write_uint32(fp, href->num);
-    for (i = 0;i < href->num;++i) {
-        write_uint32(fp, href->offsets[i]);
-    }
-
-    /* Move the file pointer to the tail. */
-    fseek(fp, end, SEEK_SET);
-
-    /* Uninitialize. */
-    free(href);
-    writer->href = NULL;
-    writer->state = WSTATE_NONE;
-    return 0;
+    return crf1dmw_close_refs(writer, &writer->header.off_attrrefs, &writer->header.off_attrfids, &writer->header.widths[4]);
 }
 
 int crf1dmw_put_attrref(crf1dmw_t* writer, int aid, const feature_refs_t* ref, int *map)
 {
-    int i, fid;
-    uint32_t n = 0, offset = 0;
-    FILE *fp = writer->fp;
-    featureref_header_t* href = writer->href;
-
     /* Make sure that we are writing attribute feature references. */
     if (writer->state != WSTATE_ATTRREFS) {
         return CRFSUITEERR_INTERNAL_LOGIC;
     }
 
-    /* Store the current offset to the offset array. */
-    href->offsets[aid] = ftell(fp);
-
-    /* Count the number of references to active features. */
-    for (i = 0;i < ref->num_features;++i) {
-        if (0 <= map[ref->fids[i]]) ++n;
-    }
+    return crf1dmw_put_ref(writer, aid, ref, map);
+}
 
-    /* Write the feature reference. */
-    write_uint32(fp, (uint32_t)n);
-    for (i = 0;i < ref->num_features;++i) {
-        fid = map[ref->fids[i]];
-        if (0 <= fid) write_uint32(fp, (uint32_t)fid);
+int crf1dmw_open_features(crf1dmw_t* writer)
+{
+    /* Check if we aren't writing anything at this moment. */
+    if (writer->state != WSTATE_NONE) {
+        return CRFSUITEERR_INTERNAL_LOGIC;
     }
 
+    writer->header.num_features = 0;
+    writer->state = WSTATE_FEATURES;
     return 0;
 }
 
-int crf1dmw_open_features(crf1dmw_t* writer)
+/*
+ * Write the weights as 8-bit integers. The weights of the features sharing
+ * a feature type and a destination label have a scale factor that maps the
+ * largest absolute weight to 127; the scale factors are written in a
+ * section before the weights.
+ */
+static int crf1dmw_write_int8_weights(crf1dmw_t* writer)
 {
+    uint32_t i, num_types = 0, stride = 0;
     FILE *fp = writer->fp;
-    feature_header_t* hfeat = NULL;
+    header_t *header = &writer->header;
+    const uint32_t K = header->num_features;
+    floatval_t *scales = NULL;
 
-    /* Check if we aren't writing anything at this moment. */
-    if (writer->state != WSTATE_NONE) {
-        return CRFSUITEERR_INTERNAL_LOGIC;
+    for (i = 0;i < K;++i) {
+        if (num_types <= writer->types[i]) num_types = writer->types[i] + 1;
+        if (stride <= writer->dsts[i]) stride = writer->dsts[i] + 1;
     }
 
-    /* Allocate a feature chunk header. */
-    hfeat = (feature_header_t*)calloc(sizeof(feature_header_t), 1);
-    if (hfeat == NULL) {
+    scales = (floatval_t*)calloc((size_t)num_types * stride + 1, sizeof(floatval_t));
+    if (scales == NULL) {
         return CRFSUITEERR_OUTOFMEMORY;
     }
 
-    writer->header.off_features = (uint32_t)ftell(fp);
-    fseek(fp, CHUNK_SIZE, SEEK_CUR);
+    /* Find the largest absolute weight of each block. */
+    for (i = 0;i < K;++i) {
+        floatval_t *scale = &scales[writer->types[i] * stride + writer->dsts[i]];
+        floatval_t a = fabs(writer->weights[i]);
+        if (*scale < a) *scale = a;
+    }
+    for (i = 0;i < num_types * stride;++i) {
+        scales[i] /= 127.;
+    }
 
-    memcpy(hfeat->chunk, CHUNK_FEATURE, 4);
-    writer->hfeat = hfeat;
+    header->scale_stride = stride;
+    header->off_scales = align_section(fp);
+    for (i = 0;i < num_types * stride;++i) write_float(fp, scales[i]);
+
+    header->off_weights = align_section(fp);
+    for (i = 0;i < K;++i) {
+        floatval_t scale = scales[writer->types[i] * stride + writer->dsts[i]];
+        int q = 0;
+        if (0 < scale) {
+            q = (int)floor(writer->weights[i] / scale + 0.5);
+            if (q < -127) q = -127;
+            if (127 < q) q = 127;
+        }
+        write_uint8(fp, (uint8_t)(int8_t)q);
+    }
 
-    writer->state = WSTATE_FEATURES;
+    free(scales);
     return 0;
 }
 
 int crf1dmw_close_features(crf1dmw_t* writer)
 {
+    int ret;
+    uint32_t i;
     FILE *fp = writer->fp;
-    feature_header_t* hfeat = writer->hfeat;
-    uint32_t begin = writer->header.off_features, end = 0;
+    header_t *header = &writer->header;
+    const uint32_t K = header->num_features;
 
-    /* Make sure that we are writing attribute feature references. */
+    /* Make sure that we are writing features. */
     if (writer->state != WSTATE_FEATURES) {
         return CRFSUITEERR_INTERNAL_LOGIC;
     }
 
-    /* Store the current offset position. */
-    end = (uint32_t)ftell(fp);
-
-    /* Compute the size of this chunk. */
-    hfeat->size = (end - begin);
-
-    /* Write the chunk header and offset array. */
-    fseek(fp, begin, SEEK_SET);
-    write_uint8_array(fp, hfeat->chunk, 4);
-    write_uint32(fp, hfeat->size);
-    write_uint32(fp, hfeat->num);
-
-    /* Move the file pointer to the tail. */
-    fseek(fp, end, SEEK_SET);
+    /* Write the fields of the features in separate sections. */
+    header->widths[0] = (uint8_t)uint_width(writer->types, K);
+    header->widths[1] = (uint8_t)uint_width(writer->srcs, K);
+    header->widths[2] = (uint8_t)uint_width(writer->dsts, K);
+    header->off_types = align_section(fp);
+    write_uint_array(fp, writer->types, K, header->widths[0]);
+    header->off_srcs = align_section(fp);
+    write_uint_array(fp, writer->srcs, K, header->widths[1]);
+    header->off_dsts = align_section(fp);
+    write_uint_array(fp, writer->dsts, K, header->widths[2]);
+    switch (writer->weight_type) {
+    case WT_FLOAT64:
+        header->off_weights = align_section(fp);
+        for (i = 0;i < K;++i) write_float(fp, writer->weights[i]);
+        break;
+    case WT_FLOAT16:
+        header->off_weights = align_section(fp);
+        for (i = 0;i < K;++i) {
+            uint16_t h = float_to_half(writer->weights[i]);
+            write_uint8(fp, (uint8_t)(h & 0xFF));
+            write_uint8(fp, (uint8_t)(h >> 8));
+        }
+        break;
+    case WT_INT8:
+        if (ret = crf1dmw_write_int8_weights(writer)) {
+            return ret;
+        }
+        break;
+    default:
+        return CRFSUITEERR_INTERNAL_LOGIC;
+    }
+    header->weight_type = (uint32_t)writer->weight_type;
 
     /* Uninitialize. */
-    free(hfeat);
-    writer->hfeat = NULL;
+    free(writer->types);
+    free(writer->srcs);
+    free(writer->dsts);
+    free(writer->weights);
+    writer->types = writer->srcs = writer->dsts = NULL;
+    writer->weights = NULL;
+    writer->cap_features = 0;
     writer->state = WSTATE_NONE;
-    return 0;
+    return ferror(fp) ? CRFSUITEERR_INTERNAL_LOGIC : 0;
 }
 
 int crf1dmw_put_feature(crf1dmw_t* writer, int fid, const crf1dm_feature_t* f)
 {
-    FILE *fp = writer->fp;
-    feature_header_t* hfeat = writer->hfeat;
+    header_t *header = &writer->header;
 
-    /* Make sure that we are writing attribute feature references. */
+    /* Make sure that we are writing features. */
     if (writer->state != WSTATE_FEATURES) {
         return CRFSUITEERR_INTERNAL_LOGIC;
     }
 
     /* We must put features #0, #1, ..., #(K-1) in this order. */
-    if (fid != hfeat->num) {
+    if (fid != header->num_features) {
         return CRFSUITEERR_INTERNAL_LOGIC;
     }
 
-    write_uint32(fp, f->type);
-    write_uint32(fp, f->src);
-    write_uint32(fp, f->dst);
-    write_float(fp, f->weight);
-    ++hfeat->num;
+    /* Expand the arrays if necessary. */
+    if (writer->cap_features <= header->num_features) {
+        uint32_t cap = (writer->cap_features + 1) * 2;
+        uint32_t *types = (uint32_t*)realloc(writer->types, sizeof(uint32_t) * cap);
+        uint32_t *srcs = (types != NULL) ? (uint32_t*)realloc(writer->srcs, sizeof(uint32_t) * cap) : NULL;
+        uint32_t *dsts = (srcs != NULL) ? (uint32_t*)realloc(writer->dsts, sizeof(uint32_t) * cap) : NULL;
+        floatval_t *weights = (dsts != NULL) ? (floatval_t*)realloc(writer->weights, sizeof(floatval_t) * cap) : NULL;
+        if (types != NULL) writer->types = types;
+        if (srcs != NULL) writer->srcs = srcs;
+        if (dsts != NULL) writer->dsts = dsts;
+        if (weights == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        writer->weights = weights;
+        writer->cap_features = cap;
+    }
+
+    writer->types[fid] = (uint32_t)f->type;
+    writer->srcs[fid] = (uint32_t)f->src;
+    writer->dsts[fid] = (uint32_t)f->dst;
+    writer->weights[fid] = f->weight;
+    ++header->num_features;
     return 0;
 }
 
-static crf1dm_t* crf1dm_new_impl(uint8_t* buffer_orig, const uint8_t* buffer, uint32_t size)
+static crf1dm_t* crf1dm_new_impl(uint8_t* buffer_orig, const uint8_t* buffer, size_t size)
 {
+    int i;
+    uint32_t size32 = 0;
     const uint8_t* p = NULL;
     crf1dm_t *model = NULL;
     header_t *header = NULL;
@@ -715,10 +1233,10 @@ static crf1dm_t* crf1dm_new_impl(uint8_t* buffer_orig, const uint8_t* buffer, ui
     model->buffer = buffer;
     model->size = size;
 
-    if (model->size <= sizeof(header_t)) {
+    if (model->size <= HEADER_SIZE) {
       goto error_exit;
     }
-    
+
     header = (header_t*)calloc(1, sizeof(header_t));
     if (header == NULL) {
         goto error_exit;
@@ -727,28 +1245,109 @@ static crf1dm_t* crf1dm_new_impl(uint8_t* buffer_orig, const uint8_t* buffer, ui
     /* Read the file header. */
     p = model->buffer;
     p += read_uint8_array(p, header->magic, sizeof(header->magic));
-    p += read_uint32(p, &header->size);
+    p += read_uint32(p, &size32);
     p += read_uint8_array(p, header->type, sizeof(header->type));
     p += read_uint32(p, &header->version);
-    p += read_uint32(p, &header->num_features);
-    p += read_uint32(p, &header->num_labels);
-    p += read_uint32(p, &header->num_attrs);
-    p += read_uint32(p, &header->off_features);
-    p += read_uint32(p, &header->off_labels);
-    p += read_uint32(p, &header->off_attrs);
-    p += read_uint32(p, &header->off_labelrefs);
-    p += read_uint32(p, &header->off_attrrefs);
     model->header = header;
 
+    /* Reject a file that is not a model (e.g., an incomplete one). */
+    if (memcmp(header->magic, FILEMAGIC, 4) != 0) {
+        goto error_exit;
+    }
+
+    if (header->version < VERSION_NUMBER_V2) {
+        uint32_t off_features, off_labels, off_attrs, off_labelrefs, off_attrrefs;
+
+        /* The version 1 with 32-bit offsets. */
+        p += read_uint32(p, &header->num_features);
+        p += read_uint32(p, &header->num_labels);
+        p += read_uint32(p, &header->num_attrs);
+        p += read_uint32(p, &off_features);
+        p += read_uint32(p, &off_labels);
+        p += read_uint32(p, &off_attrs);
+        p += read_uint32(p, &off_labelrefs);
+        p += read_uint32(p, &off_attrrefs);
+        header->size = size32;
+        header->off_features = off_features;
+        header->off_labels = off_labels;
+        header->off_attrs = off_attrs;
+        header->off_labelrefs = off_labelrefs;
+        header->off_attrrefs = off_attrrefs;
+
+        /* The writer of the version 1 left the number of features zero. */
+        if (header->num_features == 0 && header->off_features + CHUNK_SIZE <= model->size) {
+            read_uint32(model->buffer + header->off_features + 8, &header->num_features);
+        }
+    } else {
+        /* The version 2 with 64-bit offsets. */
+        if (model->size < HEADER_SIZE_V2) {
+            goto error_exit;
+        }
+        p += read_uint32(p, &header->byteorder);
+        p += read_uint32(p, &header->num_features);
+        p += read_uint32(p, &header->num_labels);
+        p += read_uint32(p, &header->num_attrs);
+        p += read_uint64(p, &header->size);
+        p += read_uint64(p, &header->off_labels);
+        p += read_uint64(p, &header->off_attrs);
+        p += read_uint64(p, &header->off_types);
+        p += read_uint64(p, &header->off_srcs);
+        p += read_uint64(p, &header->off_dsts);
+        p += read_uint64(p, &header->off_weights);
+        p += read_uint64(p, &header->off_labelrefs);
+        p += read_uint64(p, &header->off_labelfids);
+        p += read_uint64(p, &header->off_attrrefs);
+        p += read_uint64(p, &header->off_attrfids);
+        p += read_uint32(p, &header->weight_type);
+        p += read_uint32(p, &header->scale_stride);
+        p += read_uint64(p, &header->off_scales);
+        p += read_uint64(p, &header->off_attrbuckets);
+        p += read_uint64(p, &header->off_attrslots);
+        p += read_uint32(p, &header->num_attrbuckets);
+        p += read_uint32(p, &header->attr_hash_bits);
+        p += read_uint8_array(p, header->widths, sizeof(header->widths));
+
+        /* Make sure that the file is complete and in the expected byte order. */
+        if (header->byteorder != BYTEORDER_CHECK || model->size < header->size) {
+            goto error_exit;
+        }
+        if (header->weight_type != WT_FLOAT64 &&
+            header->weight_type != WT_FLOAT16 &&
+            header->weight_type != WT_INT8) {
+            goto error_exit;
+        }
+        if (header->attr_hash_bits != 0 &&
+            (CRFSUITE_HASH_MAX_BITS < header->attr_hash_bits ||
+             header->num_attrs != (1U << header->attr_hash_bits))) {
+            goto error_exit;
+        }
+        for (i = 0;i < 5;++i) {
+            if (header->widths[i] != 1 && header->widths[i] != 2 && header->widths[i] != 4) {
+                goto error_exit;
+            }
+        }
+    }
+
     model->labels = cqdb_reader(
         model->buffer + header->off_labels,
         model->size - header->off_labels
         );
 
-    model->attrs = cqdb_reader(
-        model->buffer + header->off_attrs,
-        model->size - header->off_attrs
-        );
+    /* A model of feature hashing has no attribute CQDB. */
+    if (header->attr_hash_bits == 0) {
+        model->attrs = cqdb_reader(
+            model->buffer + header->off_attrs,
+            model->size - header->off_attrs
+            );
+    }
+
+    /* Use the index of the attributes if the model has a valid one. */
+    if (header->off_attrslots != 0 && 0 < header->num_attrbuckets &&
+        header->off_attrbuckets + ATTRINDEX_BUCKET_SIZE * (uint64_t)header->num_attrbuckets <= model->size &&
+        header->off_attrslots + ATTRINDEX_SLOT_SIZE * (uint64_t)header->num_attrs <= model->size) {
+        model->attrbuckets = model->buffer + header->off_attrbuckets;
+        model->attrslots = model->buffer + header->off_attrslots;
+    }
 
     return model;
 
@@ -759,29 +1358,172 @@ error_exit:
     return NULL;
 }
 
-crf1dm_t* crf1dm_new(const char *filename)
+#ifdef  _WIN32
+
+static void *crf1dm_map_file(const char *filename, size_t *ptr_size, int flags)
+{
+    HANDLE hfile = INVALID_HANDLE_VALUE, hmap = NULL;
+    LARGE_INTEGER size;
+    void *view = NULL;
+
+    hfile = CreateFileA(
+        filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hfile == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+    if (!GetFileSizeEx(hfile, &size) || size.QuadPart == 0 || (uint64_t)SIZE_MAX < (uint64_t)size.QuadPart) {
+        CloseHandle(hfile);
+        return NULL;
+    }
+
+    /* The view remains valid after closing the handles. */
+    hmap = CreateFileMappingA(hfile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (hmap != NULL) {
+        view = MapViewOfFile(hmap, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(hmap);
+    }
+    CloseHandle(hfile);
+    if (view == NULL) {
+        return NULL;
+    }
+
+    /* crf1dm_check_flags() rejects the read-ahead and huge-page hints. */
+    if (flags & CRFSUITE_LOAD_MLOCK) {
+        if (!VirtualLock(view, (SIZE_T)size.QuadPart)) {
+            UnmapViewOfFile(view);
+            return NULL;
+        }
+    }
+
+    *ptr_size = (size_t)size.QuadPart;
+    return view;
+}
+
+static void crf1dm_unmap_file(void *view, size_t size)
+{
+    UnmapViewOfFile(view);
+}
+
+#else
+
+static void *crf1dm_map_file(const char *filename, size_t *ptr_size, int flags)
+{
+    int fd = -1;
+    struct stat st;
+    void *view = NULL;
+
+    fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size == 0 || (uint64_t)SIZE_MAX < (uint64_t)st.st_size) {
+        close(fd);
+        return NULL;
+    }
+
+    /* A shared mapping lets processes share the pages in the page cache. */
+    view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) {
+        return NULL;
+    }
+
+    /* The hints are advisory; ignore errors. */
+#ifdef  MADV_WILLNEED
+    if (flags & CRFSUITE_LOAD_WILLNEED) {
+        madvise(view, (size_t)st.st_size, MADV_WILLNEED);
+    }
+#endif/*MADV_WILLNEED*/
+#ifdef  MADV_HUGEPAGE
+    if (flags & CRFSUITE_LOAD_HUGEPAGE) {
+        madvise(view, (size_t)st.st_size, MADV_HUGEPAGE);
+    }
+#endif/*MADV_HUGEPAGE*/
+
+    if (flags & CRFSUITE_LOAD_MLOCK) {
+        if (mlock(view, (size_t)st.st_size) != 0) {
+            munmap(view, (size_t)st.st_size);
+            return NULL;
+        }
+    }
+
+    *ptr_size = (size_t)st.st_size;
+    return view;
+}
+
+static void crf1dm_unmap_file(void *view, size_t size)
+{
+    munmap(view, size);
+}
+
+#endif/*_WIN32*/
+
+static crf1dm_t* crf1dm_new_mapped(const char *filename, int flags)
+{
+    size_t size = 0;
+    crf1dm_t *model = NULL;
+    void *view = crf1dm_map_file(filename, &size, flags);
+
+    if (view == NULL) {
+        return NULL;
+    }
+
+    /* The view is aligned to a page, which satisfies the 16-byte alignment. */
+    model = crf1dm_new_impl(NULL, (const uint8_t*)view, size);
+    if (model == NULL) {
+        crf1dm_unmap_file(view, size);
+        return NULL;
+    }
+    model->mapped = view;
+    model->mapped_size = size;
+    return model;
+}
+
+int crf1dm_check_flags(int flags)
+{
+    /* The hints are available only where madvise() supports them. */
+#ifndef MADV_WILLNEED
+    if (flags & CRFSUITE_LOAD_WILLNEED) {
+        return CRFSUITEERR_NOTSUPPORTED;
+    }
+#endif/*MADV_WILLNEED*/
+#ifndef MADV_HUGEPAGE
+    if (flags & CRFSUITE_LOAD_HUGEPAGE) {
+        return CRFSUITEERR_NOTSUPPORTED;
+    }
+#endif/*MADV_HUGEPAGE*/
+    return 0;
+}
+
+crf1dm_t* crf1dm_new(const char *filename, int flags)
 {
     FILE *fp = NULL;
-    uint32_t size = 0;
+    size_t size = 0;
     uint8_t* buffer_orig = NULL;
     uint8_t* buffer = NULL;
 
+    /* Map the file into memory if requested. */
+    if (flags & (CRFSUITE_LOAD_MMAP | CRFSUITE_LOAD_WILLNEED | CRFSUITE_LOAD_HUGEPAGE | CRFSUITE_LOAD_MLOCK)) {
+        return crf1dm_new_mapped(filename, flags);
+    }
+
     fp = fopen(filename, "rb");
     if (fp == NULL) {
         goto error_exit;
     }
 
-    fseek(fp, 0, SEEK_END);
-    size = (uint32_t)ftell(fp);
-    fseek(fp, 0, SEEK_SET);
+    fseek64(fp, 0, SEEK_END);
+    size = (size_t)ftell64(fp);
+    fseek64(fp, 0, SEEK_SET);
 
-    buffer = buffer_orig = (uint8_t*)malloc(size + 16);
+    buffer = buffer_orig = (uint8_t*)malloc(size + SECTION_ALIGN);
     if (buffer_orig == NULL) {
         goto error_exit;
     }
 
-    /* Align the buffer to 16 bytes. */
-    while ((uintptr_t)buffer % 16 != 0) {
+    /* Align the buffer to the sections. */
+    while ((uintptr_t)buffer % SECTION_ALIGN != 0) {
         ++buffer;
     }
 
@@ -821,6 +1563,10 @@ void crf1dm_close(crf1dm_t* model)
         free(model->buffer_orig);
         model->buffer_orig = NULL;
     }
+    if (model->mapped != NULL) {
+        crf1dm_unmap_file(model->mapped, model->mapped_size);
+        model->mapped = NULL;
+    }
     model->buffer = NULL;
     free(model);
 }
@@ -853,13 +1599,122 @@ int crf1dm_to_lid(crf1dm_t* model, const char *value)
     }
 }
 
+/*
+ * Compare the attribute with the key of the CQDB record that a slot of the
+ * index points to, and return the attribute id if they are the same.
+ */
+static int crf1dm_check_record(crf1dm_t* model, const char *value, size_t n, uint32_t record)
+{
+    uint32_t aid, ksize;
+    const uint64_t offset = model->header->off_attrs + record;
+    const uint8_t *p = model->buffer + offset;
+
+    if (model->size < offset + 2 * sizeof(uint32_t) + n + 1) {
+        return -1;
+    }
+    read_uint32(p, &aid);
+    read_uint32(p + sizeof(uint32_t), &ksize);
+    return (ksize == n + 1 && memcmp(p + 2 * sizeof(uint32_t), value, n + 1) == 0) ? (int)aid : -1;
+}
+
+/*
+ * Find the slot of the attribute index for a hash value, or return NULL if
+ * the filter of the bucket rejects the hash value.
+ */
+static const uint8_t* crf1dm_find_slot(crf1dm_t* model, uint64_t h)
+{
+    uint32_t disp, filter, pos;
+    const uint32_t n = model->header->num_attrs;
+    const uint32_t mask = ATTRINDEX_FILTER(h);
+    const uint8_t *bucket = model->attrbuckets + ATTRINDEX_BUCKET_SIZE * (size_t)ATTRINDEX_BUCKET(h, model->header->num_attrbuckets);
+
+    read_uint32(bucket, &disp);
+    read_uint32(bucket + sizeof(uint32_t), &filter);
+    if ((filter & mask) != mask) {
+        return NULL;
+    }
+    pos = (disp & ATTRINDEX_DIRECT) ? (disp & ~ATTRINDEX_DIRECT) : ATTRINDEX_SLOT(h, disp, n);
+    return model->attrslots + ATTRINDEX_SLOT_SIZE * (size_t)(pos < n ? pos : 0);
+}
+
 int crf1dm_to_aid(crf1dm_t* model, const char *value)
 {
-    if (model->attrs != NULL) {
-        return cqdb_to_id(model->attrs, value);
-    } else {
+    const uint32_t bits = model->header->attr_hash_bits;
+
+    if (bits != 0) {
+        return CRFSUITE_HASH_TO_ID(crfsuite_attribute_hash(value, strlen(value)), bits);
+    } else if (model->attrs == NULL) {
         return -1;
+    } else if (model->attrslots != NULL) {
+        uint32_t fp, record;
+        const size_t n = strlen(value);
+        const uint64_t h = crfsuite_attribute_hash(value, n);
+        const uint8_t *slot = NULL;
+
+        slot = crf1dm_find_slot(model, h);
+        if (slot == NULL) {
+            return -1;
+        }
+        read_uint32(slot, &fp);
+        read_uint32(slot + sizeof(uint32_t), &record);
+        return (fp == (uint32_t)h) ? crf1dm_check_record(model, value, n, record) : -1;
+    } else {
+        return cqdb_to_id(model->attrs, value);
+    }
+}
+
+int crf1dm_to_aids(crf1dm_t* model, const char **values, int n, int *aids)
+{
+    int i, j, m;
+    size_t lens[16];
+    uint32_t fps[16], records[16];
+    uint64_t h;
+
+    if (model->attrs == NULL || model->attrslots == NULL) {
+        for (i = 0;i < n;++i) {
+            aids[i] = crf1dm_to_aid(model, values[i]);
+        }
+        return 0;
+    }
+
+    /*
+        Look up the slots of a block of attributes first, and then compare
+        the strings, so that the memory accesses to the slots overlap.
+     */
+    for (i = 0;i < n;i += 16) {
+        m = (n - i < 16) ? n - i : 16;
+        for (j = 0;j < m;++j) {
+            const uint8_t *slot = NULL;
+            lens[j] = strlen(values[i+j]);
+            h = crfsuite_attribute_hash(values[i+j], lens[j]);
+            slot = crf1dm_find_slot(model, h);
+            if (slot == NULL) {
+                fps[j] = 1;     /* Rejected by the filter. */
+                continue;
+            }
+            read_uint32(slot, &fps[j]);
+            read_uint32(slot + sizeof(uint32_t), &records[j]);
+            fps[j] ^= (uint32_t)h;
+        }
+        for (j = 0;j < m;++j) {
+            aids[i+j] = (fps[j] == 0) ? crf1dm_check_record(model, values[i+j], lens[j], records[j]) : -1;
+        }
+    }
+    return 0;
+}
+
+int crf1dm_hash_to_aids(crf1dm_t* model, const crfsuite_hash_t *hashes, int n, int *aids)
+{
+    int i;
+    const uint32_t bits = model->header->attr_hash_bits;
+
+    if (bits == 0) {
+        return CRFSUITEERR_NOTSUPPORTED;
+    }
+    for (i = 0;i < n;++i) {
+        aids[i] = CRFSUITE_HASH_TO_ID(hashes[i], bits);
     }
+    return 0;
 }
 
 const char *crf1dm_to_attr(crf1dm_t* model, int aid)
@@ -871,12 +1726,27 @@ const char *crf1dm_to_attr(crf1dm_t* model, int aid)
     }
 }
 
+static void crf1dm_get_ref_v2(crf1dm_t* model, uint64_t off_index, uint64_t off_fids, int width, int i, feature_refs_t* ref)
+{
+    const uint8_t *p = model->buffer + off_index;
+    uint32_t begin = read_uint_element(p, width, (uint32_t)i);
+    uint32_t end = read_uint_element(p, width, (uint32_t)i + 1);
+    ref->num_features = (int)(end - begin);
+    ref->fids = (int*)(model->buffer + off_fids + (size_t)width * begin);
+    ref->width = width;
+}
+
 int crf1dm_get_labelref(crf1dm_t* model, int lid, feature_refs_t* ref)
 {
     const uint8_t *p = model->buffer;
     uint32_t offset;
     uint32_t num_features;
 
+    if (VERSION_NUMBER_V2 <= model->header->version) {
+        crf1dm_get_ref_v2(model, model->header->off_labelrefs, model->header->off_labelfids, model->header->widths[3], lid, ref);
+        return 0;
+    }
+
     p += model->header->off_labelrefs;
     p += CHUNK_SIZE;
     p += sizeof(uint32_t) * lid;
@@ -886,6 +1756,7 @@ int crf1dm_get_labelref(crf1dm_t* model, int lid, feature_refs_t* ref)
     p += read_uint32(p, &num_features);
     ref->num_features = num_features;
     ref->fids = (int*)p;
+    ref->width = sizeof(uint32_t);
     return 0;
 }
 
@@ -895,6 +1766,11 @@ int crf1dm_get_attrref(crf1dm_t* model, int aid, feature_refs_t* ref)
     uint32_t offset;
     uint32_t num_features;
 
+    if (VERSION_NUMBER_V2 <= model->header->version) {
+        crf1dm_get_ref_v2(model, model->header->off_attrrefs, model->header->off_attrfids, model->header->widths[4], aid, ref);
+        return 0;
+    }
+
     p += model->header->off_attrrefs;
     p += CHUNK_SIZE;
     p += sizeof(uint32_t) * aid;
@@ -904,24 +1780,42 @@ int crf1dm_get_attrref(crf1dm_t* model, int aid, feature_refs_t* ref)
     p += read_uint32(p, &num_features);
     ref->num_features = num_features;
     ref->fids = (int*)p;
+    ref->width = sizeof(uint32_t);
     return 0;
 }
 
 int crf1dm_get_featureid(feature_refs_t* ref, int i)
 {
-    uint32_t fid;
-    uint8_t* p = (uint8_t*)ref->fids;
-    p += sizeof(uint32_t) * i;
-    read_uint32(p, &fid);
-    return (int)fid;
+    return (int)read_uint_element((const uint8_t*)ref->fids, ref->width, (uint32_t)i);
 }
 
 int crf1dm_get_feature(crf1dm_t* model, int fid, crf1dm_feature_t* f)
 {
     const uint8_t *p = NULL;
     uint32_t val = 0;
-    uint32_t offset = model->header->off_features + CHUNK_SIZE;
-    offset += FEATURE_SIZE * fid;
+    const header_t* header = model->header;
+    uint64_t offset = header->off_features + CHUNK_SIZE;
+
+    if (VERSION_NUMBER_V2 <= header->version) {
+        f->type = read_uint_element(model->buffer + header->off_types, header->widths[0], fid);
+        f->src = read_uint_element(model->buffer + header->off_srcs, header->widths[1], fid);
+        f->dst = read_uint_element(model->buffer + header->off_dsts, header->widths[2], fid);
+        switch (header->weight_type) {
+        case WT_FLOAT64:
+            read_float(model->buffer + header->off_weights + sizeof(floatval_t) * fid, &f->weight);
+            break;
+        case WT_FLOAT16:
+            read_half(model->buffer + header->off_weights + sizeof(uint16_t) * fid, &f->weight);
+            break;
+        case WT_INT8:
+            read_float(model->buffer + header->off_scales + sizeof(floatval_t) * ((uint64_t)f->type * header->scale_stride + f->dst), &f->weight);
+            f->weight *= (int8_t)model->buffer[header->off_weights + fid];
+            break;
+        }
+        return 0;
+    }
+
+    offset += FEATURE_SIZE * (uint64_t)fid;
     p = model->buffer + offset;
     p += read_uint32(p, &val);
     f->type = val;
@@ -933,6 +1827,148 @@ int crf1dm_get_feature(crf1dm_t* model, int fid, crf1dm_feature_t* f)
     return 0;
 }
 
+int crf1dm_get_weight_type(crf1dm_t* model)
+{
+    return (int)model->header->weight_type;
+}
+
+int crf1dm_get_state_scales(crf1dm_t* model, floatval_t *scales)
+{
+    int l;
+    const header_t* header = model->header;
+    const int L = crf1dm_get_num_labels(model);
+
+    if (header->weight_type != WT_INT8) {
+        return CRFSUITEERR_INTERNAL_LOGIC;
+    }
+
+    /* No state feature outputs a label beyond the stride. */
+    for (l = 0;l < L;++l) {
+        scales[l] = 0.;
+        if ((uint32_t)l < header->scale_stride) {
+            read_float(model->buffer + header->off_scales + sizeof(floatval_t) * ((uint64_t)FT_STATE * header->scale_stride + l), &scales[l]);
+        }
+    }
+    return 0;
+}
+
+/*
+ * Read the destination label and the encoded weight of a feature of a
+ * quantized model: the bits of a WT_FLOAT16 weight, or a WT_INT8 weight,
+ * which the scale factor of its type and destination multiplies.
+ */
+int crf1dm_get_fp16_feature(crf1dm_t* model, int fid, int *dst)
+{
+    const header_t* header = model->header;
+    const uint8_t *p = model->buffer + header->off_weights + sizeof(uint16_t) * fid;
+    *dst = (int)read_uint_element(model->buffer + header->off_dsts, header->widths[2], fid);
+    return p[0] | (p[1] << 8);
+}
+
+int crf1dm_get_int8_feature(crf1dm_t* model, int fid, int *dst)
+{
+    const header_t* header = model->header;
+    *dst = (int)read_uint_element(model->buffer + header->off_dsts, header->widths[2], fid);
+    return (int8_t)model->buffer[header->off_weights + fid];
+}
+
+static int crf1dm_copy_ref(crf1dmw_t* writer, int i, feature_refs_t* ref, int *fids, int *map, int (*put)(crf1dmw_t*, int, const feature_refs_t*, int*))
+{
+    int j;
+
+    /* Decode the feature ids, which are stored in little endian. */
+    for (j = 0;j < ref->num_features;++j) {
+        fids[j] = crf1dm_get_featureid(ref, j);
+    }
+    ref->fids = fids;
+    return put(writer, i, ref, map);
+}
+
+int crf1dm_quantize(crf1dm_t* model, const char *filename, int weight_type)
+{
+    int i, ret = 0;
+    int *map = NULL, *fids = NULL;
+    crf1dmw_t* writer = NULL;
+    feature_refs_t ref;
+    crf1dm_feature_t f;
+    const header_t* header = model->header;
+    const int K = (int)header->num_features;
+    const int L = (int)header->num_labels;
+    const int A = (int)header->num_attrs;
+
+    if (weight_type != WT_FLOAT64 && weight_type != WT_FLOAT16 && weight_type != WT_INT8) {
+        return CRFSUITEERR_INCOMPATIBLE;
+    }
+
+    /* The feature ids are kept as they are. */
+    map = (int*)malloc(sizeof(int) * (K + 1));
+    fids = (int*)malloc(sizeof(int) * (K + 1));
+    if (map == NULL || fids == NULL) {
+        ret = CRFSUITEERR_OUTOFMEMORY;
+        goto error_exit;
+    }
+    for (i = 0;i < K;++i) map[i] = i;
+
+    writer = crf1mmw(filename);
+    if (writer == NULL) {
+        ret = CRFSUITEERR_INCOMPATIBLE;
+        goto error_exit;
+    }
+    writer->weight_type = weight_type;
+
+    /* Copy the features. */
+    if (ret = crf1dmw_open_features(writer)) goto error_exit;
+    for (i = 0;i < K;++i) {
+        crf1dm_get_feature(model, i, &f);
+        if (ret = crf1dmw_put_feature(writer, i, &f)) goto error_exit;
+    }
+    if (ret = crf1dmw_close_features(writer)) goto error_exit;
+
+    /* Copy the labels and attributes. */
+    if (ret = crf1dmw_open_labels(writer, L)) goto error_exit;
+    for (i = 0;i < L;++i) {
+        if (ret = crf1dmw_put_label(writer, i, crf1dm_to_label(model, i))) goto error_exit;
+    }
+    if (ret = crf1dmw_close_labels(writer)) goto error_exit;
+
+    if (header->attr_hash_bits != 0) {
+        if (ret = crf1dmw_hash_attrs(writer, (int)header->attr_hash_bits)) goto error_exit;
+    } else {
+        if (ret = crf1dmw_open_attrs(writer, A)) goto error_exit;
+        for (i = 0;i < A;++i) {
+            if (ret = crf1dmw_put_attr(writer, i, crf1dm_to_attr(model, i))) goto error_exit;
+        }
+        if (ret = crf1dmw_close_attrs(writer)) goto error_exit;
+    }
+
+    /* Copy the feature references. */
+    if (ret = crf1dmw_open_labelrefs(writer, L)) goto error_exit;
+    for (i = 0;i < L;++i) {
+        crf1dm_get_labelref(model, i, &ref);
+        if (ret = crf1dm_copy_ref(writer, i, &ref, fids, map, crf1dmw_put_labelref)) goto error_exit;
+    }
+    if (ret = crf1dmw_close_labelrefs(writer)) goto error_exit;
+
+    if (ret = crf1dmw_open_attrrefs(writer, A)) goto error_exit;
+    for (i = 0;i < A;++i) {
+        crf1dm_get_attrref(model, i, &ref);
+        if (ret = crf1dm_copy_ref(writer, i, &ref, fids, map, crf1dmw_put_attrref)) goto error_exit;
+    }
+    if (ret = crf1dmw_close_attrrefs(writer)) goto error_exit;
+
+    free(fids);
+    free(map);
+    return crf1dmw_close(writer) ? CRFSUITEERR_INCOMPATIBLE : 0;
+
+error_exit:
+    if (writer != NULL) {
+        crf1dmw_close(writer);
+    }
+    free(fids);
+    free(map);
+    return ret;
+}
+
 void crf1dm_dump(crf1dm_t* crf1dm, FILE *fp)
 {
     int j;
@@ -944,18 +1980,47 @@ void crf1dm_dump(crf1dm_t* crf1dm, FILE *fp)
     fprintf(fp, "FILEHEADER = {\n");
     fprintf(fp, "  magic: %c%c%c%c\n",
         hfile->magic[0], hfile->magic[1], hfile->magic[2], hfile->magic[3]);
-    fprintf(fp, "  size: %" PRIu32 "\n", hfile->size);
+    fprintf(fp, "  size: %" PRIu64 "\n", hfile->size);
     fprintf(fp, "  type: %c%c%c%c\n",
         hfile->type[0], hfile->type[1], hfile->type[2], hfile->type[3]);
     fprintf(fp, "  version: %" PRIu32 "\n", hfile->version);
     fprintf(fp, "  num_features: %" PRIu32 "\n", hfile->num_features);
     fprintf(fp, "  num_labels: %" PRIu32 "\n", hfile->num_labels);
     fprintf(fp, "  num_attrs: %" PRIu32 "\n", hfile->num_attrs);
-    fprintf(fp, "  off_features: 0x%" PRIX32 "\n", hfile->off_features);
-    fprintf(fp, "  off_labels: 0x%" PRIX32 "\n", hfile->off_labels);
-    fprintf(fp, "  off_attrs: 0x%" PRIX32 "\n", hfile->off_attrs);
-    fprintf(fp, "  off_labelrefs: 0x%" PRIX32 "\n", hfile->off_labelrefs);
-    fprintf(fp, "  off_attrrefs: 0x%" PRIX32 "\n", hfile->off_attrrefs);
+    if (VERSION_NUMBER_V2 <= hfile->version) {
+        fprintf(fp, "  byteorder: 0x%" PRIX32 "\n", hfile->byteorder);
+        fprintf(fp, "  off_labels: 0x%" PRIX64 "\n", hfile->off_labels);
+        fprintf(fp, "  off_attrs: 0x%" PRIX64 "\n", hfile->off_attrs);
+        fprintf(fp, "  off_types: 0x%" PRIX64 "\n", hfile->off_types);
+        fprintf(fp, "  off_srcs: 0x%" PRIX64 "\n", hfile->off_srcs);
+        fprintf(fp, "  off_dsts: 0x%" PRIX64 "\n", hfile->off_dsts);
+        fprintf(fp, "  widths: %d, %d, %d, %d, %d\n",
+            hfile->widths[0], hfile->widths[1], hfile->widths[2], hfile->widths[3], hfile->widths[4]);
+        fprintf(fp, "  off_weights: 0x%" PRIX64 "\n", hfile->off_weights);
+        fprintf(fp, "  off_labelrefs: 0x%" PRIX64 "\n", hfile->off_labelrefs);
+        fprintf(fp, "  off_labelfids: 0x%" PRIX64 "\n", hfile->off_labelfids);
+        fprintf(fp, "  off_attrrefs: 0x%" PRIX64 "\n", hfile->off_attrrefs);
+        fprintf(fp, "  off_attrfids: 0x%" PRIX64 "\n", hfile->off_attrfids);
+        fprintf(fp, "  weight_type: %" PRIu32 "\n", hfile->weight_type);
+        if (hfile->weight_type == WT_INT8) {
+            fprintf(fp, "  scale_stride: %" PRIu32 "\n", hfile->scale_stride);
+            fprintf(fp, "  off_scales: 0x%" PRIX64 "\n", hfile->off_scales);
+        }
+        if (hfile->off_attrslots != 0) {
+            fprintf(fp, "  num_attrbuckets: %" PRIu32 "\n", hfile->num_attrbuckets);
+            fprintf(fp, "  off_attrbuckets: 0x%" PRIX64 "\n", hfile->off_attrbuckets);
+            fprintf(fp, "  off_attrslots: 0x%" PRIX64 "\n", hfile->off_attrslots);
+        }
+        if (hfile->attr_hash_bits != 0) {
+            fprintf(fp, "  attr_hash_bits: %" PRIu32 "\n", hfile->attr_hash_bits);
+        }
+    } else {
+        fprintf(fp, "  off_features: 0x%" PRIX64 "\n", hfile->off_features);
+        fprintf(fp, "  off_labels: 0x%" PRIX64 "\n", hfile->off_labels);
+        fprintf(fp, "  off_attrs: 0x%" PRIX64 "\n", hfile->off_attrs);
+        fprintf(fp, "  off_labelrefs: 0x%" PRIX64 "\n", hfile->off_labelrefs);
+        fprintf(fp, "  off_attrrefs: 0x%" PRIX64 "\n", hfile->off_attrrefs);
+    }
     fprintf(fp, "}\n");
     fprintf(fp, "\n");
 
@@ -974,9 +2039,9 @@ void crf1dm_dump(crf1dm_t* crf1dm, FILE *fp)
     fprintf(fp, "}\n");
     fprintf(fp, "\n");
 
-    /* Dump the attributes. */
+    /* Dump the attributes (a model of feature hashing has no string). */
     fprintf(fp, "ATTRIBUTES = {\n");
-    for (i = 0;i < hfile->num_attrs;++i) {
+    for (i = 0;i < hfile->num_attrs && hfile->attr_hash_bits == 0;++i) {
         const char *str = crf1dm_to_attr(crf1dm, i);
 #if 0
         int check = crf1dm_to_aid(crf1dm, str);
@@ -1024,7 +2089,11 @@ void crf1dm_dump(crf1dm_t* crf1dm, FILE *fp)
 #endif
             attr = crf1dm_to_attr(crf1dm, f.src);
             to = crf1dm_to_label(crf1dm, f.dst);
-            fprintf(fp, "  (%d) %s --> %s: %f\n", f.type, attr, to, f.weight);
+            if (attr != NULL) {
+                fprintf(fp, "  (%d) %s --> %s: %f\n", f.type, attr, to, f.weight);
+            } else {
+                fprintf(fp, "  (%d) #%d --> %s: %f\n", f.type, f.src, to, f.weight);
+            }
         }
     }
     fprintf(fp, "}\n");
@@ -36,6 +36,7 @@
 
 #include <os.h>
 
+#include <float.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -44,6 +45,8 @@
 #include <crfsuite.h>
 
 #include "crf1d.h"
+#include "parallel.h"
+#include "vecmath.h"
 
 enum {
     LEVEL_NONE = 0,
@@ -51,40 +54,231 @@ enum {
     LEVEL_ALPHABETA,
 };
 
+/**
+ * Compiled model.
+ *  This object holds the data that taggers derive from the model, i.e.,
+ *  the transition scores, their exponents, and the transposed matrix for
+ *  the Viterbi algorithm. It is immutable after crf1dt_compile(), and
+ *  taggers of different threads read it at the same time.
+ */
 typedef struct {
+    crf1dm_t *model;        /**< CRF model. */
+    crf1d_context_t *ctx;   /**< CRF context holding the transition matrices. */
+    crf1d_context_float_t *fctx;    /**< Transition matrices in single precision. */
+    int num_labels;         /**< Number of distinct output labels (L). */
+    int num_attributes;     /**< Number of distinct attributes (A). */
+
+    /**
+     * Encoding of the state weights.
+     *  The weights of a quantized model are kept in their encoding: the
+     *  bits of 16-bit floating-point values (uint16_t) or 8-bit integers
+     *  (int8_t), which state_scales[l] multiplies for the label #l.
+     */
+    int weight_type;            /**< 0 or CRFSUITE_QUANTIZE_*. */
+    floatval_t *state_scales;   /**< [L] with CRFSUITE_QUANTIZE_INT8, or NULL. */
+
+    /**
+     * Decoded state features (with CRFSUITE_LOAD_DECODE).
+     *  The state features of the attribute #a are stored in the elements
+     *  [attr_offsets[a], attr_offsets[a+1]) of attr_labels and attr_weights.
+     *  These are NULL if the state features are read from the model.
+     */
+    int *attr_offsets;          /**< [A+1] */
+    int *attr_labels;           /**< Destination labels of the state features. */
+    void *attr_weights;         /**< Weights of the state features. */
+
+    /**
+     * Dense rows of state weights (with CRFSUITE_LOAD_DENSE).
+     *  The weights of the attribute #a are stored in the row #attr_rows[a]
+     *  of dense_weights if attr_rows[a] is not negative; the run of the
+     *  attribute is empty in this case. A row holds the weights of the L
+     *  labels (zero for missing features), padded to 64 bytes. These are
+     *  NULL without dense rows.
+     */
+    int *attr_rows;             /**< [A] */
+    void *dense_weights;        /**< Rows of weights. */
+    int dense_stride;           /**< Number of elements in a row. */
+} crf1dt_compiled_t;
+
+/**
+ * Tagger (decode session).
+ *  A tagger owns the scratch buffers for an instance and reads the
+ *  transition matrices of the compiled model.
+ */
+typedef struct tag_crf1dt {
+    const crf1dt_compiled_t *compiled;  /**< Compiled model. */
     crf1dm_t *model;        /**< CRF model. */
     crf1d_context_t *ctx;   /**< CRF context. */
+    crf1d_batch_context_t *bc;  /**< Batch context (created by viterbi_batch()). */
+
+    /**
+     * Single-precision context (with CRFSUITE_TAGGER_FLOAT).
+     *  This context has the state scores of an instance rounded for the
+     *  Viterbi algorithm; the CRF context keeps them in double precision
+     *  for the other algorithms.
+     */
+    crf1d_context_float_t *fctx;
+
     int num_labels;         /**< Number of distinct output labels (L). */
     int num_attributes;     /**< Number of distinct attributes (A). */
     int level;
+    int flags;              /**< Options of the tagger (CRFSUITE_TAGGER_*). */
+
+    /**
+     * Constraints on the instance (set_constraints()).
+     *  The CRF context reads the transition matrices of the context masked,
+     *  in which the forbidden transitions are disabled, instead of those
+     *  of the compiled model. A constrained instance is decoded in double
+     *  precision even with CRFSUITE_TAGGER_FLOAT.
+     */
+    crf1d_context_t *masked;
+    int constrained;
+
+    /**
+     * Work areas of the threads of tag_batch() but the calling thread.
+     *  The threads are kept in the pool between the calls.
+     */
+    struct tag_crf1dt **workers;
+    int num_workers;
+    parallel_pool_t *pool;
+
+    /**
+     * Instance of a batch (tag_batch()).
+     *  The attributes of the instance are copied from the batch to the
+     *  array contents, which the items of this instance point to.
+     */
+    crfsuite_instance_t view;
+    crfsuite_attribute_t *contents;
+    int cap_contents;
 } crf1dt_t;
 
-static void crf1dt_state_score(crf1dt_t *crf1dt, const crfsuite_instance_t *inst)
+/**
+ * An instance in the processing order of viterbi_batch().
+ */
+typedef struct {
+    int num_items;
+    int i;
+} crf1dt_order_t;
+
+/* Size of a weight in the encoding of a compiled model. */
+static size_t crf1dt_weight_size(int weight_type)
+{
+    switch (weight_type) {
+    case CRFSUITE_QUANTIZE_FP16:
+        return sizeof(uint16_t);
+    case CRFSUITE_QUANTIZE_INT8:
+        return sizeof(int8_t);
+    default:
+        return sizeof(floatval_t);
+    }
+}
+
+static void crf1dt_item_score_decoded(crf1dt_t *crf1dt, const crfsuite_item_t *item, floatval_t *state)
+{
+    int a, i, r, n, o, row;
+    const int *labels = NULL;
+    const floatval_t *weights = NULL;
+    const uint16_t *hweights = NULL;
+    const int8_t *bweights = NULL;
+    floatval_t value;
+    const crf1dt_compiled_t* compiled = crf1dt->compiled;
+    const floatval_t *scales = compiled->state_scales;
+    const int L = crf1dt->num_labels;
+    const int S = compiled->dense_stride;
+
+    /* Loop over the contents (attributes) attached to the item. */
+    for (i = 0;i < item->num_contents;++i) {
+        a = item->contents[i].aid;
+        /* A scale usually represents the atrribute frequency in the item. */
+        value = item->contents[i].value;
+
+        /* Add the dense row of weights associated with the attribute. */
+        row = (compiled->attr_rows != NULL) ? compiled->attr_rows[a] : -1;
+        if (0 <= row) {
+            switch (compiled->weight_type) {
+            case CRFSUITE_QUANTIZE_FP16:
+                vecaaddhalf(state, value, (const uint16_t*)compiled->dense_weights + (size_t)row * S, L);
+                break;
+            case CRFSUITE_QUANTIZE_INT8:
+                vecaaddint8(state, value, scales, (const int8_t*)compiled->dense_weights + (size_t)row * S, L);
+                break;
+            default:
+                vecaadd(state, value, (const floatval_t*)compiled->dense_weights + (size_t)row * S, L);
+                break;
+            }
+            continue;
+        }
+
+        /* Access the run of state features associated with the attribute. */
+        o = compiled->attr_offsets[a];
+        labels = &compiled->attr_labels[o];
+        n = compiled->attr_offsets[a+1] - o;
+
+        /* Loop over the state features associated with the attribute. */
+        switch (compiled->weight_type) {
+        case CRFSUITE_QUANTIZE_FP16:
+            hweights = (const uint16_t*)compiled->attr_weights + o;
+            for (r = 0;r < n;++r) {
+                state[labels[r]] += vechalf(hweights[r]) * value;
+            }
+            break;
+        case CRFSUITE_QUANTIZE_INT8:
+            bweights = (const int8_t*)compiled->attr_weights + o;
+            for (r = 0;r < n;++r) {
+                state[labels[r]] += bweights[r] * scales[labels[r]] * value;
+            }
+            break;
+        default:
+            weights = (const floatval_t*)compiled->attr_weights + o;
+            for (r = 0;r < n;++r) {
+                state[labels[r]] += weights[r] * value;
+            }
+            break;
+        }
+    }
+}
+
+/* Add the state scores of an item to state[L]. */
+static void crf1dt_item_score(crf1dt_t *crf1dt, const crfsuite_item_t *item, floatval_t *state)
 {
-    int a, i, l, t, r, fid;
+    int a, i, l, q, r, fid;
     crf1dm_feature_t f;
     feature_refs_t attr;
-    floatval_t value, *state = NULL;
+    floatval_t value;
     crf1dm_t* model = crf1dt->model;
-    crf1d_context_t* ctx = crf1dt->ctx;
-    const crfsuite_item_t* item = NULL;
-    const int T = inst->num_items;
-    const int L = crf1dt->num_labels;
+    const floatval_t *scales = crf1dt->compiled->state_scales;
 
-    /* Loop over the items in the sequence. */
-    for (t = 0;t < T;++t) {
-        item = &inst->items[t];
-        state = STATE_SCORE(ctx, t);
-
-        /* Loop over the contents (attributes) attached to the item. */
-        for (i = 0;i < item->num_contents;++i) {
-            /* Access the list of state features associated with the attribute. */
-            a = item->contents[i].aid;
-            crf1dm_get_attrref(model, a, &attr);
-            /* A scale usually represents the atrribute frequency in the item. */
-            value = item->contents[i].value;
+    /* Use the decoded state features if available. */
+    if (crf1dt->compiled->attr_offsets != NULL) {
+        crf1dt_item_score_decoded(crf1dt, item, state);
+        return;
+    }
 
-            /* Loop over the state features associated with the attribute. */
+    /* Loop over the contents (attributes) attached to the item. */
+    for (i = 0;i < item->num_contents;++i) {
+        /* Access the list of state features associated with the attribute. */
+        a = item->contents[i].aid;
+        crf1dm_get_attrref(model, a, &attr);
+        /* A scale usually represents the atrribute frequency in the item. */
+        value = item->contents[i].value;
+
+        /* Loop over the state features associated with the attribute. */
+        switch (crf1dt->compiled->weight_type) {
+        case CRFSUITE_QUANTIZE_FP16:
+            for (r = 0;r < attr.num_features;++r) {
+                fid = crf1dm_get_featureid(&attr, r);
+                q = crf1dm_get_fp16_feature(model, fid, &l);
+                state[l] += vechalf((uint16_t)q) * value;
+            }
+            break;
+        case CRFSUITE_QUANTIZE_INT8:
+            for (r = 0;r < attr.num_features;++r) {
+                fid = crf1dm_get_featureid(&attr, r);
+                q = crf1dm_get_int8_feature(model, fid, &l);
+                state[l] += q * scales[l] * value;
+            }
+            break;
+        default:
             for (r = 0;r < attr.num_features;++r) {
                 /* The state feature #(attr->fids[r]), which is represented by
                    the attribute #a, outputs the label #(f->dst). */
@@ -93,19 +287,57 @@ static void crf1dt_state_score(crf1dt_t *crf1dt, const crfsuite_instance_t *inst
                 l = f.dst;
                 state[l] += f.weight * value;
             }
+            break;
         }
     }
 }
 
-static void crf1dt_transition_score(crf1dt_t* crf1dt)
+static void crf1dt_state_score(crf1dt_t *crf1dt, const crfsuite_instance_t *inst)
+{
+    int t;
+    crf1d_context_t* ctx = crf1dt->ctx;
+
+    /* Loop over the items in the sequence. */
+    for (t = 0;t < inst->num_items;++t) {
+        crf1dt_item_score(crf1dt, &inst->items[t], STATE_SCORE(ctx, t));
+    }
+}
+
+static void crf1dt_state_score_float(crf1dt_t *crf1dt, const crfsuite_instance_t *inst)
+{
+    int l, t;
+    float *state = NULL;
+    floatval_t *row = NULL;
+    crf1d_context_t* ctx = crf1dt->ctx;
+    crf1d_context_float_t* fctx = crf1dt->fctx;
+    const int L = crf1dt->num_labels;
+
+    /*
+        Accumulate the scores of an item in double, and round them for the
+        Viterbi algorithm. The scores in double are kept in the CRF context
+        for the algorithms that run in double precision (forward-backward,
+        the k-best Viterbi, and the constrained Viterbi).
+     */
+    for (t = 0;t < inst->num_items;++t) {
+        row = STATE_SCORE(ctx, t);
+        veczero(row, L);
+        crf1dt_item_score(crf1dt, &inst->items[t], row);
+        state = &fctx->state[L * t];
+        for (l = 0;l < L;++l) {
+            state[l] = (float)row[l];
+        }
+    }
+}
+
+static void crf1dt_transition_score(crf1dt_compiled_t* compiled)
 {
     int i, r, fid;
     crf1dm_feature_t f;
     feature_refs_t edge;
     floatval_t *trans = NULL;
-    crf1dm_t* model = crf1dt->model;
-    crf1d_context_t* ctx = crf1dt->ctx;
-    const int L = crf1dt->num_labels;
+    crf1dm_t* model = compiled->model;
+    crf1d_context_t* ctx = compiled->ctx;
+    const int L = compiled->num_labels;
 
     /* Compute transition scores between two labels. */
     for (i = 0;i < L;++i) {
@@ -120,11 +352,17 @@ static void crf1dt_transition_score(crf1dt_t* crf1dt)
     }
 }
 
-static void crf1dt_set_level(crf1dt_t *crf1dt, int level)
+static int crf1dt_set_level(crf1dt_t *crf1dt, int level)
 {
+    int ret = 0;
     int prev = crf1dt->level;
     crf1d_context_t* ctx = crf1dt->ctx;
 
+    /* A Viterbi-only tagger cannot compute marginals. */
+    if (!(ctx->flag & CTXF_MARGINALS)) {
+        return CRFSUITEERR_NOTSUPPORTED;
+    }
+
     if (level <= LEVEL_ALPHABETA && prev < LEVEL_ALPHABETA) {
         crf1dc_exp_state(ctx);
         crf1dc_alpha_score(ctx);
@@ -132,11 +370,203 @@ static void crf1dt_set_level(crf1dt_t *crf1dt, int level)
     }
 
     crf1dt->level = level;
+
+    /* When the constraints leave no label sequence, the forward algorithm
+       ends with a row of zeros (the scale factors fall back to one), and
+       there is no distribution to condition on. */
+    if (crf1dt->constrained && 0 < ctx->num_items &&
+        vecsum(ALPHA_SCORE(ctx, ctx->num_items-1), ctx->num_labels) <= 0.) {
+        return CRFSUITEERR_INCOMPATIBLE;
+    }
+    return ret;
+}
+
+/*
+ * Read the destination label and the weight of a state feature, keeping
+ * the weight in the encoding of the compiled model, and store the weight
+ * at weights[i].
+ */
+static int crf1dt_put_weight(const crf1dt_compiled_t* compiled, int fid, void *weights, int i)
+{
+    int dst;
+    crf1dm_feature_t f;
+
+    switch (compiled->weight_type) {
+    case CRFSUITE_QUANTIZE_FP16:
+        ((uint16_t*)weights)[i] = (uint16_t)crf1dm_get_fp16_feature(compiled->model, fid, &dst);
+        return dst;
+    case CRFSUITE_QUANTIZE_INT8:
+        ((int8_t*)weights)[i] = (int8_t)crf1dm_get_int8_feature(compiled->model, fid, &dst);
+        return dst;
+    default:
+        crf1dm_get_feature(compiled->model, fid, &f);
+        ((floatval_t*)weights)[i] = f.weight;
+        return f.dst;
+    }
+}
+
+static int crf1dt_decode_state_features(crf1dt_compiled_t* compiled, int dense)
+{
+    int a, l, r, n = 0, num_rows = 0;
+    feature_refs_t attr;
+    crf1dm_t* model = compiled->model;
+    const int A = compiled->num_attributes;
+    const int L = compiled->num_labels;
+    const size_t size = crf1dt_weight_size(compiled->weight_type);
+
+    /* Choose the attributes whose weights are stored in dense rows. */
+    if (dense && L <= CRF1D_DENSE_MAX_LABELS) {
+        compiled->attr_rows = (int*)malloc(sizeof(int) * (A+1));
+        if (compiled->attr_rows == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        for (a = 0;a < A;++a) {
+            crf1dm_get_attrref(model, a, &attr);
+            compiled->attr_rows[a] = (L <= 4 * attr.num_features) ? num_rows++ : -1;
+        }
+
+        /* Allocate the rows aligned to 64 bytes. */
+        compiled->dense_stride = (int)((L * size + 63) / 64 * 64 / size);
+        compiled->dense_weights = _aligned_malloc(
+            size * compiled->dense_stride * (num_rows+1), 64);
+        if (compiled->dense_weights == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        memset(compiled->dense_weights, 0, size * compiled->dense_stride * (num_rows+1));
+    }
+
+    /* Count the state features that are not in dense rows. */
+    compiled->attr_offsets = (int*)malloc(sizeof(int) * (A+1));
+    if (compiled->attr_offsets == NULL) {
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+    for (a = 0;a < A;++a) {
+        crf1dm_get_attrref(model, a, &attr);
+        compiled->attr_offsets[a] = n;
+        if (compiled->attr_rows == NULL || compiled->attr_rows[a] < 0) {
+            n += attr.num_features;
+        }
+    }
+    compiled->attr_offsets[A] = n;
+
+    /* Decode the destination labels and weights of the state features. */
+    compiled->attr_labels = (int*)malloc(sizeof(int) * (n+1));
+    compiled->attr_weights = malloc(size * (n+1));
+    if (compiled->attr_labels == NULL || compiled->attr_weights == NULL) {
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+    for (a = 0;a < A;++a) {
+        const int o = compiled->attr_offsets[a];
+        crf1dm_get_attrref(model, a, &attr);
+        if (compiled->attr_rows != NULL && 0 <= compiled->attr_rows[a]) {
+            /* Move a weight from the spare element #n to its label in the row. */
+            char *row = (char*)compiled->dense_weights + size * compiled->dense_stride * compiled->attr_rows[a];
+            for (r = 0;r < attr.num_features;++r) {
+                l = crf1dt_put_weight(compiled, crf1dm_get_featureid(&attr, r), compiled->attr_weights, n);
+                memcpy(row + size * l, (char*)compiled->attr_weights + size * n, size);
+            }
+            continue;
+        }
+        for (r = 0;r < attr.num_features;++r) {
+            compiled->attr_labels[o+r] = crf1dt_put_weight(compiled, crf1dm_get_featureid(&attr, r), compiled->attr_weights, o+r);
+        }
+    }
+
+    return 0;
+}
+
+static void crf1dt_compiled_delete(crf1dt_compiled_t* compiled)
+{
+    /* Note: we don't own the model object (compiled->model). */
+    free(compiled->attr_weights);
+    free(compiled->attr_labels);
+    free(compiled->attr_offsets);
+    if (compiled->dense_weights != NULL) {
+        _aligned_free(compiled->dense_weights);
+    }
+    free(compiled->attr_rows);
+    free(compiled->state_scales);
+    crf1dcf_delete(compiled->fctx);
+    if (compiled->ctx != NULL) {
+        crf1dc_delete(compiled->ctx);
+        compiled->ctx = NULL;
+    }
+    free(compiled);
+}
+
+static crf1dt_compiled_t *crf1dt_compile(crf1dm_t* crf1dm, int flags)
+{
+    crf1dt_compiled_t* compiled = NULL;
+
+    compiled = (crf1dt_compiled_t*)calloc(1, sizeof(crf1dt_compiled_t));
+    if (compiled != NULL) {
+        compiled->num_labels = crf1dm_get_num_labels(crf1dm);
+        compiled->num_attributes = crf1dm_get_num_attrs(crf1dm);
+        compiled->model = crf1dm;
+        compiled->weight_type = crf1dm_get_weight_type(crf1dm);
+        compiled->ctx = crf1dc_new(CTXF_VITERBI | CTXF_MARGINALS, compiled->num_labels, 0);
+        if (compiled->ctx == NULL) {
+            crf1dt_compiled_delete(compiled);
+            return NULL;
+        }
+
+        /* Compute the transition matrices once for all taggers. */
+        crf1dc_reset(compiled->ctx, RF_TRANS);
+        crf1dt_transition_score(compiled);
+        crf1dc_exp_transition(compiled->ctx);
+        crf1dc_transpose_transition(compiled->ctx);
+
+        /* Round the transition scores for single-precision taggers. */
+        compiled->fctx = crf1dcf_new(CTXF_VITERBI, compiled->num_labels, 0);
+        if (compiled->fctx == NULL) {
+            crf1dt_compiled_delete(compiled);
+            return NULL;
+        }
+        crf1dcf_set_transition(compiled->fctx, compiled->ctx);
+
+        /* Read the scale factors of int8 state weights. */
+        if (compiled->weight_type == CRFSUITE_QUANTIZE_INT8) {
+            compiled->state_scales = (floatval_t*)malloc(sizeof(floatval_t) * compiled->num_labels);
+            if (compiled->state_scales == NULL ||
+                crf1dm_get_state_scales(crf1dm, compiled->state_scales) != 0) {
+                crf1dt_compiled_delete(compiled);
+                return NULL;
+            }
+        }
+
+        /* Decode the state features if requested. */
+        if (flags & (CRFSUITE_LOAD_DECODE | CRFSUITE_LOAD_DENSE)) {
+            if (crf1dt_decode_state_features(compiled, flags & CRFSUITE_LOAD_DENSE) != 0) {
+                crf1dt_compiled_delete(compiled);
+                return NULL;
+            }
+        }
+    }
+
+    return compiled;
 }
 
 static void crf1dt_delete(crf1dt_t* crf1dt)
 {
-    /* Note: we don't own the model object (crf1t->model). */
+    int i;
+
+    /* Note: we don't own the compiled model (crf1dt->compiled). */
+    parallel_pool_delete(crf1dt->pool);
+    crf1dt->pool = NULL;
+    for (i = 0;i < crf1dt->num_workers;++i) {
+        crf1dt_delete(crf1dt->workers[i]);
+    }
+    free(crf1dt->workers);
+    free(crf1dt->view.items);
+    free(crf1dt->contents);
+    crf1dbc_delete(crf1dt->bc);
+    crf1dt->bc = NULL;
+    if (crf1dt->masked != NULL) {
+        crf1dc_delete(crf1dt->masked);
+        crf1dt->masked = NULL;
+    }
+    crf1dcf_delete(crf1dt->fctx);
+    crf1dt->fctx = NULL;
     if (crf1dt->ctx != NULL) {
         crf1dc_delete(crf1dt->ctx);
         crf1dt->ctx = NULL;
@@ -144,24 +574,34 @@ static void crf1dt_delete(crf1dt_t* crf1dt)
     free(crf1dt);
 }
 
-static crf1dt_t *crf1dt_new(crf1dm_t* crf1dm)
+static crf1dt_t *crf1dt_new(const crf1dt_compiled_t* compiled, int flags)
 {
     crf1dt_t* crf1dt = NULL;
+    /* A Viterbi-only tagger needs neither marginals nor the Viterbi lattice. */
+    const int ctxf = (flags & CRFSUITE_TAGGER_VITERBI) ? CTXF_LEAN : CTXF_MARGINALS;
 
     crf1dt = (crf1dt_t*)calloc(1, sizeof(crf1dt_t));
     if (crf1dt != NULL) {
-        crf1dt->num_labels = crf1dm_get_num_labels(crf1dm);
-        crf1dt->num_attributes = crf1dm_get_num_attrs(crf1dm);
-        crf1dt->model = crf1dm;
-        crf1dt->ctx = crf1dc_new(CTXF_VITERBI | CTXF_MARGINALS, crf1dt->num_labels, 0);
-        if (crf1dt->ctx != NULL) {
-            crf1dc_reset(crf1dt->ctx, RF_TRANS);
-            crf1dt_transition_score(crf1dt);
-            crf1dc_exp_transition(crf1dt->ctx);
-        } else {
+        crf1dt->compiled = compiled;
+        crf1dt->num_labels = compiled->num_labels;
+        crf1dt->num_attributes = compiled->num_attributes;
+        crf1dt->model = compiled->model;
+        crf1dt->flags = flags;
+        crf1dt->ctx = crf1dc_new(
+            CTXF_VITERBI | CTXF_SHARED_TRANS | ctxf, crf1dt->num_labels, 0);
+        if (crf1dt->ctx == NULL) {
             crf1dt_delete(crf1dt);
-            crf1dt = NULL;
-            return crf1dt;
+            return NULL;
+        }
+        crf1dc_share_transition(crf1dt->ctx, compiled->ctx);
+        if (flags & CRFSUITE_TAGGER_FLOAT) {
+            crf1dt->fctx = crf1dcf_new(
+                CTXF_VITERBI | CTXF_SHARED_TRANS | (ctxf & CTXF_LEAN), crf1dt->num_labels, 0);
+            if (crf1dt->fctx == NULL) {
+                crf1dt_delete(crf1dt);
+                return NULL;
+            }
+            crf1dcf_share_transition(crf1dt->fctx, compiled->fctx);
         }
         crf1dt->level = LEVEL_NONE;
     }
@@ -192,44 +632,413 @@ static int tagger_release(crfsuite_tagger_t* tagger)
     return count;
 }
 
-static int tagger_set(crfsuite_tagger_t* tagger, crfsuite_instance_t *inst)
+/* Remove the constraints on the instance. */
+static void crf1dt_unconstrain(crf1dt_t* crf1dt)
 {
-    crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
+    if (crf1dt->constrained) {
+        crf1dc_share_transition(crf1dt->ctx, crf1dt->compiled->ctx);
+        crf1dc_set_allowed(crf1dt->ctx, NULL);
+        crf1dt->constrained = 0;
+    }
+}
+
+static int crf1dt_set(crf1dt_t* crf1dt, const crfsuite_instance_t *inst)
+{
+    int ret = 0;
     crf1d_context_t* ctx = crf1dt->ctx;
-    crf1dc_set_num_items(ctx, inst->num_items);
-    crf1dc_reset(crf1dt->ctx, RF_STATE);
-    crf1dt_state_score(crf1dt, inst);
+    crf1d_context_float_t* fctx = crf1dt->fctx;
+
+    crf1dt_unconstrain(crf1dt);
+
+    if (fctx != NULL) {
+        if ((ret = crf1dcf_set_num_items(fctx, inst->num_items)) ||
+            (ret = crf1dc_set_num_items(ctx, inst->num_items))) {
+            return ret;
+        }
+        crf1dcf_reset(fctx);
+        crf1dt_state_score_float(crf1dt, inst);
+    } else {
+        if (ret = crf1dc_set_num_items(ctx, inst->num_items)) {
+            return ret;
+        }
+        crf1dc_reset(crf1dt->ctx, RF_STATE);
+        crf1dt_state_score(crf1dt, inst);
+    }
     crf1dt->level = LEVEL_SET;
     return 0;
 }
 
+static floatval_t crf1dt_viterbi(crf1dt_t* crf1dt, int *labels)
+{
+    if (crf1dt->fctx != NULL && !crf1dt->constrained) {
+        /* Find the path in single precision, and score it in double. */
+        crf1dcf_viterbi(crf1dt->fctx, labels);
+        return crf1dc_score(crf1dt->ctx, labels);
+    } else {
+        return crf1dc_viterbi(crf1dt->ctx, labels);
+    }
+}
+
+static int tagger_set(crfsuite_tagger_t* tagger, crfsuite_instance_t *inst)
+{
+    crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
+    return crf1dt_set(crf1dt, inst);
+}
+
 static int tagger_length(crfsuite_tagger_t* tagger)
 {
     crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
     crf1d_context_t* ctx = crf1dt->ctx;
+    if (crf1dt->fctx != NULL) {
+        return crf1dt->fctx->num_items;
+    }
     return ctx->num_items;
 }
 
 static int tagger_viterbi(crfsuite_tagger_t* tagger, int *labels, floatval_t *ptr_score)
 {
-    floatval_t score;
     crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
-    crf1d_context_t* ctx = crf1dt->ctx;
+    floatval_t score = crf1dt_viterbi(crf1dt, labels);
 
-    score = crf1dc_viterbi(ctx, labels);
     if (ptr_score != NULL) {
         *ptr_score = score;
     }
 
+    /* No label sequence satisfies the constraints. */
+    if (crf1dt->constrained && score <= -FLOAT_MAX) {
+        return CRFSUITEERR_INCOMPATIBLE;
+    }
+
+    return 0;
+}
+
+static int tagger_set_constraints(crfsuite_tagger_t* tagger, const unsigned char *allowed, const unsigned char *forbidden)
+{
+    int ret = 0;
+    crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
+    crf1d_context_t* ctx = crf1dt->ctx;
+
+    if (forbidden != NULL) {
+        if (crf1dt->masked == NULL) {
+            crf1dt->masked = crf1dc_new(
+                CTXF_VITERBI | (ctx->flag & CTXF_MARGINALS), crf1dt->num_labels, 0);
+            if (crf1dt->masked == NULL) {
+                return CRFSUITEERR_OUTOFMEMORY;
+            }
+        }
+        crf1dc_mask_transition(crf1dt->masked, crf1dt->compiled->ctx, forbidden);
+        crf1dc_share_transition(ctx, crf1dt->masked);
+    } else {
+        crf1dc_share_transition(ctx, crf1dt->compiled->ctx);
+    }
+
+    if (ret = crf1dc_set_allowed(ctx, allowed)) {
+        return ret;
+    }
+
+    /* The forward-backward scores are computed again. */
+    crf1dt->constrained = 1;
+    crf1dt->level = LEVEL_SET;
     return 0;
 }
 
+static int tagger_viterbi_nbest(crfsuite_tagger_t* tagger, int k, int *paths, floatval_t *scores, int *ptr_num)
+{
+    crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
+
+    /* The k best paths are found in double precision. */
+    return crf1dc_viterbi_nbest(crf1dt->ctx, k, paths, scores, ptr_num);
+}
+
+static int compare_order(const void *x, const void *y)
+{
+    const crf1dt_order_t *a = (const crf1dt_order_t*)x;
+    const crf1dt_order_t *b = (const crf1dt_order_t*)y;
+    if (a->num_items != b->num_items) {
+        return (a->num_items < b->num_items) ? -1 : 1;
+    }
+    return (a->i < b->i) ? -1 : (a->i > b->i);
+}
+
+static int tagger_viterbi_batch(crfsuite_tagger_t* tagger, const crfsuite_instance_t *insts, int n, int *labels, floatval_t *scores)
+{
+    int b, i, k, m, ret = 0;
+    int *offsets = NULL;
+    int *paths[CRF1D_BATCH_LANES];
+    floatval_t lane_scores[CRF1D_BATCH_LANES];
+    crf1dt_order_t *order = NULL;
+    crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
+    crf1d_context_t* ctx = crf1dt->ctx;
+
+    /* The instance set by set() is discarded. */
+    crf1dt_unconstrain(crf1dt);
+    crf1dt->level = LEVEL_NONE;
+    ctx->num_items = 0;
+    if (crf1dt->fctx != NULL) {
+        crf1dt->fctx->num_items = 0;
+    }
+
+    /* The lanes run in double precision; a tagger of single precision
+       decodes the instances one by one as tag_batch() does, so that the
+       scores agree with those of viterbi(). */
+    if (crf1dt->fctx != NULL) {
+        for (i = 0, k = 0;i < n;++i) {
+            floatval_t score = 0.;
+            if (0 < insts[i].num_items) {
+                if (ret = crf1dt_set(crf1dt, &insts[i])) {
+                    break;
+                }
+                score = crf1dt_viterbi(crf1dt, &labels[k]);
+            }
+            if (scores != NULL) {
+                scores[i] = score;
+            }
+            k += insts[i].num_items;
+        }
+        crf1dt->level = LEVEL_NONE;
+        ctx->num_items = 0;
+        crf1dt->fctx->num_items = 0;
+        return ret;
+    }
+
+    if (crf1dt->bc == NULL) {
+        crf1dt->bc = crf1dbc_new(CTXF_VITERBI, crf1dt->num_labels, 0);
+        if (crf1dt->bc == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        crf1dbc_share_transition(crf1dt->bc, crf1dt->compiled->ctx);
+    }
+
+    /* Sort the instances by their lengths, and locate their label sequences. */
+    order = (crf1dt_order_t*)malloc(sizeof(crf1dt_order_t) * (n+1));
+    offsets = (int*)malloc(sizeof(int) * (n+1));
+    if (order == NULL || offsets == NULL) {
+        ret = CRFSUITEERR_OUTOFMEMORY;
+        goto error_exit;
+    }
+    for (i = 0, k = 0;i < n;++i) {
+        order[i].num_items = insts[i].num_items;
+        order[i].i = i;
+        offsets[i] = k;
+        k += insts[i].num_items;
+    }
+    qsort(order, n, sizeof(crf1dt_order_t), compare_order);
+
+    for (i = 0;i < n;i += m) {
+        m = (n - i < CRF1D_BATCH_LANES) ? n - i : CRF1D_BATCH_LANES;
+
+        /* The last instance of the batch is the longest. */
+        if (ret = crf1dbc_set_num_items(crf1dt->bc, order[i+m-1].num_items)) {
+            goto error_exit;
+        }
+        crf1dbc_reset(crf1dt->bc);
+
+        for (b = 0;b < CRF1D_BATCH_LANES;++b) {
+            paths[b] = NULL;
+            lane_scores[b] = 0.;
+        }
+        for (b = 0;b < m;++b) {
+            const crfsuite_instance_t *inst = &insts[order[i+b].i];
+            if (ret = crf1dc_set_num_items(ctx, inst->num_items)) {
+                goto error_exit;
+            }
+            crf1dc_reset(ctx, RF_STATE);
+            crf1dt_state_score(crf1dt, inst);
+            crf1dbc_set_state(crf1dt->bc, b, ctx->state, inst->num_items);
+            paths[b] = &labels[offsets[order[i+b].i]];
+        }
+
+        crf1dbc_viterbi(crf1dt->bc, paths, lane_scores);
+        if (scores != NULL) {
+            for (b = 0;b < m;++b) {
+                scores[order[i+b].i] = lane_scores[b];
+            }
+        }
+    }
+
+error_exit:
+    ctx->num_items = 0;
+    free(offsets);
+    free(order);
+    return ret;
+}
+
+/*
+ * Let the instance crf1dt->view present the instance #n of a batch.
+ */
+static int crf1dt_view_batch(crf1dt_t* crf1dt, const crfsuite_batch_t *batch, int n)
+{
+    int i, k, t, a;
+    crfsuite_instance_t *view = &crf1dt->view;
+    const int begin = batch->item_offsets[n];
+    const int T = batch->item_offsets[n+1] - begin;
+    const int M = batch->attr_offsets[begin+T] - batch->attr_offsets[begin];
+
+    if (view->cap_items < T) {
+        free(view->items);
+        view->cap_items = 0;
+        view->items = (crfsuite_item_t*)calloc(T, sizeof(crfsuite_item_t));
+        if (view->items == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        view->cap_items = T;
+    }
+    if (crf1dt->cap_contents < M) {
+        free(crf1dt->contents);
+        crf1dt->cap_contents = 0;
+        crf1dt->contents = (crfsuite_attribute_t*)malloc(sizeof(crfsuite_attribute_t) * M);
+        if (crf1dt->contents == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        crf1dt->cap_contents = M;
+    }
+
+    /* Copy the attributes known to the model. */
+    for (t = 0, k = 0;t < T;++t) {
+        crfsuite_item_t *item = &view->items[t];
+        item->contents = &crf1dt->contents[k];
+        for (i = batch->attr_offsets[begin+t];i < batch->attr_offsets[begin+t+1];++i) {
+            a = batch->aids[i];
+            if (0 <= a && a < crf1dt->num_attributes) {
+                crf1dt->contents[k].aid = a;
+                crf1dt->contents[k].value = (batch->values != NULL) ? batch->values[i] : 1.;
+                ++k;
+            }
+        }
+        item->num_contents = (int)(&crf1dt->contents[k] - item->contents);
+    }
+    view->num_items = T;
+    return 0;
+}
+
+/* The number of instances that a thread of tag_batch() takes at a time. */
+#define CRF1DT_BATCH_CHUNK  16
+
+/**
+ * Shared state of the threads of tag_batch().
+ */
+typedef struct {
+    crf1dt_t *crf1dt;           /**< Tagger of the calling thread. */
+    const crfsuite_batch_t *batch;
+    int *labels;
+    floatval_t *scores;
+    int next;                   /**< The next instance to be taken. */
+    int *rets;                  /**< Status codes of the threads. */
+} crf1dt_batch_job_t;
+
+static void crf1dt_batch_worker(void *instance, int i)
+{
+    int n, end, ret = 0;
+    floatval_t score;
+    crf1dt_batch_job_t *job = (crf1dt_batch_job_t*)instance;
+    crf1dt_t *crf1dt = (i == 0) ? job->crf1dt : job->crf1dt->workers[i-1];
+    const crfsuite_batch_t *batch = job->batch;
+    const int N = batch->num_instances;
+
+    for (;;) {
+        /* Take the next chunk of instances. */
+        n = parallel_fetch_add(&job->next, CRF1DT_BATCH_CHUNK);
+        if (N <= n) {
+            break;
+        }
+        end = (CRF1DT_BATCH_CHUNK < N - n) ? n + CRF1DT_BATCH_CHUNK : N;
+
+        for (;n < end;++n) {
+            score = 0.;
+            /* An empty instance has no label to find. */
+            if (batch->item_offsets[n] < batch->item_offsets[n+1]) {
+                if ((ret = crf1dt_view_batch(crf1dt, batch, n)) ||
+                    (ret = crf1dt_set(crf1dt, &crf1dt->view))) {
+                    job->rets[i] = ret;
+                    return;
+                }
+                score = crf1dt_viterbi(crf1dt, &job->labels[batch->item_offsets[n]]);
+            }
+            if (job->scores != NULL) {
+                job->scores[n] = score;
+            }
+        }
+    }
+}
+
+static int tagger_tag_batch(crfsuite_tagger_t* tagger, const crfsuite_batch_t *batch, int num_threads, int *labels, floatval_t *scores)
+{
+    int i, ret = 0;
+    crf1dt_t **workers = NULL;
+    crf1dt_batch_job_t job;
+    crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
+    const int P = (1 < num_threads) ? num_threads : 1;
+
+    /* Create the work areas of the threads other than the calling one. */
+    if (crf1dt->num_workers < P-1) {
+        workers = (crf1dt_t**)realloc(crf1dt->workers, sizeof(crf1dt_t*) * (P-1));
+        if (workers == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        crf1dt->workers = workers;
+        for (i = crf1dt->num_workers;i < P-1;++i) {
+            workers[i] = crf1dt_new(crf1dt->compiled, crf1dt->flags);
+            if (workers[i] == NULL) {
+                return CRFSUITEERR_OUTOFMEMORY;
+            }
+            ++crf1dt->num_workers;
+        }
+    }
+
+    /* Start the threads (once unless more threads are requested). */
+    if (1 < P && (crf1dt->pool == NULL || parallel_pool_size(crf1dt->pool) < P)) {
+        parallel_pool_delete(crf1dt->pool);
+        crf1dt->pool = parallel_pool_new(P);
+        if (crf1dt->pool == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.crf1dt = crf1dt;
+    job.batch = batch;
+    job.labels = labels;
+    job.scores = scores;
+    job.rets = (int*)calloc(P, sizeof(int));
+    if (job.rets == NULL) {
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+
+    if (1 < P) {
+        parallel_pool_run(crf1dt->pool, P, crf1dt_batch_worker, &job);
+    } else {
+        crf1dt_batch_worker(&job, 0);
+    }
+    for (i = 0;i < P;++i) {
+        if (ret == 0) {
+            ret = job.rets[i];
+        }
+    }
+
+    /* The instance set by set() is discarded. */
+    crf1dt->level = LEVEL_NONE;
+    crf1dt->ctx->num_items = 0;
+    if (crf1dt->fctx != NULL) {
+        crf1dt->fctx->num_items = 0;
+    }
+
+    free(job.rets);
+    return ret;
+}
+
 static int tagger_score(crfsuite_tagger_t* tagger, int *path, floatval_t *ptr_score)
 {
     floatval_t score;
     crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
     crf1d_context_t* ctx = crf1dt->ctx;
-    score = crf1dc_score(ctx, path);
+    if (ctx->trans != crf1dt->compiled->ctx->trans) {
+        /* Score the path with the transitions of the model, not masked. */
+        crf1dc_share_transition(ctx, crf1dt->compiled->ctx);
+        score = crf1dc_score(ctx, path);
+        crf1dc_share_transition(ctx, crf1dt->masked);
+    } else {
+        score = crf1dc_score(ctx, path);
+    }
     if (ptr_score != NULL) {
         *ptr_score = score;
     }
@@ -238,24 +1047,76 @@ static int tagger_score(crfsuite_tagger_t* tagger, int *path, floatval_t *ptr_sc
 
 static int tagger_lognorm(crfsuite_tagger_t* tagger, floatval_t *ptr_norm)
 {
+    int ret;
     crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
-    crf1dt_set_level(crf1dt, LEVEL_ALPHABETA);
+    if (ret = crf1dt_set_level(crf1dt, LEVEL_ALPHABETA)) {
+        return ret;
+    }
     *ptr_norm = crf1dc_lognorm(crf1dt->ctx);
     return 0;
 }
 
 static int tagger_marginal_point(crfsuite_tagger_t *tagger, int l, int t, floatval_t *ptr_prob)
 {
+    int ret;
     crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
-    crf1dt_set_level(crf1dt, LEVEL_ALPHABETA);
+    if (ret = crf1dt_set_level(crf1dt, LEVEL_ALPHABETA)) {
+        return ret;
+    }
     *ptr_prob = crf1dc_marginal_point(crf1dt->ctx, l, t);
     return 0;
 }
 
+static int tagger_marginals(crfsuite_tagger_t *tagger, floatval_t *probs)
+{
+    int t, ret;
+    crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
+    crf1d_context_t* ctx = crf1dt->ctx;
+    if (ret = crf1dt_set_level(crf1dt, LEVEL_ALPHABETA)) {
+        return ret;
+    }
+    for (t = 0;t < ctx->num_items;++t) {
+        crf1dc_marginal_points(ctx, t, &probs[ctx->num_labels * t]);
+    }
+    return 0;
+}
+
+static int tagger_marginals_sparse(crfsuite_tagger_t *tagger, floatval_t threshold, int *offsets, int *labels, floatval_t *probs, int size)
+{
+    int l, t, k = 0, ret;
+    crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
+    crf1d_context_t* ctx = crf1dt->ctx;
+    floatval_t *row = NULL;
+    if (ret = crf1dt_set_level(crf1dt, LEVEL_ALPHABETA)) {
+        return ret;
+    }
+    /* The work row may be reallocated when the level is set. */
+    row = ctx->row;
+    for (t = 0;t < ctx->num_items;++t) {
+        offsets[t] = k;
+        crf1dc_marginal_points(ctx, t, row);
+        for (l = 0;l < ctx->num_labels;++l) {
+            if (threshold < row[l]) {
+                if (size <= k) {
+                    return CRFSUITEERR_OVERFLOW;
+                }
+                labels[k] = l;
+                probs[k] = row[l];
+                ++k;
+            }
+        }
+    }
+    offsets[t] = k;
+    return 0;
+}
+
 static int tagger_marginal_path(crfsuite_tagger_t *tagger, const int *path, int begin, int end, floatval_t *ptr_prob)
 {
+    int ret;
     crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
-    crf1dt_set_level(crf1dt, LEVEL_ALPHABETA);
+    if (ret = crf1dt_set_level(crf1dt, LEVEL_ALPHABETA)) {
+        return ret;
+    }
     *ptr_prob = crf1dc_marginal_path(crf1dt->ctx, path, begin, end);
     return 0;
 }
@@ -291,6 +1152,18 @@ static int model_attrs_to_id(crfsuite_dictionary_t* dic, const char *str)
     return crf1dm_to_aid(crf1dm, str);
 }
 
+static int model_attrs_to_ids(crfsuite_dictionary_t* dic, const char **strs, int n, int *ids)
+{
+    crf1dm_t *crf1dm = (crf1dm_t*)dic->internal;
+    return crf1dm_to_aids(crf1dm, strs, n, ids);
+}
+
+static int model_attrs_hash_to_ids(crfsuite_dictionary_t* dic, const crfsuite_hash_t *hashes, int n, int *ids)
+{
+    crf1dm_t *crf1dm = (crf1dm_t*)dic->internal;
+    return crf1dm_hash_to_aids(crf1dm, hashes, n, ids);
+}
+
 static int model_attrs_to_string(crfsuite_dictionary_t* dic, int id, char const **pstr)
 {
     crf1dm_t *crf1dm = (crf1dm_t*)dic->internal;
@@ -341,6 +1214,22 @@ static int model_labels_to_id(crfsuite_dictionary_t* dic, const char *str)
     return crf1dm_to_lid(crf1dm, str);
 }
 
+static int model_labels_to_ids(crfsuite_dictionary_t* dic, const char **strs, int n, int *ids)
+{
+    int i;
+    crf1dm_t *crf1dm = (crf1dm_t*)dic->internal;
+    for (i = 0;i < n;++i) {
+        ids[i] = crf1dm_to_lid(crf1dm, strs[i]);
+    }
+    return 0;
+}
+
+static int model_labels_hash_to_ids(crfsuite_dictionary_t* dic, const crfsuite_hash_t *hashes, int n, int *ids)
+{
+    /* Labels are not hashed. */
+    return CRFSUITEERR_NOTSUPPORTED;
+}
+
 static int model_labels_to_string(crfsuite_dictionary_t* dic, int id, char const **pstr)
 {
     crf1dm_t *crf1dm = (crf1dm_t*)dic->internal;
@@ -368,6 +1257,7 @@ static void model_labels_free(crfsuite_dictionary_t* dic, const char *str)
 
 typedef struct {
     crf1dm_t*    crf1dm;
+    crf1dt_compiled_t*  compiled;
 
     crfsuite_dictionary_t*    attrs;
     crfsuite_dictionary_t*    labels;
@@ -386,6 +1276,7 @@ static int model_release(crfsuite_model_t* model)
         model_internal_t* internal = (model_internal_t*)model->internal;
         free(internal->labels);
         free(internal->attrs);
+        crf1dt_compiled_delete(internal->compiled);
         crf1dm_close(internal->crf1dm);
         free(internal);
         free(model);
@@ -393,15 +1284,19 @@ static int model_release(crfsuite_model_t* model)
     return count;
 }
 
-static int model_get_tagger(crfsuite_model_t* model, crfsuite_tagger_t** ptr_tagger)
+static int model_get_tagger_ex(crfsuite_model_t* model, int flags, crfsuite_tagger_t** ptr_tagger)
 {
     int ret = 0;
     crf1dt_t *crf1dt = NULL;
     crfsuite_tagger_t *tagger = NULL;
     model_internal_t* internal = (model_internal_t*)model->internal;
 
+    if (flags & ~(CRFSUITE_TAGGER_FLOAT | CRFSUITE_TAGGER_VITERBI)) {
+        return CRFSUITEERR_NOTSUPPORTED;
+    }
+
     /* Construct a tagger based on the model. */
-    crf1dt = crf1dt_new(internal->crf1dm);
+    crf1dt = crf1dt_new(internal->compiled, flags);
     if (crf1dt == NULL) {
         ret = CRFSUITEERR_OUTOFMEMORY;
         goto error_exit;
@@ -424,6 +1319,12 @@ static int model_get_tagger(crfsuite_model_t* model, crfsuite_tagger_t** ptr_tag
     tagger->lognorm = tagger_lognorm;
     tagger->marginal_point = tagger_marginal_point;
     tagger->marginal_path = tagger_marginal_path;
+    tagger->viterbi_batch = tagger_viterbi_batch;
+    tagger->tag_batch = tagger_tag_batch;
+    tagger->marginals = tagger_marginals;
+    tagger->marginals_sparse = tagger_marginals_sparse;
+    tagger->viterbi_nbest = tagger_viterbi_nbest;
+    tagger->set_constraints = tagger_set_constraints;
 
     *ptr_tagger = tagger;
     return 0;
@@ -436,6 +1337,11 @@ error_exit:
     return ret;
 }
 
+static int model_get_tagger(crfsuite_model_t* model, crfsuite_tagger_t** ptr_tagger)
+{
+    return model_get_tagger_ex(model, CRFSUITE_TAGGER_DEFAULT, ptr_tagger);
+}
+
 static int model_get_labels(crfsuite_model_t* model, crfsuite_dictionary_t** ptr_labels)
 {
     model_internal_t* internal = (model_internal_t*)model->internal;
@@ -459,7 +1365,7 @@ static int model_dump(crfsuite_model_t* model, FILE *fpo)
     return 0;
 }
 
-static int crf1m_model_create(crf1dm_t *crf1dm, void** ptr_model)
+static int crf1m_model_create(crf1dm_t *crf1dm, int flags, void** ptr_model)
 {
     int ret = 0;
     crfsuite_model_t *model = NULL;
@@ -480,6 +1386,13 @@ static int crf1m_model_create(crf1dm_t *crf1dm, void** ptr_model)
         goto error_exit;
     }
 
+    /* Compile the data shared by the taggers. */
+    internal->compiled = crf1dt_compile(crf1dm, flags);
+    if (internal->compiled == NULL) {
+        ret = CRFSUITEERR_OUTOFMEMORY;
+        goto error_exit;
+    }
+
     /* Create an instance of dictionary object for attributes. */
     attrs = (crfsuite_dictionary_t*)calloc(1, sizeof(crfsuite_dictionary_t));
     if (attrs == NULL) {
@@ -495,6 +1408,8 @@ static int crf1m_model_create(crf1dm_t *crf1dm, void** ptr_model)
     attrs->to_string = model_attrs_to_string;
     attrs->num = model_attrs_num;
     attrs->free = model_attrs_free;
+    attrs->to_ids = model_attrs_to_ids;
+    attrs->hash_to_ids = model_attrs_hash_to_ids;
 
     /* Create an instance of dictionary object for labels. */
     labels = (crfsuite_dictionary_t*)calloc(1, sizeof(crfsuite_dictionary_t));
@@ -511,6 +1426,8 @@ static int crf1m_model_create(crf1dm_t *crf1dm, void** ptr_model)
     labels->to_string = model_labels_to_string;
     labels->num = model_labels_num;
     labels->free = model_labels_free;
+    labels->to_ids = model_labels_to_ids;
+    labels->hash_to_ids = model_labels_hash_to_ids;
 
     /* Set the internal data for the model object. */
     internal->crf1dm = crf1dm;
@@ -531,6 +1448,7 @@ static int crf1m_model_create(crf1dm_t *crf1dm, void** ptr_model)
     model->get_labels = model_get_labels;
     model->get_tagger = model_get_tagger;
     model->dump = model_dump;
+    model->get_tagger_ex = model_get_tagger_ex;
 
     *ptr_model = model;
     return 0;
@@ -538,6 +1456,9 @@ static int crf1m_model_create(crf1dm_t *crf1dm, void** ptr_model)
 error_exit:
     free(labels);
     free(attrs);
+    if (internal != NULL && internal->compiled != NULL) {
+        crf1dt_compiled_delete(internal->compiled);
+    }
     if (crf1dm != NULL) {
         crf1dm_close(crf1dm);
     }
@@ -546,12 +1467,31 @@ error_exit:
     return ret;
 }
 
-int crf1m_create_instance_from_file(const char *filename, void **ptr)
+int crf1m_create_instance_from_file(const char *filename, int flags, void **ptr)
 {
-    return crf1m_model_create(crf1dm_new(filename), ptr);
+    int ret = 0;
+
+    *ptr = NULL;
+    if (ret = crf1dm_check_flags(flags)) {
+        return ret;
+    }
+    return crf1m_model_create(crf1dm_new(filename, flags), flags, ptr);
 }
 
-int crf1m_create_instance_from_memory(const void *data, size_t size, void **ptr)
+int crf1m_create_instance_from_memory(const void *data, size_t size, int flags, void **ptr)
 {
-    return crf1m_model_create(crf1dm_new_from_memory(data, size), ptr);
+    return crf1m_model_create(crf1dm_new_from_memory(data, size), flags, ptr);
+}
+
+int crf1m_quantize(const char *input, const char *output, int type)
+{
+    int ret = 0;
+    crf1dm_t *crf1dm = crf1dm_new(input, CRFSUITE_LOAD_DEFAULT);
+
+    if (crf1dm == NULL) {
+        return CRFSUITEERR_INCOMPATIBLE;
+    }
+    ret = crf1dm_quantize(crf1dm, output, type);
+    crf1dm_close(crf1dm);
+    return ret;
 }
@@ -30,6 +30,10 @@
 
 /* $Id$ */
 
+#ifdef    HAVE_CONFIG_H
+#include <config.h>
+#endif/*HAVE_CONFIG_H*/
+
 #include <os.h>
 
 #include <stdarg.h>
@@ -39,15 +43,20 @@
 
 #include <crfsuite.h>
 #include "logging.h"
+#include "vecmath.h"
 
 int crf1de_create_instance(const char *iid, void **ptr);
 int crfsuite_dictionary_create_instance(const char *interface, void **ptr);
-int crf1m_create_instance_from_file(const char *filename, void **ptr);
-int crf1m_create_instance_from_memory(const void *data, size_t size, void **ptr);
+int crf1m_create_instance_from_file(const char *filename, int flags, void **ptr);
+int crf1m_create_instance_from_memory(const void *data, size_t size, int flags, void **ptr);
+int crf1m_quantize(const char *input, const char *output, int type);
 
 int crfsuite_create_instance(const char *iid, void **ptr)
 {
-    int ret = 
+    int ret;
+
+    vecmath_init();
+    ret = 
         crf1de_create_instance(iid, ptr) == 0 ||
         crfsuite_dictionary_create_instance(iid, ptr) == 0;
 
@@ -56,16 +65,37 @@ int crfsuite_create_instance(const char *iid, void **ptr)
 
 int crfsuite_create_instance_from_file(const char *filename, void **ptr)
 {
-    int ret = crf1m_create_instance_from_file(filename, ptr);
+    return crfsuite_create_instance_from_file_ex(filename, CRFSUITE_LOAD_DEFAULT, ptr);
+}
+
+int crfsuite_create_instance_from_file_ex(const char *filename, int flags, void **ptr)
+{
+    int ret;
+
+    vecmath_init();
+    ret = crf1m_create_instance_from_file(filename, flags, ptr);
     return ret;
 }
 
 int crfsuite_create_instance_from_memory(const void *data, size_t size, void **ptr)
 {
-    int ret = crf1m_create_instance_from_memory(data, size, ptr);
+    return crfsuite_create_instance_from_memory_ex(data, size, CRFSUITE_LOAD_DEFAULT, ptr);
+}
+
+int crfsuite_create_instance_from_memory_ex(const void *data, size_t size, int flags, void **ptr)
+{
+    int ret;
+
+    vecmath_init();
+    ret = crf1m_create_instance_from_memory(data, size, flags, ptr);
     return ret;
 }
 
+int crfsuite_quantize_model(const char *input, const char *output, int type)
+{
+    return crf1m_quantize(input, output, type);
+}
+
 
 void crfsuite_attribute_init(crfsuite_attribute_t* cont)
 {
@@ -392,6 +422,27 @@ int crfsuite_evaluation_accmulate(crfsuite_evaluation_t* eval, const int* refere
     return 0;
 }
 
+int crfsuite_evaluation_merge(crfsuite_evaluation_t* eval, const crfsuite_evaluation_t* src)
+{
+    int i;
+
+    if (eval->num_labels != src->num_labels) {
+        return 1;
+    }
+
+    for (i = 0;i <= eval->num_labels;++i) {
+        eval->tbl[i].num_correct += src->tbl[i].num_correct;
+        eval->tbl[i].num_observation += src->tbl[i].num_observation;
+        eval->tbl[i].num_model += src->tbl[i].num_model;
+    }
+
+    eval->item_total_num += src->item_total_num;
+    eval->inst_total_correct += src->inst_total_correct;
+    eval->inst_total_num += src->inst_total_num;
+
+    return 0;
+}
+
 void crfsuite_evaluation_finalize(crfsuite_evaluation_t* eval)
 {
     int i;
@@ -500,3 +551,8 @@ int crfsuite_interlocked_decrement(int *count)
 {
     return --(*count);
 }
+
+const char* crfsuite_vecmath_name()
+{
+    return vecmath_init()->name;
+}
@@ -61,11 +61,13 @@ typedef struct {
     crfsuite_data_t *data;
     int *perm;
     int num_instances;
+    unsigned long long rng;     /**< State of the random number generator. */
 } dataset_t;
 
 void dataset_init_trainset(dataset_t *ds, crfsuite_data_t *data, int holdout);
 void dataset_init_testset(dataset_t *ds, crfsuite_data_t *data, int holdout);
 void dataset_finish(dataset_t *ds);
+void dataset_seed(dataset_t *ds, unsigned int seed);
 void dataset_shuffle(dataset_t *ds);
 crfsuite_instance_t *dataset_get(dataset_t *ds, int i);
 
@@ -80,6 +82,7 @@ struct tag_crfsuite_train_internal {
     logging_t* lg;              /**< Logging interface. */
     int feature_type;           /**< Feature type. */
     int algorithm;              /**< Training algorithm. */
+    int random_seed;            /**< Seed for shuffling instances. */
 };
 
 /**
@@ -98,6 +101,7 @@ struct tag_encoder
 
     int num_features;
     int cap_items;
+    int num_threads;
 
     /**
      * Exchanges options.
@@ -158,6 +162,18 @@ struct tag_encoder
 
     int (*save_model)(encoder_t *self, const char *filename, const floatval_t *w, logging_t *lg);
 
+    /**
+     * Creates an encoder that shares the features with this encoder.
+     *  The new encoder has its own work area so that it can process
+     *  instances on another thread. It updates the array in
+     *  objective_and_gradients() with relaxed atomic operations, so that
+     *  threads may update the same feature weights without a lock.
+     *  The new encoder must be released before this encoder.
+     *  @param  self        The encoder instance (initialized).
+     *  @return             The new encoder, or NULL if out of memory.
+     */
+    encoder_t* (*fork)(encoder_t *self);
+
     void (*release)(encoder_t *self);
 };
 
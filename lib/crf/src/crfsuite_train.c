@@ -44,6 +44,21 @@
 #include "params.h"
 #include "logging.h"
 #include "crf1d.h"
+#include "vecmath.h"
+
+static int crfsuite_train_exchange_options(crfsuite_train_internal_t* tr, int mode)
+{
+    crfsuite_params_t* params = tr->params;
+
+    BEGIN_PARAM_MAP(params, mode)
+        DDX_PARAM_INT(
+            "random_seed", tr->random_seed, 0,
+            "The seed of the random number generator for shuffling instances."
+            )
+    END_PARAM_MAP()
+
+    return 0;
+}
 
 static crfsuite_train_internal_t* crfsuite_train_new(int ftype, int algorithm)
 {
@@ -56,6 +71,7 @@ static crfsuite_train_internal_t* crfsuite_train_new(int ftype, int algorithm)
 
         tr->gm = crf1d_create_encoder();
         tr->gm->exchange_options(tr->gm, tr->params, 0);
+        crfsuite_train_exchange_options(tr, 0);
 
         /* Initialize parameters for the training algorithm. */
         switch (algorithm) {
@@ -141,13 +157,20 @@ static int crfsuite_train_train(
     dataset_t testset;
 
     /* Prepare the data set(s) for training (and holdout evaluation). */
+    crfsuite_train_exchange_options(tr, -1);
     dataset_init_trainset(&trainset, (crfsuite_data_t*)data, holdout);
+    dataset_seed(&trainset, (unsigned int)tr->random_seed);
     if (0 <= holdout) {
         dataset_init_testset(&testset, (crfsuite_data_t*)data, holdout);
         logging(lg, "Holdout group: %d\n", holdout+1);
         logging(lg, "\n");
     }
 
+    /* Report the implementation of vector operations. */
+    logging(lg, "Vector operations: %s\n", vecmath_init()->name);
+    logging(lg, "Random seed: %d\n", tr->random_seed);
+    logging(lg, "\n");
+
     /* Set the training set to the CRF, and generate features. */
     gm->exchange_options(gm, tr->params, -1);
     gm->initialize(gm, &trainset, lg);
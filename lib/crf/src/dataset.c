@@ -53,6 +53,7 @@ void dataset_init_trainset(dataset_t *ds, crfsuite_data_t *data, int holdout)
     ds->data = data;
     ds->num_instances = n;
     ds->perm = (int*)malloc(sizeof(int) * n);
+    dataset_seed(ds, 0);
 
     n = 0;
     for (i = 0;i < data->num_instances;++i) {
@@ -75,6 +76,7 @@ void dataset_init_testset(dataset_t *ds, crfsuite_data_t *data, int holdout)
     ds->data = data;
     ds->num_instances = n;
     ds->perm = (int*)malloc(sizeof(int) * n);
+    dataset_seed(ds, 0);
 
     n = 0;
     for (i = 0;i < data->num_instances;++i) {
@@ -89,11 +91,29 @@ void dataset_finish(dataset_t *ds)
     free(ds->perm);
 }
 
+void dataset_seed(dataset_t *ds, unsigned int seed)
+{
+    ds->rng = seed;
+}
+
+/*
+ * Generate a pseudo-random number with SplitMix64. The generator is owned
+ * by the data set (and hence by the trainer), so that the order of the
+ * instances does not depend on the global state of rand().
+ */
+static unsigned long long dataset_random(dataset_t *ds)
+{
+    unsigned long long z = (ds->rng += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
 void dataset_shuffle(dataset_t *ds)
 {
     int i;
     for (i = 0;i < ds->num_instances;++i) {
-        int j = rand() % ds->num_instances;
+        int j = (int)(dataset_random(ds) % (unsigned long long)ds->num_instances);
         int tmp = ds->perm[j];
         ds->perm[j] = ds->perm[i];
         ds->perm[i] = tmp;
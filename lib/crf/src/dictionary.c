@@ -66,6 +66,16 @@ static int dictionary_to_id(crfsuite_dictionary_t* dic, const char *str)
     return quark_to_id(qrk, str);    
 }
 
+static int dictionary_to_ids(crfsuite_dictionary_t* dic, const char **strs, int n, int *ids)
+{
+    int i;
+    quark_t *qrk = (quark_t*)dic->internal;
+    for (i = 0;i < n;++i) {
+        ids[i] = quark_to_id(qrk, strs[i]);
+    }
+    return 0;
+}
+
 static int dictionary_to_string(crfsuite_dictionary_t* dic, int id, char const **pstr)
 {
     quark_t *qrk = (quark_t*)dic->internal;
@@ -92,6 +102,106 @@ static void dictionary_free(crfsuite_dictionary_t* dic, const char *str)
     free((char*)str);
 }
 
+static int dictionary_hash_to_ids(crfsuite_dictionary_t* dic, const crfsuite_hash_t *hashes, int n, int *ids)
+{
+    return CRFSUITEERR_NOTSUPPORTED;
+}
+
+
+
+/*
+ *    Implementation of crfsuite_dictionary_t object for feature hashing.
+ *    This object maps an attribute to an ID by its hash value and stores
+ *    no string, so that the dictionary uses a fixed amount of memory.
+ */
+
+typedef struct {
+    int bits;       /**< Number of bits of the IDs. */
+} hashdic_t;
+
+static int hashdic_release(crfsuite_dictionary_t* dic)
+{
+    int count = crfsuite_interlocked_decrement(&dic->nref);
+    if (count == 0) {
+        free(dic->internal);
+        free(dic);
+    }
+    return count;
+}
+
+static int hashdic_to_id(crfsuite_dictionary_t* dic, const char *str)
+{
+    hashdic_t *hd = (hashdic_t*)dic->internal;
+    return CRFSUITE_HASH_TO_ID(crfsuite_attribute_hash(str, strlen(str)), hd->bits);
+}
+
+static int hashdic_to_ids(crfsuite_dictionary_t* dic, const char **strs, int n, int *ids)
+{
+    int i;
+    hashdic_t *hd = (hashdic_t*)dic->internal;
+    for (i = 0;i < n;++i) {
+        ids[i] = CRFSUITE_HASH_TO_ID(crfsuite_attribute_hash(strs[i], strlen(strs[i])), hd->bits);
+    }
+    return 0;
+}
+
+static int hashdic_hash_to_ids(crfsuite_dictionary_t* dic, const crfsuite_hash_t *hashes, int n, int *ids)
+{
+    int i;
+    hashdic_t *hd = (hashdic_t*)dic->internal;
+    for (i = 0;i < n;++i) {
+        ids[i] = CRFSUITE_HASH_TO_ID(hashes[i], hd->bits);
+    }
+    return 0;
+}
+
+static int hashdic_to_string(crfsuite_dictionary_t* dic, int id, char const **pstr)
+{
+    /* This object stores no string. */
+    *pstr = NULL;
+    return 1;
+}
+
+static int hashdic_num(crfsuite_dictionary_t* dic)
+{
+    hashdic_t *hd = (hashdic_t*)dic->internal;
+    return 1 << hd->bits;
+}
+
+static crfsuite_dictionary_t* hashdic_create(const char *arg)
+{
+    char *end = NULL;
+    hashdic_t *hd = NULL;
+    crfsuite_dictionary_t* dic = NULL;
+    long bits = strtol(arg, &end, 10);
+
+    if (end == arg || *end != '\0' || bits < 1 || CRFSUITE_HASH_MAX_BITS < bits) {
+        return NULL;
+    }
+
+    dic = (crfsuite_dictionary_t*)calloc(1, sizeof(crfsuite_dictionary_t));
+    hd = (hashdic_t*)calloc(1, sizeof(hashdic_t));
+    if (dic == NULL || hd == NULL) {
+        free(hd);
+        free(dic);
+        return NULL;
+    }
+
+    hd->bits = (int)bits;
+    dic->internal = hd;
+    dic->nref = 1;
+    dic->addref = dictionary_addref;
+    dic->release = hashdic_release;
+    dic->get = hashdic_to_id;
+    dic->to_id = hashdic_to_id;
+    dic->to_string = hashdic_to_string;
+    dic->num = hashdic_num;
+    dic->free = dictionary_free;
+    dic->to_ids = hashdic_to_ids;
+    dic->hash_to_ids = hashdic_hash_to_ids;
+    return dic;
+}
+
 int crfsuite_dictionary_create_instance(const char *interface, void **ptr)
 {
     if (strcmp(interface, "dictionary") == 0) {
@@ -107,6 +217,16 @@ int crfsuite_dictionary_create_instance(const char *interface, void **ptr)
             dic->to_string = dictionary_to_string;
             dic->num = dictionary_num;
             dic->free = dictionary_free;
+            dic->to_ids = dictionary_to_ids;
+            dic->hash_to_ids = dictionary_hash_to_ids;
+            *ptr = dic;
+            return 0;
+        } else {
+            return -1;
+        }
+    } else if (strncmp(interface, "dictionary/hash:", 16) == 0) {
+        crfsuite_dictionary_t* dic = hashdic_create(interface + 16);
+        if (dic != NULL) {
             *ptr = dic;
             return 0;
         } else {
@@ -0,0 +1,364 @@
+/*
+ *      Fork-join parallelism.
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* $Id$ */
+
+#ifdef    HAVE_CONFIG_H
+#include <config.h>
+#endif/*HAVE_CONFIG_H*/
+
+#include <os.h>
+
+#include <stdlib.h>
+
+#include "parallel.h"
+
+#ifdef  _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif/*_WIN32*/
+
+typedef struct {
+    parallel_func_t func;
+    void *instance;
+    int i;
+} parallel_task_t;
+
+#ifdef  _WIN32
+
+static DWORD WINAPI parallel_thread(LPVOID arg)
+{
+    parallel_task_t* task = (parallel_task_t*)arg;
+    task->func(task->instance, task->i);
+    return 0;
+}
+
+void parallel_run(int n, parallel_func_t func, void *instance)
+{
+    int i;
+    HANDLE *threads = NULL;
+    parallel_task_t *tasks = NULL;
+
+    if (n <= 1) {
+        func(instance, 0);
+        return;
+    }
+
+    threads = (HANDLE*)calloc(n, sizeof(HANDLE));
+    tasks = (parallel_task_t*)calloc(n, sizeof(parallel_task_t));
+    if (threads == NULL || tasks == NULL) {
+        /* Fall back to the sequential execution. */
+        for (i = 0;i < n;++i) {
+            func(instance, i);
+        }
+        goto exit;
+    }
+
+    for (i = 1;i < n;++i) {
+        tasks[i].func = func;
+        tasks[i].instance = instance;
+        tasks[i].i = i;
+        threads[i] = CreateThread(NULL, 0, parallel_thread, &tasks[i], 0, NULL);
+    }
+
+    func(instance, 0);
+
+    for (i = 1;i < n;++i) {
+        if (threads[i] != NULL) {
+            WaitForSingleObject(threads[i], INFINITE);
+            CloseHandle(threads[i]);
+        } else {
+            func(instance, i);
+        }
+    }
+
+exit:
+    free(tasks);
+    free(threads);
+}
+
+#else
+
+static void *parallel_thread(void *arg)
+{
+    parallel_task_t* task = (parallel_task_t*)arg;
+    task->func(task->instance, task->i);
+    return NULL;
+}
+
+void parallel_run(int n, parallel_func_t func, void *instance)
+{
+    int i;
+    int *created = NULL;
+    pthread_t *threads = NULL;
+    parallel_task_t *tasks = NULL;
+
+    if (n <= 1) {
+        func(instance, 0);
+        return;
+    }
+
+    created = (int*)calloc(n, sizeof(int));
+    threads = (pthread_t*)calloc(n, sizeof(pthread_t));
+    tasks = (parallel_task_t*)calloc(n, sizeof(parallel_task_t));
+    if (created == NULL || threads == NULL || tasks == NULL) {
+        /* Fall back to the sequential execution. */
+        for (i = 0;i < n;++i) {
+            func(instance, i);
+        }
+        goto exit;
+    }
+
+    for (i = 1;i < n;++i) {
+        tasks[i].func = func;
+        tasks[i].instance = instance;
+        tasks[i].i = i;
+        created[i] = (pthread_create(&threads[i], NULL, parallel_thread, &tasks[i]) == 0);
+    }
+
+    func(instance, 0);
+
+    for (i = 1;i < n;++i) {
+        if (created[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            func(instance, i);
+        }
+    }
+
+exit:
+    free(tasks);
+    free(threads);
+    free(created);
+}
+
+#endif/*_WIN32*/
+
+/* Threads, mutexes, and condition variables for the pools. */
+#ifdef  _WIN32
+
+typedef HANDLE thread_t;
+typedef CRITICAL_SECTION mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+
+#define THREAD_FUNC(name, arg)  static DWORD WINAPI name(LPVOID arg)
+#define THREAD_RETURN           return 0
+#define thread_create(th, func, arg)    ((*(th) = CreateThread(NULL, 0, func, arg, 0, NULL)) != NULL ? 0 : 1)
+#define thread_join(th)     (WaitForSingleObject(th, INFINITE), CloseHandle(th))
+#define mutex_init(m)       InitializeCriticalSection(m)
+#define mutex_destroy(m)    DeleteCriticalSection(m)
+#define mutex_lock(m)       EnterCriticalSection(m)
+#define mutex_unlock(m)     LeaveCriticalSection(m)
+#define cond_init(c)        InitializeConditionVariable(c)
+#define cond_destroy(c)
+#define cond_wait(c, m)     SleepConditionVariableCS(c, m, INFINITE)
+#define cond_signal(c)      WakeConditionVariable(c)
+#define cond_broadcast(c)   WakeAllConditionVariable(c)
+
+#else
+
+typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t cond_t;
+
+#define THREAD_FUNC(name, arg)  static void *name(void *arg)
+#define THREAD_RETURN           return NULL
+#define thread_create(th, func, arg)    pthread_create(th, NULL, func, arg)
+#define thread_join(th)     pthread_join(th, NULL)
+#define mutex_init(m)       pthread_mutex_init(m, NULL)
+#define mutex_destroy(m)    pthread_mutex_destroy(m)
+#define mutex_lock(m)       pthread_mutex_lock(m)
+#define mutex_unlock(m)     pthread_mutex_unlock(m)
+#define cond_init(c)        pthread_cond_init(c, NULL)
+#define cond_destroy(c)     pthread_cond_destroy(c)
+#define cond_wait(c, m)     pthread_cond_wait(c, m)
+#define cond_signal(c)      pthread_cond_signal(c)
+#define cond_broadcast(c)   pthread_cond_broadcast(c)
+
+#endif/*_WIN32*/
+
+typedef struct {
+    parallel_pool_t *pool;
+    int i;
+} parallel_member_t;
+
+struct tag_parallel_pool {
+    int num_threads;            /**< Threads including the calling one. */
+    int num_created;            /**< Threads created (#1, ..., #num_created). */
+    thread_t *threads;          /**< [num_threads] */
+    parallel_member_t *members; /**< [num_threads] */
+
+    mutex_t mutex;
+    cond_t cond_start;          /**< Signaled when a run starts or the pool stops. */
+    cond_t cond_done;           /**< Signaled when the threads finish a run. */
+    int generation;             /**< The number of runs started. */
+    int pending;                /**< Threads yet to finish the current run. */
+    int quit;                   /**< Non-zero when the pool stops. */
+
+    int n;                      /**< The current run. */
+    parallel_func_t func;
+    void *instance;
+};
+
+THREAD_FUNC(parallel_pool_thread, arg)
+{
+    parallel_member_t *member = (parallel_member_t*)arg;
+    parallel_pool_t *pool = member->pool;
+    int generation = 0;
+
+    mutex_lock(&pool->mutex);
+    for (;;) {
+        while (!pool->quit && pool->generation == generation) {
+            cond_wait(&pool->cond_start, &pool->mutex);
+        }
+        if (pool->quit) {
+            break;
+        }
+        generation = pool->generation;
+
+        if (member->i < pool->n) {
+            parallel_func_t func = pool->func;
+            void *instance = pool->instance;
+            mutex_unlock(&pool->mutex);
+            func(instance, member->i);
+            mutex_lock(&pool->mutex);
+        }
+
+        if (--pool->pending == 0) {
+            cond_signal(&pool->cond_done);
+        }
+    }
+    mutex_unlock(&pool->mutex);
+    THREAD_RETURN;
+}
+
+parallel_pool_t* parallel_pool_new(int n)
+{
+    int i;
+    parallel_pool_t *pool = NULL;
+
+    if (n < 1) {
+        n = 1;
+    }
+
+    pool = (parallel_pool_t*)calloc(1, sizeof(parallel_pool_t));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->num_threads = n;
+    pool->threads = (thread_t*)calloc(n, sizeof(thread_t));
+    pool->members = (parallel_member_t*)calloc(n, sizeof(parallel_member_t));
+    if (pool->threads == NULL || pool->members == NULL) {
+        free(pool->members);
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+
+    mutex_init(&pool->mutex);
+    cond_init(&pool->cond_start);
+    cond_init(&pool->cond_done);
+
+    /* A thread that cannot be created leaves its calls to the caller. */
+    for (i = 1;i < n;++i) {
+        pool->members[i].pool = pool;
+        pool->members[i].i = i;
+        if (thread_create(&pool->threads[i], parallel_pool_thread, &pool->members[i]) != 0) {
+            break;
+        }
+        ++pool->num_created;
+    }
+
+    return pool;
+}
+
+void parallel_pool_delete(parallel_pool_t* pool)
+{
+    int i;
+
+    if (pool == NULL) {
+        return;
+    }
+
+    mutex_lock(&pool->mutex);
+    pool->quit = 1;
+    cond_broadcast(&pool->cond_start);
+    mutex_unlock(&pool->mutex);
+
+    for (i = 1;i <= pool->num_created;++i) {
+        thread_join(pool->threads[i]);
+    }
+
+    cond_destroy(&pool->cond_done);
+    cond_destroy(&pool->cond_start);
+    mutex_destroy(&pool->mutex);
+    free(pool->members);
+    free(pool->threads);
+    free(pool);
+}
+
+int parallel_pool_size(const parallel_pool_t* pool)
+{
+    return pool->num_threads;
+}
+
+void parallel_pool_run(parallel_pool_t* pool, int n, parallel_func_t func, void *instance)
+{
+    int i;
+
+    if (n <= 1 || pool->num_created == 0) {
+        for (i = 0;i < n;++i) {
+            func(instance, i);
+        }
+        return;
+    }
+
+    /* Wake up the threads; those beyond n just acknowledge the run. */
+    mutex_lock(&pool->mutex);
+    pool->n = n;
+    pool->func = func;
+    pool->instance = instance;
+    pool->pending = pool->num_created;
+    ++pool->generation;
+    cond_broadcast(&pool->cond_start);
+    mutex_unlock(&pool->mutex);
+
+    func(instance, 0);
+    for (i = pool->num_created + 1;i < n;++i) {
+        func(instance, i);
+    }
+
+    mutex_lock(&pool->mutex);
+    while (0 < pool->pending) {
+        cond_wait(&pool->cond_done, &pool->mutex);
+    }
+    mutex_unlock(&pool->mutex);
+}
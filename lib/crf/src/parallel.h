@@ -0,0 +1,139 @@
+/*
+ *      Fork-join parallelism.
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* $Id$ */
+
+#ifndef    __PARALLEL_H__
+#define    __PARALLEL_H__
+
+/**
+ * Function executed by a thread.
+ *  @param  instance    The user data.
+ *  @param  i           The index of the thread, from 0 to n-1.
+ */
+typedef void (*parallel_func_t)(void *instance, int i);
+
+/**
+ * Run a function concurrently on threads and wait for completion.
+ *  This function calls func(instance, i) for i = 0, ..., n-1 on separate
+ *  threads; the calling thread runs the call for i = 0. If a thread cannot
+ *  be created, the calling thread runs the remaining calls by itself, so
+ *  the function must not expect the calls to run at the same time.
+ *  @param  n           The number of threads.
+ *  @param  func        The function.
+ *  @param  instance    The user data passed to the function.
+ */
+void parallel_run(int n, parallel_func_t func, void *instance);
+
+/**
+ * Threads kept for repeated fork-join runs.
+ *  A pool creates its threads once; between runs, they wait on a condition
+ *  variable instead of being created and joined for every run.
+ */
+typedef struct tag_parallel_pool parallel_pool_t;
+
+/**
+ * Create a pool of threads.
+ *  @param  n           The number of threads including the calling one;
+ *                      the pool creates n-1 threads.
+ *  @return             The pointer to the pool, or NULL if out of memory.
+ */
+parallel_pool_t* parallel_pool_new(int n);
+
+/**
+ * Stop and join the threads of a pool, and delete the pool.
+ *  @param  pool        The pointer to the pool; this can be NULL.
+ */
+void parallel_pool_delete(parallel_pool_t* pool);
+
+/**
+ * Obtain the number of threads of a pool including the calling one.
+ *  @param  pool        The pointer to the pool.
+ *  @return             The number of threads given to parallel_pool_new().
+ */
+int parallel_pool_size(const parallel_pool_t* pool);
+
+/**
+ * Run a function concurrently on the threads of a pool and wait for
+ * completion.
+ *  This function behaves like parallel_run(), but on the threads of the
+ *  pool. Calls without a thread of the pool (i.e., those whose thread
+ *  could not be created) run on the calling thread. A pool must not run
+ *  two functions at the same time.
+ *  @param  pool        The pointer to the pool.
+ *  @param  n           The number of threads, which must not exceed the
+ *                      size of the pool.
+ *  @param  func        The function.
+ *  @param  instance    The user data passed to the function.
+ */
+void parallel_pool_run(parallel_pool_t* pool, int n, parallel_func_t func, void *instance);
+
+#ifdef  _MSC_VER
+#include <intrin.h>
+#endif/*_MSC_VER*/
+
+/**
+ * Add a value to an integer shared by threads, and return the old value.
+ *  @param  p           The pointer to the integer.
+ *  @param  v           The value to add.
+ *  @return             The value of the integer before the addition.
+ */
+inline static int parallel_fetch_add(int *p, int v)
+{
+#ifdef  _MSC_VER
+    return (int)_InterlockedExchangeAdd((volatile long*)p, (long)v);
+#else
+    return __atomic_fetch_add(p, v, __ATOMIC_RELAXED);
+#endif/*_MSC_VER*/
+}
+
+/**
+ * Add a value to a real number shared by threads without a lock.
+ *  The number is loaded and stored by relaxed atomic operations, so that
+ *  a thread never reads a torn value. The update is not a read-modify-write
+ *  operation, though; it may be lost when another thread writes the number
+ *  at the same time, which lock-free SGD (Hogwild!) tolerates.
+ *  @param  p           The pointer to the number (aligned to 8 bytes).
+ *  @param  v           The value to add.
+ */
+inline static void parallel_add_relaxed(double *p, double v)
+{
+#ifdef  _MSC_VER
+    /* Aligned 8-byte loads and stores are atomic on x86 and x64. */
+    *(volatile double*)p += v;
+#else
+    double x;
+    __atomic_load(p, &x, __ATOMIC_RELAXED);
+    x += v;
+    __atomic_store(p, &x, __ATOMIC_RELAXED);
+#endif/*_MSC_VER*/
+}
+
+#endif/*__PARALLEL_H__*/
@@ -45,6 +45,7 @@
 #include "logging.h"
 #include "params.h"
 #include "vecmath.h"
+#include "parallel.h"
 
 #define MIN(a, b)   ((a) < (b) ? (a) : (b))
 
@@ -202,6 +203,110 @@ static floatval_t tau2(floatval_t cost, floatval_t norm, floatval_t c)
     return cost / (norm + 0.5 / c);
 }
 
+/**
+ * Work area for training on a shard of the data set.
+ */
+typedef struct {
+    encoder_t *gm;      /**< Encoder of the thread. */
+    dataset_t *ds;      /**< Data set. */
+    int begin;          /**< Index of the first instance in the shard. */
+    int end;            /**< Index of the last instance in the shard plus one. */
+    floatval_t *mean;   /**< Mean vector [K]. */
+    floatval_t *cov;    /**< Covariance vector (diagonal matrix) [K]. */
+    floatval_t *prod;   /**< Squared difference vector [K]. */
+    int *viterbi;       /**< Viterbi path [T]. */
+    delta_t dc;         /**< Difference vector. */
+    floatval_t loss;    /**< Loss on the shard. */
+    const training_option_t *opt;
+} shard_t;
+
+static void train_shard(void *instance, int p)
+{
+    int n, j, k;
+    shard_t *shard = &((shard_t*)instance)[p];
+    encoder_t *gm = shard->gm;
+    delta_t *dc = &shard->dc;
+    int *viterbi = shard->viterbi;
+    floatval_t *mean = shard->mean, *cov = shard->cov, *prod = shard->prod;
+    const training_option_t *opt = shard->opt;
+
+    shard->loss = 0.;
+
+    /* Loop for each instance. */
+    for (n = shard->begin;n < shard->end;++n) {
+        int d = 0;
+        floatval_t sv;
+        const crfsuite_instance_t *inst = dataset_get(shard->ds, n);
+
+        /* Set the feature weights to the encoder. */
+        gm->set_weights(gm, mean, 1.);
+        gm->set_instance(gm, inst);
+
+        /* Tag the sequence with the current model. */
+        gm->viterbi(gm, viterbi, &sv);
+
+        /* Compute the number of different labels. */
+        d = diff(inst->labels, viterbi, inst->num_items);
+        if (0 < d) {
+            floatval_t alpha, frac;
+            floatval_t sc;
+            floatval_t cost;
+
+            /*
+                Compute the cost of this instance.
+             */
+            gm->score(gm, inst->labels, &sc);
+            cost = sv - sc + (double)d;
+
+            /* Initialize delta[k] = 0. */
+            delta_reset(dc);
+
+            /*
+                For every feature k on the correct path:
+                    delta[k] += 1;
+             */
+            dc->c = inst->weight;
+            gm->features_on_path(gm, inst, inst->labels, delta_collect, dc);
+
+            /*
+                For every feature k on the Viterbi path:
+                    delta[k] -= 1;
+             */
+            dc->c = -inst->weight;
+            gm->features_on_path(gm, inst, viterbi, delta_collect, dc);
+
+            delta_finalize(dc);
+
+            /* Compute prod[k] = delta[k] * delta[k]. */
+            for (j = 0;j < dc->num_actives;++j) {
+                k = dc->actives[j];
+                prod[k] = dc->delta[k] * dc->delta[k];
+            }
+
+            /*
+                Compute alpha.
+             */
+            frac = opt->gamma;
+            for (j = 0;j < dc->num_actives;++j) {
+                k = dc->actives[j];
+                frac += prod[k] * cov[k];
+            }
+            alpha = cost / frac;
+
+            /*
+                Update.
+             */
+            for (j = 0;j < dc->num_actives;++j) {
+                k = dc->actives[j];
+                mean[k] += alpha * cov[k] * dc->delta[k];
+                cov[k] = 1.0 / ((1.0 / cov[k]) + prod[k] / opt->gamma);
+            }
+
+            shard->loss += cost * inst->weight;
+        }
+    }
+}
+
 static int exchange_options(crfsuite_params_t* params, training_option_t* opt, int mode)
 {
     BEGIN_PARAM_MAP(params, mode)
@@ -240,36 +345,58 @@ int crfsuite_train_arow(
     floatval_t **ptr_w
     )
 {
-    int n, i, j, k, ret = 0;
-    int *viterbi = NULL;
+    int i, p, ret = 0;
     floatval_t beta;
-    floatval_t *mean = NULL, *cov = NULL, *prod = NULL;
+    floatval_t *mean = NULL, *cov = NULL;
+    shard_t *shards = NULL;
     const int N = trainset->num_instances;
     const int K = gm->num_features;
     const int T = gm->cap_items;
+    const int P = (1 < gm->num_threads) ? gm->num_threads : 1;
     training_option_t opt;
-    delta_t dc;
     clock_t begin = clock();
 
-	/* Initialize the variable. */
-    if (delta_init(&dc, K) != 0) {
-        ret = CRFSUITEERR_OUTOFMEMORY;
-        goto error_exit;
-    }
-
     /* Obtain parameter values. */
     exchange_options(params, &opt, -1);
 
     /* Allocate arrays. */
     mean = (floatval_t*)calloc(sizeof(floatval_t), K);
     cov = (floatval_t*)calloc(sizeof(floatval_t), K);
-    prod = (floatval_t*)calloc(sizeof(floatval_t), K);
-    viterbi = (int*)calloc(sizeof(int), T);
-    if (mean == NULL || cov == NULL || prod == NULL || viterbi == NULL) {
+    shards = (shard_t*)calloc(P, sizeof(shard_t));
+    if (mean == NULL || cov == NULL || shards == NULL) {
         ret = CRFSUITEERR_OUTOFMEMORY;
         goto error_exit;
     }
 
+    /*
+        Prepare the shards. The first shard trains the global mean and
+        covariance; the other shards train their own copies with forked
+        encoders, and the copies are mixed into the global vectors at the
+        end of every epoch (iterative parameter mixing).
+     */
+    for (p = 0;p < P;++p) {
+        shard_t *shard = &shards[p];
+        shard->ds = trainset;
+        shard->opt = &opt;
+        shard->prod = (floatval_t*)calloc(sizeof(floatval_t), K);
+        shard->viterbi = (int*)calloc(sizeof(int), T);
+        if (p == 0) {
+            shard->gm = gm;
+            shard->mean = mean;
+            shard->cov = cov;
+        } else {
+            shard->gm = gm->fork(gm);
+            shard->mean = (floatval_t*)calloc(sizeof(floatval_t), K);
+            shard->cov = (floatval_t*)calloc(sizeof(floatval_t), K);
+        }
+        if (delta_init(&shard->dc, K) != 0 || shard->gm == NULL ||
+            shard->mean == NULL || shard->cov == NULL ||
+            shard->prod == NULL || shard->viterbi == NULL) {
+            ret = CRFSUITEERR_OUTOFMEMORY;
+            goto error_exit;
+        }
+    }
+
     /* Initialize the covariance vector (diagnal matrix). */
     vecset(cov, opt.variance, K);
 
@@ -279,6 +406,7 @@ int crfsuite_train_arow(
     logging(lg, "gamma: %f\n", opt.gamma);
     logging(lg, "max_iterations: %d\n", opt.max_iterations);
     logging(lg, "epsilon: %f\n", opt.epsilon);
+    logging(lg, "num_threads: %d\n", P);
     logging(lg, "\n");
 
     beta = 1.0 / opt.gamma;
@@ -291,78 +419,35 @@ int crfsuite_train_arow(
         /* Shuffle the instances. */
         dataset_shuffle(trainset);
 
-		/* Loop for each instance. */
-        for (n = 0;n < N;++n) {
-            int d = 0;
-            floatval_t sv;
-            const crfsuite_instance_t *inst = dataset_get(trainset, n);
-
-            /* Set the feature weights to the encoder. */
-            gm->set_weights(gm, mean, 1.);
-            gm->set_instance(gm, inst);
-
-            /* Tag the sequence with the current model. */
-            gm->viterbi(gm, viterbi, &sv);
-
-            /* Compute the number of different labels. */
-            d = diff(inst->labels, viterbi, inst->num_items);
-            if (0 < d) {
-                floatval_t alpha, frac;
-                floatval_t sc;
-                floatval_t cost;
-
-                /*
-                    Compute the cost of this instance.
-                 */
-                gm->score(gm, inst->labels, &sc);
-                cost = sv - sc + (double)d;
-
-                /* Initialize delta[k] = 0. */
-                delta_reset(&dc);
-
-                /*
-                    For every feature k on the correct path:
-                        delta[k] += 1;
-                 */
-                dc.c = inst->weight;
-                gm->features_on_path(gm, inst, inst->labels, delta_collect, &dc);
-
-                /*
-                    For every feature k on the Viterbi path:
-                        delta[k] -= 1;
-                 */
-                dc.c = -inst->weight;
-                gm->features_on_path(gm, inst, viterbi, delta_collect, &dc);
-
-                delta_finalize(&dc);
-
-                /* Compute prod[k] = delta[k] * delta[k]. */
-                for (j = 0;j < dc.num_actives;++j) {
-                    k = dc.actives[j];
-                    prod[k] = dc.delta[k] * dc.delta[k];
-                }
-
-                /*
-                    Compute alpha.
-                 */
-                frac = opt.gamma;
-                for (j = 0;j < dc.num_actives;++j) {
-                    k = dc.actives[j];
-                    frac += prod[k] * cov[k];
-                }
-                alpha = cost / frac;
-
-                /*
-                    Update.
-                 */
-                for (j = 0;j < dc.num_actives;++j) {
-                    k = dc.actives[j];
-                    mean[k] += alpha * cov[k] * dc.delta[k];
-                    cov[k] = 1.0 / ((1.0 / cov[k]) + prod[k] / opt.gamma);
-                }
-
-                sum_loss += cost * inst->weight;
+        /* Train the shards on the threads, starting from the same vectors. */
+        for (p = 0;p < P;++p) {
+            shard_t *shard = &shards[p];
+            shard->begin = (int)((long long)N * p / P);
+            shard->end = (int)((long long)N * (p+1) / P);
+            if (0 < p) {
+                veccopy(shard->mean, mean, K);
+                veccopy(shard->cov, cov, K);
+            }
+        }
+        parallel_run(P, train_shard, shards);
+
+        /*
+            Mix the shards: average the means and the precisions (inverse
+            covariances), i.e., average the updates of the shards.
+         */
+        if (1 < P) {
+            vecinv(cov, K);
+            for (p = 1;p < P;++p) {
+                vecadd(mean, shards[p].mean, K);
+                vecinv(shards[p].cov, K);
+                vecadd(cov, shards[p].cov, K);
             }
+            vecscale(mean, 1. / P, K);
+            vecscale(cov, 1. / P, K);
+            vecinv(cov, K);
+        }
+        for (p = 0;p < P;++p) {
+            sum_loss += shards[p].loss;
         }
 
         /* Output the progress. */
@@ -389,20 +474,30 @@ int crfsuite_train_arow(
     logging(lg, "Total seconds required for training: %.3f\n", (clock() - begin) / (double)CLOCKS_PER_SEC);
     logging(lg, "\n");
 
-    free(viterbi);
-    free(prod);
-    free(cov);
     *ptr_w = mean;
-    delta_finish(&dc);
-    return ret;
+    mean = NULL;
 
 error_exit:
-    free(viterbi);
-    free(prod);
+    if (shards != NULL) {
+        for (p = 0;p < P;++p) {
+            delta_finish(&shards[p].dc);
+            free(shards[p].viterbi);
+            free(shards[p].prod);
+            if (0 < p) {
+                if (shards[p].gm != NULL) {
+                    shards[p].gm->release(shards[p].gm);
+                }
+                free(shards[p].cov);
+                free(shards[p].mean);
+            }
+        }
+        free(shards);
+    }
     free(cov);
     free(mean);
-    *ptr_w = NULL;
-    delta_finish(&dc);
+    if (ret != 0) {
+        *ptr_w = NULL;
+    }
 
     return ret;
 }
@@ -45,6 +45,7 @@
 #include "logging.h"
 #include "params.h"
 #include "vecmath.h"
+#include "parallel.h"
 
 /**
  * Training parameters (configurable with crfsuite_params_t interface).
@@ -71,6 +72,21 @@ static void update_weights(void *instance, int fid, floatval_t value)
     ud->ws[fid] += ud->cs * value;
 }
 
+/**
+ * Work area for training on a shard of the data set.
+ */
+typedef struct {
+    encoder_t *gm;      /**< Encoder of the thread. */
+    dataset_t *ds;      /**< Data set. */
+    int begin;          /**< Index of the first instance in the shard. */
+    int end;            /**< Index of the last instance in the shard plus one. */
+    floatval_t *w;      /**< Feature weights [K]. */
+    floatval_t *ws;     /**< Feature weights weighted by the update counter [K]. */
+    int *viterbi;       /**< Viterbi path [T]. */
+    int c;              /**< Update counter. */
+    floatval_t loss;    /**< Loss on the shard. */
+} shard_t;
+
 static int diff(int *x, int *y, int n)
 {
     int i, d = 0;
@@ -82,6 +98,57 @@ static int diff(int *x, int *y, int n)
     return d;
 }
 
+static void train_shard(void *instance, int p)
+{
+    int n;
+    update_data ud;
+    shard_t *shard = &((shard_t*)instance)[p];
+    encoder_t *gm = shard->gm;
+
+    ud.w = shard->w;
+    ud.ws = shard->ws;
+    shard->loss = 0.;
+
+    /* Loop for each instance. */
+    for (n = shard->begin;n < shard->end;++n) {
+        int d = 0;
+        floatval_t score;
+        const crfsuite_instance_t *inst = dataset_get(shard->ds, n);
+
+        /* Set the feature weights to the encoder. */
+        gm->set_weights(gm, shard->w, 1.);
+        gm->set_instance(gm, inst);
+
+        /* Tag the sequence with the current model. */
+        gm->viterbi(gm, shard->viterbi, &score);
+
+        /* Compute the number of different labels. */
+        d = diff(inst->labels, shard->viterbi, inst->num_items);
+        if (0 < d) {
+            /*
+                For every feature k on the correct path:
+                    w[k] += 1; ws[k] += c;
+             */
+            ud.c = inst->weight;
+            ud.cs = shard->c * inst->weight;
+            gm->features_on_path(gm, inst, inst->labels, update_weights, &ud);
+
+            /*
+                For every feature k on the Viterbi path:
+                    w[k] -= 1; ws[k] -= c;
+             */
+            ud.c = -inst->weight;
+            ud.cs = -shard->c * inst->weight;
+            gm->features_on_path(gm, inst, shard->viterbi, update_weights, &ud);
+
+            /* We define the loss as the ratio of wrongly predicted labels. */
+            shard->loss += d / (floatval_t)inst->num_items * inst->weight;
+        }
+
+        ++shard->c;
+    }
+}
+
 static int exchange_options(crfsuite_params_t* params, training_option_t* opt, int mode)
 {
     BEGIN_PARAM_MAP(params, mode)
@@ -112,21 +179,18 @@ int crfsuite_train_averaged_perceptron(
     floatval_t **ptr_w
     )
 {
-    int n, i, c, ret = 0;
-    int *viterbi = NULL;
+    int i, p, c, ret = 0;
     floatval_t *w = NULL;
     floatval_t *ws = NULL;
     floatval_t *wa = NULL;
+    shard_t *shards = NULL;
     const int N = trainset->num_instances;
     const int K = gm->num_features;
     const int T = gm->cap_items;
+    const int P = (1 < gm->num_threads) ? gm->num_threads : 1;
     training_option_t opt;
-    update_data ud;
     clock_t begin = clock();
 
-	/* Initialize the variable. */
-	memset(&ud, 0, sizeof(ud));
-
     /* Obtain parameter values. */
     exchange_options(params, &opt, -1);
 
@@ -134,21 +198,45 @@ int crfsuite_train_averaged_perceptron(
     w = (floatval_t*)calloc(sizeof(floatval_t), K);
     ws = (floatval_t*)calloc(sizeof(floatval_t), K);
     wa = (floatval_t*)calloc(sizeof(floatval_t), K);
-    viterbi = (int*)calloc(sizeof(int), T);
-    if (w == NULL || ws == NULL || wa == NULL || viterbi == NULL) {
+    shards = (shard_t*)calloc(P, sizeof(shard_t));
+    if (w == NULL || ws == NULL || wa == NULL || shards == NULL) {
         ret = CRFSUITEERR_OUTOFMEMORY;
         goto error_exit;
     }
 
+    /*
+        Prepare the shards. The first shard trains the global weights; the
+        other shards train their own copies with forked encoders, and the
+        copies are mixed into the global weights at the end of every epoch
+        (iterative parameter mixing).
+     */
+    for (p = 0;p < P;++p) {
+        shard_t *shard = &shards[p];
+        shard->ds = trainset;
+        shard->viterbi = (int*)calloc(sizeof(int), T);
+        if (p == 0) {
+            shard->gm = gm;
+            shard->w = w;
+            shard->ws = ws;
+        } else {
+            shard->gm = gm->fork(gm);
+            shard->w = (floatval_t*)calloc(sizeof(floatval_t), K);
+            shard->ws = (floatval_t*)calloc(sizeof(floatval_t), K);
+        }
+        if (shard->gm == NULL || shard->w == NULL || shard->ws == NULL || shard->viterbi == NULL) {
+            ret = CRFSUITEERR_OUTOFMEMORY;
+            goto error_exit;
+        }
+    }
+
     /* Show the parameters. */
     logging(lg, "Averaged perceptron\n");
     logging(lg, "max_iterations: %d\n", opt.max_iterations);
     logging(lg, "epsilon: %f\n", opt.epsilon);
+    logging(lg, "num_threads: %d\n", P);
     logging(lg, "\n");
 
     c = 1;
-    ud.w = w;
-    ud.ws = ws;
 
 	/* Loop for epoch. */
     for (i = 0;i < opt.max_iterations;++i) {
@@ -158,43 +246,37 @@ int crfsuite_train_averaged_perceptron(
         /* Shuffle the instances. */
         dataset_shuffle(trainset);
 
-		/* Loop for each instance. */
-        for (n = 0;n < N;++n) {
-            int d = 0;
-            floatval_t score;
-            const crfsuite_instance_t *inst = dataset_get(trainset, n);
-
-            /* Set the feature weights to the encoder. */
-            gm->set_weights(gm, w, 1.);
-            gm->set_instance(gm, inst);
-
-            /* Tag the sequence with the current model. */
-            gm->viterbi(gm, viterbi, &score);
-
-            /* Compute the number of different labels. */
-            d = diff(inst->labels, viterbi, inst->num_items);
-            if (0 < d) {
-                /*
-                    For every feature k on the correct path:
-                        w[k] += 1; ws[k] += c;
-                 */
-                ud.c = inst->weight;
-                ud.cs = c * inst->weight;
-                gm->features_on_path(gm, inst, inst->labels, update_weights, &ud);
-
-                /*
-                    For every feature k on the Viterbi path:
-                        w[k] -= 1; ws[k] -= c;
-                 */
-                ud.c = -inst->weight;
-                ud.cs = -c * inst->weight;
-                gm->features_on_path(gm, inst, viterbi, update_weights, &ud);
-
-                /* We define the loss as the ratio of wrongly predicted labels. */
-                loss += d / (floatval_t)inst->num_items * inst->weight;
+        /* Train the shards on the threads, starting from the same weights. */
+        for (p = 0;p < P;++p) {
+            shard_t *shard = &shards[p];
+            shard->begin = (int)((long long)N * p / P);
+            shard->end = (int)((long long)N * (p+1) / P);
+            shard->c = c;
+            if (0 < p) {
+                veccopy(shard->w, w, K);
+                veccopy(shard->ws, ws, K);
+            }
+        }
+        parallel_run(P, train_shard, shards);
+
+        /*
+            Mix the weights of the shards. The update counter advances by
+            the size of the largest shard; a smaller shard keeps its last
+            weights for the remaining steps in the average.
+         */
+        for (p = 1;p < P;++p) {
+            vecadd(w, shards[p].w, K);
+            vecadd(ws, shards[p].ws, K);
+        }
+        if (1 < P) {
+            vecscale(w, 1. / P, K);
+            vecscale(ws, 1. / P, K);
+        }
+        for (p = 0;p < P;++p) {
+            loss += shards[p].loss;
+            if (c < shards[p].c) {
+                c = shards[p].c;
             }
-
-            ++c;
         }
 
         /* Perform averaging to wa. */
@@ -225,18 +307,29 @@ int crfsuite_train_averaged_perceptron(
     logging(lg, "Total seconds required for training: %.3f\n", (clock() - begin) / (double)CLOCKS_PER_SEC);
     logging(lg, "\n");
 
-    free(viterbi);
-    free(ws);
-    free(w);
     *ptr_w = wa;
-    return ret;
+    wa = NULL;
 
 error_exit:
-    free(viterbi);
+    if (shards != NULL) {
+        for (p = 0;p < P;++p) {
+            free(shards[p].viterbi);
+            if (0 < p) {
+                if (shards[p].gm != NULL) {
+                    shards[p].gm->release(shards[p].gm);
+                }
+                free(shards[p].ws);
+                free(shards[p].w);
+            }
+        }
+        free(shards);
+    }
     free(wa);
     free(ws);
     free(w);
-    *ptr_w = NULL;
+    if (ret != 0) {
+        *ptr_w = NULL;
+    }
 
     return ret;
 }
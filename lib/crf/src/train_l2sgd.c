@@ -84,6 +84,22 @@
             delta = gain * (-P(y|x)) * f(x,y)
             w += delta
     4) Goto 1 until convergence.
+
+    Because eta * lambda = 1 / (t0 + t), the decay factor telescopes:
+        decay = \prod_{s=t_b}^{t} (1 - 1 / (t0 + s)) = (t0 + t_b - 1) / (t0 + t)
+    where t_b is the value of t when decay was reset to 1 (at the beginning
+    of an epoch). With multiple threads (num_threads), each thread takes the
+    next instance from the shared counter t, computes its decay and gain
+    from the closed form, and adds the updates to the shared weights with
+    relaxed atomic operations (Hogwild!):
+
+    Feng Niu, Benjamin Recht, Christopher Re, and Stephen J. Wright.
+    HOGWILD!: A Lock-Free Approach to Parallelizing Stochastic Gradient
+    Descent. In Proc. of NIPS 2011, pp 693-701, 2011.
+
+    A thread may thus read weights scaled with a slightly older decay, or
+    lose an update that collides with another thread; both are rare for
+    sparse features and do not affect the convergence in practice.
 */
 
 
@@ -107,6 +123,7 @@
 #include "params.h"
 #include "crf1d.h"
 #include "vecmath.h"
+#include "parallel.h"
 
 #define MIN(a, b)   ((a) < (b) ? (a) : (b))
 
@@ -124,6 +141,54 @@ typedef struct {
     int         calibration_max_trials;
 } training_option_t;
 
+/**
+ * Shared state of the threads processing an epoch.
+ */
+typedef struct {
+    encoder_t **gms;            /**< Encoders of the threads [num_threads]. */
+    floatval_t *losses;         /**< Losses accumulated by the threads [num_threads]. */
+    dataset_t *trainset;
+    floatval_t *w;
+    int N;
+    floatval_t t0;
+    floatval_t lambda;
+    floatval_t t;               /**< Number of updates before the epoch. */
+    int next;                   /**< Index of the next instance. */
+} l2sgd_hogwild_t;
+
+static void l2sgd_hogwild(void *instance, int p)
+{
+    l2sgd_hogwild_t *hw = (l2sgd_hogwild_t*)instance;
+    encoder_t *gm = hw->gms[p];
+    floatval_t eta, gain, decay, loss = 0, sum_loss = 0;
+    const floatval_t t0 = hw->t0;
+    const floatval_t lambda = hw->lambda;
+
+    for (;;) {
+        const int i = parallel_fetch_add(&hw->next, 1);
+        const floatval_t t = hw->t + i;
+        const crfsuite_instance_t *inst = NULL;
+        if (hw->N <= i) {
+            break;
+        }
+        inst = dataset_get(hw->trainset, i);
+
+        /* Compute various factors for the update #t. */
+        eta = 1 / (lambda * (t0 + t));
+        decay = (t0 + hw->t - 1) / (t0 + t);
+        gain = eta / decay;
+
+        /* Compute the loss and update the shared weights. */
+        gm->set_weights(gm, hw->w, decay);
+        gm->set_instance(gm, inst);
+        gm->objective_and_gradients(gm, &loss, hw->w, gain, inst->weight);
+
+        sum_loss += loss;
+    }
+
+    hw->losses[p] = sum_loss;
+}
+
 static int l2sgd(
     encoder_t *gm,
     dataset_t *trainset,
@@ -137,10 +202,12 @@ static int l2sgd(
     int calibration,
     int period,
     const floatval_t epsilon,
+    int num_threads,
     floatval_t *ptr_loss
     )
 {
     int i, epoch, ret = 0;
+    l2sgd_hogwild_t hw;
     floatval_t t = 0;
     floatval_t loss = 0, sum_loss = 0;
     floatval_t best_sum_loss = DBL_MAX;
@@ -152,6 +219,29 @@ static int l2sgd(
     clock_t clk_prev, clk_begin = clock();
     const int K = gm->num_features;
 
+    memset(&hw, 0, sizeof(hw));
+    if (1 < num_threads) {
+        /* Create an encoder for each thread. */
+        hw.gms = (encoder_t**)calloc(num_threads, sizeof(encoder_t*));
+        hw.losses = (floatval_t*)calloc(num_threads, sizeof(floatval_t));
+        if (hw.gms == NULL || hw.losses == NULL) {
+            ret = CRFSUITEERR_OUTOFMEMORY;
+            goto error_exit;
+        }
+        for (i = 0;i < num_threads;++i) {
+            hw.gms[i] = gm->fork(gm);
+            if (hw.gms[i] == NULL) {
+                ret = CRFSUITEERR_OUTOFMEMORY;
+                goto error_exit;
+            }
+        }
+        hw.trainset = trainset;
+        hw.w = w;
+        hw.N = N;
+        hw.t0 = t0;
+        hw.lambda = lambda;
+    }
+
     if (!calibration) {
         pf = (floatval_t*)malloc(sizeof(floatval_t) * period);
         best_w = (floatval_t*)calloc(K, sizeof(floatval_t));
@@ -176,21 +266,37 @@ static int l2sgd(
 
         /* Loop for instances. */
         sum_loss = 0.;
-        for (i = 0;i < N;++i) {
-            const crfsuite_instance_t *inst = dataset_get(trainset, i);
+        if (1 < num_threads) {
+            /* Process the instances on the threads. */
+            hw.t = t;
+            hw.next = 0;
+            parallel_run(num_threads, l2sgd_hogwild, &hw);
+            for (i = 0;i < num_threads;++i) {
+                sum_loss += hw.losses[i];
+            }
+            loss = sum_loss;
+            t += N;
+
+            /* The factors of the last update. */
+            eta = 1 / (lambda * (t0 + t - 1));
+            decay = (t0 + hw.t - 1) / (t0 + t - 1);
+        } else {
+            for (i = 0;i < N;++i) {
+                const crfsuite_instance_t *inst = dataset_get(trainset, i);
 
-            /* Update various factors. */
-            eta = 1 / (lambda * (t0 + t));
-            decay *= (1.0 - eta * lambda);
-            gain = eta / decay;
+                /* Update various factors. */
+                eta = 1 / (lambda * (t0 + t));
+                decay *= (1.0 - eta * lambda);
+                gain = eta / decay;
 
-            /* Compute the loss and gradients for the instance. */
-            gm->set_weights(gm, w, decay);
-            gm->set_instance(gm, inst);
-            gm->objective_and_gradients(gm, &loss, w, gain, inst->weight);
+                /* Compute the loss and gradients for the instance. */
+                gm->set_weights(gm, w, decay);
+                gm->set_instance(gm, inst);
+                gm->objective_and_gradients(gm, &loss, w, gain, inst->weight);
 
-            sum_loss += loss;
-            ++t;
+                sum_loss += loss;
+                ++t;
+            }
         }
 
         /* Terminate when the loss is abnormal (NaN, -Inf, +Inf). */
@@ -272,6 +378,15 @@ static int l2sgd(
     }
 
 error_exit:
+    if (hw.gms != NULL) {
+        for (i = 0;i < num_threads;++i) {
+            if (hw.gms[i] != NULL) {
+                hw.gms[i]->release(hw.gms[i]);
+            }
+        }
+    }
+    free(hw.gms);
+    free(hw.losses);
     free(best_w);
     free(pf);
     if (ptr_loss != NULL) {
@@ -343,7 +458,7 @@ l2sgd_calibration(
             NULL,
             w,
             lg,
-            S, 1.0 / (lambda * eta), lambda, 1, 1, 1, 0., &loss);
+            S, 1.0 / (lambda * eta), lambda, 1, 1, 1, 0., 1, &loss);
 
         /* Make sure that the learning rate decreases the log-likelihood. */
         ok = isfinite(loss) && (loss < init_loss);
@@ -471,6 +586,7 @@ int crfsuite_train_l2sgd(
     logging(lg, "max_iterations: %d\n", opt.max_iterations);
     logging(lg, "period: %d\n", opt.period);
     logging(lg, "delta: %f\n", opt.delta);
+    logging(lg, "num_threads: %d\n", gm->num_threads);
     logging(lg, "\n");
     clk_begin = clock();
 
@@ -491,6 +607,7 @@ int crfsuite_train_l2sgd(
         0,
         opt.period,
         opt.delta,
+        gm->num_threads,
         &loss
         );
 
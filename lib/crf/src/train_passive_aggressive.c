@@ -45,6 +45,7 @@
 #include "logging.h"
 #include "params.h"
 #include "vecmath.h"
+#include "parallel.h"
 
 #define MIN(a, b)   ((a) < (b) ? (a) : (b))
 
@@ -60,6 +61,12 @@ typedef struct {
     floatval_t epsilon;
 } training_option_t;
 
+/**
+ * Update rules chosen by the training parameters.
+ */
+typedef floatval_t (*cost_function_t)(floatval_t err, floatval_t d);
+typedef floatval_t (*tau_function_t)(floatval_t cost, floatval_t norm, floatval_t c);
+
 /**
  * Internal data structure for computing the sparse vector F(x, y) - F(x, y').
  */
@@ -204,6 +211,98 @@ static floatval_t tau2(floatval_t cost, floatval_t norm, floatval_t c)
     return cost / (norm + 0.5 / c);
 }
 
+/**
+ * Work area for training on a shard of the data set.
+ */
+typedef struct {
+    encoder_t *gm;      /**< Encoder of the thread. */
+    dataset_t *ds;      /**< Data set. */
+    int begin;          /**< Index of the first instance in the shard. */
+    int end;            /**< Index of the last instance in the shard plus one. */
+    floatval_t *w;      /**< Feature weights [K]. */
+    floatval_t *ws;     /**< Feature weights weighted by the update counter [K]. */
+    int *viterbi;       /**< Viterbi path [T]. */
+    delta_t dc;         /**< Difference vector. */
+    int u;              /**< Update counter. */
+    floatval_t loss;    /**< Loss on the shard. */
+    const training_option_t *opt;
+    cost_function_t cost_function;
+    tau_function_t tau_function;
+} shard_t;
+
+static void train_shard(void *instance, int p)
+{
+    int n;
+    shard_t *shard = &((shard_t*)instance)[p];
+    encoder_t *gm = shard->gm;
+    delta_t *dc = &shard->dc;
+    int *viterbi = shard->viterbi;
+
+    shard->loss = 0.;
+
+    /* Loop for each instance. */
+    for (n = shard->begin;n < shard->end;++n) {
+        int d = 0;
+        floatval_t sv;
+        const crfsuite_instance_t *inst = dataset_get(shard->ds, n);
+
+        /* Set the feature weights to the encoder. */
+        gm->set_weights(gm, shard->w, 1.);
+        gm->set_instance(gm, inst);
+
+        /* Tag the sequence with the current model. */
+        gm->viterbi(gm, viterbi, &sv);
+
+        /* Compute the number of different labels. */
+        d = diff(inst->labels, viterbi, inst->num_items);
+        if (0 < d) {
+            floatval_t sc, norm2;
+            floatval_t tau, cost;
+
+            /*
+                Compute the cost of this instance.
+             */
+            gm->score(gm, inst->labels, &sc);
+            cost = shard->cost_function(sv - sc, (double)d);
+
+            /* Initialize delta[k] = 0. */
+            delta_reset(dc);
+
+            /*
+                For every feature k on the correct path:
+                    delta[k] += 1;
+             */
+            dc->c = 1;
+            gm->features_on_path(gm, inst, inst->labels, delta_collect, dc);
+
+            /*
+                For every feature k on the Viterbi path:
+                    delta[k] -= 1;
+             */
+            dc->c = -1;
+            gm->features_on_path(gm, inst, viterbi, delta_collect, dc);
+
+            delta_finalize(dc);
+
+            /*
+                Compute tau (dpending on PA, PA-I, and PA-II).
+             */
+            norm2 = delta_norm2(dc);
+            tau = shard->tau_function(cost, norm2, shard->opt->c);
+
+            /*
+                Update the feature weights:
+                    w[k] += tau * delta[k]
+                    ws[k] += tau * u * delta[k]
+             */
+            delta_add(dc, shard->w, shard->ws, tau * inst->weight, shard->u);
+
+            shard->loss += cost * inst->weight;
+        }
+        ++shard->u;
+    }
+}
+
 static int exchange_options(crfsuite_params_t* params, training_option_t* opt, int mode)
 {
     BEGIN_PARAM_MAP(params, mode)
@@ -254,23 +353,17 @@ int crfsuite_train_passive_aggressive(
     floatval_t **ptr_w
     )
 {
-    int n, i, u, ret = 0;
-    int *viterbi = NULL;
+    int i, p, u, ret = 0;
     floatval_t *w = NULL, *ws = NULL, *wa = NULL;
+    shard_t *shards = NULL;
     const int N = trainset->num_instances;
     const int K = gm->num_features;
     const int T = gm->cap_items;
+    const int P = (1 < gm->num_threads) ? gm->num_threads : 1;
     training_option_t opt;
-    delta_t dc;
     clock_t begin = clock();
-    floatval_t (*cost_function)(floatval_t err, floatval_t d) = NULL;
-    floatval_t (*tau_function)(floatval_t cost, floatval_t norm, floatval_t c) = NULL;
-
-	/* Initialize the variable. */
-    if (delta_init(&dc, K) != 0) {
-        ret = CRFSUITEERR_OUTOFMEMORY;
-        goto error_exit;
-    }
+    cost_function_t cost_function = NULL;
+    tau_function_t tau_function = NULL;
 
     /* Obtain parameter values. */
     exchange_options(params, &opt, -1);
@@ -279,8 +372,8 @@ int crfsuite_train_passive_aggressive(
     w = (floatval_t*)calloc(sizeof(floatval_t), K);
     ws = (floatval_t*)calloc(sizeof(floatval_t), K);
     wa = (floatval_t*)calloc(sizeof(floatval_t), K);
-    viterbi = (int*)calloc(sizeof(int), T);
-    if (w == NULL || ws == NULL || wa == NULL || viterbi == NULL) {
+    shards = (shard_t*)calloc(P, sizeof(shard_t));
+    if (w == NULL || ws == NULL || wa == NULL || shards == NULL) {
         ret = CRFSUITEERR_OUTOFMEMORY;
         goto error_exit;
     }
@@ -301,6 +394,35 @@ int crfsuite_train_passive_aggressive(
         tau_function = tau0;
     }
 
+    /*
+        Prepare the shards. The first shard trains the global weights; the
+        other shards train their own copies with forked encoders, and the
+        copies are mixed into the global weights at the end of every epoch
+        (iterative parameter mixing).
+     */
+    for (p = 0;p < P;++p) {
+        shard_t *shard = &shards[p];
+        shard->ds = trainset;
+        shard->opt = &opt;
+        shard->cost_function = cost_function;
+        shard->tau_function = tau_function;
+        shard->viterbi = (int*)calloc(sizeof(int), T);
+        if (p == 0) {
+            shard->gm = gm;
+            shard->w = w;
+            shard->ws = ws;
+        } else {
+            shard->gm = gm->fork(gm);
+            shard->w = (floatval_t*)calloc(sizeof(floatval_t), K);
+            shard->ws = (floatval_t*)calloc(sizeof(floatval_t), K);
+        }
+        if (delta_init(&shard->dc, K) != 0 || shard->gm == NULL ||
+            shard->w == NULL || shard->ws == NULL || shard->viterbi == NULL) {
+            ret = CRFSUITEERR_OUTOFMEMORY;
+            goto error_exit;
+        }
+    }
+
     /* Show the parameters. */
     logging(lg, "Passive Aggressive\n");
     logging(lg, "type: %d\n", opt.type);
@@ -309,6 +431,7 @@ int crfsuite_train_passive_aggressive(
     logging(lg, "averaging: %d\n", opt.averaging);
     logging(lg, "max_iterations: %d\n", opt.max_iterations);
     logging(lg, "epsilon: %f\n", opt.epsilon);
+    logging(lg, "num_threads: %d\n", P);
     logging(lg, "\n");
 
     u = 1;
@@ -321,66 +444,37 @@ int crfsuite_train_passive_aggressive(
         /* Shuffle the instances. */
         dataset_shuffle(trainset);
 
-		/* Loop for each instance. */
-        for (n = 0;n < N;++n) {
-            int d = 0;
-            floatval_t sv;
-            const crfsuite_instance_t *inst = dataset_get(trainset, n);
-
-            /* Set the feature weights to the encoder. */
-            gm->set_weights(gm, w, 1.);
-            gm->set_instance(gm, inst);
-
-            /* Tag the sequence with the current model. */
-            gm->viterbi(gm, viterbi, &sv);
-
-            /* Compute the number of different labels. */
-            d = diff(inst->labels, viterbi, inst->num_items);
-            if (0 < d) {
-                floatval_t sc, norm2;
-                floatval_t tau, cost;
-
-                /*
-                    Compute the cost of this instance.
-                 */
-                gm->score(gm, inst->labels, &sc);
-                cost = cost_function(sv - sc, (double)d);
-
-                /* Initialize delta[k] = 0. */
-                delta_reset(&dc);
-
-                /*
-                    For every feature k on the correct path:
-                        delta[k] += 1;
-                 */
-                dc.c = 1;
-                gm->features_on_path(gm, inst, inst->labels, delta_collect, &dc);
-
-                /*
-                    For every feature k on the Viterbi path:
-                        delta[k] -= 1;
-                 */
-                dc.c = -1;
-                gm->features_on_path(gm, inst, viterbi, delta_collect, &dc);
-
-                delta_finalize(&dc);
-
-                /*
-                    Compute tau (dpending on PA, PA-I, and PA-II).
-                 */
-                norm2 = delta_norm2(&dc);
-                tau = tau_function(cost, norm2, opt.c);
-
-                /*
-                    Update the feature weights:
-                        w[k] += tau * delta[k]
-                        ws[k] += tau * u * delta[k]
-                 */
-                delta_add(&dc, w, ws, tau * inst->weight, u);
-
-                sum_loss += cost * inst->weight;
+        /* Train the shards on the threads, starting from the same weights. */
+        for (p = 0;p < P;++p) {
+            shard_t *shard = &shards[p];
+            shard->begin = (int)((long long)N * p / P);
+            shard->end = (int)((long long)N * (p+1) / P);
+            shard->u = u;
+            if (0 < p) {
+                veccopy(shard->w, w, K);
+                veccopy(shard->ws, ws, K);
+            }
+        }
+        parallel_run(P, train_shard, shards);
+
+        /*
+            Mix the weights of the shards. The update counter advances by
+            the size of the largest shard; a smaller shard keeps its last
+            weights for the remaining steps in the average.
+         */
+        for (p = 1;p < P;++p) {
+            vecadd(w, shards[p].w, K);
+            vecadd(ws, shards[p].ws, K);
+        }
+        if (1 < P) {
+            vecscale(w, 1. / P, K);
+            vecscale(ws, 1. / P, K);
+        }
+        for (p = 0;p < P;++p) {
+            sum_loss += shards[p].loss;
+            if (u < shards[p].u) {
+                u = shards[p].u;
             }
-            ++u;
         }
 
         if (opt.averaging) {
@@ -416,20 +510,30 @@ int crfsuite_train_passive_aggressive(
     logging(lg, "Total seconds required for training: %.3f\n", (clock() - begin) / (double)CLOCKS_PER_SEC);
     logging(lg, "\n");
 
-    free(viterbi);
-    free(ws);
-    free(w);
     *ptr_w = wa;
-    delta_finish(&dc);
-    return ret;
+    wa = NULL;
 
 error_exit:
-    free(viterbi);
+    if (shards != NULL) {
+        for (p = 0;p < P;++p) {
+            delta_finish(&shards[p].dc);
+            free(shards[p].viterbi);
+            if (0 < p) {
+                if (shards[p].gm != NULL) {
+                    shards[p].gm->release(shards[p].gm);
+                }
+                free(shards[p].ws);
+                free(shards[p].w);
+            }
+        }
+        free(shards);
+    }
     free(wa);
     free(ws);
     free(w);
-    *ptr_w = NULL;
-    delta_finish(&dc);
+    if (ret != 0) {
+        *ptr_w = NULL;
+    }
 
     return ret;
 }
@@ -0,0 +1,1717 @@
+/*
+ *      Mathematical operations for vectors (run-time dispatch).
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* $Id$ */
+
+#ifdef    HAVE_CONFIG_H
+#include <config.h>
+#endif/*HAVE_CONFIG_H*/
+
+#include <os.h>
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <crfsuite.h>
+#include "vecmath.h"
+
+/*
+    The SSE2, AVX2, and AVX-512 implementations are compiled into every x86
+    build (unless SSE2 is disabled by the configure script); GCC and Clang
+    enable the instruction sets per function with the target attribute so
+    that the library runs on any CPU, and MSVC accepts the intrinsics without
+    special compiler options.
+ */
+#if defined(USE_SSE) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+#define VECMATH_X86     1
+#include <immintrin.h>
+#if defined(__GNUC__)
+#include <cpuid.h>
+#define VECMATH_TARGET(isa)     __attribute__((target(isa)))
+#else
+#include <intrin.h>
+#define VECMATH_TARGET(isa)
+#endif
+#endif/*USE_SSE*/
+
+/*
+    The range reductions of the exponential and logarithm kernels rely on the
+    order of the floating-point operations; GCC keeps it under -ffast-math
+    for the functions with this attribute.
+ */
+#if defined(__GNUC__) && !defined(__clang__)
+#define VECMATH_STRICT          __attribute__((optimize("no-associative-math")))
+#else
+#define VECMATH_STRICT
+#endif
+
+
+/*
+    Constants for the exponential function, exp(x) = 2^k * exp(r), where
+    k is an integer close to x / log(2) and r = x - k * log(2) is computed in
+    two steps (EXP_C1 + EXP_C2 = log(2)) to retain the precision. The
+    arguments are clamped to [EXP_MINLOG, EXP_MAXLOG].
+ */
+#define EXP_LOG2E   1.4426950408889634073599
+#define EXP_MAXLOG  7.09782712893383996843e2    /* log(2**1024) */
+#define EXP_MINLOG  -7.08396418532264106224e2   /* log(2**-1022) */
+#define EXP_C1      6.93145751953125E-1
+#define EXP_C2      1.42860682030941723212E-6
+
+/* Polynomial approximation of exp(r) for r in [0, log(2)). */
+#define EXP_W11     3.5524625185478232665958141148891055719216674475023e-8
+#define EXP_W10     2.5535368519306500343384723775435166753084614063349e-7
+#define EXP_W9      2.77750562801295315877005242757916081614772210463065e-6
+#define EXP_W8      2.47868893393199945541176652007657202642495832996107e-5
+#define EXP_W7      1.98419213985637881240770890090795533564573406893163e-4
+#define EXP_W6      1.3888869684178659239014256260881685824525255547326e-3
+#define EXP_W5      8.3333337052009872221152811550156335074160546333973e-3
+#define EXP_W4      4.1666666621080810610346717440523105184720007971655e-2
+#define EXP_W3      0.166666666669960803484477734308515404418108830469798
+#define EXP_W2      0.499999999999877094481580370323249951329122224389189
+#define EXP_W1      1.0000000000000017952745258419615282194236357388884
+#define EXP_W0      0.99999999999999999566016490920259318691496540598896
+
+/*
+    Taylor polynomial of exp(r) of degree 7 for the fast exponential
+    function, where r in [-log(2)/2, log(2)/2] (k is rounded to the nearest
+    integer). The truncation error is below r^8/8! < 5.2e-9 (relative error
+    below 7.4e-9).
+ */
+#define FEXP_W7     (1. / 5040.)
+#define FEXP_W6     (1. / 720.)
+#define FEXP_W5     (1. / 120.)
+#define FEXP_W4     (1. / 24.)
+#define FEXP_W3     (1. / 6.)
+#define FEXP_W2     (1. / 2.)
+
+/*
+    Constants for the logarithm function (from fdlibm e_log.c), log(x) =
+    k * log(2) + log(1+f), where x = 2^k * (1+f) and sqrt(2)/2 <= 1+f <
+    sqrt(2). With s = f / (2+f), log(1+f) = f - f*f/2 + s * (f*f/2 + R(s*s)),
+    where R is a polynomial of degree 7 whose error is below 2^-58.45; the
+    result is accurate to 1 ulp. The vectorized implementations handle
+    positive normal numbers and fall back to libm for other values.
+ */
+#define LOG_SQRT2   1.41421356237309504880
+#define LOG_LN2HI   6.93147180369123816490e-01
+#define LOG_LN2LO   1.90821492927058770002e-10
+#define LOG_LG1     6.666666666666735130e-01
+#define LOG_LG2     3.999999999940941908e-01
+#define LOG_LG3     2.857142874366239149e-01
+#define LOG_LG4     2.222219843214978396e-01
+#define LOG_LG5     1.818357216161805012e-01
+#define LOG_LG6     1.531383769920937332e-01
+#define LOG_LG7     1.479819860511658591e-01
+
+
+/*
+ * Plain C implementations.
+ */
+
+static void scalar_add(floatval_t *y, const floatval_t *x, const int n)
+{
+    int i;
+    for (i = 0;i < n;++i) {
+        y[i] += x[i];
+    }
+}
+
+static void scalar_aadd(floatval_t *y, const floatval_t a, const floatval_t *x, const int n)
+{
+    int i;
+    for (i = 0;i < n;++i) {
+        y[i] += a * x[i];
+    }
+}
+
+static void scalar_sub(floatval_t *y, const floatval_t *x, const int n)
+{
+    int i;
+    for (i = 0;i < n;++i) {
+        y[i] -= x[i];
+    }
+}
+
+static void scalar_asub(floatval_t *y, const floatval_t a, const floatval_t *x, const int n)
+{
+    int i;
+    for (i = 0;i < n;++i) {
+        y[i] -= a * x[i];
+    }
+}
+
+static void scalar_mul(floatval_t *y, const floatval_t *x, const int n)
+{
+    int i;
+    for (i = 0;i < n;++i) {
+        y[i] *= x[i];
+    }
+}
+
+static void scalar_inv(floatval_t *y, const int n)
+{
+    int i;
+    for (i = 0;i < n;++i) {
+        y[i] = 1. / y[i];
+    }
+}
+
+static void scalar_scale(floatval_t *y, const floatval_t a, const int n)
+{
+    int i;
+    for (i = 0;i < n;++i) {
+        y[i] *= a;
+    }
+}
+
+static floatval_t scalar_dot(const floatval_t *x, const floatval_t *y, const int n)
+{
+    int i;
+    floatval_t s = 0;
+    for (i = 0;i < n;++i) {
+        s += x[i] * y[i];
+    }
+    return s;
+}
+
+static floatval_t scalar_sum(const floatval_t *x, const int n)
+{
+    int i;
+    floatval_t s = 0.;
+    for (i = 0;i < n;++i) {
+        s += x[i];
+    }
+    return s;
+}
+
+static floatval_t scalar_sumlog(const floatval_t *x, const int n)
+{
+    int i;
+    floatval_t s = 0.;
+    for (i = 0;i < n;++i) {
+        s += log(x[i]);
+    }
+    return s;
+}
+
+static void scalar_exp(floatval_t *values, const int n)
+{
+    int i;
+    for (i = 0;i < n;++i) {
+        values[i] = exp(values[i]);
+    }
+}
+
+static int scalar_addargmax(floatval_t *max, const floatval_t *x, const floatval_t *y, const int n)
+{
+    int i, argmax = -1;
+    floatval_t s, m = *max;
+    for (i = 0;i < n;++i) {
+        s = x[i] + y[i];
+        if (m < s) {
+            m = s;
+            argmax = i;
+        }
+    }
+    if (0 <= argmax) {
+        *max = m;
+    }
+    return argmax;
+}
+
+/*
+ * Scan the elements [k, n) sequentially after a SIMD pass has found the
+ * maximum m of the leading elements [0, k). A later sum must exceed m to
+ * win a tie. On return, *found tells whether any sum exceeds the lower
+ * bound *max (and *max is updated if so); the function returns the index
+ * of the maximum if it lies in [k, n), or -1 if the caller must locate it
+ * among the leading elements.
+ */
+static int addargmax_tail(floatval_t *max, floatval_t m, const floatval_t *x, const floatval_t *y, const int k, const int n, int *found)
+{
+    int i, argmax = -1;
+    floatval_t s;
+
+    *found = (*max < m);
+    for (i = k;i < n;++i) {
+        s = x[i] + y[i];
+        if (m < s) {
+            m = s;
+            argmax = i;
+            *found = 1;
+        }
+    }
+    if (*found) {
+        *max = m;
+    }
+    return argmax;
+}
+
+static void scalar_lanematmul(floatval_t *y, const floatval_t *a, const floatval_t *x, const int n)
+{
+    int i, j, b;
+    for (j = 0;j < n;++j) {
+        floatval_t *yj = &y[j * VECMATH_LANES];
+        for (b = 0;b < VECMATH_LANES;++b) {
+            yj[b] = 0.;
+        }
+        for (i = 0;i < n;++i) {
+            const floatval_t aij = a[i * n + j];
+            const floatval_t *xi = &x[i * VECMATH_LANES];
+            for (b = 0;b < VECMATH_LANES;++b) {
+                yj[b] += aij * xi[b];
+            }
+        }
+    }
+}
+
+static void scalar_lanemuladd(floatval_t *y, const floatval_t *x, const floatval_t *z, const int n)
+{
+    int i;
+    for (i = 0;i < n * VECMATH_LANES;++i) {
+        y[i] += x[i % VECMATH_LANES] * z[i];
+    }
+}
+
+static void scalar_lanemaxplus(floatval_t *y, int *back, const floatval_t *a, const floatval_t *x, const int n)
+{
+    int i, j, b;
+    for (j = 0;j < n;++j) {
+        floatval_t *yj = &y[j * VECMATH_LANES];
+        int *bj = &back[j * VECMATH_LANES];
+        for (b = 0;b < VECMATH_LANES;++b) {
+            yj[b] = x[b] + a[j];
+            bj[b] = 0;
+        }
+        for (i = 1;i < n;++i) {
+            const floatval_t aij = a[i * n + j];
+            const floatval_t *xi = &x[i * VECMATH_LANES];
+            for (b = 0;b < VECMATH_LANES;++b) {
+                if (yj[b] < xi[b] + aij) {
+                    yj[b] = xi[b] + aij;
+                    bj[b] = i;
+                }
+            }
+        }
+    }
+}
+
+static void scalar_maxplusf(float *y, int *back, const float *a, const float *x, const int n)
+{
+    int i, j;
+    for (j = 0;j < n;++j) {
+        float m = x[0] + a[j];
+        int argmax = 0;
+        for (i = 1;i < n;++i) {
+            if (m < x[i] + a[i * n + j]) {
+                m = x[i] + a[i * n + j];
+                argmax = i;
+            }
+        }
+        y[j] = m;
+        back[j] = argmax;
+    }
+}
+
+static const vecmath_t vecmath_scalar = {
+    VECMATH_SCALAR, "scalar",
+    scalar_add, scalar_aadd, scalar_sub, scalar_asub, scalar_mul,
+    scalar_inv, scalar_scale, scalar_dot, scalar_sum, scalar_sumlog,
+    scalar_exp, scalar_exp, scalar_addargmax,
+    scalar_lanematmul, scalar_lanemuladd, scalar_lanemaxplus,
+    scalar_maxplusf,
+};
+
+#ifdef  VECMATH_X86
+
+/*
+ * SSE2 implementations.
+ */
+
+static void sse2_add(floatval_t *y, const floatval_t *x, const int n)
+{
+    int i;
+    for (i = 0;i + 2 <= n;i += 2) {
+        _mm_storeu_pd(y+i, _mm_add_pd(_mm_loadu_pd(y+i), _mm_loadu_pd(x+i)));
+    }
+    for (;i < n;++i) {
+        y[i] += x[i];
+    }
+}
+
+static void sse2_aadd(floatval_t *y, const floatval_t a, const floatval_t *x, const int n)
+{
+    int i;
+    const __m128d va = _mm_set1_pd(a);
+    for (i = 0;i + 2 <= n;i += 2) {
+        __m128d vx = _mm_mul_pd(va, _mm_loadu_pd(x+i));
+        _mm_storeu_pd(y+i, _mm_add_pd(_mm_loadu_pd(y+i), vx));
+    }
+    for (;i < n;++i) {
+        y[i] += a * x[i];
+    }
+}
+
+static void sse2_sub(floatval_t *y, const floatval_t *x, const int n)
+{
+    int i;
+    for (i = 0;i + 2 <= n;i += 2) {
+        _mm_storeu_pd(y+i, _mm_sub_pd(_mm_loadu_pd(y+i), _mm_loadu_pd(x+i)));
+    }
+    for (;i < n;++i) {
+        y[i] -= x[i];
+    }
+}
+
+static void sse2_asub(floatval_t *y, const floatval_t a, const floatval_t *x, const int n)
+{
+    int i;
+    const __m128d va = _mm_set1_pd(a);
+    for (i = 0;i + 2 <= n;i += 2) {
+        __m128d vx = _mm_mul_pd(va, _mm_loadu_pd(x+i));
+        _mm_storeu_pd(y+i, _mm_sub_pd(_mm_loadu_pd(y+i), vx));
+    }
+    for (;i < n;++i) {
+        y[i] -= a * x[i];
+    }
+}
+
+static void sse2_mul(floatval_t *y, const floatval_t *x, const int n)
+{
+    int i;
+    for (i = 0;i + 2 <= n;i += 2) {
+        _mm_storeu_pd(y+i, _mm_mul_pd(_mm_loadu_pd(y+i), _mm_loadu_pd(x+i)));
+    }
+    for (;i < n;++i) {
+        y[i] *= x[i];
+    }
+}
+
+static void sse2_inv(floatval_t *y, const int n)
+{
+    int i;
+    const __m128d one = _mm_set1_pd(1.);
+    for (i = 0;i + 2 <= n;i += 2) {
+        _mm_storeu_pd(y+i, _mm_div_pd(one, _mm_loadu_pd(y+i)));
+    }
+    for (;i < n;++i) {
+        y[i] = 1. / y[i];
+    }
+}
+
+static void sse2_scale(floatval_t *y, const floatval_t a, const int n)
+{
+    int i;
+    const __m128d va = _mm_set1_pd(a);
+    for (i = 0;i + 2 <= n;i += 2) {
+        _mm_storeu_pd(y+i, _mm_mul_pd(_mm_loadu_pd(y+i), va));
+    }
+    for (;i < n;++i) {
+        y[i] *= a;
+    }
+}
+
+static floatval_t sse2_dot(const floatval_t *x, const floatval_t *y, const int n)
+{
+    int i;
+    floatval_t s;
+    __m128d vs = _mm_setzero_pd();
+    for (i = 0;i + 2 <= n;i += 2) {
+        vs = _mm_add_pd(vs, _mm_mul_pd(_mm_loadu_pd(x+i), _mm_loadu_pd(y+i)));
+    }
+    s = _mm_cvtsd_f64(_mm_add_sd(vs, _mm_unpackhi_pd(vs, vs)));
+    for (;i < n;++i) {
+        s += x[i] * y[i];
+    }
+    return s;
+}
+
+static floatval_t sse2_sum(const floatval_t *x, const int n)
+{
+    int i;
+    floatval_t s;
+    __m128d vs = _mm_setzero_pd();
+    for (i = 0;i + 2 <= n;i += 2) {
+        vs = _mm_add_pd(vs, _mm_loadu_pd(x+i));
+    }
+    s = _mm_cvtsd_f64(_mm_add_sd(vs, _mm_unpackhi_pd(vs, vs)));
+    for (;i < n;++i) {
+        s += x[i];
+    }
+    return s;
+}
+
+VECMATH_STRICT
+static void sse2_exp(floatval_t *values, const int n)
+{
+    int i;
+    CONST_128D(one, 1.);
+    CONST_128D(log2e, 1.4426950408889634073599);
+    CONST_128D(maxlog, 7.09782712893383996843e2);   // log(2**1024)
+    CONST_128D(minlog, -7.08396418532264106224e2);  // log(2**-1022)
+    CONST_128D(c1, 6.93145751953125E-1);
+    CONST_128D(c2, 1.42860682030941723212E-6);
+    CONST_128D(w11, 3.5524625185478232665958141148891055719216674475023e-8);
+    CONST_128D(w10, 2.5535368519306500343384723775435166753084614063349e-7);
+    CONST_128D(w9, 2.77750562801295315877005242757916081614772210463065e-6);
+    CONST_128D(w8, 2.47868893393199945541176652007657202642495832996107e-5);
+    CONST_128D(w7, 1.98419213985637881240770890090795533564573406893163e-4);
+    CONST_128D(w6, 1.3888869684178659239014256260881685824525255547326e-3);
+    CONST_128D(w5, 8.3333337052009872221152811550156335074160546333973e-3);
+    CONST_128D(w4, 4.1666666621080810610346717440523105184720007971655e-2);
+    CONST_128D(w3, 0.166666666669960803484477734308515404418108830469798);
+    CONST_128D(w2, 0.499999999999877094481580370323249951329122224389189);
+    CONST_128D(w1, 1.0000000000000017952745258419615282194236357388884);
+    CONST_128D(w0, 0.99999999999999999566016490920259318691496540598896);
+    const __m128i offset = _mm_setr_epi32(1023, 1023, 0, 0);
+
+    for (i = 0;i < n;i += 4) {
+        __m128i k1, k2;
+        __m128d p1, p2;
+        __m128d a1, a2;
+        __m128d xmm0, xmm1;
+        __m128d x1, x2;
+
+        /* Load four double values. */
+        xmm0 = _mm_load_pd(maxlog);
+        xmm1 = _mm_load_pd(minlog);
+        x1 = _mm_load_pd(values+i);
+        x2 = _mm_load_pd(values+i+2);
+        x1 = _mm_min_pd(x1, xmm0);
+        x2 = _mm_min_pd(x2, xmm0);
+        x1 = _mm_max_pd(x1, xmm1);
+        x2 = _mm_max_pd(x2, xmm1);
+
+        /* a = x / log2; */
+        xmm0 = _mm_load_pd(log2e);
+        xmm1 = _mm_setzero_pd();
+        a1 = _mm_mul_pd(x1, xmm0);
+        a2 = _mm_mul_pd(x2, xmm0);
+
+        /* k = (int)floor(a); p = (float)k; */
+        p1 = _mm_cmplt_pd(a1, xmm1);
+        p2 = _mm_cmplt_pd(a2, xmm1);
+        xmm0 = _mm_load_pd(one);
+        p1 = _mm_and_pd(p1, xmm0);
+        p2 = _mm_and_pd(p2, xmm0);
+        a1 = _mm_sub_pd(a1, p1);
+        a2 = _mm_sub_pd(a2, p2);
+        k1 = _mm_cvttpd_epi32(a1);
+        k2 = _mm_cvttpd_epi32(a2);
+        p1 = _mm_cvtepi32_pd(k1);
+        p2 = _mm_cvtepi32_pd(k2);
+
+        /* x -= p * log2; */
+        xmm0 = _mm_load_pd(c1);
+        xmm1 = _mm_load_pd(c2);
+        a1 = _mm_mul_pd(p1, xmm0);
+        a2 = _mm_mul_pd(p2, xmm0);
+        x1 = _mm_sub_pd(x1, a1);
+        x2 = _mm_sub_pd(x2, a2);
+        a1 = _mm_mul_pd(p1, xmm1);
+        a2 = _mm_mul_pd(p2, xmm1);
+        x1 = _mm_sub_pd(x1, a1);
+        x2 = _mm_sub_pd(x2, a2);
+
+        xmm0 = _mm_load_pd(w11);
+        xmm1 = _mm_load_pd(w10);
+        a1 = _mm_mul_pd(x1, xmm0);
+        a2 = _mm_mul_pd(x2, xmm0);
+        a1 = _mm_add_pd(a1, xmm1);
+        a2 = _mm_add_pd(a2, xmm1);
+
+        xmm0 = _mm_load_pd(w9);
+        xmm1 = _mm_load_pd(w8);
+        a1 = _mm_mul_pd(a1, x1);
+        a2 = _mm_mul_pd(a2, x2);
+        a1 = _mm_add_pd(a1, xmm0);
+        a2 = _mm_add_pd(a2, xmm0);
+        a1 = _mm_mul_pd(a1, x1);
+        a2 = _mm_mul_pd(a2, x2);
+        a1 = _mm_add_pd(a1, xmm1);
+        a2 = _mm_add_pd(a2, xmm1);
+
+        xmm0 = _mm_load_pd(w7);
+        xmm1 = _mm_load_pd(w6);
+        a1 = _mm_mul_pd(a1, x1);
+        a2 = _mm_mul_pd(a2, x2);
+        a1 = _mm_add_pd(a1, xmm0);
+        a2 = _mm_add_pd(a2, xmm0);
+        a1 = _mm_mul_pd(a1, x1);
+        a2 = _mm_mul_pd(a2, x2);
+        a1 = _mm_add_pd(a1, xmm1);
+        a2 = _mm_add_pd(a2, xmm1);
+
+        xmm0 = _mm_load_pd(w5);
+        xmm1 = _mm_load_pd(w4);
+        a1 = _mm_mul_pd(a1, x1);
+        a2 = _mm_mul_pd(a2, x2);
+        a1 = _mm_add_pd(a1, xmm0);
+        a2 = _mm_add_pd(a2, xmm0);
+        a1 = _mm_mul_pd(a1, x1);
+        a2 = _mm_mul_pd(a2, x2);
+        a1 = _mm_add_pd(a1, xmm1);
+        a2 = _mm_add_pd(a2, xmm1);
+
+        xmm0 = _mm_load_pd(w3);
+        xmm1 = _mm_load_pd(w2);
+        a1 = _mm_mul_pd(a1, x1);
+        a2 = _mm_mul_pd(a2, x2);
+        a1 = _mm_add_pd(a1, xmm0);
+        a2 = _mm_add_pd(a2, xmm0);
+        a1 = _mm_mul_pd(a1, x1);
+        a2 = _mm_mul_pd(a2, x2);
+        a1 = _mm_add_pd(a1, xmm1);
+        a2 = _mm_add_pd(a2, xmm1);
+
+        xmm0 = _mm_load_pd(w1);
+        xmm1 = _mm_load_pd(w0);
+        a1 = _mm_mul_pd(a1, x1);
+        a2 = _mm_mul_pd(a2, x2);
+        a1 = _mm_add_pd(a1, xmm0);
+        a2 = _mm_add_pd(a2, xmm0);
+        a1 = _mm_mul_pd(a1, x1);
+        a2 = _mm_mul_pd(a2, x2);
+        a1 = _mm_add_pd(a1, xmm1);
+        a2 = _mm_add_pd(a2, xmm1);
+
+        /* p = 2^k; */
+        k1 = _mm_add_epi32(k1, offset);
+        k2 = _mm_add_epi32(k2, offset);
+        k1 = _mm_slli_epi32(k1, 20);
+        k2 = _mm_slli_epi32(k2, 20);
+        k1 = _mm_shuffle_epi32(k1, 0x72);
+        k2 = _mm_shuffle_epi32(k2, 0x72);
+        p1 = _mm_castsi128_pd(k1);
+        p2 = _mm_castsi128_pd(k2);
+
+        /* a *= 2^k. */
+        a1 = _mm_mul_pd(a1, p1);
+        a2 = _mm_mul_pd(a2, p2);
+
+        /* Store the results. */
+        _mm_store_pd(values+i, a1);
+        _mm_store_pd(values+i+2, a2);
+    }
+}
+
+static void sse2_fastexp(floatval_t *values, const int n)
+{
+    int i;
+    const __m128d maxlog = _mm_set1_pd(EXP_MAXLOG);
+    const __m128d minlog = _mm_set1_pd(EXP_MINLOG);
+    const __m128d log2e = _mm_set1_pd(EXP_LOG2E);
+    const __m128d c1 = _mm_set1_pd(EXP_C1);
+    const __m128d c2 = _mm_set1_pd(EXP_C2);
+    const __m128d one = _mm_set1_pd(1.);
+    const __m128i offset = _mm_setr_epi32(1023, 1023, 0, 0);
+
+    for (i = 0;i < n;i += 2) {
+        __m128i k;
+        __m128d x, p, a;
+
+        x = _mm_load_pd(values+i);
+        x = _mm_min_pd(x, maxlog);
+        x = _mm_max_pd(x, minlog);
+
+        /* k = round(x / log2); */
+        k = _mm_cvtpd_epi32(_mm_mul_pd(x, log2e));
+        p = _mm_cvtepi32_pd(k);
+
+        /* x -= k * log2; */
+        x = _mm_sub_pd(x, _mm_mul_pd(p, c1));
+        x = _mm_sub_pd(x, _mm_mul_pd(p, c2));
+
+        a = _mm_add_pd(_mm_mul_pd(_mm_set1_pd(FEXP_W7), x), _mm_set1_pd(FEXP_W6));
+        a = _mm_add_pd(_mm_mul_pd(a, x), _mm_set1_pd(FEXP_W5));
+        a = _mm_add_pd(_mm_mul_pd(a, x), _mm_set1_pd(FEXP_W4));
+        a = _mm_add_pd(_mm_mul_pd(a, x), _mm_set1_pd(FEXP_W3));
+        a = _mm_add_pd(_mm_mul_pd(a, x), _mm_set1_pd(FEXP_W2));
+        a = _mm_add_pd(_mm_mul_pd(a, x), one);
+        a = _mm_add_pd(_mm_mul_pd(a, x), one);
+
+        /* a *= 2^k. */
+        k = _mm_add_epi32(k, offset);
+        k = _mm_slli_epi32(k, 20);
+        k = _mm_shuffle_epi32(k, 0x72);
+        a = _mm_mul_pd(a, _mm_castsi128_pd(k));
+
+        _mm_store_pd(values+i, a);
+    }
+}
+
+static int sse2_addargmax(floatval_t *max, const floatval_t *x, const floatval_t *y, const int n)
+{
+    int i, k, found, argmax;
+    __m128d vm = _mm_set1_pd(*max), vmax;
+
+    /* The maximum of the leading elements. */
+    for (i = 0;i + 2 <= n;i += 2) {
+        __m128d vs = _mm_add_pd(_mm_loadu_pd(x+i), _mm_loadu_pd(y+i));
+        vm = _mm_max_pd(vs, vm);
+    }
+    vm = _mm_max_sd(vm, _mm_unpackhi_pd(vm, vm));
+
+    argmax = addargmax_tail(max, _mm_cvtsd_f64(vm), x, y, i, n, &found);
+    if (!found || 0 <= argmax) {
+        return argmax;
+    }
+
+    /* Locate the first of the leading elements that reaches the maximum. */
+    vmax = _mm_set1_pd(*max);
+    for (i = 0;;i += 2) {
+        __m128d vs = _mm_add_pd(_mm_loadu_pd(x+i), _mm_loadu_pd(y+i));
+        int mask = _mm_movemask_pd(_mm_cmpeq_pd(vs, vmax));
+        if (mask) {
+            for (k = 0;!(mask & (1 << k));++k) ;
+            return i + k;
+        }
+    }
+}
+
+static void sse2_lanematmul(floatval_t *y, const floatval_t *a, const floatval_t *x, const int n)
+{
+    int i, j;
+    for (j = 0;j < n;++j) {
+        __m128d y0 = _mm_setzero_pd(), y1 = _mm_setzero_pd();
+        __m128d y2 = _mm_setzero_pd(), y3 = _mm_setzero_pd();
+        for (i = 0;i < n;++i) {
+            const __m128d aij = _mm_set1_pd(a[i * n + j]);
+            const floatval_t *xi = &x[i * VECMATH_LANES];
+            y0 = _mm_add_pd(y0, _mm_mul_pd(aij, _mm_loadu_pd(xi)));
+            y1 = _mm_add_pd(y1, _mm_mul_pd(aij, _mm_loadu_pd(xi+2)));
+            y2 = _mm_add_pd(y2, _mm_mul_pd(aij, _mm_loadu_pd(xi+4)));
+            y3 = _mm_add_pd(y3, _mm_mul_pd(aij, _mm_loadu_pd(xi+6)));
+        }
+        _mm_storeu_pd(&y[j * VECMATH_LANES], y0);
+        _mm_storeu_pd(&y[j * VECMATH_LANES + 2], y1);
+        _mm_storeu_pd(&y[j * VECMATH_LANES + 4], y2);
+        _mm_storeu_pd(&y[j * VECMATH_LANES + 6], y3);
+    }
+}
+
+static void sse2_lanemuladd(floatval_t *y, const floatval_t *x, const floatval_t *z, const int n)
+{
+    int i, b;
+    for (i = 0;i < n * VECMATH_LANES;i += VECMATH_LANES) {
+        for (b = 0;b < VECMATH_LANES;b += 2) {
+            __m128d v = _mm_mul_pd(_mm_loadu_pd(x+b), _mm_loadu_pd(z+i+b));
+            _mm_storeu_pd(y+i+b, _mm_add_pd(_mm_loadu_pd(y+i+b), v));
+        }
+    }
+}
+
+static void sse2_lanemaxplus(floatval_t *y, int *back, const floatval_t *a, const floatval_t *x, const int n)
+{
+    int i, j, b;
+    for (j = 0;j < n;++j) {
+        for (b = 0;b < VECMATH_LANES;b += 2) {
+            __m128d vm = _mm_add_pd(_mm_loadu_pd(x+b), _mm_set1_pd(a[j]));
+            __m128d vi = _mm_setzero_pd();
+            for (i = 1;i < n;++i) {
+                __m128d vs = _mm_add_pd(
+                    _mm_loadu_pd(&x[i * VECMATH_LANES + b]), _mm_set1_pd(a[i * n + j]));
+                __m128d gt = _mm_cmpgt_pd(vs, vm);
+                vm = _mm_max_pd(vs, vm);
+                vi = _mm_or_pd(_mm_and_pd(gt, _mm_set1_pd((double)i)), _mm_andnot_pd(gt, vi));
+            }
+            _mm_storeu_pd(&y[j * VECMATH_LANES + b], vm);
+            _mm_storel_epi64((__m128i*)&back[j * VECMATH_LANES + b], _mm_cvtpd_epi32(vi));
+        }
+    }
+}
+
+static void sse2_maxplusf(float *y, int *back, const float *a, const float *x, const int n)
+{
+    int i, j;
+    for (j = 0;j + 4 <= n;j += 4) {
+        __m128 vm = _mm_add_ps(_mm_set1_ps(x[0]), _mm_loadu_ps(a+j));
+        __m128i vi = _mm_setzero_si128();
+        for (i = 1;i < n;++i) {
+            __m128 vs = _mm_add_ps(_mm_set1_ps(x[i]), _mm_loadu_ps(&a[i * n + j]));
+            __m128i gt = _mm_castps_si128(_mm_cmpgt_ps(vs, vm));
+            vi = _mm_or_si128(_mm_and_si128(gt, _mm_set1_epi32(i)), _mm_andnot_si128(gt, vi));
+            vm = _mm_max_ps(vs, vm);
+        }
+        _mm_storeu_ps(y+j, vm);
+        _mm_storeu_si128((__m128i*)(back+j), vi);
+    }
+    for (;j < n;++j) {
+        float m = x[0] + a[j];
+        int argmax = 0;
+        for (i = 1;i < n;++i) {
+            if (m < x[i] + a[i * n + j]) {
+                m = x[i] + a[i * n + j];
+                argmax = i;
+            }
+        }
+        y[j] = m;
+        back[j] = argmax;
+    }
+}
+
+static const vecmath_t vecmath_sse2 = {
+    VECMATH_SSE2, "sse2",
+    sse2_add, sse2_aadd, sse2_sub, sse2_asub, sse2_mul,
+    sse2_inv, sse2_scale, sse2_dot, sse2_sum, scalar_sumlog,
+    sse2_exp, sse2_fastexp, sse2_addargmax,
+    sse2_lanematmul, sse2_lanemuladd, sse2_lanemaxplus,
+    sse2_maxplusf,
+};
+
+
+
+/*
+ * AVX2 implementations.
+ */
+
+VECMATH_TARGET("avx2,fma")
+static void avx2_add(floatval_t *y, const floatval_t *x, const int n)
+{
+    int i;
+    for (i = 0;i + 4 <= n;i += 4) {
+        _mm256_storeu_pd(y+i, _mm256_add_pd(_mm256_loadu_pd(y+i), _mm256_loadu_pd(x+i)));
+    }
+    for (;i < n;++i) {
+        y[i] += x[i];
+    }
+}
+
+VECMATH_TARGET("avx2,fma")
+static void avx2_aadd(floatval_t *y, const floatval_t a, const floatval_t *x, const int n)
+{
+    int i;
+    const __m256d va = _mm256_set1_pd(a);
+    for (i = 0;i + 4 <= n;i += 4) {
+        _mm256_storeu_pd(y+i, _mm256_fmadd_pd(va, _mm256_loadu_pd(x+i), _mm256_loadu_pd(y+i)));
+    }
+    for (;i < n;++i) {
+        y[i] += a * x[i];
+    }
+}
+
+VECMATH_TARGET("avx2,fma")
+static void avx2_sub(floatval_t *y, const floatval_t *x, const int n)
+{
+    int i;
+    for (i = 0;i + 4 <= n;i += 4) {
+        _mm256_storeu_pd(y+i, _mm256_sub_pd(_mm256_loadu_pd(y+i), _mm256_loadu_pd(x+i)));
+    }
+    for (;i < n;++i) {
+        y[i] -= x[i];
+    }
+}
+
+VECMATH_TARGET("avx2,fma")
+static void avx2_asub(floatval_t *y, const floatval_t a, const floatval_t *x, const int n)
+{
+    int i;
+    const __m256d va = _mm256_set1_pd(a);
+    for (i = 0;i + 4 <= n;i += 4) {
+        _mm256_storeu_pd(y+i, _mm256_fnmadd_pd(va, _mm256_loadu_pd(x+i), _mm256_loadu_pd(y+i)));
+    }
+    for (;i < n;++i) {
+        y[i] -= a * x[i];
+    }
+}
+
+VECMATH_TARGET("avx2,fma")
+static void avx2_mul(floatval_t *y, const floatval_t *x, const int n)
+{
+    int i;
+    for (i = 0;i + 4 <= n;i += 4) {
+        _mm256_storeu_pd(y+i, _mm256_mul_pd(_mm256_loadu_pd(y+i), _mm256_loadu_pd(x+i)));
+    }
+    for (;i < n;++i) {
+        y[i] *= x[i];
+    }
+}
+
+VECMATH_TARGET("avx2,fma")
+static void avx2_inv(floatval_t *y, const int n)
+{
+    int i;
+    const __m256d one = _mm256_set1_pd(1.);
+    for (i = 0;i + 4 <= n;i += 4) {
+        _mm256_storeu_pd(y+i, _mm256_div_pd(one, _mm256_loadu_pd(y+i)));
+    }
+    for (;i < n;++i) {
+        y[i] = 1. / y[i];
+    }
+}
+
+VECMATH_TARGET("avx2,fma")
+static void avx2_scale(floatval_t *y, const floatval_t a, const int n)
+{
+    int i;
+    const __m256d va = _mm256_set1_pd(a);
+    for (i = 0;i + 4 <= n;i += 4) {
+        _mm256_storeu_pd(y+i, _mm256_mul_pd(_mm256_loadu_pd(y+i), va));
+    }
+    for (;i < n;++i) {
+        y[i] *= a;
+    }
+}
+
+VECMATH_TARGET("avx2,fma")
+static floatval_t avx2_hsum(__m256d v)
+{
+    __m128d lo = _mm256_castpd256_pd128(v);
+    __m128d hi = _mm256_extractf128_pd(v, 1);
+    lo = _mm_add_pd(lo, hi);
+    return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+VECMATH_TARGET("avx2,fma")
+static floatval_t avx2_dot(const floatval_t *x, const floatval_t *y, const int n)
+{
+    int i;
+    floatval_t s;
+    __m256d vs = _mm256_setzero_pd();
+    for (i = 0;i + 4 <= n;i += 4) {
+        vs = _mm256_fmadd_pd(_mm256_loadu_pd(x+i), _mm256_loadu_pd(y+i), vs);
+    }
+    s = avx2_hsum(vs);
+    for (;i < n;++i) {
+        s += x[i] * y[i];
+    }
+    return s;
+}
+
+VECMATH_TARGET("avx2,fma")
+static floatval_t avx2_sum(const floatval_t *x, const int n)
+{
+    int i;
+    floatval_t s;
+    __m256d vs = _mm256_setzero_pd();
+    for (i = 0;i + 4 <= n;i += 4) {
+        vs = _mm256_add_pd(vs, _mm256_loadu_pd(x+i));
+    }
+    s = avx2_hsum(vs);
+    for (;i < n;++i) {
+        s += x[i];
+    }
+    return s;
+}
+
+VECMATH_TARGET("avx2,fma")
+VECMATH_STRICT
+static void avx2_exp(floatval_t *values, const int n)
+{
+    int i;
+    const __m256d maxlog = _mm256_set1_pd(EXP_MAXLOG);
+    const __m256d minlog = _mm256_set1_pd(EXP_MINLOG);
+    const __m256d log2e = _mm256_set1_pd(EXP_LOG2E);
+    const __m256d c1 = _mm256_set1_pd(EXP_C1);
+    const __m256d c2 = _mm256_set1_pd(EXP_C2);
+    const __m256i offset = _mm256_set1_epi64x(1023);
+
+    for (i = 0;i < n;i += 4) {
+        __m256i k;
+        __m256d x, p, a;
+
+        x = _mm256_loadu_pd(values+i);
+        x = _mm256_min_pd(x, maxlog);
+        x = _mm256_max_pd(x, minlog);
+
+        /* k = floor(x / log2); */
+        p = _mm256_floor_pd(_mm256_mul_pd(x, log2e));
+
+        /* x -= k * log2; */
+        x = _mm256_fnmadd_pd(p, c1, x);
+        x = _mm256_fnmadd_pd(p, c2, x);
+
+        a = _mm256_fmadd_pd(_mm256_set1_pd(EXP_W11), x, _mm256_set1_pd(EXP_W10));
+        a = _mm256_fmadd_pd(a, x, _mm256_set1_pd(EXP_W9));
+        a = _mm256_fmadd_pd(a, x, _mm256_set1_pd(EXP_W8));
+        a = _mm256_fmadd_pd(a, x, _mm256_set1_pd(EXP_W7));
+        a = _mm256_fmadd_pd(a, x, _mm256_set1_pd(EXP_W6));
+        a = _mm256_fmadd_pd(a, x, _mm256_set1_pd(EXP_W5));
+        a = _mm256_fmadd_pd(a, x, _mm256_set1_pd(EXP_W4));
+        a = _mm256_fmadd_pd(a, x, _mm256_set1_pd(EXP_W3));
+        a = _mm256_fmadd_pd(a, x, _mm256_set1_pd(EXP_W2));
+        a = _mm256_fmadd_pd(a, x, _mm256_set1_pd(EXP_W1));
+        a = _mm256_fmadd_pd(a, x, _mm256_set1_pd(EXP_W0));
+
+        /* a *= 2^k. */
+        k = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(p));
+        k = _mm256_slli_epi64(_mm256_add_epi64(k, offset), 52);
+        a = _mm256_mul_pd(a, _mm256_castsi256_pd(k));
+
+        _mm256_storeu_pd(values+i, a);
+    }
+}
+
+VECMATH_TARGET("avx2,fma")
+static void avx2_fastexp(floatval_t *values, const int n)
+{
+    int i;
+    const __m256d maxlog = _mm256_set1_pd(EXP_MAXLOG);
+    const __m256d minlog = _mm256_set1_pd(EXP_MINLOG);
+    const __m256d log2e = _mm256_set1_pd(EXP_LOG2E);
+    const __m256d c1 = _mm256_set1_pd(EXP_C1);
+    const __m256d c2 = _mm256_set1_pd(EXP_C2);
+    const __m256d one = _mm256_set1_pd(1.);
+    const __m256i offset = _mm256_set1_epi64x(1023);
+
+    for (i = 0;i < n;i += 4) {
+        __m256i k;
+        __m256d x, p, a;
+
+        x = _mm256_loadu_pd(values+i);
+        x = _mm256_min_pd(x, maxlog);
+        x = _mm256_max_pd(x, minlog);
+
+        /* k = round(x / log2); */
+        p = _mm256_round_pd(_mm256_mul_pd(x, log2e), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+
+        /* x -= k * log2; */
+        x = _mm256_fnmadd_pd(p, c1, x);
+        x = _mm256_fnmadd_pd(p, c2, x);
+
+        a = _mm256_fmadd_pd(_mm256_set1_pd(FEXP_W7), x, _mm256_set1_pd(FEXP_W6));
+        a = _mm256_fmadd_pd(a, x, _mm256_set1_pd(FEXP_W5));
+        a = _mm256_fmadd_pd(a, x, _mm256_set1_pd(FEXP_W4));
+        a = _mm256_fmadd_pd(a, x, _mm256_set1_pd(FEXP_W3));
+        a = _mm256_fmadd_pd(a, x, _mm256_set1_pd(FEXP_W2));
+        a = _mm256_fmadd_pd(a, x, one);
+        a = _mm256_fmadd_pd(a, x, one);
+
+        /* a *= 2^k. */
+        k = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(p));
+        k = _mm256_slli_epi64(_mm256_add_epi64(k, offset), 52);
+        a = _mm256_mul_pd(a, _mm256_castsi256_pd(k));
+
+        _mm256_storeu_pd(values+i, a);
+    }
+}
+
+/* Logarithms of four positive normal numbers. */
+VECMATH_TARGET("avx2,fma")
+VECMATH_STRICT
+static __m256d avx2_log(__m256d x)
+{
+    __m256i bits = _mm256_castpd_si256(x);
+    __m256d k, m, f, s, z, w, r, hfsq, big;
+    const __m256d one = _mm256_set1_pd(1.);
+
+    /* x = 2^k * m, where m in [1, 2). */
+    k = _mm256_castsi256_pd(_mm256_or_si256(
+        _mm256_srli_epi64(bits, 52), _mm256_set1_epi64x(0x4330000000000000LL)));
+    k = _mm256_sub_pd(k, _mm256_set1_pd(4503599627370496. + 1023.));
+    m = _mm256_castsi256_pd(_mm256_or_si256(
+        _mm256_and_si256(bits, _mm256_set1_epi64x(0x000FFFFFFFFFFFFFLL)),
+        _mm256_set1_epi64x(0x3FF0000000000000LL)));
+
+    /* Move m into [sqrt(2)/2, sqrt(2)). */
+    big = _mm256_cmp_pd(m, _mm256_set1_pd(LOG_SQRT2), _CMP_GE_OQ);
+    m = _mm256_blendv_pd(m, _mm256_mul_pd(m, _mm256_set1_pd(0.5)), big);
+    k = _mm256_add_pd(k, _mm256_and_pd(big, one));
+
+    f = _mm256_sub_pd(m, one);
+    s = _mm256_div_pd(f, _mm256_add_pd(f, _mm256_set1_pd(2.)));
+    z = _mm256_mul_pd(s, s);
+    w = _mm256_mul_pd(z, z);
+    r = _mm256_fmadd_pd(w, _mm256_set1_pd(LOG_LG7), _mm256_set1_pd(LOG_LG5));
+    r = _mm256_fmadd_pd(w, r, _mm256_set1_pd(LOG_LG3));
+    r = _mm256_fmadd_pd(w, r, _mm256_set1_pd(LOG_LG1));
+    r = _mm256_mul_pd(z, r);
+    w = _mm256_mul_pd(w, _mm256_fmadd_pd(w,
+        _mm256_fmadd_pd(w, _mm256_set1_pd(LOG_LG6), _mm256_set1_pd(LOG_LG4)),
+        _mm256_set1_pd(LOG_LG2)));
+    r = _mm256_add_pd(r, w);
+    hfsq = _mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(0.5), f), f);
+
+    /* k * ln2_hi - ((hfsq - (s * (hfsq + R) + k * ln2_lo)) - f) */
+    r = _mm256_fmadd_pd(s, _mm256_add_pd(hfsq, r), _mm256_mul_pd(k, _mm256_set1_pd(LOG_LN2LO)));
+    r = _mm256_sub_pd(_mm256_sub_pd(hfsq, r), f);
+    return _mm256_sub_pd(_mm256_mul_pd(k, _mm256_set1_pd(LOG_LN2HI)), r);
+}
+
+VECMATH_TARGET("avx2,fma")
+VECMATH_STRICT
+static floatval_t avx2_sumlog(const floatval_t *x, const int n)
+{
+    int i = 0;
+    floatval_t s = 0.;
+    const __m256d lower = _mm256_set1_pd(DBL_MIN);
+    const __m256d upper = _mm256_set1_pd(DBL_MAX);
+
+    while (i + 4 <= n) {
+        /* Sum up a run of blocks of normal numbers in a register. */
+        __m256d vs = _mm256_setzero_pd();
+        for (;i + 4 <= n;i += 4) {
+            __m256d v = _mm256_loadu_pd(x+i);
+            __m256d normal = _mm256_and_pd(
+                _mm256_cmp_pd(v, lower, _CMP_GE_OQ),
+                _mm256_cmp_pd(v, upper, _CMP_LE_OQ));
+            if (_mm256_movemask_pd(normal) != 0x0F) {
+                break;
+            }
+            vs = _mm256_add_pd(vs, avx2_log(v));
+        }
+        s += avx2_hsum(vs);
+
+        /* A block with a zero, subnormal, infinite, or NaN value. */
+        if (i + 4 <= n) {
+            s += scalar_sumlog(x+i, 4);
+            i += 4;
+        }
+    }
+    for (;i < n;++i) {
+        s += log(x[i]);
+    }
+    return s;
+}
+
+VECMATH_TARGET("avx2,fma")
+static int avx2_addargmax(floatval_t *max, const floatval_t *x, const floatval_t *y, const int n)
+{
+    int i, k, found, argmax;
+    __m128d lo, hi;
+    __m256d vm = _mm256_set1_pd(*max), vmax;
+
+    /* The maximum of the leading elements. */
+    for (i = 0;i + 4 <= n;i += 4) {
+        __m256d vs = _mm256_add_pd(_mm256_loadu_pd(x+i), _mm256_loadu_pd(y+i));
+        vm = _mm256_max_pd(vs, vm);
+    }
+    lo = _mm256_castpd256_pd128(vm);
+    hi = _mm256_extractf128_pd(vm, 1);
+    lo = _mm_max_pd(lo, hi);
+    lo = _mm_max_sd(lo, _mm_unpackhi_pd(lo, lo));
+
+    argmax = addargmax_tail(max, _mm_cvtsd_f64(lo), x, y, i, n, &found);
+    if (!found || 0 <= argmax) {
+        return argmax;
+    }
+
+    /* Locate the first of the leading elements that reaches the maximum. */
+    vmax = _mm256_set1_pd(*max);
+    for (i = 0;;i += 4) {
+        __m256d vs = _mm256_add_pd(_mm256_loadu_pd(x+i), _mm256_loadu_pd(y+i));
+        int mask = _mm256_movemask_pd(_mm256_cmp_pd(vs, vmax, _CMP_EQ_OQ));
+        if (mask) {
+            for (k = 0;!(mask & (1 << k));++k) ;
+            return i + k;
+        }
+    }
+}
+
+VECMATH_TARGET("avx2,fma")
+static void avx2_lanematmul(floatval_t *y, const floatval_t *a, const floatval_t *x, const int n)
+{
+    int i, j;
+    for (j = 0;j + 2 <= n;j += 2) {
+        __m256d y0 = _mm256_setzero_pd(), y1 = _mm256_setzero_pd();
+        __m256d y2 = _mm256_setzero_pd(), y3 = _mm256_setzero_pd();
+        for (i = 0;i < n;++i) {
+            const __m256d a0 = _mm256_set1_pd(a[i * n + j]);
+            const __m256d a1 = _mm256_set1_pd(a[i * n + j + 1]);
+            const __m256d x0 = _mm256_loadu_pd(&x[i * VECMATH_LANES]);
+            const __m256d x1 = _mm256_loadu_pd(&x[i * VECMATH_LANES + 4]);
+            y0 = _mm256_fmadd_pd(a0, x0, y0);
+            y1 = _mm256_fmadd_pd(a0, x1, y1);
+            y2 = _mm256_fmadd_pd(a1, x0, y2);
+            y3 = _mm256_fmadd_pd(a1, x1, y3);
+        }
+        _mm256_storeu_pd(&y[j * VECMATH_LANES], y0);
+        _mm256_storeu_pd(&y[j * VECMATH_LANES + 4], y1);
+        _mm256_storeu_pd(&y[(j+1) * VECMATH_LANES], y2);
+        _mm256_storeu_pd(&y[(j+1) * VECMATH_LANES + 4], y3);
+    }
+    for (;j < n;++j) {
+        __m256d y0 = _mm256_setzero_pd(), y1 = _mm256_setzero_pd();
+        for (i = 0;i < n;++i) {
+            const __m256d a0 = _mm256_set1_pd(a[i * n + j]);
+            y0 = _mm256_fmadd_pd(a0, _mm256_loadu_pd(&x[i * VECMATH_LANES]), y0);
+            y1 = _mm256_fmadd_pd(a0, _mm256_loadu_pd(&x[i * VECMATH_LANES + 4]), y1);
+        }
+        _mm256_storeu_pd(&y[j * VECMATH_LANES], y0);
+        _mm256_storeu_pd(&y[j * VECMATH_LANES + 4], y1);
+    }
+}
+
+VECMATH_TARGET("avx2,fma")
+static void avx2_lanemuladd(floatval_t *y, const floatval_t *x, const floatval_t *z, const int n)
+{
+    int i;
+    const __m256d x0 = _mm256_loadu_pd(x), x1 = _mm256_loadu_pd(x+4);
+    for (i = 0;i < n * VECMATH_LANES;i += VECMATH_LANES) {
+        _mm256_storeu_pd(y+i, _mm256_fmadd_pd(x0, _mm256_loadu_pd(z+i), _mm256_loadu_pd(y+i)));
+        _mm256_storeu_pd(y+i+4, _mm256_fmadd_pd(x1, _mm256_loadu_pd(z+i+4), _mm256_loadu_pd(y+i+4)));
+    }
+}
+
+VECMATH_TARGET("avx2,fma")
+static void avx2_lanemaxplus(floatval_t *y, int *back, const floatval_t *a, const floatval_t *x, const int n)
+{
+    int i, j;
+    for (j = 0;j < n;++j) {
+        __m256d a0 = _mm256_set1_pd(a[j]);
+        __m256d m0 = _mm256_add_pd(_mm256_loadu_pd(x), a0);
+        __m256d m1 = _mm256_add_pd(_mm256_loadu_pd(x+4), a0);
+        __m256d i0 = _mm256_setzero_pd(), i1 = _mm256_setzero_pd();
+        for (i = 1;i < n;++i) {
+            const __m256d aij = _mm256_set1_pd(a[i * n + j]);
+            const __m256d vi = _mm256_set1_pd((double)i);
+            __m256d s0 = _mm256_add_pd(_mm256_loadu_pd(&x[i * VECMATH_LANES]), aij);
+            __m256d s1 = _mm256_add_pd(_mm256_loadu_pd(&x[i * VECMATH_LANES + 4]), aij);
+            i0 = _mm256_blendv_pd(i0, vi, _mm256_cmp_pd(s0, m0, _CMP_GT_OQ));
+            i1 = _mm256_blendv_pd(i1, vi, _mm256_cmp_pd(s1, m1, _CMP_GT_OQ));
+            m0 = _mm256_max_pd(s0, m0);
+            m1 = _mm256_max_pd(s1, m1);
+        }
+        _mm256_storeu_pd(&y[j * VECMATH_LANES], m0);
+        _mm256_storeu_pd(&y[j * VECMATH_LANES + 4], m1);
+        _mm_storeu_si128((__m128i*)&back[j * VECMATH_LANES], _mm256_cvtpd_epi32(i0));
+        _mm_storeu_si128((__m128i*)&back[j * VECMATH_LANES + 4], _mm256_cvtpd_epi32(i1));
+    }
+}
+
+VECMATH_TARGET("avx2,fma")
+static void avx2_maxplusf(float *y, int *back, const float *a, const float *x, const int n)
+{
+    int i, j;
+    for (j = 0;j < n;j += 8) {
+        /* Mask out the labels [n, j+8) in the last block. */
+        const __m256i mask = _mm256_cmpgt_epi32(
+            _mm256_set1_epi32(n - j), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        __m256 vm = _mm256_add_ps(_mm256_set1_ps(x[0]), _mm256_maskload_ps(a+j, mask));
+        __m256i vi = _mm256_setzero_si256();
+        for (i = 1;i < n;++i) {
+            __m256 vs = _mm256_add_ps(_mm256_set1_ps(x[i]), _mm256_maskload_ps(&a[i * n + j], mask));
+            __m256 gt = _mm256_cmp_ps(vs, vm, _CMP_GT_OQ);
+            vi = _mm256_blendv_epi8(vi, _mm256_set1_epi32(i), _mm256_castps_si256(gt));
+            vm = _mm256_max_ps(vs, vm);
+        }
+        _mm256_maskstore_ps(y+j, mask, vm);
+        _mm256_maskstore_epi32(back+j, mask, vi);
+    }
+}
+
+static const vecmath_t vecmath_avx2 = {
+    VECMATH_AVX2, "avx2",
+    avx2_add, avx2_aadd, avx2_sub, avx2_asub, avx2_mul,
+    avx2_inv, avx2_scale, avx2_dot, avx2_sum, avx2_sumlog,
+    avx2_exp, avx2_fastexp, avx2_addargmax,
+    avx2_lanematmul, avx2_lanemuladd, avx2_lanemaxplus,
+    avx2_maxplusf,
+};
+
+
+
+/*
+ * AVX-512 implementations.
+ */
+
+VECMATH_TARGET("avx512f")
+static void avx512_add(floatval_t *y, const floatval_t *x, const int n)
+{
+    int i;
+    for (i = 0;i + 8 <= n;i += 8) {
+        _mm512_storeu_pd(y+i, _mm512_add_pd(_mm512_loadu_pd(y+i), _mm512_loadu_pd(x+i)));
+    }
+    for (;i < n;++i) {
+        y[i] += x[i];
+    }
+}
+
+VECMATH_TARGET("avx512f")
+static void avx512_aadd(floatval_t *y, const floatval_t a, const floatval_t *x, const int n)
+{
+    int i;
+    const __m512d va = _mm512_set1_pd(a);
+    for (i = 0;i + 8 <= n;i += 8) {
+        _mm512_storeu_pd(y+i, _mm512_fmadd_pd(va, _mm512_loadu_pd(x+i), _mm512_loadu_pd(y+i)));
+    }
+    for (;i < n;++i) {
+        y[i] += a * x[i];
+    }
+}
+
+VECMATH_TARGET("avx512f")
+static void avx512_sub(floatval_t *y, const floatval_t *x, const int n)
+{
+    int i;
+    for (i = 0;i + 8 <= n;i += 8) {
+        _mm512_storeu_pd(y+i, _mm512_sub_pd(_mm512_loadu_pd(y+i), _mm512_loadu_pd(x+i)));
+    }
+    for (;i < n;++i) {
+        y[i] -= x[i];
+    }
+}
+
+VECMATH_TARGET("avx512f")
+static void avx512_asub(floatval_t *y, const floatval_t a, const floatval_t *x, const int n)
+{
+    int i;
+    const __m512d va = _mm512_set1_pd(a);
+    for (i = 0;i + 8 <= n;i += 8) {
+        _mm512_storeu_pd(y+i, _mm512_fnmadd_pd(va, _mm512_loadu_pd(x+i), _mm512_loadu_pd(y+i)));
+    }
+    for (;i < n;++i) {
+        y[i] -= a * x[i];
+    }
+}
+
+VECMATH_TARGET("avx512f")
+static void avx512_mul(floatval_t *y, const floatval_t *x, const int n)
+{
+    int i;
+    for (i = 0;i + 8 <= n;i += 8) {
+        _mm512_storeu_pd(y+i, _mm512_mul_pd(_mm512_loadu_pd(y+i), _mm512_loadu_pd(x+i)));
+    }
+    for (;i < n;++i) {
+        y[i] *= x[i];
+    }
+}
+
+VECMATH_TARGET("avx512f")
+static void avx512_inv(floatval_t *y, const int n)
+{
+    int i;
+    const __m512d one = _mm512_set1_pd(1.);
+    for (i = 0;i + 8 <= n;i += 8) {
+        _mm512_storeu_pd(y+i, _mm512_div_pd(one, _mm512_loadu_pd(y+i)));
+    }
+    for (;i < n;++i) {
+        y[i] = 1. / y[i];
+    }
+}
+
+VECMATH_TARGET("avx512f")
+static void avx512_scale(floatval_t *y, const floatval_t a, const int n)
+{
+    int i;
+    const __m512d va = _mm512_set1_pd(a);
+    for (i = 0;i + 8 <= n;i += 8) {
+        _mm512_storeu_pd(y+i, _mm512_mul_pd(_mm512_loadu_pd(y+i), va));
+    }
+    for (;i < n;++i) {
+        y[i] *= a;
+    }
+}
+
+VECMATH_TARGET("avx512f")
+static floatval_t avx512_dot(const floatval_t *x, const floatval_t *y, const int n)
+{
+    int i;
+    floatval_t s;
+    __m512d vs = _mm512_setzero_pd();
+    for (i = 0;i + 8 <= n;i += 8) {
+        vs = _mm512_fmadd_pd(_mm512_loadu_pd(x+i), _mm512_loadu_pd(y+i), vs);
+    }
+    s = _mm512_reduce_add_pd(vs);
+    for (;i < n;++i) {
+        s += x[i] * y[i];
+    }
+    return s;
+}
+
+VECMATH_TARGET("avx512f")
+static floatval_t avx512_sum(const floatval_t *x, const int n)
+{
+    int i;
+    floatval_t s;
+    __m512d vs = _mm512_setzero_pd();
+    for (i = 0;i + 8 <= n;i += 8) {
+        vs = _mm512_add_pd(vs, _mm512_loadu_pd(x+i));
+    }
+    s = _mm512_reduce_add_pd(vs);
+    for (;i < n;++i) {
+        s += x[i];
+    }
+    return s;
+}
+
+/* Exponents of values, eight at a time; POLYNOMIAL computes a = exp(x). */
+#define AVX512_EXP(values, n, ROUNDING, POLYNOMIAL) \
+    { \
+        int i; \
+        for (i = 0;i < n;i += 8) { \
+            __m512d x, p, a; \
+            const __mmask8 mask = (n - i < 8) ? (__mmask8)((1 << (n - i)) - 1) : (__mmask8)0xFF; \
+            x = _mm512_maskz_loadu_pd(mask, values+i); \
+            x = _mm512_min_pd(x, _mm512_set1_pd(EXP_MAXLOG)); \
+            x = _mm512_max_pd(x, _mm512_set1_pd(EXP_MINLOG)); \
+            p = _mm512_roundscale_pd(_mm512_mul_pd(x, _mm512_set1_pd(EXP_LOG2E)), ROUNDING | _MM_FROUND_NO_EXC); \
+            x = _mm512_fnmadd_pd(p, _mm512_set1_pd(EXP_C1), x); \
+            x = _mm512_fnmadd_pd(p, _mm512_set1_pd(EXP_C2), x); \
+            POLYNOMIAL \
+            a = _mm512_scalef_pd(a, p); \
+            _mm512_mask_storeu_pd(values+i, mask, a); \
+        } \
+    }
+
+VECMATH_TARGET("avx512f")
+VECMATH_STRICT
+static void avx512_exp(floatval_t *values, const int n)
+{
+    AVX512_EXP(values, n, _MM_FROUND_TO_NEG_INF,
+        a = _mm512_fmadd_pd(_mm512_set1_pd(EXP_W11), x, _mm512_set1_pd(EXP_W10));
+        a = _mm512_fmadd_pd(a, x, _mm512_set1_pd(EXP_W9));
+        a = _mm512_fmadd_pd(a, x, _mm512_set1_pd(EXP_W8));
+        a = _mm512_fmadd_pd(a, x, _mm512_set1_pd(EXP_W7));
+        a = _mm512_fmadd_pd(a, x, _mm512_set1_pd(EXP_W6));
+        a = _mm512_fmadd_pd(a, x, _mm512_set1_pd(EXP_W5));
+        a = _mm512_fmadd_pd(a, x, _mm512_set1_pd(EXP_W4));
+        a = _mm512_fmadd_pd(a, x, _mm512_set1_pd(EXP_W3));
+        a = _mm512_fmadd_pd(a, x, _mm512_set1_pd(EXP_W2));
+        a = _mm512_fmadd_pd(a, x, _mm512_set1_pd(EXP_W1));
+        a = _mm512_fmadd_pd(a, x, _mm512_set1_pd(EXP_W0));
+        )
+}
+
+VECMATH_TARGET("avx512f")
+static void avx512_fastexp(floatval_t *values, const int n)
+{
+    AVX512_EXP(values, n, _MM_FROUND_TO_NEAREST_INT,
+        a = _mm512_fmadd_pd(_mm512_set1_pd(FEXP_W7), x, _mm512_set1_pd(FEXP_W6));
+        a = _mm512_fmadd_pd(a, x, _mm512_set1_pd(FEXP_W5));
+        a = _mm512_fmadd_pd(a, x, _mm512_set1_pd(FEXP_W4));
+        a = _mm512_fmadd_pd(a, x, _mm512_set1_pd(FEXP_W3));
+        a = _mm512_fmadd_pd(a, x, _mm512_set1_pd(FEXP_W2));
+        a = _mm512_fmadd_pd(a, x, _mm512_set1_pd(1.));
+        a = _mm512_fmadd_pd(a, x, _mm512_set1_pd(1.));
+        )
+}
+
+/* Logarithms of eight positive normal numbers. */
+VECMATH_TARGET("avx512f")
+VECMATH_STRICT
+static __m512d avx512_log(__m512d x)
+{
+    __m512d k, m, f, s, z, w, r, hfsq;
+    __mmask8 big;
+
+    /* x = 2^k * m, where m in [1, 2). */
+    k = _mm512_getexp_pd(x);
+    m = _mm512_getmant_pd(x, _MM_MANT_NORM_1_2, _MM_MANT_SIGN_zero);
+
+    /* Move m into [sqrt(2)/2, sqrt(2)). */
+    big = _mm512_cmp_pd_mask(m, _mm512_set1_pd(LOG_SQRT2), _CMP_GE_OQ);
+    m = _mm512_mask_mul_pd(m, big, m, _mm512_set1_pd(0.5));
+    k = _mm512_mask_add_pd(k, big, k, _mm512_set1_pd(1.));
+
+    f = _mm512_sub_pd(m, _mm512_set1_pd(1.));
+    s = _mm512_div_pd(f, _mm512_add_pd(f, _mm512_set1_pd(2.)));
+    z = _mm512_mul_pd(s, s);
+    w = _mm512_mul_pd(z, z);
+    r = _mm512_fmadd_pd(w, _mm512_set1_pd(LOG_LG7), _mm512_set1_pd(LOG_LG5));
+    r = _mm512_fmadd_pd(w, r, _mm512_set1_pd(LOG_LG3));
+    r = _mm512_fmadd_pd(w, r, _mm512_set1_pd(LOG_LG1));
+    r = _mm512_mul_pd(z, r);
+    w = _mm512_mul_pd(w, _mm512_fmadd_pd(w,
+        _mm512_fmadd_pd(w, _mm512_set1_pd(LOG_LG6), _mm512_set1_pd(LOG_LG4)),
+        _mm512_set1_pd(LOG_LG2)));
+    r = _mm512_add_pd(r, w);
+    hfsq = _mm512_mul_pd(_mm512_mul_pd(_mm512_set1_pd(0.5), f), f);
+
+    /* k * ln2_hi - ((hfsq - (s * (hfsq + R) + k * ln2_lo)) - f) */
+    r = _mm512_fmadd_pd(s, _mm512_add_pd(hfsq, r), _mm512_mul_pd(k, _mm512_set1_pd(LOG_LN2LO)));
+    r = _mm512_sub_pd(_mm512_sub_pd(hfsq, r), f);
+    return _mm512_sub_pd(_mm512_mul_pd(k, _mm512_set1_pd(LOG_LN2HI)), r);
+}
+
+VECMATH_TARGET("avx512f")
+VECMATH_STRICT
+static floatval_t avx512_sumlog(const floatval_t *x, const int n)
+{
+    int i = 0;
+    floatval_t s = 0.;
+    const __m512d lower = _mm512_set1_pd(DBL_MIN);
+    const __m512d upper = _mm512_set1_pd(DBL_MAX);
+
+    while (i + 8 <= n) {
+        /* Sum up a run of blocks of normal numbers in a register. */
+        __m512d vs = _mm512_setzero_pd();
+        for (;i + 8 <= n;i += 8) {
+            __m512d v = _mm512_loadu_pd(x+i);
+            __mmask8 normal =
+                _mm512_cmp_pd_mask(v, lower, _CMP_GE_OQ) &
+                _mm512_cmp_pd_mask(v, upper, _CMP_LE_OQ);
+            if (normal != 0xFF) {
+                break;
+            }
+            vs = _mm512_add_pd(vs, avx512_log(v));
+        }
+        s += _mm512_reduce_add_pd(vs);
+
+        /* A block with a zero, subnormal, infinite, or NaN value. */
+        if (i + 8 <= n) {
+            s += scalar_sumlog(x+i, 8);
+            i += 8;
+        }
+    }
+    for (;i < n;++i) {
+        s += log(x[i]);
+    }
+    return s;
+}
+
+VECMATH_TARGET("avx512f")
+static int avx512_addargmax(floatval_t *max, const floatval_t *x, const floatval_t *y, const int n)
+{
+    int i, k, found, argmax;
+    __m512d vm = _mm512_set1_pd(*max), vmax;
+
+    /* The maximum of the leading elements. */
+    for (i = 0;i + 8 <= n;i += 8) {
+        __m512d vs = _mm512_add_pd(_mm512_loadu_pd(x+i), _mm512_loadu_pd(y+i));
+        vm = _mm512_max_pd(vs, vm);
+    }
+
+    argmax = addargmax_tail(max, _mm512_reduce_max_pd(vm), x, y, i, n, &found);
+    if (!found || 0 <= argmax) {
+        return argmax;
+    }
+
+    /* Locate the first of the leading elements that reaches the maximum. */
+    vmax = _mm512_set1_pd(*max);
+    for (i = 0;;i += 8) {
+        __m512d vs = _mm512_add_pd(_mm512_loadu_pd(x+i), _mm512_loadu_pd(y+i));
+        int mask = (int)_mm512_cmp_pd_mask(vs, vmax, _CMP_EQ_OQ);
+        if (mask) {
+            for (k = 0;!(mask & (1 << k));++k) ;
+            return i + k;
+        }
+    }
+}
+
+VECMATH_TARGET("avx512f")
+static void avx512_lanematmul(floatval_t *y, const floatval_t *a, const floatval_t *x, const int n)
+{
+    int i, j;
+    for (j = 0;j + 4 <= n;j += 4) {
+        __m512d y0 = _mm512_setzero_pd(), y1 = _mm512_setzero_pd();
+        __m512d y2 = _mm512_setzero_pd(), y3 = _mm512_setzero_pd();
+        for (i = 0;i < n;++i) {
+            const floatval_t *ai = &a[i * n + j];
+            const __m512d xi = _mm512_loadu_pd(&x[i * VECMATH_LANES]);
+            y0 = _mm512_fmadd_pd(_mm512_set1_pd(ai[0]), xi, y0);
+            y1 = _mm512_fmadd_pd(_mm512_set1_pd(ai[1]), xi, y1);
+            y2 = _mm512_fmadd_pd(_mm512_set1_pd(ai[2]), xi, y2);
+            y3 = _mm512_fmadd_pd(_mm512_set1_pd(ai[3]), xi, y3);
+        }
+        _mm512_storeu_pd(&y[j * VECMATH_LANES], y0);
+        _mm512_storeu_pd(&y[(j+1) * VECMATH_LANES], y1);
+        _mm512_storeu_pd(&y[(j+2) * VECMATH_LANES], y2);
+        _mm512_storeu_pd(&y[(j+3) * VECMATH_LANES], y3);
+    }
+    for (;j < n;++j) {
+        __m512d y0 = _mm512_setzero_pd();
+        for (i = 0;i < n;++i) {
+            y0 = _mm512_fmadd_pd(
+                _mm512_set1_pd(a[i * n + j]), _mm512_loadu_pd(&x[i * VECMATH_LANES]), y0);
+        }
+        _mm512_storeu_pd(&y[j * VECMATH_LANES], y0);
+    }
+}
+
+VECMATH_TARGET("avx512f")
+static void avx512_lanemuladd(floatval_t *y, const floatval_t *x, const floatval_t *z, const int n)
+{
+    int i;
+    const __m512d vx = _mm512_loadu_pd(x);
+    for (i = 0;i < n * VECMATH_LANES;i += VECMATH_LANES) {
+        _mm512_storeu_pd(y+i, _mm512_fmadd_pd(vx, _mm512_loadu_pd(z+i), _mm512_loadu_pd(y+i)));
+    }
+}
+
+VECMATH_TARGET("avx512f")
+static void avx512_lanemaxplus(floatval_t *y, int *back, const floatval_t *a, const floatval_t *x, const int n)
+{
+    int i, j;
+    for (j = 0;j < n;++j) {
+        __m512d vm = _mm512_add_pd(_mm512_loadu_pd(x), _mm512_set1_pd(a[j]));
+        __m512i vi = _mm512_setzero_si512();
+        for (i = 1;i < n;++i) {
+            __m512d vs = _mm512_add_pd(
+                _mm512_loadu_pd(&x[i * VECMATH_LANES]), _mm512_set1_pd(a[i * n + j]));
+            __mmask8 gt = _mm512_cmp_pd_mask(vs, vm, _CMP_GT_OQ);
+            vi = _mm512_mask_mov_epi64(vi, gt, _mm512_set1_epi64(i));
+            vm = _mm512_max_pd(vs, vm);
+        }
+        _mm512_storeu_pd(&y[j * VECMATH_LANES], vm);
+        _mm256_storeu_si256((__m256i*)&back[j * VECMATH_LANES], _mm512_cvtepi64_epi32(vi));
+    }
+}
+
+VECMATH_TARGET("avx512f")
+static void avx512_maxplusf(float *y, int *back, const float *a, const float *x, const int n)
+{
+    int i, j;
+    for (j = 0;j < n;j += 16) {
+        /* Mask out the labels [n, j+16) in the last block. */
+        const __mmask16 mask = (n - j < 16) ? (__mmask16)((1u << (n - j)) - 1) : (__mmask16)0xFFFF;
+        __m512 vm = _mm512_add_ps(_mm512_set1_ps(x[0]), _mm512_maskz_loadu_ps(mask, a+j));
+        __m512i vi = _mm512_setzero_si512();
+        for (i = 1;i < n;++i) {
+            __m512 vs = _mm512_add_ps(_mm512_set1_ps(x[i]), _mm512_maskz_loadu_ps(mask, &a[i * n + j]));
+            __mmask16 gt = _mm512_cmp_ps_mask(vs, vm, _CMP_GT_OQ);
+            vi = _mm512_mask_mov_epi32(vi, gt, _mm512_set1_epi32(i));
+            vm = _mm512_max_ps(vs, vm);
+        }
+        _mm512_mask_storeu_ps(y+j, mask, vm);
+        _mm512_mask_storeu_epi32(back+j, mask, vi);
+    }
+}
+
+static const vecmath_t vecmath_avx512 = {
+    VECMATH_AVX512, "avx512",
+    avx512_add, avx512_aadd, avx512_sub, avx512_asub, avx512_mul,
+    avx512_inv, avx512_scale, avx512_dot, avx512_sum, avx512_sumlog,
+    avx512_exp, avx512_fastexp, avx512_addargmax,
+    avx512_lanematmul, avx512_lanemuladd, avx512_lanemaxplus,
+    avx512_maxplusf,
+};
+
+
+
+/*
+ * CPU detection.
+ */
+
+static void cpuid(unsigned int leaf, unsigned int regs[4])
+{
+#if defined(__GNUC__)
+    __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#else
+    int info[4];
+    __cpuidex(info, (int)leaf, 0);
+    regs[0] = info[0]; regs[1] = info[1]; regs[2] = info[2]; regs[3] = info[3];
+#endif
+}
+
+static unsigned int xgetbv0(void)
+{
+#if defined(__GNUC__)
+    unsigned int eax, edx;
+    __asm__ __volatile__ ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return eax;
+#else
+    return (unsigned int)_xgetbv(0);
+#endif
+}
+
+static int vecmath_detect(void)
+{
+    unsigned int regs[4], xcr0;
+    int avx, fma;
+
+    cpuid(0, regs);
+    if (regs[0] < 7) {
+        return VECMATH_SSE2;
+    }
+
+    /* AVX requires the OS to save the YMM registers (OSXSAVE and XCR0). */
+    cpuid(1, regs);
+    if (!(regs[2] & (1u << 27))) {
+        return VECMATH_SSE2;
+    }
+    avx = (regs[2] & (1u << 28)) != 0;
+    fma = (regs[2] & (1u << 12)) != 0;
+    xcr0 = xgetbv0();
+    if (!avx || !fma || (xcr0 & 0x06) != 0x06) {
+        return VECMATH_SSE2;
+    }
+
+    cpuid(7, regs);
+    if ((regs[1] & (1u << 16)) && (xcr0 & 0xE6) == 0xE6) {
+        return VECMATH_AVX512;
+    }
+    if (regs[1] & (1u << 5)) {
+        return VECMATH_AVX2;
+    }
+    return VECMATH_SSE2;
+}
+
+#endif/*VECMATH_X86*/
+
+
+
+#ifdef  VECMATH_X86
+const vecmath_t* vecmath_impl = &vecmath_sse2;
+#else
+const vecmath_t* vecmath_impl = &vecmath_scalar;
+#endif/*VECMATH_X86*/
+
+const vecmath_t* vecmath_init()
+{
+    static int initialized = 0;
+
+    /*
+        The selection is deterministic, so concurrent callers may race here
+        harmlessly; they store the same pointer.
+     */
+    if (!initialized) {
+        int simd = VECMATH_SCALAR;
+        const char *env = getenv("CRFSUITE_VECMATH");
+
+#ifdef  VECMATH_X86
+        simd = vecmath_detect();
+#endif/*VECMATH_X86*/
+
+        /* Honor a request for a lower instruction set. */
+        if (env != NULL) {
+            if (strcmp(env, "scalar") == 0) {
+                simd = VECMATH_SCALAR;
+            } else if (strcmp(env, "sse2") == 0 && VECMATH_SSE2 < simd) {
+                simd = VECMATH_SSE2;
+            } else if (strcmp(env, "avx2") == 0 && VECMATH_AVX2 < simd) {
+                simd = VECMATH_AVX2;
+            }
+        }
+
+        switch (simd) {
+#ifdef  VECMATH_X86
+        case VECMATH_AVX512:
+            vecmath_impl = &vecmath_avx512;
+            break;
+        case VECMATH_AVX2:
+            vecmath_impl = &vecmath_avx2;
+            break;
+        case VECMATH_SSE2:
+            vecmath_impl = &vecmath_sse2;
+            break;
+#endif/*VECMATH_X86*/
+        default:
+            vecmath_impl = &vecmath_scalar;
+            break;
+        }
+        initialized = 1;
+    }
+
+    return vecmath_impl;
+}
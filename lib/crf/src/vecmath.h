@@ -35,15 +35,15 @@
 
 #include <math.h>
 #include <memory.h>
-
-#ifdef  USE_SSE
-#include <emmintrin.h>
-#endif/*USE_SSE*/
+#include <stdint.h>
 
 #if defined(_MSC_VER) || defined(__MINGW32__) || defined(__MINGW64__)
 #include <malloc.h>
 #else
 #include <stdlib.h>
+#ifdef  HAVE_MALLOC_H
+#include <malloc.h>
+#endif/*HAVE_MALLOC_H*/
 static inline void *_aligned_malloc(size_t size, size_t alignment)
 {
 #if __STDC_VERSION__ >= 201112L
@@ -72,6 +72,68 @@ static inline void _aligned_free(void *p)
 #define CONST_128D(var, val) \
     MIE_ALIGN(16) static const double var[2] = {(val), (val)}
 
+/**
+ * Instruction sets for the vector operations.
+ */
+enum {
+    VECMATH_SCALAR = 0,     /**< Plain C loops. */
+    VECMATH_SSE2,           /**< SSE2 (2 doubles per instruction). */
+    VECMATH_AVX2,           /**< AVX2 and FMA (4 doubles per instruction). */
+    VECMATH_AVX512,         /**< AVX-512F (8 doubles per instruction). */
+};
+
+/**
+ * Number of lanes of a lane vector.
+ *  A lane vector holds a value for each of VECMATH_LANES sequences that
+ *  are processed in lockstep; an array of n lane vectors stores the lanes
+ *  of the element #i in [i * VECMATH_LANES, (i+1) * VECMATH_LANES).
+ */
+#define VECMATH_LANES   8
+
+/**
+ * Implementations of the vector operations for an instruction set.
+ *  The inline functions below forward the computation to the table chosen
+ *  by vecmath_init(), which probes the CPU once at run time. The table
+ *  defaults to the instruction set enabled at compile time (SSE2 with
+ *  USE_SSE), so the functions are usable before vecmath_init() is called.
+ */
+typedef struct {
+    int         simd;       /**< Instruction set (VECMATH_*). */
+    const char* name;       /**< Name of the instruction set. */
+    void (*add)(floatval_t *y, const floatval_t *x, const int n);
+    void (*aadd)(floatval_t *y, const floatval_t a, const floatval_t *x, const int n);
+    void (*sub)(floatval_t *y, const floatval_t *x, const int n);
+    void (*asub)(floatval_t *y, const floatval_t a, const floatval_t *x, const int n);
+    void (*mul)(floatval_t *y, const floatval_t *x, const int n);
+    void (*inv)(floatval_t *y, const int n);
+    void (*scale)(floatval_t *y, const floatval_t a, const int n);
+    floatval_t (*dot)(const floatval_t *x, const floatval_t *y, const int n);
+    floatval_t (*sum)(const floatval_t *x, const int n);
+    floatval_t (*sumlog)(const floatval_t *x, const int n);
+    void (*exp)(floatval_t *values, const int n);
+    void (*fastexp)(floatval_t *values, const int n);
+    int (*addargmax)(floatval_t *max, const floatval_t *x, const floatval_t *y, const int n);
+    void (*lanematmul)(floatval_t *y, const floatval_t *a, const floatval_t *x, const int n);
+    void (*lanemuladd)(floatval_t *y, const floatval_t *x, const floatval_t *z, const int n);
+    void (*lanemaxplus)(floatval_t *y, int *back, const floatval_t *a, const floatval_t *x, const int n);
+    void (*maxplusf)(float *y, int *back, const float *a, const float *x, const int n);
+} vecmath_t;
+
+/**
+ * The implementation of the vector operations in use.
+ */
+extern const vecmath_t* vecmath_impl;
+
+/**
+ * Choose the fastest implementation of the vector operations.
+ *  This function probes the instruction sets supported by the CPU and
+ *  the operating system at the first call, and sets ::vecmath_impl. The
+ *  environment variable CRFSUITE_VECMATH ("scalar", "sse2", "avx2", or
+ *  "avx512") restricts the choice to a lower instruction set.
+ *  @return The implementation in use.
+ */
+const vecmath_t* vecmath_init();
+
 
 inline static void veczero(floatval_t *x, const int n)
 {
@@ -97,256 +159,188 @@ inline static void veccopy(floatval_t *y, const floatval_t *x, const int n)
 
 inline static void vecadd(floatval_t *y, const floatval_t *x, const int n)
 {
-    int i;
-    for (i = 0;i < n;++i) {
-        y[i] += x[i];
-    }
+    vecmath_impl->add(y, x, n);
 }
 
 inline static void vecaadd(floatval_t *y, const floatval_t a, const floatval_t *x, const int n)
 {
-    int i;
-    for (i = 0;i < n;++i) {
-        y[i] += a * x[i];
+    vecmath_impl->aadd(y, a, x, n);
+}
+
+/*
+ * Convert a 16-bit floating-point value (IEEE 754 binary16) to a double.
+ *  The exponent of a normal value is rebiased with integer operations, so
+ *  that the exact result does not depend on the denormal modes of the FPU.
+ */
+inline static floatval_t vechalf(const uint16_t h)
+{
+    uint64_t x;
+    floatval_t value;
+    const uint32_t exp = (h >> 10) & 0x1F, mant = h & 0x3FF;
+
+    if (exp == 0) {
+        value = mant * (1. / 16777216.);
+    } else if (exp == 31) {
+        value = (mant != 0) ? (floatval_t)NAN : (floatval_t)INFINITY;
+    } else {
+        x = ((uint64_t)(exp + 1008) << 52) | ((uint64_t)mant << 42);
+        memcpy(&value, &x, sizeof(value));
     }
+    return (h & 0x8000) ? -value : value;
 }
 
-inline static void vecsub(floatval_t *y, const floatval_t *x, const int n)
+/*
+ * Add a vector of 16-bit floating-point values multiplied by a scalar.
+ *  y[i] += a * x[i]
+ */
+inline static void vecaaddhalf(floatval_t *y, const floatval_t a, const uint16_t *x, const int n)
 {
     int i;
     for (i = 0;i < n;++i) {
-        y[i] -= x[i];
+        y[i] += a * vechalf(x[i]);
     }
 }
 
-inline static void vecasub(floatval_t *y, const floatval_t a, const floatval_t *x, const int n)
+/*
+ * Add a vector of 8-bit integers multiplied by a scalar and scale factors.
+ *  y[i] += a * s[i] * x[i]
+ */
+inline static void vecaaddint8(floatval_t *y, const floatval_t a, const floatval_t *s, const int8_t *x, const int n)
 {
     int i;
     for (i = 0;i < n;++i) {
-        y[i] -= a * x[i];
+        y[i] += a * s[i] * x[i];
     }
 }
 
+inline static void vecsub(floatval_t *y, const floatval_t *x, const int n)
+{
+    vecmath_impl->sub(y, x, n);
+}
+
+inline static void vecasub(floatval_t *y, const floatval_t a, const floatval_t *x, const int n)
+{
+    vecmath_impl->asub(y, a, x, n);
+}
+
 inline static void vecmul(floatval_t *y, const floatval_t *x, const int n)
 {
-    int i;
-    for (i = 0;i < n;++i) {
-        y[i] *= x[i];
-    }
+    vecmath_impl->mul(y, x, n);
 }
 
 inline static void vecinv(floatval_t *y, const int n)
 {
-    int i;
-    for (i = 0;i < n;++i) {
-        y[i] = 1. / y[i];
-    }
+    vecmath_impl->inv(y, n);
 }
 
 inline static void vecscale(floatval_t *y, const floatval_t a, const int n)
 {
-    int i;
-    for (i = 0;i < n;++i) {
-        y[i] *= a;
-    }
+    vecmath_impl->scale(y, a, n);
 }
 
 inline static floatval_t vecdot(const floatval_t *x, const floatval_t *y, const int n)
 {
-    int i;
-    floatval_t s = 0;
-    for (i = 0;i < n;++i) {
-        s += x[i] * y[i];
-    }
-    return s;
+    return vecmath_impl->dot(x, y, n);
 }
 
 inline static floatval_t vecsum(floatval_t* x, const int n)
 {
-    int i;
-    floatval_t s = 0.;
-
-    for (i = 0;i < n;++i) {
-        s += x[i];
-    }
-    return s;
+    return vecmath_impl->sum(x, n);
 }
 
+/*
+ * Compute the sum of the logarithms of the values.
+ *  The AVX2 and AVX-512 implementations compute the logarithms of positive
+ *  normal numbers with an error below 1 ulp (each), with the compiler
+ *  requirement noted for vecexp(). The scalar and SSE2 implementations
+ *  call log() of the C library, which GCC may replace with a vector
+ *  variant (below 2 ulps in glibc) under -ffast-math.
+ */
 inline static floatval_t vecsumlog(floatval_t* x, const int n)
 {
-    int i;
-    floatval_t s = 0.;
-    for (i = 0;i < n;++i) {
-        s += log(x[i]);
-    }
-    return s;
+    return vecmath_impl->sumlog(x, n);
 }
 
-#ifdef  USE_SSE
-
+/*
+ * Compute the exponents of the values in place.
+ *  The array must be aligned to 16 bytes and have room for up to three
+ *  extra elements after the n-th element, which may be overwritten.
+ *  The SIMD implementations evaluate a polynomial of degree 11 after the
+ *  range reduction; the relative error is below 4e-16 (2 ulps) for
+ *  arguments in [log(2^-1022), log(2^1024)], outside which the arguments
+ *  are clamped. These bounds assume that the compiler keeps the order of
+ *  the operations in the kernels, which GCC does even under -ffast-math
+ *  (see VECMATH_STRICT in vecmath.c); other compilers need a build
+ *  without -ffast-math.
+ */
 inline static void vecexp(double *values, const int n)
 {
-    int i;
-    CONST_128D(one, 1.);
-    CONST_128D(log2e, 1.4426950408889634073599);
-    CONST_128D(maxlog, 7.09782712893383996843e2);   // log(2**1024)
-    CONST_128D(minlog, -7.08396418532264106224e2);  // log(2**-1022)
-    CONST_128D(c1, 6.93145751953125E-1);
-    CONST_128D(c2, 1.42860682030941723212E-6);
-    CONST_128D(w11, 3.5524625185478232665958141148891055719216674475023e-8);
-    CONST_128D(w10, 2.5535368519306500343384723775435166753084614063349e-7);
-    CONST_128D(w9, 2.77750562801295315877005242757916081614772210463065e-6);
-    CONST_128D(w8, 2.47868893393199945541176652007657202642495832996107e-5);
-    CONST_128D(w7, 1.98419213985637881240770890090795533564573406893163e-4);
-    CONST_128D(w6, 1.3888869684178659239014256260881685824525255547326e-3);
-    CONST_128D(w5, 8.3333337052009872221152811550156335074160546333973e-3);
-    CONST_128D(w4, 4.1666666621080810610346717440523105184720007971655e-2);
-    CONST_128D(w3, 0.166666666669960803484477734308515404418108830469798);
-    CONST_128D(w2, 0.499999999999877094481580370323249951329122224389189);
-    CONST_128D(w1, 1.0000000000000017952745258419615282194236357388884);
-    CONST_128D(w0, 0.99999999999999999566016490920259318691496540598896);
-    const __m128i offset = _mm_setr_epi32(1023, 1023, 0, 0);
-
-    for (i = 0;i < n;i += 4) {
-        __m128i k1, k2;
-        __m128d p1, p2;
-        __m128d a1, a2;
-        __m128d xmm0, xmm1;
-        __m128d x1, x2;
-
-        /* Load four double values. */
-        xmm0 = _mm_load_pd(maxlog);
-        xmm1 = _mm_load_pd(minlog);
-        x1 = _mm_load_pd(values+i);
-        x2 = _mm_load_pd(values+i+2);
-        x1 = _mm_min_pd(x1, xmm0);
-        x2 = _mm_min_pd(x2, xmm0);
-        x1 = _mm_max_pd(x1, xmm1);
-        x2 = _mm_max_pd(x2, xmm1);
-
-        /* a = x / log2; */
-        xmm0 = _mm_load_pd(log2e);
-        xmm1 = _mm_setzero_pd();
-        a1 = _mm_mul_pd(x1, xmm0);
-        a2 = _mm_mul_pd(x2, xmm0);
-
-        /* k = (int)floor(a); p = (float)k; */
-        p1 = _mm_cmplt_pd(a1, xmm1);
-        p2 = _mm_cmplt_pd(a2, xmm1);
-        xmm0 = _mm_load_pd(one);
-        p1 = _mm_and_pd(p1, xmm0);
-        p2 = _mm_and_pd(p2, xmm0);
-        a1 = _mm_sub_pd(a1, p1);
-        a2 = _mm_sub_pd(a2, p2);
-        k1 = _mm_cvttpd_epi32(a1);
-        k2 = _mm_cvttpd_epi32(a2);
-        p1 = _mm_cvtepi32_pd(k1);
-        p2 = _mm_cvtepi32_pd(k2);
-
-        /* x -= p * log2; */
-        xmm0 = _mm_load_pd(c1);
-        xmm1 = _mm_load_pd(c2);
-        a1 = _mm_mul_pd(p1, xmm0);
-        a2 = _mm_mul_pd(p2, xmm0);
-        x1 = _mm_sub_pd(x1, a1);
-        x2 = _mm_sub_pd(x2, a2);
-        a1 = _mm_mul_pd(p1, xmm1);
-        a2 = _mm_mul_pd(p2, xmm1);
-        x1 = _mm_sub_pd(x1, a1);
-        x2 = _mm_sub_pd(x2, a2);
-
-        xmm0 = _mm_load_pd(w11);
-        xmm1 = _mm_load_pd(w10);
-        a1 = _mm_mul_pd(x1, xmm0);
-        a2 = _mm_mul_pd(x2, xmm0);
-        a1 = _mm_add_pd(a1, xmm1);
-        a2 = _mm_add_pd(a2, xmm1);
-
-        xmm0 = _mm_load_pd(w9);
-        xmm1 = _mm_load_pd(w8);
-        a1 = _mm_mul_pd(a1, x1);
-        a2 = _mm_mul_pd(a2, x2);
-        a1 = _mm_add_pd(a1, xmm0);
-        a2 = _mm_add_pd(a2, xmm0);
-        a1 = _mm_mul_pd(a1, x1);
-        a2 = _mm_mul_pd(a2, x2);
-        a1 = _mm_add_pd(a1, xmm1);
-        a2 = _mm_add_pd(a2, xmm1);
-
-        xmm0 = _mm_load_pd(w7);
-        xmm1 = _mm_load_pd(w6);
-        a1 = _mm_mul_pd(a1, x1);
-        a2 = _mm_mul_pd(a2, x2);
-        a1 = _mm_add_pd(a1, xmm0);
-        a2 = _mm_add_pd(a2, xmm0);
-        a1 = _mm_mul_pd(a1, x1);
-        a2 = _mm_mul_pd(a2, x2);
-        a1 = _mm_add_pd(a1, xmm1);
-        a2 = _mm_add_pd(a2, xmm1);
-
-        xmm0 = _mm_load_pd(w5);
-        xmm1 = _mm_load_pd(w4);
-        a1 = _mm_mul_pd(a1, x1);
-        a2 = _mm_mul_pd(a2, x2);
-        a1 = _mm_add_pd(a1, xmm0);
-        a2 = _mm_add_pd(a2, xmm0);
-        a1 = _mm_mul_pd(a1, x1);
-        a2 = _mm_mul_pd(a2, x2);
-        a1 = _mm_add_pd(a1, xmm1);
-        a2 = _mm_add_pd(a2, xmm1);
-
-        xmm0 = _mm_load_pd(w3);
-        xmm1 = _mm_load_pd(w2);
-        a1 = _mm_mul_pd(a1, x1);
-        a2 = _mm_mul_pd(a2, x2);
-        a1 = _mm_add_pd(a1, xmm0);
-        a2 = _mm_add_pd(a2, xmm0);
-        a1 = _mm_mul_pd(a1, x1);
-        a2 = _mm_mul_pd(a2, x2);
-        a1 = _mm_add_pd(a1, xmm1);
-        a2 = _mm_add_pd(a2, xmm1);
-
-        xmm0 = _mm_load_pd(w1);
-        xmm1 = _mm_load_pd(w0);
-        a1 = _mm_mul_pd(a1, x1);
-        a2 = _mm_mul_pd(a2, x2);
-        a1 = _mm_add_pd(a1, xmm0);
-        a2 = _mm_add_pd(a2, xmm0);
-        a1 = _mm_mul_pd(a1, x1);
-        a2 = _mm_mul_pd(a2, x2);
-        a1 = _mm_add_pd(a1, xmm1);
-        a2 = _mm_add_pd(a2, xmm1);
-
-        /* p = 2^k; */
-        k1 = _mm_add_epi32(k1, offset);
-        k2 = _mm_add_epi32(k2, offset);
-        k1 = _mm_slli_epi32(k1, 20);
-        k2 = _mm_slli_epi32(k2, 20);
-        k1 = _mm_shuffle_epi32(k1, 0x72);
-        k2 = _mm_shuffle_epi32(k2, 0x72);
-        p1 = _mm_castsi128_pd(k1);
-        p2 = _mm_castsi128_pd(k2);
-
-        /* a *= 2^k. */
-        a1 = _mm_mul_pd(a1, p1);
-        a2 = _mm_mul_pd(a2, p2);
-
-        /* Store the results. */
-        _mm_store_pd(values+i, a1);
-        _mm_store_pd(values+i+2, a2);
-    }
+    vecmath_impl->exp(values, n);
 }
 
-#else
+/*
+ * Compute the approximated exponents of the values in place.
+ *  This is a faster variant of vecexp() with a polynomial of degree 7,
+ *  whose relative error is below 1e-8. The array must satisfy the same
+ *  requirements as vecexp().
+ */
+inline static void vecfastexp(double *values, const int n)
+{
+    vecmath_impl->fastexp(values, n);
+}
 
-inline static void vecexp(double *values, const int n)
+/*
+ * Find the first index #i that maximizes x[i] + y[i].
+ *  On entry, *max holds a lower bound; sums that do not exceed the bound
+ *  are ignored. On return, *max holds the maximum sum and the function
+ *  returns its smallest index, or -1 (leaving *max untouched) if no sum
+ *  exceeds the bound. This is identical to a sequential scan that updates
+ *  the maximum with a strict comparison (max < x[i] + y[i]).
+ */
+inline static int vecaddargmax(floatval_t *max, const floatval_t *x, const floatval_t *y, const int n)
 {
-    int i;
-    for (i = 0;i < n;++i) {
-        values[i] = exp(values[i]);
-    }
+    return vecmath_impl->addargmax(max, x, y, n);
+}
+
+/*
+ * Find the maximum sums of a vector and the rows of a matrix (single
+ * precision).
+ *  y[j] = \max_{i} x[i] + a[i][j] for the [n][n] matrix a; back[j]
+ *  receives the smallest #i that gives the maximum.
+ */
+inline static void vecmaxplusf(float *y, int *back, const float *a, const float *x, const int n)
+{
+    vecmath_impl->maxplusf(y, back, a, x, n);
+}
+
+/*
+ * Multiply n lane vectors by a matrix.
+ *  y[j] = \sum_{i} a[i][j] * x[i] for the lane vectors x[i] and y[j] and
+ *  the [n][n] matrix a; the products are added in the order of #i.
+ */
+inline static void veclanematmul(floatval_t *y, const floatval_t *a, const floatval_t *x, const int n)
+{
+    vecmath_impl->lanematmul(y, a, x, n);
 }
 
-#endif /*USE_SSE*/
+/*
+ * Add the lane-wise products of a lane vector and n lane vectors.
+ *  y[j] += x * z[j] for the lane vectors x, y[j], and z[j].
+ */
+inline static void veclanemuladd(floatval_t *y, const floatval_t *x, const floatval_t *z, const int n)
+{
+    vecmath_impl->lanemuladd(y, x, z, n);
+}
+
+/*
+ * Find the maximum sums of n lane vectors and a matrix.
+ *  y[j] = \max_{i} x[i] + a[i][j] for the lane vectors x[i] and y[j] and
+ *  the [n][n] matrix a; back[j] receives the lanes of the smallest #i that
+ *  gives the maximum.
+ */
+inline static void veclanemaxplus(floatval_t *y, int *back, const floatval_t *a, const floatval_t *x, const int n)
+{
+    vecmath_impl->lanemaxplus(y, back, a, x, n);
+}
 
 #endif/*__VECMATH_H__*/
@@ -39,8 +39,14 @@
     }
 }
 
+// Scripting languages pass strings to open(const std::string&, int).
+%ignore CRFSuite::Tagger::open(const char*, int);
+
 %include "crfsuite_api.hpp"
 
 %template(Item) std::vector<CRFSuite::Attribute>;
 %template(ItemSequence) std::vector<CRFSuite::Item>;
 %template(StringList) std::vector<std::string>;
+%template(HashedItem) std::vector<CRFSuite::HashedAttribute>;
+%template(HashedItemSequence) std::vector<CRFSuite::HashedItem>;
+%template(ScoredPathList) std::vector<CRFSuite::ScoredPath>;
@@ -0,0 +1,223 @@
+/*
+ *      Regression tests of the batch tagging.
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* $Id$ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <crfsuite.h>
+#include "testutil.h"
+
+#define    SAFE_RELEASE(obj)    if ((obj) != NULL) { (obj)->release(obj); (obj) = NULL; }
+
+/*
+ * viterbi_batch() and tag_batch() must find the same label sequences and
+ * scores as set() and viterbi() do for every instance of a batch, with
+ * any number of threads, for the instances of any lengths (including the
+ * empty ones), and with any options of the tagger.
+ */
+
+typedef struct {
+    int num_instances;
+    int *item_offsets;
+    int *attr_offsets;
+    int *aids;
+    floatval_t *values;
+    int *labels;            /**< The reference label sequences. */
+    floatval_t *scores;     /**< The reference scores. */
+} reference_t;
+
+static int same_score(floatval_t x, floatval_t y)
+{
+    return fabs(x - y) <= 1e-9 * (1. + fabs(x));
+}
+
+/* Pack the instances into the CSR arrays, and tag them one by one. */
+static void reference_init(reference_t *ref, crfsuite_tagger_t *tagger, const crfsuite_instance_t *insts, int n, int A)
+{
+    int i, j, k, t, num_items = 0, num_attrs = 0;
+
+    for (i = 0;i < n;++i) {
+        num_items += insts[i].num_items;
+        for (t = 0;t < insts[i].num_items;++t) {
+            num_attrs += insts[i].items[t].num_contents;
+        }
+    }
+
+    ref->num_instances = n;
+    ref->item_offsets = (int*)calloc(n+1, sizeof(int));
+    ref->attr_offsets = (int*)calloc(num_items+1, sizeof(int));
+    /* One more attribute in each item, out of the range of the model. */
+    ref->aids = (int*)calloc(num_attrs + num_items + 1, sizeof(int));
+    ref->values = (floatval_t*)calloc(num_attrs + num_items + 1, sizeof(floatval_t));
+    ref->labels = (int*)calloc(num_items+1, sizeof(int));
+    ref->scores = (floatval_t*)calloc(n, sizeof(floatval_t));
+
+    for (i = 0, j = 0, k = 0;i < n;++i) {
+        const crfsuite_instance_t *inst = &insts[i];
+        ref->item_offsets[i] = j;
+        for (t = 0;t < inst->num_items;++t) {
+            int c;
+            const crfsuite_item_t *item = &inst->items[t];
+            ref->attr_offsets[j++] = k;
+            for (c = 0;c < item->num_contents;++c) {
+                ref->aids[k] = item->contents[c].aid;
+                ref->values[k++] = item->contents[c].value;
+            }
+            ref->aids[k] = A + t;
+            ref->values[k++] = 1.;
+        }
+
+        if (0 < inst->num_items) {
+            CHECK(tagger->set(tagger, (crfsuite_instance_t*)inst) == 0);
+            CHECK(tagger->viterbi(tagger, &ref->labels[ref->item_offsets[i]], &ref->scores[i]) == 0);
+        }
+    }
+    ref->item_offsets[n] = j;
+    ref->attr_offsets[j] = k;
+}
+
+static void reference_finish(reference_t *ref)
+{
+    free(ref->scores);
+    free(ref->labels);
+    free(ref->values);
+    free(ref->aids);
+    free(ref->attr_offsets);
+    free(ref->item_offsets);
+}
+
+static void check_results(const reference_t *ref, const int *labels, const floatval_t *scores)
+{
+    int i;
+    const int num_items = ref->item_offsets[ref->num_instances];
+    CHECK(memcmp(ref->labels, labels, sizeof(int) * num_items) == 0);
+    for (i = 0;i < ref->num_instances;++i) {
+        if (0 < ref->item_offsets[i+1] - ref->item_offsets[i]) {
+            CHECK(same_score(ref->scores[i], scores[i]));
+        } else {
+            CHECK(scores[i] == 0.);
+        }
+    }
+}
+
+static void test_tagger(crfsuite_model_t *model, int flags, const crfsuite_instance_t *insts, int n, int A)
+{
+    int i;
+    reference_t ref;
+    crfsuite_batch_t batch;
+    crfsuite_tagger_t *tagger = NULL;
+    static const int num_threads[] = {1, 2, 3, 4, 2, 4, 1};
+    int *labels = NULL;
+    floatval_t *scores = NULL;
+
+    if (!CHECK(model->get_tagger_ex(model, flags, &tagger) == 0)) {
+        return;
+    }
+    reference_init(&ref, tagger, insts, n, A);
+    labels = (int*)calloc(ref.item_offsets[n]+1, sizeof(int));
+    scores = (floatval_t*)calloc(n, sizeof(floatval_t));
+
+    memset(labels, 0xFF, sizeof(int) * ref.item_offsets[n]);
+    memset(scores, 0xFF, sizeof(floatval_t) * n);
+    CHECK(tagger->viterbi_batch(tagger, insts, n, labels, scores) == 0);
+    check_results(&ref, labels, scores);
+
+    /* tag_batch() with the attribute values, and the threads of the
+       tagger reused, added, and left idle. */
+    batch.num_instances = n;
+    batch.item_offsets = ref.item_offsets;
+    batch.attr_offsets = ref.attr_offsets;
+    batch.aids = ref.aids;
+    batch.values = ref.values;
+    for (i = 0;i < (int)(sizeof(num_threads) / sizeof(num_threads[0]));++i) {
+        memset(labels, 0xFF, sizeof(int) * ref.item_offsets[n]);
+        memset(scores, 0xFF, sizeof(floatval_t) * n);
+        CHECK(tagger->tag_batch(tagger, &batch, num_threads[i], labels, scores) == 0);
+        check_results(&ref, labels, scores);
+    }
+
+    /* tag_batch() without the scores. */
+    memset(labels, 0xFF, sizeof(int) * ref.item_offsets[n]);
+    CHECK(tagger->tag_batch(tagger, &batch, 3, labels, NULL) == 0);
+    CHECK(memcmp(ref.labels, labels, sizeof(int) * ref.item_offsets[n]) == 0);
+
+    free(scores);
+    free(labels);
+    reference_finish(&ref);
+    SAFE_RELEASE(tagger);
+}
+
+int main(int argc, char *argv[])
+{
+    int i, j, n, A, flags;
+    crfsuite_data_t data;
+    crfsuite_instance_t *insts = NULL;
+    crfsuite_model_t *model = NULL;
+    const char *filename = "test_batch.crf";
+
+    if (!CHECK(test_train(filename, "dictionary", 0) == 0) ||
+        !CHECK(crfsuite_create_instance_from_file(filename, (void**)&model) == 0)) {
+        return test_finish("test_batch");
+    }
+    CHECK(test_read_model_data(model, &data) == 0);
+    A = data.attrs->num(data.attrs);
+
+    /* The instances of the training data, followed by the instances of
+       random attributes, of which every fifth is empty. */
+    n = data.num_instances + 100;
+    insts = (crfsuite_instance_t*)calloc(n, sizeof(crfsuite_instance_t));
+    for (i = 0;i < data.num_instances;++i) {
+        crfsuite_instance_copy(&insts[i], &data.instances[i]);
+    }
+    for (j = 0;j < 100;++j, ++i) {
+        test_random_instance(&insts[i], (j % 5) * (1 + j % 7), A, (unsigned int)j);
+    }
+
+    for (flags = 0;flags <= (CRFSUITE_TAGGER_FLOAT | CRFSUITE_TAGGER_VITERBI);++flags) {
+        test_tagger(model, flags, insts, n, A);
+    }
+
+    /* An empty batch. */
+    test_tagger(model, CRFSUITE_TAGGER_DEFAULT, insts, 0, A);
+
+    for (i = 0;i < n;++i) {
+        crfsuite_instance_finish(&insts[i]);
+    }
+    free(insts);
+    SAFE_RELEASE(data.attrs);
+    SAFE_RELEASE(data.labels);
+    crfsuite_data_finish(&data);
+    SAFE_RELEASE(model);
+    return test_finish("test_batch");
+}
@@ -0,0 +1,274 @@
+/*
+ *      Regression tests of the constrained decoding.
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* $Id$ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <crfsuite.h>
+#include "testutil.h"
+
+#define    SAFE_RELEASE(obj)    if ((obj) != NULL) { (obj)->release(obj); (obj) = NULL; }
+
+/*
+ * For instances of a few items and random constraints, the label sequences
+ * that satisfy the constraints are enumerated and scored by score().
+ * viterbi(), viterbi_nbest(), lognorm(), and the marginal probabilities
+ * must consider only these sequences; when there is none of them,
+ * viterbi(), lognorm(), and the marginal probabilities must return
+ * CRFSUITEERR_INCOMPATIBLE.
+ */
+
+#define MAX_ITEMS   4
+
+#define    HAS_LABEL(set, l)    ((set)[(l) / 8] & (1 << ((l) % 8)))
+#define    ADD_LABEL(set, l)    ((set)[(l) / 8] |= (1 << ((l) % 8)))
+
+typedef struct {
+    int path[MAX_ITEMS];
+    floatval_t score;
+} path_t;
+
+static int num_infeasible = 0;
+
+static int compare_paths(const void *x, const void *y)
+{
+    const path_t *a = (const path_t*)x;
+    const path_t *b = (const path_t*)y;
+    return (a->score < b->score) ? 1 : ((b->score < a->score) ? -1 : 0);
+}
+
+static int same_score(floatval_t x, floatval_t y)
+{
+    return fabs(x - y) <= 1e-9 * (1. + fabs(x));
+}
+
+static int is_feasible(const int *path, int T, int B, const unsigned char *allowed, const unsigned char *forbidden)
+{
+    int t;
+    for (t = 0;t < T;++t) {
+        if (allowed != NULL && !HAS_LABEL(&allowed[B * t], path[t])) {
+            return 0;
+        }
+        if (forbidden != NULL && 0 < t && HAS_LABEL(&forbidden[B * path[t-1]], path[t])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void test_constraints(
+    crfsuite_tagger_t *tagger,
+    int flags,
+    crfsuite_instance_t *inst,
+    int L,
+    const unsigned char *allowed,
+    const unsigned char *forbidden
+    )
+{
+    int i, j, t, l, n = 0, num = 0;
+    const int T = inst->num_items;
+    const int B = (L + 7) / 8;
+    const int ks[] = {1, 3, 1000};
+    int path[MAX_ITEMS], labels[MAX_ITEMS];
+    floatval_t max_score, norm, lognorm, score, prob, zero_score, viterbi_score;
+    path_t *paths = (path_t*)calloc(1000, sizeof(path_t));
+    int *nbest = (int*)calloc(1000 * T, sizeof(int));
+    floatval_t *scores = (floatval_t*)calloc(1000, sizeof(floatval_t));
+    floatval_t *marginals = (floatval_t*)calloc(T * L, sizeof(floatval_t));
+    floatval_t *probs = (floatval_t*)calloc(T * L, sizeof(floatval_t));
+
+    /* Score the label sequences that satisfy the constraints. */
+    CHECK(tagger->set(tagger, inst) == 0);
+    memset(path, 0, sizeof(path));
+    do {
+        if (is_feasible(path, T, B, allowed, forbidden)) {
+            memcpy(paths[n].path, path, sizeof(int) * T);
+            CHECK(tagger->score(tagger, path, &paths[n].score) == 0);
+            ++n;
+        }
+    } while (test_next_path(path, T, L));
+    qsort(paths, n, sizeof(path_t), compare_paths);
+
+    /* The results without the constraints. */
+    CHECK(tagger->score(tagger, path, &zero_score) == 0);
+    CHECK(tagger->viterbi(tagger, labels, &viterbi_score) == 0);
+
+    CHECK(tagger->set_constraints(tagger, allowed, forbidden) == 0);
+
+    if (n == 0) {
+        ++num_infeasible;
+        CHECK(tagger->viterbi(tagger, labels, &score) == CRFSUITEERR_INCOMPATIBLE);
+        if (!(flags & CRFSUITE_TAGGER_VITERBI)) {
+            CHECK(tagger->lognorm(tagger, &lognorm) == CRFSUITEERR_INCOMPATIBLE);
+            CHECK(tagger->marginals(tagger, marginals) == CRFSUITEERR_INCOMPATIBLE);
+            CHECK(tagger->marginal_point(tagger, 0, 0, &prob) == CRFSUITEERR_INCOMPATIBLE);
+        }
+        CHECK(tagger->viterbi_nbest(tagger, 3, nbest, scores, &num) == 0);
+        CHECK(num == 0);
+        goto unconstrained;
+    }
+    max_score = paths[0].score;
+
+    /* viterbi() */
+    CHECK(tagger->viterbi(tagger, labels, &score) == 0);
+    CHECK(is_feasible(labels, T, B, allowed, forbidden));
+    if (flags & CRFSUITE_TAGGER_FLOAT) {
+        CHECK(fabs(score - max_score) <= 1e-5 * (1. + fabs(max_score)));
+    } else {
+        CHECK(same_score(score, max_score));
+    }
+
+    /* viterbi_nbest() finds no more sequences than the feasible ones. */
+    for (j = 0;j < (int)(sizeof(ks) / sizeof(ks[0]));++j) {
+        CHECK(tagger->viterbi_nbest(tagger, ks[j], nbest, scores, &num) == 0);
+        if (!CHECK(num == (ks[j] < n ? ks[j] : n))) {
+            continue;
+        }
+        for (i = 0;i < num;++i) {
+            CHECK(is_feasible(&nbest[i * T], T, B, allowed, forbidden));
+            CHECK(same_score(scores[i], paths[i].score));
+        }
+    }
+
+    if (!(flags & CRFSUITE_TAGGER_VITERBI)) {
+        /* The probabilities are conditioned on the constraints. */
+        norm = 0.;
+        for (i = 0;i < n;++i) {
+            norm += exp(paths[i].score - max_score);
+        }
+        CHECK(tagger->lognorm(tagger, &lognorm) == 0);
+        CHECK(same_score(lognorm, max_score + log(norm)));
+
+        for (i = 0;i < n;++i) {
+            prob = exp(paths[i].score - max_score) / norm;
+            for (t = 0;t < T;++t) {
+                probs[t * L + paths[i].path[t]] += prob;
+            }
+        }
+        CHECK(tagger->marginals(tagger, marginals) == 0);
+        for (t = 0;t < T;++t) {
+            for (l = 0;l < L;++l) {
+                CHECK(fabs(marginals[t * L + l] - probs[t * L + l]) <= 1e-9);
+                CHECK(tagger->marginal_point(tagger, l, t, &prob) == 0);
+                CHECK(fabs(prob - probs[t * L + l]) <= 1e-9);
+            }
+        }
+    }
+
+unconstrained:
+    /* score() is not affected by the constraints. */
+    memset(path, 0, sizeof(path));
+    CHECK(tagger->score(tagger, path, &score) == 0);
+    CHECK(score == zero_score);
+
+    /* set() removes the constraints. */
+    CHECK(tagger->set(tagger, inst) == 0);
+    CHECK(tagger->viterbi(tagger, labels, &score) == 0);
+    CHECK(score == viterbi_score);
+
+    free(probs);
+    free(marginals);
+    free(scores);
+    free(nbest);
+    free(paths);
+}
+
+int main(int argc, char *argv[])
+{
+    int i, j, l, t, T, L, A, B;
+    size_t f;
+    crfsuite_data_t data;
+    crfsuite_model_t *model = NULL;
+    unsigned char *allowed = NULL, *forbidden = NULL;
+    static const int flags[] = {
+        CRFSUITE_TAGGER_DEFAULT,
+        CRFSUITE_TAGGER_FLOAT,
+        CRFSUITE_TAGGER_VITERBI,
+    };
+    const char *filename = "test_constraints.crf";
+
+    if (!CHECK(test_train(filename, "dictionary", 0) == 0) ||
+        !CHECK(crfsuite_create_instance_from_file(filename, (void**)&model) == 0)) {
+        return test_finish("test_constraints");
+    }
+    CHECK(test_read_model_data(model, &data) == 0);
+    L = data.labels->num(data.labels);
+    A = data.attrs->num(data.attrs);
+    B = (L + 7) / 8;
+    allowed = (unsigned char*)calloc(MAX_ITEMS * B, 1);
+    forbidden = (unsigned char*)calloc(L * B, 1);
+
+    for (f = 0;f < sizeof(flags) / sizeof(flags[0]);++f) {
+        crfsuite_tagger_t *tagger = NULL;
+        if (!CHECK(model->get_tagger_ex(model, flags[f], &tagger) == 0)) {
+            continue;
+        }
+        for (T = 1;T <= MAX_ITEMS;++T) {
+            for (i = 0;i < 20;++i) {
+                crfsuite_instance_t inst;
+                test_random_instance(&inst, T, A, (unsigned int)(T * 100 + i));
+
+                /* Random sets of the allowed labels and forbidden
+                   transitions, which may leave no label sequence. */
+                memset(allowed, 0, MAX_ITEMS * B);
+                memset(forbidden, 0, L * B);
+                for (t = 0;t < T;++t) {
+                    for (l = 0;l < L;++l) {
+                        if (rand() % 3 != 0) ADD_LABEL(&allowed[B * t], l);
+                    }
+                }
+                for (j = 0;j < L;++j) {
+                    for (l = 0;l < L;++l) {
+                        if (rand() % 3 == 0) ADD_LABEL(&forbidden[B * j], l);
+                    }
+                }
+
+                test_constraints(tagger, flags[f], &inst, L, allowed, forbidden);
+                test_constraints(tagger, flags[f], &inst, L, allowed, NULL);
+                test_constraints(tagger, flags[f], &inst, L, NULL, forbidden);
+                crfsuite_instance_finish(&inst);
+            }
+        }
+        SAFE_RELEASE(tagger);
+    }
+    printf("infeasible constraints: %d\n", num_infeasible);
+
+    free(forbidden);
+    free(allowed);
+    SAFE_RELEASE(data.attrs);
+    SAFE_RELEASE(data.labels);
+    crfsuite_data_finish(&data);
+    SAFE_RELEASE(model);
+    return test_finish("test_constraints");
+}
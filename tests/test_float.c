@@ -0,0 +1,158 @@
+/*
+ *      Regression tests of the single-precision tagger.
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* $Id$ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <crfsuite.h>
+#include "testutil.h"
+
+#define    SAFE_RELEASE(obj)    if ((obj) != NULL) { (obj)->release(obj); (obj) = NULL; }
+
+/*
+ * A tagger with CRFSUITE_TAGGER_FLOAT computes only the Viterbi algorithm
+ * in single precision; the score of the Viterbi label sequence, lognorm(),
+ * the marginal probabilities, and viterbi_nbest() must be identical to
+ * those of a double-precision tagger, and the Viterbi label sequence must
+ * be optimal up to the rounding errors of the Viterbi scores.
+ */
+
+#define NBEST   4
+
+static int num_different = 0;
+
+static void compare_taggers(crfsuite_tagger_t *dt, crfsuite_tagger_t *ft, crfsuite_instance_t *inst, int L)
+{
+    int t, l, dn, fn;
+    const int T = inst->num_items;
+    floatval_t dz, fz, ds, fs, ss, dp, fp;
+    int *dl = (int*)calloc(T, sizeof(int));
+    int *fl = (int*)calloc(T, sizeof(int));
+    int *dpaths = (int*)calloc(NBEST * T, sizeof(int));
+    int *fpaths = (int*)calloc(NBEST * T, sizeof(int));
+    floatval_t *dm = (floatval_t*)calloc(T * L, sizeof(floatval_t));
+    floatval_t *fm = (floatval_t*)calloc(T * L, sizeof(floatval_t));
+    floatval_t dscores[NBEST], fscores[NBEST];
+
+    CHECK(dt->set(dt, inst) == 0);
+    CHECK(ft->set(ft, inst) == 0);
+
+    /* The Viterbi label sequence and its score. */
+    CHECK(dt->viterbi(dt, dl, &ds) == 0);
+    CHECK(ft->viterbi(ft, fl, &fs) == 0);
+    CHECK(dt->score(dt, fl, &ss) == 0);
+    CHECK(fs == ss);
+    CHECK(fabs(fs - ds) <= 1e-5 * (1. + fabs(ds)));
+    if (memcmp(dl, fl, sizeof(int) * T) != 0) {
+        ++num_different;
+    }
+
+    /* The score of a label sequence. */
+    CHECK(dt->score(dt, dl, &ds) == 0);
+    CHECK(ft->score(ft, dl, &fs) == 0);
+    CHECK(fs == ds);
+
+    /* The partition factor and the marginal probabilities. */
+    CHECK(dt->lognorm(dt, &dz) == 0);
+    CHECK(ft->lognorm(ft, &fz) == 0);
+    CHECK(dz == fz);
+    CHECK(dt->marginals(dt, dm) == 0);
+    CHECK(ft->marginals(ft, fm) == 0);
+    CHECK(memcmp(dm, fm, sizeof(floatval_t) * T * L) == 0);
+    for (t = 0;t < T;++t) {
+        for (l = 0;l < L;++l) {
+            CHECK(dt->marginal_point(dt, l, t, &dp) == 0);
+            CHECK(ft->marginal_point(ft, l, t, &fp) == 0);
+            CHECK(dp == fp);
+        }
+    }
+
+    /* The k-best label sequences. */
+    CHECK(dt->viterbi_nbest(dt, NBEST, dpaths, dscores, &dn) == 0);
+    CHECK(ft->viterbi_nbest(ft, NBEST, fpaths, fscores, &fn) == 0);
+    if (CHECK(dn == fn)) {
+        CHECK(memcmp(dpaths, fpaths, sizeof(int) * dn * T) == 0);
+        CHECK(memcmp(dscores, fscores, sizeof(floatval_t) * dn) == 0);
+    }
+
+    free(fm);
+    free(dm);
+    free(fpaths);
+    free(dpaths);
+    free(fl);
+    free(dl);
+}
+
+int main(int argc, char *argv[])
+{
+    int i, L, A;
+    crfsuite_data_t data;
+    crfsuite_model_t *model = NULL;
+    crfsuite_tagger_t *dt = NULL, *ft = NULL;
+    const char *filename = "test_float.crf";
+
+    if (!CHECK(test_train(filename, "dictionary", 0) == 0) ||
+        !CHECK(crfsuite_create_instance_from_file(filename, (void**)&model) == 0)) {
+        return test_finish("test_float");
+    }
+    CHECK(test_read_model_data(model, &data) == 0);
+    L = data.labels->num(data.labels);
+    A = data.attrs->num(data.attrs);
+
+    CHECK(model->get_tagger_ex(model, CRFSUITE_TAGGER_DEFAULT, &dt) == 0);
+    CHECK(model->get_tagger_ex(model, CRFSUITE_TAGGER_FLOAT, &ft) == 0);
+    if (dt != NULL && ft != NULL) {
+        /* The instances of the training data. */
+        for (i = 0;i < data.num_instances;++i) {
+            compare_taggers(dt, ft, &data.instances[i], L);
+        }
+
+        /* The instances of random attributes, including a single item. */
+        for (i = 0;i < 100;++i) {
+            crfsuite_instance_t inst;
+            test_random_instance(&inst, 1 + i % 20, A, (unsigned int)i);
+            compare_taggers(dt, ft, &inst, L);
+            crfsuite_instance_finish(&inst);
+        }
+    }
+    printf("different Viterbi label sequences: %d\n", num_different);
+
+    SAFE_RELEASE(ft);
+    SAFE_RELEASE(dt);
+    SAFE_RELEASE(data.attrs);
+    SAFE_RELEASE(data.labels);
+    crfsuite_data_finish(&data);
+    SAFE_RELEASE(model);
+    return test_finish("test_float");
+}
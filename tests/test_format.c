@@ -0,0 +1,205 @@
+/*
+ *      Regression tests of the model formats.
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* $Id$ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <crfsuite.h>
+#include "testutil.h"
+
+#define    SAFE_RELEASE(obj)    if ((obj) != NULL) { (obj)->release(obj); (obj) = NULL; }
+
+/*
+ * The model model_v1.crf was written by CRFsuite 0.12 (the format version
+ * 1) from train.txt with "crfsuite learn -a ap -p max_iterations=10". The
+ * version 2 copy of the model must have the same dictionaries and weights,
+ * and must tag the instances of train.txt in the same way, with any of the
+ * loading options.
+ */
+
+static const int load_flags[] = {
+    CRFSUITE_LOAD_DEFAULT,
+    CRFSUITE_LOAD_DECODE,
+    CRFSUITE_LOAD_DENSE,
+    CRFSUITE_LOAD_MMAP,
+    CRFSUITE_LOAD_MMAP | CRFSUITE_LOAD_DENSE,
+};
+
+static void *read_file(const char *filename, size_t *size)
+{
+    long n;
+    void *buffer = NULL;
+    FILE *fp = fopen(filename, "rb");
+    if (fp == NULL) {
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    n = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    buffer = malloc(n);
+    if (buffer != NULL && fread(buffer, 1, n, fp) != (size_t)n) {
+        free(buffer);
+        buffer = NULL;
+    }
+    fclose(fp);
+    *size = (size_t)n;
+    return buffer;
+}
+
+/* Compare the dictionaries of two models. */
+static void compare_dictionaries(crfsuite_model_t *ref, crfsuite_model_t *model)
+{
+    int i;
+    crfsuite_dictionary_t *rd = NULL, *md = NULL;
+
+    /* Labels. */
+    ref->get_labels(ref, &rd);
+    model->get_labels(model, &md);
+    CHECK(rd->num(rd) == md->num(md));
+    for (i = 0;i < rd->num(rd);++i) {
+        const char *rs = NULL, *ms = NULL;
+        rd->to_string(rd, i, &rs);
+        md->to_string(md, i, &ms);
+        CHECK(rs != NULL && ms != NULL && strcmp(rs, ms) == 0);
+        rd->free(rd, rs);
+        md->free(md, ms);
+    }
+    SAFE_RELEASE(md);
+    SAFE_RELEASE(rd);
+
+    /* Attributes; the string of every id maps back to the id. */
+    ref->get_attrs(ref, &rd);
+    model->get_attrs(model, &md);
+    CHECK(rd->num(rd) == md->num(md));
+    for (i = 0;i < rd->num(rd);++i) {
+        const char *rs = NULL;
+        rd->to_string(rd, i, &rs);
+        CHECK(rs != NULL && md->to_id(md, rs) == i);
+        rd->free(rd, rs);
+    }
+    CHECK(md->to_id(md, "no such attribute") < 0);
+    CHECK(md->to_id(md, "w[0]=w99") < 0);
+    SAFE_RELEASE(md);
+    SAFE_RELEASE(rd);
+}
+
+/* Compare the Viterbi labels, the scores, and the partition factors. */
+static void compare_tagging(crfsuite_model_t *ref, crfsuite_model_t *model, const crfsuite_data_t *data)
+{
+    int i, t;
+    int *rl = NULL, *ml = NULL;
+    floatval_t rs, ms, rz, mz;
+    crfsuite_tagger_t *rt = NULL, *mt = NULL;
+
+    ref->get_tagger(ref, &rt);
+    model->get_tagger(model, &mt);
+    for (i = 0;i < data->num_instances;++i) {
+        crfsuite_instance_t *inst = &data->instances[i];
+        rl = (int*)calloc(inst->num_items, sizeof(int));
+        ml = (int*)calloc(inst->num_items, sizeof(int));
+        CHECK(rt->set(rt, inst) == 0);
+        CHECK(mt->set(mt, inst) == 0);
+        CHECK(rt->viterbi(rt, rl, &rs) == 0);
+        CHECK(mt->viterbi(mt, ml, &ms) == 0);
+        CHECK(rt->lognorm(rt, &rz) == 0);
+        CHECK(mt->lognorm(mt, &mz) == 0);
+        for (t = 0;t < inst->num_items;++t) {
+            CHECK(rl[t] == ml[t]);
+        }
+        CHECK(fabs(rs - ms) <= 1e-9 * (1. + fabs(rs)));
+        CHECK(fabs(rz - mz) <= 1e-9 * (1. + fabs(rz)));
+        free(ml);
+        free(rl);
+    }
+    SAFE_RELEASE(mt);
+    SAFE_RELEASE(rt);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t i, size = 0;
+    void *buffer = NULL;
+    crfsuite_data_t data;
+    crfsuite_model_t *ref = NULL, *model = NULL;
+    const char *v2 = "test_format_v2.crf";
+
+    /* The reference is the model of the version 1. */
+    if (!CHECK(crfsuite_create_instance_from_file(test_srcpath("model_v1.crf"), (void**)&ref) == 0)) {
+        return test_finish("test_format");
+    }
+    CHECK(test_read_model_data(ref, &data) == 0);
+    CHECK(0 < data.num_instances);
+
+    /* Write the model in the version 2. */
+    CHECK(crfsuite_quantize_model(test_srcpath("model_v1.crf"), v2, CRFSUITE_QUANTIZE_NONE) == 0);
+
+    for (i = 0;i < sizeof(load_flags) / sizeof(load_flags[0]);++i) {
+        /* The version 1 with the options. */
+        if (CHECK(crfsuite_create_instance_from_file_ex(test_srcpath("model_v1.crf"), load_flags[i], (void**)&model) == 0)) {
+            compare_dictionaries(ref, model);
+            compare_tagging(ref, model, &data);
+            SAFE_RELEASE(model);
+        }
+
+        /* The version 2 with the options. */
+        if (CHECK(crfsuite_create_instance_from_file_ex(v2, load_flags[i], (void**)&model) == 0)) {
+            compare_dictionaries(ref, model);
+            compare_tagging(ref, model, &data);
+            SAFE_RELEASE(model);
+        }
+    }
+
+    /* The version 2 in a memory block. */
+    buffer = read_file(v2, &size);
+    if (CHECK(buffer != NULL) &&
+        CHECK(crfsuite_create_instance_from_memory(buffer, size, (void**)&model) == 0)) {
+        compare_dictionaries(ref, model);
+        compare_tagging(ref, model, &data);
+        SAFE_RELEASE(model);
+    }
+    free(buffer);
+
+    /* A truncated model is rejected. */
+    buffer = read_file(v2, &size);
+    if (CHECK(buffer != NULL)) {
+        CHECK(crfsuite_create_instance_from_memory(buffer, size / 2, (void**)&model) != 0);
+    }
+    free(buffer);
+
+    SAFE_RELEASE(data.attrs);
+    SAFE_RELEASE(data.labels);
+    crfsuite_data_finish(&data);
+    SAFE_RELEASE(ref);
+    return test_finish("test_format");
+}
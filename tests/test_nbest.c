@@ -0,0 +1,210 @@
+/*
+ *      Regression tests of the n-best Viterbi algorithm.
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* $Id$ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <crfsuite.h>
+#include "testutil.h"
+
+#define    SAFE_RELEASE(obj)    if ((obj) != NULL) { (obj)->release(obj); (obj) = NULL; }
+
+/*
+ * For instances of a few items, the L^T label sequences are enumerated
+ * and scored by score(). viterbi_nbest() must find the k sequences of the
+ * highest scores in descending order, viterbi() the best one, lognorm()
+ * the log-sum-exp of the scores, and the marginal probabilities the sums
+ * of the normalized probabilities of the sequences.
+ */
+
+#define MAX_ITEMS   4
+
+typedef struct {
+    int path[MAX_ITEMS];
+    floatval_t score;
+} path_t;
+
+static int compare_paths(const void *x, const void *y)
+{
+    const path_t *a = (const path_t*)x;
+    const path_t *b = (const path_t*)y;
+    return (a->score < b->score) ? 1 : ((b->score < a->score) ? -1 : 0);
+}
+
+static int same_score(floatval_t x, floatval_t y)
+{
+    return fabs(x - y) <= 1e-9 * (1. + fabs(x));
+}
+
+static void test_instance(crfsuite_tagger_t *tagger, int flags, crfsuite_instance_t *inst, int L)
+{
+    int i, j, k, t, l, n = 1, num = 0;
+    int ks[6];
+    const int T = inst->num_items;
+    int path[MAX_ITEMS], labels[MAX_ITEMS];
+    floatval_t max_score, norm, lognorm, score, prob;
+    path_t *paths = NULL;
+    int *nbest = NULL;
+    floatval_t *scores = NULL, *marginals = NULL, *probs = NULL;
+
+    for (t = 0;t < T;++t) {
+        n *= L;
+    }
+    paths = (path_t*)calloc(n, sizeof(path_t));
+    nbest = (int*)calloc((n+2) * T, sizeof(int));
+    scores = (floatval_t*)calloc(n+2, sizeof(floatval_t));
+    marginals = (floatval_t*)calloc(T * L, sizeof(floatval_t));
+    probs = (floatval_t*)calloc(T * L, sizeof(floatval_t));
+
+    /* Score all the label sequences. */
+    CHECK(tagger->set(tagger, inst) == 0);
+    memset(path, 0, sizeof(path));
+    i = 0;
+    do {
+        memcpy(paths[i].path, path, sizeof(int) * T);
+        CHECK(tagger->score(tagger, path, &paths[i].score) == 0);
+        ++i;
+    } while (test_next_path(path, T, L));
+    qsort(paths, n, sizeof(path_t), compare_paths);
+    max_score = paths[0].score;
+
+    /* viterbi() */
+    CHECK(tagger->viterbi(tagger, labels, &score) == 0);
+    if (flags & CRFSUITE_TAGGER_FLOAT) {
+        /* The Viterbi scores are rounded to single precision. */
+        CHECK(fabs(score - max_score) <= 1e-5 * (1. + fabs(max_score)));
+    } else {
+        CHECK(same_score(score, max_score));
+    }
+
+    /* viterbi_nbest() with k up to more than L^T. */
+    ks[0] = 1; ks[1] = 2; ks[2] = 5; ks[3] = n - 1; ks[4] = n; ks[5] = n + 2;
+    for (j = 0;j < 6;++j) {
+        k = ks[j];
+        CHECK(tagger->viterbi_nbest(tagger, k, nbest, scores, &num) == 0);
+        if (!CHECK(num == (k < n ? k : n))) {
+            continue;
+        }
+        for (i = 0;i < num;++i) {
+            CHECK(same_score(scores[i], paths[i].score));
+            CHECK(tagger->score(tagger, &nbest[i * T], &score) == 0);
+            CHECK(same_score(score, scores[i]));
+            if (0 < i) {
+                CHECK(memcmp(&nbest[(i-1) * T], &nbest[i * T], sizeof(int) * T) != 0);
+            }
+        }
+    }
+
+    /* The scores may be omitted. */
+    CHECK(tagger->viterbi_nbest(tagger, 2, nbest, NULL, &num) == 0);
+
+    if (flags & CRFSUITE_TAGGER_VITERBI) {
+        CHECK(tagger->lognorm(tagger, &lognorm) == CRFSUITEERR_NOTSUPPORTED);
+        CHECK(tagger->marginals(tagger, marginals) == CRFSUITEERR_NOTSUPPORTED);
+    } else {
+        /* lognorm() is the log-sum-exp of the scores. */
+        norm = 0.;
+        for (i = 0;i < n;++i) {
+            norm += exp(paths[i].score - max_score);
+        }
+        CHECK(tagger->lognorm(tagger, &lognorm) == 0);
+        CHECK(same_score(lognorm, max_score + log(norm)));
+
+        /* The marginal probabilities. */
+        for (i = 0;i < n;++i) {
+            prob = exp(paths[i].score - max_score) / norm;
+            for (t = 0;t < T;++t) {
+                probs[t * L + paths[i].path[t]] += prob;
+            }
+        }
+        CHECK(tagger->marginals(tagger, marginals) == 0);
+        for (t = 0;t < T;++t) {
+            for (l = 0;l < L;++l) {
+                CHECK(fabs(marginals[t * L + l] - probs[t * L + l]) <= 1e-9);
+                CHECK(tagger->marginal_point(tagger, l, t, &prob) == 0);
+                CHECK(fabs(prob - probs[t * L + l]) <= 1e-9);
+            }
+        }
+    }
+
+    free(probs);
+    free(marginals);
+    free(scores);
+    free(nbest);
+    free(paths);
+}
+
+int main(int argc, char *argv[])
+{
+    int i, T, L, A;
+    size_t f;
+    crfsuite_data_t data;
+    crfsuite_model_t *model = NULL;
+    static const int flags[] = {
+        CRFSUITE_TAGGER_DEFAULT,
+        CRFSUITE_TAGGER_FLOAT,
+        CRFSUITE_TAGGER_VITERBI,
+    };
+    const char *filename = "test_nbest.crf";
+
+    if (!CHECK(test_train(filename, "dictionary", 0) == 0) ||
+        !CHECK(crfsuite_create_instance_from_file(filename, (void**)&model) == 0)) {
+        return test_finish("test_nbest");
+    }
+    CHECK(test_read_model_data(model, &data) == 0);
+    L = data.labels->num(data.labels);
+    A = data.attrs->num(data.attrs);
+
+    for (f = 0;f < sizeof(flags) / sizeof(flags[0]);++f) {
+        crfsuite_tagger_t *tagger = NULL;
+        if (!CHECK(model->get_tagger_ex(model, flags[f], &tagger) == 0)) {
+            continue;
+        }
+        for (T = 1;T <= MAX_ITEMS;++T) {
+            for (i = 0;i < 5;++i) {
+                crfsuite_instance_t inst;
+                test_random_instance(&inst, T, A, (unsigned int)(T * 100 + i));
+                test_instance(tagger, flags[f], &inst, L);
+                crfsuite_instance_finish(&inst);
+            }
+        }
+        SAFE_RELEASE(tagger);
+    }
+
+    SAFE_RELEASE(data.attrs);
+    SAFE_RELEASE(data.labels);
+    crfsuite_data_finish(&data);
+    SAFE_RELEASE(model);
+    return test_finish("test_nbest");
+}
@@ -0,0 +1,215 @@
+/*
+ *      Regression tests of the quantized models.
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* $Id$ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <crfsuite.h>
+#include "testutil.h"
+
+#define    SAFE_RELEASE(obj)    if ((obj) != NULL) { (obj)->release(obj); (obj) = NULL; }
+
+/*
+ * A quantized model must tag nearly as the original model does: the score
+ * of every label sequence may differ only by the rounding errors of the
+ * weights, and the taggers with any of the loading options must agree.
+ */
+
+static const int load_flags[] = {
+    CRFSUITE_LOAD_DEFAULT,
+    CRFSUITE_LOAD_DECODE,
+    CRFSUITE_LOAD_DENSE,
+    CRFSUITE_LOAD_MMAP | CRFSUITE_LOAD_DENSE,
+};
+
+static long file_size(const char *filename)
+{
+    long n = -1;
+    FILE *fp = fopen(filename, "rb");
+    if (fp != NULL) {
+        fseek(fp, 0, SEEK_END);
+        n = ftell(fp);
+        fclose(fp);
+    }
+    return n;
+}
+
+static int same_file(const char *x, const char *y)
+{
+    int a, b;
+    FILE *fx = fopen(x, "rb"), *fy = fopen(y, "rb");
+    int same = (fx != NULL && fy != NULL);
+    while (same) {
+        a = fgetc(fx);
+        b = fgetc(fy);
+        same = (a == b);
+        if (a == EOF || b == EOF) break;
+    }
+    if (fx != NULL) fclose(fx);
+    if (fy != NULL) fclose(fy);
+    return same;
+}
+
+/*
+ * Tag the instances with the original and the quantized models; return
+ * the ratio of the items on which the Viterbi labels agree.
+ */
+static double compare_tagging(crfsuite_model_t *ref, crfsuite_model_t *model, const crfsuite_data_t *data, double tolerance)
+{
+    int i, t, num_items = 0, num_agreed = 0;
+    floatval_t rs, ms, qs;
+    crfsuite_tagger_t *rt = NULL, *mt = NULL;
+
+    ref->get_tagger(ref, &rt);
+    model->get_tagger(model, &mt);
+    for (i = 0;i < data->num_instances;++i) {
+        crfsuite_instance_t *inst = &data->instances[i];
+        int *rl = (int*)calloc(inst->num_items, sizeof(int));
+        int *ml = (int*)calloc(inst->num_items, sizeof(int));
+        CHECK(rt->set(rt, inst) == 0);
+        CHECK(mt->set(mt, inst) == 0);
+        CHECK(rt->viterbi(rt, rl, &rs) == 0);
+        CHECK(mt->viterbi(mt, ml, &ms) == 0);
+
+        /* The same label sequence has nearly the same score. */
+        CHECK(mt->score(mt, rl, &qs) == 0);
+        CHECK(fabs(qs - rs) <= tolerance * (1. + fabs(rs)));
+        /* The quantized Viterbi sequence is no worse than the original one. */
+        CHECK(qs <= ms + 1e-9 * (1. + fabs(ms)));
+
+        for (t = 0;t < inst->num_items;++t) {
+            if (rl[t] == ml[t]) ++num_agreed;
+        }
+        num_items += inst->num_items;
+        free(ml);
+        free(rl);
+    }
+    SAFE_RELEASE(mt);
+    SAFE_RELEASE(rt);
+    return num_items ? num_agreed / (double)num_items : 0.;
+}
+
+/* The quantized model gives the same results with any loading option. */
+static void compare_options(const char *filename, const crfsuite_data_t *data)
+{
+    size_t k;
+    int i, t;
+    crfsuite_model_t *ref = NULL, *model = NULL;
+    crfsuite_tagger_t *rt = NULL, *mt = NULL;
+
+    if (!CHECK(crfsuite_create_instance_from_file(filename, (void**)&ref) == 0)) {
+        return;
+    }
+    ref->get_tagger(ref, &rt);
+    for (k = 1;k < sizeof(load_flags) / sizeof(load_flags[0]);++k) {
+        if (!CHECK(crfsuite_create_instance_from_file_ex(filename, load_flags[k], (void**)&model) == 0)) {
+            continue;
+        }
+        model->get_tagger(model, &mt);
+        for (i = 0;i < data->num_instances;++i) {
+            floatval_t rs, ms;
+            crfsuite_instance_t *inst = &data->instances[i];
+            int *rl = (int*)calloc(inst->num_items, sizeof(int));
+            int *ml = (int*)calloc(inst->num_items, sizeof(int));
+            CHECK(rt->set(rt, inst) == 0);
+            CHECK(mt->set(mt, inst) == 0);
+            CHECK(rt->viterbi(rt, rl, &rs) == 0);
+            CHECK(mt->viterbi(mt, ml, &ms) == 0);
+            CHECK(fabs(rs - ms) <= 1e-9 * (1. + fabs(rs)));
+            for (t = 0;t < inst->num_items;++t) {
+                CHECK(rl[t] == ml[t]);
+            }
+            free(ml);
+            free(rl);
+        }
+        SAFE_RELEASE(mt);
+        SAFE_RELEASE(model);
+    }
+    SAFE_RELEASE(rt);
+    SAFE_RELEASE(ref);
+}
+
+int main(int argc, char *argv[])
+{
+    double agreement;
+    crfsuite_data_t data;
+    crfsuite_model_t *ref = NULL, *model = NULL;
+    const char *original = "test_quantize.crf";
+    const char *fp16 = "test_quantize_fp16.crf";
+    const char *int8 = "test_quantize_int8.crf";
+
+    if (!CHECK(test_train(original, "dictionary", 0) == 0) ||
+        !CHECK(crfsuite_create_instance_from_file(original, (void**)&ref) == 0)) {
+        return test_finish("test_quantize");
+    }
+    CHECK(test_read_model_data(ref, &data) == 0);
+
+    /* An unknown encoding is rejected. */
+    CHECK(crfsuite_quantize_model(original, int8, 3) != 0);
+
+    CHECK(crfsuite_quantize_model(original, fp16, CRFSUITE_QUANTIZE_FP16) == 0);
+    CHECK(crfsuite_quantize_model(original, int8, CRFSUITE_QUANTIZE_INT8) == 0);
+    CHECK(file_size(fp16) < file_size(original));
+    CHECK(file_size(int8) < file_size(fp16));
+
+    /* The relative error of a weight is below 2^-11 in fp16. */
+    if (CHECK(crfsuite_create_instance_from_file(fp16, (void**)&model) == 0)) {
+        agreement = compare_tagging(ref, model, &data, 1e-3);
+        printf("fp16 agreement: %f\n", agreement);
+        CHECK(0.99 <= agreement);
+        SAFE_RELEASE(model);
+    }
+    compare_options(fp16, &data);
+
+    /* The error of a weight is below 1/254 of the maximum weight in int8. */
+    if (CHECK(crfsuite_create_instance_from_file(int8, (void**)&model) == 0)) {
+        agreement = compare_tagging(ref, model, &data, 2e-2);
+        printf("int8 agreement: %f\n", agreement);
+        CHECK(0.97 <= agreement);
+        SAFE_RELEASE(model);
+    }
+    compare_options(int8, &data);
+
+    /* Quantizing the version 1 model and its version 2 copy gives the same file. */
+    CHECK(crfsuite_quantize_model(test_srcpath("model_v1.crf"), "test_quantize_v1.crf", CRFSUITE_QUANTIZE_NONE) == 0);
+    CHECK(crfsuite_quantize_model(test_srcpath("model_v1.crf"), "test_quantize_v1_int8.crf", CRFSUITE_QUANTIZE_INT8) == 0);
+    CHECK(crfsuite_quantize_model("test_quantize_v1.crf", "test_quantize_v2_int8.crf", CRFSUITE_QUANTIZE_INT8) == 0);
+    CHECK(same_file("test_quantize_v1_int8.crf", "test_quantize_v2_int8.crf"));
+
+    SAFE_RELEASE(data.attrs);
+    SAFE_RELEASE(data.labels);
+    crfsuite_data_finish(&data);
+    SAFE_RELEASE(ref);
+    return test_finish("test_quantize");
+}
@@ -0,0 +1,51 @@
+#!/bin/sh
+# $Id:$
+#
+# "crfsuite tag -j N" must output the same results as "crfsuite tag -j 1"
+# in the order of the input. The data set is repeated so that the
+# instances span more batches than the pipeline keeps in flight.
+
+CRFSUITE=${CRFSUITE:-../frontend/crfsuite}
+srcdir=${srcdir:-.}
+MODEL=test_tag.crf
+DATA=test_tag.data
+failures=0
+
+$CRFSUITE learn -a ap -p max_iterations=10 -m $MODEL $srcdir/train.txt > /dev/null || {
+    echo "crfsuite learn failed!"
+    exit 1
+}
+
+rm -f $DATA
+for i in 1 2 3 4 5 6 7 8 9 10
+do
+    cat $srcdir/train.txt >> $DATA
+done
+
+for options in "" "-r -p -i" "-l" "-l --marginal-threshold=0.1" "-t -q" "-d --float"
+do
+    $CRFSUITE tag -m $MODEL -j 1 $options $DATA | grep -v '^Elapsed time' > test_tag.1.out
+    for jobs in 2 4
+    do
+        $CRFSUITE tag -m $MODEL -j $jobs $options $DATA | grep -v '^Elapsed time' > test_tag.$jobs.out
+        if cmp -s test_tag.1.out test_tag.$jobs.out && [ -s test_tag.1.out ];
+        then
+            :
+        else
+            echo "crfsuite tag -j $jobs $options differs from -j 1"
+            failures=`expr $failures + 1`
+        fi
+    done
+done
+
+# Read the data from STDIN.
+$CRFSUITE tag -m $MODEL -j 4 - < $DATA > test_tag.4.out
+$CRFSUITE tag -m $MODEL -j 1 $DATA > test_tag.1.out
+cmp -s test_tag.1.out test_tag.4.out || {
+    echo "crfsuite tag -j 4 - differs from -j 1"
+    failures=`expr $failures + 1`
+}
+
+rm -f $DATA test_tag.*.out
+echo "test_tag: $failures failures"
+test $failures -eq 0
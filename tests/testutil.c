@@ -0,0 +1,226 @@
+/*
+ *      Utilities for the regression tests.
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* $Id$ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <crfsuite.h>
+#include "testutil.h"
+
+#define    SAFE_RELEASE(obj)    if ((obj) != NULL) { (obj)->release(obj); (obj) = NULL; }
+
+static int num_checks = 0;
+static int num_failures = 0;
+
+int test_check(int cond, const char *expr, const char *file, int line)
+{
+    ++num_checks;
+    if (!cond) {
+        ++num_failures;
+        /* Report only the first failures of a check in a loop. */
+        if (num_failures <= 20) {
+            fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+        }
+    }
+    return cond;
+}
+
+int test_finish(const char *name)
+{
+    printf("%s: %d checks, %d failures\n", name, num_checks, num_failures);
+    return (num_failures == 0) ? 0 : 1;
+}
+
+const char *test_srcpath(const char *name)
+{
+    static char path[4096];
+    const char *srcdir = getenv("srcdir");
+    if (srcdir == NULL || *srcdir == 0) {
+        srcdir = ".";
+    }
+    snprintf(path, sizeof(path), "%s/%s", srcdir, name);
+    return path;
+}
+
+/* Append an attribute "name[:value]" of an item. */
+static void append_attribute(crfsuite_item_t *item, crfsuite_dictionary_t *attrs, char *field, int add)
+{
+    int aid;
+    double value = 1.0;
+    crfsuite_attribute_t cont;
+    char *colon = strrchr(field, ':');
+
+    if (colon != NULL) {
+        *colon = 0;
+        value = atof(colon+1);
+    }
+    aid = add ? attrs->get(attrs, field) : attrs->to_id(attrs, field);
+    if (0 <= aid) {
+        crfsuite_attribute_set(&cont, aid, value);
+        crfsuite_item_append_attribute(item, &cont);
+    }
+}
+
+int test_read_data(const char *filename, crfsuite_data_t *data, int add)
+{
+    char line[4096];
+    crfsuite_instance_t inst;
+    crfsuite_item_t item;
+    FILE *fp = fopen(filename, "r");
+
+    if (fp == NULL) {
+        fprintf(stderr, "ERROR: failed to open %s\n", filename);
+        return 1;
+    }
+
+    crfsuite_instance_init(&inst);
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        int lid;
+        char *field = NULL, *next = NULL;
+
+        line[strcspn(line, "\r\n")] = 0;
+        if (line[0] == 0) {
+            /* An empty line ends an instance. */
+            if (!crfsuite_instance_empty(&inst)) {
+                crfsuite_data_append(data, &inst);
+            }
+            crfsuite_instance_finish(&inst);
+            crfsuite_instance_init(&inst);
+            continue;
+        }
+
+        /* The first field is the label; the rest are the attributes. */
+        field = line;
+        next = strchr(field, '\t');
+        if (next != NULL) *next++ = 0;
+        lid = add ? data->labels->get(data->labels, field) : data->labels->to_id(data->labels, field);
+        if (lid < 0) lid = 0;
+
+        crfsuite_item_init(&item);
+        while (next != NULL) {
+            field = next;
+            next = strchr(field, '\t');
+            if (next != NULL) *next++ = 0;
+            append_attribute(&item, data->attrs, field, add);
+        }
+        crfsuite_instance_append(&inst, &item, lid);
+        crfsuite_item_finish(&item);
+    }
+    if (!crfsuite_instance_empty(&inst)) {
+        crfsuite_data_append(data, &inst);
+    }
+    crfsuite_instance_finish(&inst);
+
+    fclose(fp);
+    return 0;
+}
+
+int test_train(const char *filename, const char *attrs_iid, int hash_bits)
+{
+    int ret = 1;
+    char value[16];
+    crfsuite_data_t data;
+    crfsuite_trainer_t *trainer = NULL;
+    crfsuite_params_t *params = NULL;
+
+    crfsuite_data_init(&data);
+    if (!crfsuite_create_instance(attrs_iid, (void**)&data.attrs) ||
+        !crfsuite_create_instance("dictionary", (void**)&data.labels) ||
+        !crfsuite_create_instance("train/crf1d/averaged-perceptron", (void**)&trainer)) {
+        fprintf(stderr, "ERROR: failed to create the instances for training\n");
+        goto exit;
+    }
+    if (test_read_data(test_srcpath("train.txt"), &data, 1)) {
+        goto exit;
+    }
+
+    params = trainer->params(trainer);
+    params->set(params, "max_iterations", "10");
+    sprintf(value, "%d", hash_bits);
+    params->set(params, "feature.hash_bits", value);
+    params->release(params);
+
+    /* Keep the training quiet. */
+    trainer->set_message_callback(trainer, NULL, NULL);
+    if (trainer->train(trainer, &data, filename, -1) != 0) {
+        fprintf(stderr, "ERROR: failed to train a model\n");
+        goto exit;
+    }
+    ret = 0;
+
+exit:
+    SAFE_RELEASE(trainer);
+    SAFE_RELEASE(data.labels);
+    SAFE_RELEASE(data.attrs);
+    crfsuite_data_finish(&data);
+    return ret;
+}
+
+int test_read_model_data(crfsuite_model_t *model, crfsuite_data_t *data)
+{
+    crfsuite_data_init(data);
+    if (model->get_attrs(model, &data->attrs) != 0 ||
+        model->get_labels(model, &data->labels) != 0) {
+        return 1;
+    }
+    return test_read_data(test_srcpath("train.txt"), data, 0);
+}
+
+void test_random_instance(crfsuite_instance_t *inst, int T, int A, unsigned int seed)
+{
+    int i, t;
+    crfsuite_attribute_t cont;
+
+    srand(seed);
+    crfsuite_instance_init_n(inst, T);
+    for (t = 0;t < T;++t) {
+        crfsuite_item_init(&inst->items[t]);
+        for (i = 0;i < 4;++i) {
+            crfsuite_attribute_set(&cont, rand() % A, 1.0 + (rand() % 3) * 0.5);
+            crfsuite_item_append_attribute(&inst->items[t], &cont);
+        }
+    }
+}
+
+int test_next_path(int *path, int T, int L)
+{
+    int t;
+
+    for (t = T-1;0 <= t;--t) {
+        if (++path[t] < L) {
+            return 1;
+        }
+        path[t] = 0;
+    }
+    return 0;
+}
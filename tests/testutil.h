@@ -0,0 +1,123 @@
+/*
+ *      Utilities for the regression tests.
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* $Id$ */
+
+#ifndef    __TESTUTIL_H__
+#define    __TESTUTIL_H__
+
+#include <crfsuite.h>
+
+/**
+ * Check a condition, and report the failure with the position.
+ */
+#define CHECK(cond) \
+    test_check((cond), #cond, __FILE__, __LINE__)
+
+/**
+ * Count a failure of a check, and report it.
+ *  @param  cond        The result of the condition.
+ *  @param  expr        The expression of the condition.
+ *  @param  file        The source file of the check.
+ *  @param  line        The line of the check.
+ *  @return int         The result of the condition.
+ */
+int test_check(int cond, const char *expr, const char *file, int line);
+
+/**
+ * Report the result of the checks.
+ *  @param  name        The name of the test.
+ *  @return int         The exit status of the test program (0 if no check
+ *                      failed, 1 otherwise).
+ */
+int test_finish(const char *name);
+
+/**
+ * Obtain the path of a file in the source directory of the tests.
+ *  The source directory is given by the environment variable "srcdir",
+ *  which "make check" sets; the current directory is used otherwise.
+ *  @param  name        The filename.
+ *  @return const char* The path (in a static buffer).
+ */
+const char *test_srcpath(const char *name);
+
+/**
+ * Read a data set of the format of "crfsuite learn".
+ *  The labels and attributes are registered to the dictionaries of the
+ *  data set if add is non-zero. Otherwise, the labels and attributes are
+ *  looked up; the unknown attributes are skipped, and the unknown labels
+ *  are replaced by the label #0. Escaped characters are not supported.
+ *  @param  filename    The filename of the data set.
+ *  @param  data        The data set with the dictionaries.
+ *  @param  add         Non-zero to register the labels and attributes.
+ *  @return int         0 if successful, non-zero otherwise.
+ */
+int test_read_data(const char *filename, crfsuite_data_t *data, int add);
+
+/**
+ * Train a model with the averaged perceptron on the data set of the tests.
+ *  @param  filename    The filename of the model to write.
+ *  @param  attrs_iid   The interface identifier of the attribute
+ *                      dictionary (e.g., "dictionary", "dictionary/hash:10").
+ *  @param  hash_bits   The number of bits of feature hashing (0 for none).
+ *  @return int         0 if successful, non-zero otherwise.
+ */
+int test_train(const char *filename, const char *attrs_iid, int hash_bits);
+
+/**
+ * Read the data set of the tests with the dictionaries of a model.
+ *  @param  model       The model.
+ *  @param  data        The data set to be initialized.
+ *  @return int         0 if successful, non-zero otherwise.
+ */
+int test_read_model_data(crfsuite_model_t *model, crfsuite_data_t *data);
+
+/**
+ * Make an instance of random attributes.
+ *  @param  inst        The instance to be initialized.
+ *  @param  T           The number of items.
+ *  @param  A           The number of attributes.
+ *  @param  seed        The seed of the random numbers.
+ */
+void test_random_instance(crfsuite_instance_t *inst, int T, int A, unsigned int seed);
+
+/**
+ * Advance a label sequence to the next one in lexicographic order.
+ *  Starting from the sequence of all zeros, this function enumerates all
+ *  the L^T label sequences for the brute-force computations.
+ *  @param  path        The label sequence [T].
+ *  @param  T           The number of items.
+ *  @param  L           The number of labels.
+ *  @return int         0 if path was the last sequence (and is reset to
+ *                      all zeros), non-zero otherwise.
+ */
+int test_next_path(int *path, int T, int L);
+
+#endif/*__TESTUTIL_H__*/